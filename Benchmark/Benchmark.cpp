@@ -0,0 +1,445 @@
+#include "stdafx.h"
+
+#include "SyntheticBlueprint.h"
+#include "Workspace.h"
+#include "NodeSearcher.h"
+#include "WorkspaceSettings.h"
+#include "InputSession.h"
+#include "InputReplayer.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPrinter>
+#include <QTemporaryDir>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <thread>
+
+namespace
+{
+	//Sheet in world units and the image the view benchmarks paint into; at zoom 1 the sheet fills the image's width
+	constexpr Vector2D SheetSize{ 1920.0, 1358.0 };
+	constexpr qint32 ImageWidth = 1920;
+	constexpr qint32 ImageHeight = 1080;
+
+	constexpr std::array ZoomLevels = { 1.0, 4.0, 16.0, 64.0 };
+
+	constexpr size_t SnapQueryCount = 500;
+
+	//A measurement is repeated up to the requested number of runs while it stays within this budget
+	constexpr double RunBudgetMs = 3000.0;
+
+	struct Timings
+	{
+		std::vector<double> samplesMs;
+
+		void Add(const double ms) { samplesMs.push_back(ms); }
+
+		double Percentile(const double p) const
+		{
+			if (samplesMs.empty())
+				return 0.0;
+
+			auto sorted = samplesMs;
+			std::ranges::sort(sorted);
+			return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * static_cast<double>(sorted.size())))];
+		}
+
+		double Min() const { return samplesMs.empty() ? 0.0 : std::ranges::min(samplesMs); }
+		double Max() const { return samplesMs.empty() ? 0.0 : std::ranges::max(samplesMs); }
+
+		double Mean() const
+		{
+			double sum = 0.0;
+			for (const auto sample : samplesMs)
+				sum += sample;
+
+			return samplesMs.empty() ? 0.0 : sum / static_cast<double>(samplesMs.size());
+		}
+
+		QJsonObject ToJson() const
+		{
+			return {
+				{ "runs", static_cast<qint64>(samplesMs.size()) },
+				{ "minMs", Min() },
+				{ "medianMs", Percentile(0.5) },
+				{ "meanMs", Mean() },
+				{ "maxMs", Max() } };
+		}
+	};
+
+	double ElapsedMs(const QElapsedTimer& timer) { return static_cast<double>(timer.nsecsElapsed()) / 1e6; }
+
+	//Runs fRun up to runCount times, at least once, and times each run
+	template<typename F>
+	Timings Measure(const qint32 runCount, F&& fRun)
+	{
+		Timings result;
+
+		QElapsedTimer total;
+		total.start();
+
+		for (qint32 i = 0; i < runCount && (i == 0 || ElapsedMs(total) < RunBudgetMs); i++)
+		{
+			QElapsedTimer timer;
+			timer.start();
+			fRun();
+			result.Add(ElapsedMs(timer));
+		}
+
+		return result;
+	}
+
+	double ToMegabytesPerSecond(const qint64 bytes, const double ms) { return ms > 0.0 ? bytes / 1e6 / (ms / 1e3) : 0.0; }
+
+	QString GetTypeName(const Shape::Type type)
+	{
+		switch (type)
+		{
+		case Shape::Type::LINE: return "line";
+		case Shape::Type::BOX: return "box";
+		case Shape::Type::CIRCLE: return "circle";
+		case Shape::Type::OVAL: return "oval";
+		case Shape::Type::CURVE: return "curve";
+		case Shape::Type::SECTOR: return "sector";
+		default: return "other";
+		}
+	}
+
+	QString GetCompiler()
+	{
+#if defined(_MSC_VER)
+		return QString("MSVC %0").arg(_MSC_VER);
+#elif defined(__clang__)
+		return QString("Clang %0").arg(__clang_version__);
+#elif defined(__GNUC__)
+		return QString("GCC %0").arg(__VERSION__);
+#else
+		return "unknown";
+#endif
+	}
+
+	std::vector<StyleIndex> InternStyles(Workspace& ws)
+	{
+		QPen thin(Qt::black);
+		thin.setWidthF(0.5);
+
+		QPen thick(Qt::black);
+		thick.setWidthF(1.5);
+
+		QPen dashed(Qt::darkGray);
+		dashed.setWidthF(0.5);
+		dashed.setStyle(Qt::DashLine);
+
+		QPen cosmetic(Qt::blue);
+		cosmetic.setCosmetic(true);
+
+		return { ws.InternStyle(thin), ws.InternStyle(thick), ws.InternStyle(dashed), ws.InternStyle(cosmetic) };
+	}
+
+	//Time per shape of Shape::Update, i.e. rebuilding the cached geometry, by type
+	QJsonObject MeasureShapeUpdate(const BlueprintReader::ShapeBatch& shapes, const qint32 runCount)
+	{
+		std::map<Shape::Type, std::vector<Shape*>> byType;
+		for (const auto& shape : shapes)
+			byType[shape->GetType()].push_back(shape.get());
+
+		QJsonObject perType;
+		double totalMs = 0.0;
+		for (const auto& [type, typeShapes] : byType)
+		{
+			const auto timings = Measure(runCount, [&typeShapes]
+			{
+				for (auto* shape : typeShapes)
+					shape->Update();
+			});
+
+			const auto ms = timings.Percentile(0.5);
+			totalMs += ms;
+			perType.insert(GetTypeName(type), QJsonObject{
+				{ "count", static_cast<qint64>(typeShapes.size()) },
+				{ "nsPerShape", ms * 1e6 / static_cast<double>(typeShapes.size()) } });
+		}
+
+		return {
+			{ "totalMs", totalMs },
+			{ "nsPerShape", shapes.empty() ? 0.0 : totalMs * 1e6 / static_cast<double>(shapes.size()) },
+			{ "types", perType } };
+	}
+
+	//Latency of a full snap search, half of the cursors next to a node and half anywhere on the sheet
+	QJsonObject MeasureSnapSearch(const Workspace& ws, const std::vector<Vector2D>& nodes, const quint32 seed)
+	{
+		std::mt19937 random(seed);
+		std::uniform_real_distribution<double> jitter(-NodeSearcher::SnapRadius, NodeSearcher::SnapRadius);
+		std::uniform_real_distribution<double> x(0.0, SheetSize.x);
+		std::uniform_real_distribution<double> y(0.0, SheetSize.y);
+		std::uniform_int_distribution<size_t> nodeIndex(0, nodes.size() - 1);
+
+		const NodeSearcher::View view{ &ws, Vector2D(), 1.0, ws.GetEditGeneration() };
+
+		Timings timings;
+		size_t snappedCount = 0;
+		for (size_t i = 0; i < SnapQueryCount; i++)
+		{
+			const auto cursor = i % 2 == 0
+				? view.WorldToScreen(nodes[nodeIndex(random)]) + Vector2D(jitter(random), jitter(random))
+				: Vector2D(x(random), y(random));
+
+			QElapsedTimer timer;
+			timer.start();
+			const auto result = NodeSearcher::SearchNow({ view, cursor });
+			timings.Add(ElapsedMs(timer));
+
+			if (std::get<0>(result).has_value())
+				snappedCount++;
+		}
+
+		auto result = timings.ToJson();
+		result.insert("p95Ms", timings.Percentile(0.95));
+		result.insert("p99Ms", timings.Percentile(0.99));
+		result.insert("snapped", static_cast<qint64>(snappedCount));
+		return result;
+	}
+
+	//DrawShapes into an image the size of a screen, centred on the sheet, as paintEvent sets it up
+	QJsonArray MeasureDraw(const Workspace& ws, const qint32 runCount)
+	{
+		QImage image(ImageWidth, ImageHeight, QImage::Format_ARGB32_Premultiplied);
+
+		QJsonArray result;
+		for (const auto zoom : ZoomLevels)
+		{
+			const auto offset = Vector2D(ImageWidth, ImageHeight) / (2.0 * zoom) - SheetSize / 2.0;
+
+			const auto timings = Measure(runCount, [&]
+			{
+				image.fill(Qt::white);
+
+				QPainter painter(&image);
+				painter.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
+				painter.scale(zoom, zoom);
+				painter.translate(offset);
+
+				ws.DrawShapes(&painter);
+			});
+
+			auto zoomResult = timings.ToJson();
+			zoomResult.insert("zoom", zoom);
+			result.append(zoomResult);
+		}
+
+		return result;
+	}
+
+	QJsonObject MeasureSerialization(const Workspace& ws, NodeSearcher* nodeSearcher, const qint32 runCount)
+	{
+		QByteArray data;
+		const auto serializeTimings = Measure(runCount, [&]
+		{
+			data.clear();
+			QDataStream out(&data, QIODevice::WriteOnly);
+			ws.Serialize(out);
+		});
+
+		//Every run reads into a fresh workspace, only the reading is timed
+		bool bIsRead = true;
+		Timings deserializeTimings;
+		QElapsedTimer total;
+		total.start();
+
+		for (qint32 i = 0; i < runCount && (i == 0 || ElapsedMs(total) < RunBudgetMs); i++)
+		{
+			Workspace target(nullptr, FormatType::A3, nodeSearcher);
+			QDataStream in(data);
+
+			QElapsedTimer timer;
+			timer.start();
+			target.Deserialize(in);
+			deserializeTimings.Add(ElapsedMs(timer));
+
+			bIsRead = bIsRead && in.status() == QDataStream::Ok && target.GetShapeCount() == ws.GetShapeCount();
+		}
+
+		auto serialize = serializeTimings.ToJson();
+		serialize.insert("megabytesPerSecond", ToMegabytesPerSecond(data.size(), serializeTimings.Percentile(0.5)));
+
+		auto deserialize = deserializeTimings.ToJson();
+		deserialize.insert("megabytesPerSecond", ToMegabytesPerSecond(data.size(), deserializeTimings.Percentile(0.5)));
+		deserialize.insert("roundTrip", bIsRead);
+
+		return {
+			{ "bytes", static_cast<qint64>(data.size()) },
+			{ "serialize", serialize },
+			{ "deserialize", deserialize } };
+	}
+
+	//The print path of the app into a PDF, which needs no printer
+	QJsonObject MeasurePrint(const Workspace& ws, const qint32 runCount)
+	{
+		QTemporaryDir directory;
+		const auto path = directory.filePath("print.pdf");
+
+		const auto timings = Measure(runCount, [&]
+		{
+			QPrinter printer(QPrinter::HighResolution);
+			printer.setOutputFormat(QPrinter::PdfFormat);
+			printer.setOutputFileName(path);
+			printer.setPageSize(QPageSize(QPageSize::A3));
+			printer.setPageOrientation(QPageLayout::Landscape);
+
+			ws.Print(&printer, Vector2D(), true);
+		});
+
+		auto result = timings.ToJson();
+		result.insert("bytes", QFileInfo(path).size());
+		return result;
+	}
+
+	QJsonObject RunSize(const size_t shapeCount, const quint32 seed, const qint32 runCount, const bool bShouldPrint)
+	{
+		QTextStream(stderr) << "Benchmarking " << shapeCount << " shapes\n";
+
+		NodeSearcher nodeSearcher;
+		Workspace ws(nullptr, FormatType::A3, &nodeSearcher);
+		nodeSearcher.SetWorkspace(&ws);
+
+		QElapsedTimer timer;
+		timer.start();
+		auto shapes = SyntheticBlueprint::Generate(shapeCount, seed, SheetSize, InternStyles(ws));
+		const auto generateMs = ElapsedMs(timer);
+
+		std::vector<Vector2D> nodes;
+		for (const auto& shape : shapes)
+		{
+			for (const auto& node : shape->GetNodes())
+				nodes.push_back(node.position);
+		}
+
+		QJsonObject result{
+			{ "shapes", static_cast<qint64>(shapeCount) },
+			{ "nodes", static_cast<qint64>(nodes.size()) },
+			{ "generateMs", generateMs },
+			{ "shapeUpdate", MeasureShapeUpdate(shapes, runCount) } };
+
+		ws.ImportShapes(std::move(shapes));
+
+		result.insert("snapSearch", MeasureSnapSearch(ws, nodes, seed));
+		result.insert("draw", MeasureDraw(ws, runCount));
+		result.insert("serialization", MeasureSerialization(ws, &nodeSearcher, runCount));
+
+		if (bShouldPrint)
+			result.insert("print", MeasurePrint(ws, runCount));
+
+		nodeSearcher.SetWorkspace(nullptr);
+		return result;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	//Runs without a display unless a platform is asked for
+	if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+		qputenv("QT_QPA_PLATFORM", "offscreen");
+
+	QApplication a(argc, argv);
+	QApplication::setApplicationName("ProtractorBenchmark");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Times the hot paths of Protractor on synthetic blueprints and prints the results as JSON.");
+	parser.addHelpOption();
+
+	const QCommandLineOption sizesOption("sizes", "Comma separated shape counts, 1000,10000,100000,1000000 by default.", "counts", "1000,10000,100000,1000000");
+	const QCommandLineOption runsOption("runs", "Runs per measurement, fewer if a measurement exceeds its time budget.", "count", "5");
+	const QCommandLineOption seedOption("seed", "Seed of the synthetic drawings.", "seed", "1");
+	const QCommandLineOption outputOption("output", "Write the JSON to <file> instead of the standard output.", "file");
+	const QCommandLineOption noPrintOption("no-print", "Skip print rendering.");
+	const QCommandLineOption sessionOption("session", "Also replay the recorded input session <file>, may be repeated.", "file");
+	parser.addOption(sizesOption);
+	parser.addOption(runsOption);
+	parser.addOption(seedOption);
+	parser.addOption(outputOption);
+	parser.addOption(noPrintOption);
+	parser.addOption(sessionOption);
+	parser.process(a);
+
+	std::vector<size_t> sizes;
+	for (const auto& size : parser.value(sizesOption).split(',', Qt::SkipEmptyParts))
+	{
+		bool bIsNumber = false;
+		const auto shapeCount = size.trimmed().toULongLong(&bIsNumber);
+		if (!bIsNumber || shapeCount == 0)
+		{
+			QTextStream(stderr) << "Invalid shape count " << size << '\n';
+			return 1;
+		}
+
+		sizes.push_back(static_cast<size_t>(shapeCount));
+	}
+
+	const auto runCount = std::max(1, parser.value(runsOption).toInt());
+	const auto seed = parser.value(seedOption).toUInt();
+
+	WorkspaceSettings::Instance()->SetMaxWorkspaceSize(SheetSize);
+
+	QJsonArray results;
+	for (const auto shapeCount : sizes)
+		results.append(RunSize(shapeCount, seed, runCount, !parser.isSet(noPrintOption)));
+
+	//Recorded sessions are replayed back to back, like the synthetic measurements
+	QJsonArray sessions;
+	for (const auto& path : parser.values(sessionOption))
+	{
+		QTextStream(stderr) << "Replaying " << path << '\n';
+
+		InputSession session;
+		const auto report = session.ReadFromFile(path) ? InputReplayer::Run(session, InputReplayer::Pace::FAST) : std::nullopt;
+		if (!report.has_value())
+		{
+			QTextStream(stderr) << "Cannot replay " << path << '\n';
+			return 1;
+		}
+
+		auto sessionResult = report->ToJson();
+		sessionResult.insert("session", QFileInfo(path).fileName());
+		sessions.append(sessionResult);
+	}
+
+	const QJsonObject report{
+		{ "qt", qVersion() },
+		{ "platform", QGuiApplication::platformName() },
+		{ "compiler", GetCompiler() },
+#ifdef NDEBUG
+		{ "build", "release" },
+#else
+		{ "build", "debug" },
+#endif
+		{ "hardwareThreads", static_cast<qint32>(std::thread::hardware_concurrency()) },
+		{ "seed", static_cast<qint64>(seed) },
+		{ "runs", runCount },
+		{ "image", QJsonArray{ ImageWidth, ImageHeight } },
+		{ "results", results },
+		{ "sessions", sessions } };
+
+	const auto json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+	if (!parser.isSet(outputOption))
+	{
+		QTextStream(stdout) << json;
+		return 0;
+	}
+
+	QFile file(parser.value(outputOption));
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) == -1)
+	{
+		QTextStream(stderr) << "Cannot write " << file.fileName() << '\n';
+		return 1;
+	}
+
+	return 0;
+}
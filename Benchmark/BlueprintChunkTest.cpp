@@ -0,0 +1,338 @@
+#include "stdafx.h"
+
+#include "BlueprintChunk.h"
+#include "BlueprintReader.h"
+#include "BlueprintSaver.h"
+#include "DocumentSnapshot.h"
+#include "EditJournal.h"
+#include "SyntheticBlueprint.h"
+#include "Workspace.h"
+
+#include <QTest>
+#include <QTemporaryDir>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+	constexpr Vector2D SheetSize{ 420.0, 297.0 };
+
+	//Chunk directory with a single chunk, its header patched by fPatch before it is written
+	QByteArray WriteChunk(const BlueprintChunk& chunk, const std::function<void(BlueprintChunk::Header&)>& fPatch = nullptr)
+	{
+		auto header = chunk.GetHeader();
+		if (fPatch != nullptr)
+			fPatch(header);
+
+		QByteArray result;
+		QDataStream out(&result, QIODevice::WriteOnly);
+		out.setVersion(QDataStream::Qt_6_2);
+
+		out << quint32(1);
+		BlueprintChunk::SerializeHeader(out, header);
+		out.writeRawData(chunk.GetData().constData(), static_cast<int>(chunk.GetData().size()));
+
+		return result;
+	}
+
+	bool ReadChunks(const QByteArray& data, const size_t styleCount, BlueprintChunk::ShapeBatch& result)
+	{
+		QDataStream in(data);
+		in.setVersion(QDataStream::Qt_6_2);
+
+		return BlueprintChunk::ReadAll(in, styleCount, [&result](BlueprintChunk::ShapeBatch&& batch)
+		{
+			result.insert(result.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+		});
+	}
+
+	BlueprintChunk EncodeLines(const BlueprintFormat::ChunkEncoding encoding, const StyleIndex styleIndex = 0)
+	{
+		const auto first = SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 1.0, 2.0 }, { 3.0, 4.0 } }, styleIndex);
+		const auto second = SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 3.0, 4.0 }, { 8.0, 4.0 } }, styleIndex);
+
+		BlueprintChunk::EncodingOptions options;
+		options.encoding = encoding;
+		return BlueprintChunk::Encode(Shape::Type::LINE, { first.get(), second.get() }, options);
+	}
+}
+
+//Chunked blueprints written and read back, and chunks that have to be refused
+class BlueprintChunkTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void DocumentKeepsItsOrder();
+	void LongPolylinesKeepTheirNodes();
+	void ValidChunksAreRead();
+	void DeltaChunksRoundToTheirGrid();
+	void WrongNodeCountsAreRejected();
+	void WrongNodeTotalIsRejected();
+	void UnknownStylesAreRejected();
+	void CorruptArraysAreRejected();
+	void OversizedDirectoriesAreRejected();
+	void CommittedJournalsAreFolded();
+};
+
+void BlueprintChunkTest::DocumentKeepsItsOrder()
+{
+	Workspace ws(nullptr, FormatType::A3, nullptr);
+	for (qint32 i = 0; i < 3; i++)
+		ws.InternStyle(QPen(Qt::black, 0.5 + i));
+
+	//Types alternate, and an array sits between two runs of shapes
+	ws.ImportShapes(SyntheticBlueprint::Generate(3000, 3, SheetSize, { 0, 1, 2 }));
+
+	ShapeArray::Settings settings;
+	settings.columns = 3;
+	settings.columnSpacing = Vector2D(5.0, 0.0);
+	QVERIFY(ws.MakeArray(settings));
+
+	ws.ImportShapes(SyntheticBlueprint::Generate(500, 4, SheetSize, { 0, 1, 2 }));
+
+	const auto snapshot = ws.MakeSnapshot();
+
+	QByteArray file;
+	{
+		QDataStream out(&file, QIODevice::WriteOnly);
+		out.setVersion(QDataStream::Qt_6_2);
+		snapshot->Serialize(out);
+	}
+
+	QDataStream in(file);
+	in.setVersion(QDataStream::Qt_6_2);
+
+	BlueprintReader reader(in);
+	QVERIFY(reader.ReadHeader());
+	QVERIFY(reader.GetVersion() == BlueprintFormat::CurrentVersion);
+
+	BlueprintReader::ShapeBatch shapes;
+	QVERIFY(reader.ReadShapes([&shapes](BlueprintReader::ShapeBatch&& batch)
+	{
+		shapes.insert(shapes.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+	}));
+
+	QCOMPARE(shapes.size(), snapshot->shapes.size());
+	for (size_t i = 0; i < shapes.size(); i++)
+	{
+		const auto& saved = *snapshot->shapes[i];
+		QVERIFY(shapes[i]->GetType() == saved.GetType());
+		QCOMPARE(shapes[i]->GetStyleIndex(), saved.GetStyleIndex());
+		QCOMPARE(shapes[i]->GetNodes().size(), saved.GetNodes().size());
+
+		for (size_t n = 0; n < saved.GetNodes().size(); n++)
+			QVERIFY(shapes[i]->GetNodes()[n].position == saved.GetNodes()[n].position);
+	}
+}
+
+void BlueprintChunkTest::LongPolylinesKeepTheirNodes()
+{
+	constexpr size_t NodeCount = 100000;
+
+	std::vector<Vector2D> nodes;
+	for (size_t i = 0; i < NodeCount; i++)
+		nodes.emplace_back(static_cast<double>(i) / 256.0, static_cast<double>(i % 7));
+
+	for (const auto encoding : { BlueprintFormat::ChunkEncoding::RAW, BlueprintFormat::ChunkEncoding::DELTA_COMPRESSED })
+	{
+		DocumentSnapshot snapshot;
+		snapshot.styles.Intern(QPen());
+		snapshot.shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::POLYLINE, nodes));
+
+		QByteArray file;
+		{
+			QDataStream out(&file, QIODevice::WriteOnly);
+			out.setVersion(QDataStream::Qt_6_2);
+
+			BlueprintChunk::EncodingOptions options;
+			options.encoding = encoding;
+			snapshot.Serialize(out, options);
+		}
+
+		QDataStream in(file);
+		in.setVersion(QDataStream::Qt_6_2);
+
+		BlueprintReader reader(in);
+		QVERIFY(reader.ReadHeader());
+
+		BlueprintReader::ShapeBatch shapes;
+		QVERIFY(reader.ReadShapes([&shapes](BlueprintReader::ShapeBatch&& batch)
+		{
+			shapes.insert(shapes.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+		}));
+
+		QCOMPARE(shapes.size(), size_t(1));
+		QCOMPARE(shapes.front()->GetNodes().size(), NodeCount);
+		QVERIFY(shapes.front()->GetNodes().back().position == nodes.back());
+	}
+}
+
+void BlueprintChunkTest::ValidChunksAreRead()
+{
+	for (const auto encoding : { BlueprintFormat::ChunkEncoding::RAW, BlueprintFormat::ChunkEncoding::DELTA })
+	{
+		BlueprintChunk::ShapeBatch shapes;
+		QVERIFY(ReadChunks(WriteChunk(EncodeLines(encoding)), 1, shapes));
+		QCOMPARE(shapes.size(), size_t(2));
+		QVERIFY(shapes[1]->GetNodes()[1].position == Vector2D(8.0, 4.0));
+	}
+}
+
+void BlueprintChunkTest::DeltaChunksRoundToTheirGrid()
+{
+	const auto line = SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 1.03, 2.0 }, { 3.0, 4.26 } });
+
+	BlueprintChunk::EncodingOptions options;
+	options.encoding = BlueprintFormat::ChunkEncoding::DELTA;
+	options.grid = 0.1;
+
+	BlueprintChunk::ShapeBatch shapes;
+	QVERIFY(ReadChunks(WriteChunk(BlueprintChunk::Encode(Shape::Type::LINE, { line.get() }, options)), 1, shapes));
+	QCOMPARE(shapes.size(), size_t(1));
+
+	const auto& nodes = shapes.front()->GetNodes();
+	QCOMPARE(nodes[0].position.x, 10.0 * 0.1);
+	QCOMPARE(nodes[1].position.y, 43.0 * 0.1);
+}
+
+void BlueprintChunkTest::WrongNodeCountsAreRejected()
+{
+	const auto polyline = SyntheticBlueprint::MakeShape(Shape::Type::POLYLINE, { { 0.0, 0.0 }, { 1.0, 0.0 }, { 1.0, 1.0 } });
+	const auto chunk = BlueprintChunk::Encode(Shape::Type::POLYLINE, { polyline.get() });
+
+	//The same payload read as a line has one node too many
+	BlueprintChunk::ShapeBatch shapes;
+	QVERIFY(ReadChunks(WriteChunk(chunk), 1, shapes));
+	QVERIFY(!ReadChunks(WriteChunk(chunk, [](auto& header) { header.type = Shape::Type::LINE; }), 1, shapes));
+
+	//Instances and arrays are never chunked
+	QVERIFY(!ReadChunks(WriteChunk(chunk, [](auto& header) { header.type = Shape::Type::ARRAY; }), 1, shapes));
+}
+
+void BlueprintChunkTest::WrongNodeTotalIsRejected()
+{
+	BlueprintChunk::ShapeBatch shapes;
+	QVERIFY(!ReadChunks(WriteChunk(EncodeLines(BlueprintFormat::ChunkEncoding::DELTA), [](auto& header) { header.nodeCount++; }), 1, shapes));
+	QVERIFY(!ReadChunks(WriteChunk(EncodeLines(BlueprintFormat::ChunkEncoding::RAW), [](auto& header) { header.nodeCount++; }), 1, shapes));
+}
+
+void BlueprintChunkTest::UnknownStylesAreRejected()
+{
+	BlueprintChunk::ShapeBatch shapes;
+	QVERIFY(ReadChunks(WriteChunk(EncodeLines(BlueprintFormat::ChunkEncoding::RAW, 2)), 3, shapes));
+	QVERIFY(!ReadChunks(WriteChunk(EncodeLines(BlueprintFormat::ChunkEncoding::RAW, 2)), 2, shapes));
+	QVERIFY(!ReadChunks(WriteChunk(EncodeLines(BlueprintFormat::ChunkEncoding::DELTA, 2)), 2, shapes));
+}
+
+void BlueprintChunkTest::CorruptArraysAreRejected()
+{
+	const auto source = SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 0.0, 0.0 }, { 1.0, 0.0 } });
+
+	//An array record as Shape::Serialize writes it, with the layout and counts given
+	const auto fRead = [&source](const ShapeArray::Layout layout, const quint16 columns, const quint16 rows)
+	{
+		QByteArray record;
+		{
+			QDataStream out(&record, QIODevice::WriteOnly);
+			out.setVersion(QDataStream::Qt_6_2);
+
+			out << Shape::Type::ARRAY << quint32(3) << StyleIndex(0);
+			for (const auto& position : { Vector2D(0.5, 0.0), Vector2D(2.5, 0.0), Vector2D(0.5, 2.0) })
+				out << position;
+
+			out << layout << columns << rows;
+			source->Serialize(out);
+		}
+
+		QDataStream in(record);
+		in.setVersion(QDataStream::Qt_6_2);
+
+		Shape::Type type;
+		in >> type;
+
+		PenStyleTable styles;
+		Shape::Make(type)->Deserialize(in, BlueprintFormat::CurrentVersion, styles);
+		return in.status() == QDataStream::Ok;
+	};
+
+	QVERIFY(fRead(ShapeArray::Layout::RECTANGULAR, 1000, 1000));
+	QVERIFY(!fRead(ShapeArray::Layout::RECTANGULAR, 1001, 1000));
+	QVERIFY(!fRead(ShapeArray::Layout::RECTANGULAR, 0, 1));
+	QVERIFY(!fRead(static_cast<ShapeArray::Layout>(2), 2, 2));
+
+	//Polar arrays have two nodes and a single row
+	QVERIFY(!fRead(ShapeArray::Layout::POLAR, 4, 1));
+}
+
+void BlueprintChunkTest::OversizedDirectoriesAreRejected()
+{
+	BlueprintChunk::ShapeBatch shapes;
+
+	//A chunk count the file cannot hold
+	QByteArray directory;
+	{
+		QDataStream out(&directory, QIODevice::WriteOnly);
+		out.setVersion(QDataStream::Qt_6_2);
+		out << std::numeric_limits<quint32>::max();
+	}
+	QVERIFY(!ReadChunks(directory, 1, shapes));
+
+	//A payload larger than the rest of the file
+	const auto chunk = EncodeLines(BlueprintFormat::ChunkEncoding::DELTA);
+	QVERIFY(!ReadChunks(WriteChunk(chunk, [](auto& header) { header.byteSize = quint64(1) << 40; }), 1, shapes));
+	QVERIFY(!ReadChunks(WriteChunk(chunk, [](auto& header) { header.shapeCount = std::numeric_limits<quint32>::max(); }), 1, shapes));
+	QVERIFY(shapes.empty());
+}
+
+void BlueprintChunkTest::CommittedJournalsAreFolded()
+{
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const auto path = dir.filePath("folded.prob");
+
+	DocumentSnapshot snapshot;
+	snapshot.styles.Intern(QPen());
+	snapshot.shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 0.0, 0.0 }, { 10.0, 0.0 } }));
+	snapshot.shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::BOX, { { 0.0, 0.0 }, { 5.0, 5.0 } }));
+	QVERIFY(BlueprintSaver::Write(snapshot, path));
+
+	//One committed edit of each kind, in a pen the file does not know yet, and one that was never saved
+	PenStyleTable styles = snapshot.styles;
+	{
+		EditJournal journal;
+		QVERIFY(journal.Start(path, styles));
+
+		const auto added = SyntheticBlueprint::MakeShape(Shape::Type::CIRCLE, { { 50.0, 50.0 }, { 55.0, 50.0 } }, styles.Intern(QPen(Qt::red, 2.0)));
+		journal.RecordAdd(*added, styles);
+		journal.RecordRemove(*snapshot.shapes[0], styles);
+		QVERIFY(journal.Commit());
+
+		journal.RecordRemove(*snapshot.shapes[1], styles);
+	}
+
+	QVERIFY(BlueprintSaver::FoldJournal(path, nullptr));
+	QVERIFY(!QFile::exists(EditJournal::GetJournalPath(path)));
+
+	QFile file(path);
+	QVERIFY(file.open(QIODevice::ReadOnly));
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_6_2);
+
+	BlueprintReader reader(in);
+	QVERIFY(reader.ReadHeader());
+
+	BlueprintReader::ShapeBatch shapes;
+	QVERIFY(reader.ReadShapes([&shapes](BlueprintReader::ShapeBatch&& batch)
+	{
+		shapes.insert(shapes.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+	}));
+
+	QCOMPARE(shapes.size(), size_t(2));
+	QVERIFY(shapes[0]->GetType() == Shape::Type::BOX);
+	QVERIFY(shapes[1]->GetType() == Shape::Type::CIRCLE);
+	QVERIFY(reader.GetStyles().Get(shapes[1]->GetStyleIndex()) == QPen(Qt::red, 2.0));
+}
+
+QTEST_MAIN(BlueprintChunkTest)
+#include "BlueprintChunkTest.moc"
@@ -0,0 +1,66 @@
+#include "stdafx.h"
+
+#include "BlueprintImporter.h"
+
+#include <QTest>
+#include <QTemporaryDir>
+
+namespace
+{
+	bool ReadDxf(const QByteArray& entities, BlueprintImporter::Result& result)
+	{
+		QTemporaryDir dir;
+		const auto path = dir.filePath("drawing.dxf");
+
+		QFile file(path);
+		if (!file.open(QIODevice::WriteOnly))
+			return false;
+
+		file.write("0\nSECTION\n2\nENTITIES\n" + entities + "0\nENDSEC\n0\nEOF\n");
+		file.close();
+
+		BlueprintImporter::Settings settings;
+		settings.sheetHeight = 297.0;
+		return BlueprintImporter::Read(path, settings, result);
+	}
+}
+
+//Drawings of other programs turned into shapes
+class BlueprintImporterTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void ArcsBecomePolylines();
+};
+
+void BlueprintImporterTest::ArcsBecomePolylines()
+{
+	//A quarter of a circle of radius 10, counter-clockwise from three o'clock
+	BlueprintImporter::Result result;
+	QVERIFY(ReadDxf("0\nARC\n8\n0\n10\n50.0\n20\n50.0\n40\n10.0\n50\n0.0\n51\n90.0\n", result));
+
+	QCOMPARE(result.shapes.size(), size_t(1));
+	QVERIFY(result.shapes.front()->GetType() == Shape::Type::POLYLINE);
+
+	//No node sits in the centre, every one of them lies on the circle and so do the middles of the chords
+	const auto& nodes = result.shapes.front()->GetNodes();
+	QVERIFY(nodes.size() > 2);
+
+	const auto center = nodes.front().position - Vector2D(10.0, 0.0);
+	QVERIFY(Vector2D::Distance(nodes.back().position, center + Vector2D(0.0, -10.0)) < 1e-9);
+
+	for (size_t i = 0; i < nodes.size(); i++)
+	{
+		QVERIFY(std::abs(Vector2D::Distance(nodes[i].position, center) - 10.0) < 1e-9);
+
+		if (i > 0)
+		{
+			const auto middle = (nodes[i - 1].position + nodes[i].position) / 2.0;
+			QVERIFY(10.0 - Vector2D::Distance(middle, center) <= 1.0 / 1024.0);
+		}
+	}
+}
+
+QTEST_MAIN(BlueprintImporterTest)
+#include "BlueprintImporterTest.moc"
@@ -0,0 +1,175 @@
+#include "stdafx.h"
+
+#include "CompactDocument.h"
+#include "DocumentSnapshot.h"
+#include "SyntheticBlueprint.h"
+#include "Workspace.h"
+
+#include <QTest>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace
+{
+	constexpr Vector2D SheetSize{ 420.0, 297.0 };
+
+	bool IsWithinBound(const Vector2D& quantized, const Vector2D& exact)
+	{
+		return std::abs(quantized.x - exact.x) <= QuantizedVector2D::MaxError
+			&& std::abs(quantized.y - exact.y) <= QuantizedVector2D::MaxError;
+	}
+
+	std::vector<std::shared_ptr<Shape>> MakeShapes(const size_t shapeCount, const quint32 seed)
+	{
+		auto batch = SyntheticBlueprint::Generate(shapeCount, seed, SheetSize, { 0, 1, 2 });
+		return { std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()) };
+	}
+}
+
+//Compact documents against the double-precision shapes they were made from
+class CompactDocumentTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void QuantizationErrorIsBounded();
+	void DocumentRoundTripsWithinBound();
+	void LongShapesKeepTheirNodeCount();
+	void OutOfRangeNodesAreRejected();
+	void WorkspaceCompactsAndExpands();
+};
+
+void CompactDocumentTest::QuantizationErrorIsBounded()
+{
+	std::mt19937 random(1);
+	std::uniform_real_distribution<double> coordinate(-2.0 * SheetSize.x, 2.0 * SheetSize.x);
+
+	for (qint32 i = 0; i < 100000; i++)
+	{
+		const Vector2D exact(coordinate(random), coordinate(random));
+
+		const auto quantized = QuantizedVector2D::FromVector2D(exact);
+		QVERIFY(quantized.has_value());
+		QVERIFY(IsWithinBound(quantized->ToVector2D(), exact));
+	}
+
+	//Halfway between two grid points is the worst case
+	const Vector2D halfway(QuantizedVector2D::Resolution * 10.5, -QuantizedVector2D::Resolution * 3.5);
+	QVERIFY(IsWithinBound(QuantizedVector2D::FromVector2D(halfway)->ToVector2D(), halfway));
+
+	//Grid points come back exactly
+	const Vector2D onGrid(QuantizedVector2D::Resolution * 4097.0, QuantizedVector2D::Resolution * -17.0);
+	QVERIFY(QuantizedVector2D::FromVector2D(onGrid)->ToVector2D() == onGrid);
+}
+
+void CompactDocumentTest::DocumentRoundTripsWithinBound()
+{
+	const auto shapes = MakeShapes(5000, 7);
+
+	CompactDocument document;
+	for (const auto& shape : shapes)
+		QVERIFY(document.Append(shape));
+
+	QCOMPARE(document.GetShapeCount(), shapes.size());
+
+	for (size_t i = 0; i < shapes.size(); i++)
+	{
+		const auto& exact = *shapes[i];
+		const auto materialized = document.Materialize(i);
+		QVERIFY(materialized != nullptr);
+
+		QVERIFY(materialized->GetType() == exact.GetType());
+		QCOMPARE(materialized->GetStyleIndex(), exact.GetStyleIndex());
+		QCOMPARE(materialized->GetNodes().size(), exact.GetNodes().size());
+
+		for (size_t n = 0; n < exact.GetNodes().size(); n++)
+			QVERIFY(IsWithinBound(materialized->GetNodes()[n].position, exact.GetNodes()[n].position));
+
+		//Bounds of shapes spanned by their nodes move no further than the nodes
+		if (exact.GetType() == Shape::Type::LINE || exact.GetType() == Shape::Type::BOX)
+		{
+			const auto bounds = materialized->GetBounds();
+			const auto exactBounds = exact.GetBounds();
+			QVERIFY(IsWithinBound(bounds.topLeft(), exactBounds.topLeft()));
+			QVERIFY(IsWithinBound(bounds.bottomRight(), exactBounds.bottomRight()));
+		}
+	}
+}
+
+void CompactDocumentTest::LongShapesKeepTheirNodeCount()
+{
+	constexpr size_t NodeCount = 1000;
+
+	std::shared_ptr<Shape> polyline = Shape::Make(Shape::Type::POLYLINE);
+	polyline->Restore(0, NodeCount, [](const size_t i) { return Vector2D(static_cast<double>(i) * 0.1, std::sin(static_cast<double>(i) * 0.01)); });
+
+	CompactDocument document;
+	QVERIFY(document.Append(polyline));
+
+	const auto materialized = document.Materialize(0);
+	QCOMPARE(materialized->GetNodes().size(), NodeCount);
+	QVERIFY(IsWithinBound(materialized->GetNodes().back().position, polyline->GetNodes().back().position));
+}
+
+void CompactDocumentTest::OutOfRangeNodesAreRejected()
+{
+	CompactDocument document;
+	QVERIFY(document.Append(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 1.0, 1.0 }, { 2.0, 2.0 } })));
+
+	QVERIFY(!document.Append(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 1.0, 1.0 }, { 1e7, 0.0 } })));
+	QVERIFY(!document.Append(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { std::numeric_limits<double>::quiet_NaN(), 0.0 }, { 1.0, 1.0 } })));
+
+	//A rejected shape leaves nothing behind
+	QCOMPARE(document.GetShapeCount(), size_t(1));
+	QCOMPARE(document.GetQuantizedNodes().size(), size_t(2));
+}
+
+void CompactDocumentTest::WorkspaceCompactsAndExpands()
+{
+	Workspace ws(nullptr, FormatType::A3, nullptr);
+	for (qint32 i = 0; i < 3; i++)
+		ws.InternStyle(QPen(Qt::black, 0.5 + i));
+
+	auto batch = SyntheticBlueprint::Generate(2000, 11, SheetSize, { 0, 1, 2 });
+	ws.ImportShapes(std::move(batch));
+
+	ShapeArray::Settings settings;
+	settings.columns = 4;
+	settings.columnSpacing = Vector2D(10.0, 0.0);
+	QVERIFY(ws.MakeArray(settings));
+
+	const auto before = ws.MakeSnapshot();
+	const auto nodeCount = ws.GetNodeCount();
+
+	QVERIFY(ws.Compact());
+	QVERIFY(ws.IsCompact());
+	QCOMPARE(ws.GetShapeCount(), before->shapes.size());
+	QCOMPARE(ws.GetNodeCount(), nodeCount);
+	QVERIFY(ws.GetMemoryReport().compactDocument != 0);
+
+	//Saving a compacted document does not expand it
+	QCOMPARE(ws.MakeSnapshot()->shapes.size(), before->shapes.size());
+	QVERIFY(ws.IsCompact());
+
+	ws.Expand();
+	QVERIFY(!ws.IsCompact());
+
+	const auto after = ws.MakeSnapshot();
+	QCOMPARE(after->shapes.size(), before->shapes.size());
+
+	for (size_t i = 0; i < before->shapes.size(); i++)
+	{
+		QVERIFY(after->shapes[i]->GetType() == before->shapes[i]->GetType());
+		QCOMPARE(after->shapes[i]->GetNodes().size(), before->shapes[i]->GetNodes().size());
+
+		for (size_t n = 0; n < before->shapes[i]->GetNodes().size(); n++)
+			QVERIFY(IsWithinBound(after->shapes[i]->GetNodes()[n].position, before->shapes[i]->GetNodes()[n].position));
+	}
+
+	//The array is kept as it is, still the most recent shape
+	QVERIFY(after->shapes.back() == before->shapes.back());
+}
+
+QTEST_MAIN(CompactDocumentTest)
+#include "CompactDocumentTest.moc"
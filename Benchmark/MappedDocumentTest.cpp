@@ -0,0 +1,94 @@
+#include "stdafx.h"
+
+#include "DocumentSnapshot.h"
+#include "MappedDocument.h"
+#include "Profiler.h"
+#include "SyntheticBlueprint.h"
+
+#include <QTest>
+#include <QTemporaryFile>
+#include <QImage>
+#include <QPainter>
+
+namespace
+{
+	bool HasInk(const QImage& image, const QRect& area)
+	{
+		for (qint32 y = area.top(); y <= area.bottom(); y++)
+		{
+			for (qint32 x = area.left(); x <= area.right(); x++)
+			{
+				if (image.pixel(x, y) != qRgb(255, 255, 255))
+					return true;
+			}
+		}
+
+		return false;
+	}
+}
+
+//Documents drawn straight from the mapped file
+class MappedDocumentTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void ShapesAreDrawnFromTheMapping();
+};
+
+void MappedDocumentTest::ShapesAreDrawnFromTheMapping()
+{
+	//One shape of each type on the left of the sheet, and lines far off to the right
+	DocumentSnapshot snapshot;
+	snapshot.styles.Intern(QPen(Qt::black, 1.0));
+	snapshot.shapes.push_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 5.0, 5.0 }, { 15.0, 5.0 } }));
+	snapshot.shapes.push_back(SyntheticBlueprint::MakeShape(Shape::Type::BOX, { { 20.0, 0.0 }, { 30.0, 10.0 } }));
+	snapshot.shapes.push_back(SyntheticBlueprint::MakeShape(Shape::Type::OVAL, { { 35.0, 0.0 }, { 45.0, 10.0 } }));
+	snapshot.shapes.push_back(SyntheticBlueprint::MakeShape(Shape::Type::CIRCLE, { { 55.0, 5.0 }, { 60.0, 5.0 } }));
+	snapshot.shapes.push_back(SyntheticBlueprint::MakeShape(Shape::Type::CURVE, { { 65.0, 5.0 }, { 75.0, 5.0 }, { 70.0, 0.0 } }));
+	snapshot.shapes.push_back(SyntheticBlueprint::MakeShape(Shape::Type::POLYLINE, { { 80.0, 5.0 }, { 85.0, 0.0 }, { 90.0, 5.0 } }));
+	for (qint32 i = 0; i < 10; i++)
+		snapshot.shapes.push_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 1000.0, 5.0 * i }, { 1010.0, 5.0 * i } }));
+
+	QTemporaryFile file;
+	QVERIFY(file.open());
+	{
+		QDataStream out(&file);
+		out.setVersion(QDataStream::Qt_6_2);
+		snapshot.Serialize(out);
+	}
+	file.close();
+
+	MappedDocument document;
+	FormatType type;
+	PenStyleTable styles;
+	QVERIFY(document.Open(file.fileName(), type, styles));
+
+	QImage image(100, 20, QImage::Format_RGB32);
+	image.fill(Qt::white);
+
+	Profiler::SetEnabled(true);
+	const auto drawnBefore = Profiler::Instance()->GetCounter(ProfileCounter::SHAPES_DRAWN);
+	const auto culledBefore = Profiler::Instance()->GetCounter(ProfileCounter::SHAPES_CULLED);
+	{
+		QPainter painter(&image);
+		std::optional<StyleIndex> currentStyle;
+		document.Draw(&painter, QRectF(image.rect()), currentStyle, styles);
+	}
+	const auto drawnCount = Profiler::Instance()->GetCounter(ProfileCounter::SHAPES_DRAWN) - drawnBefore;
+	const auto culledCount = Profiler::Instance()->GetCounter(ProfileCounter::SHAPES_CULLED) - culledBefore;
+	Profiler::SetEnabled(false);
+
+	QCOMPARE(drawnCount, quint64(6));
+	QCOMPARE(culledCount, quint64(10));
+
+	//Every type leaves its mark where it lies
+	for (const auto& area : { QRect(5, 4, 11, 3), QRect(19, 0, 12, 11), QRect(34, 0, 12, 11),
+		QRect(49, 0, 12, 11), QRect(64, 0, 12, 6), QRect(79, 0, 12, 6) })
+	{
+		QVERIFY(HasInk(image, area));
+	}
+}
+
+QTEST_MAIN(MappedDocumentTest)
+#include "MappedDocumentTest.moc"
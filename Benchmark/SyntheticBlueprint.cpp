@@ -0,0 +1,134 @@
+#include "stdafx.h"
+
+#include "SyntheticBlueprint.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <optional>
+#include <random>
+
+namespace
+{
+	//Consecutive shapes share a style for a while, as they do when a sheet is drawn layer by layer
+	constexpr size_t StyleRunLength = 64;
+
+	//Chance that a line starts where the previous one ended
+	constexpr double ChainProbability = 0.8;
+
+	class Generator
+	{
+	public:
+		Generator(const quint32 seed, const Vector2D& size) : random_(seed), size_(size) {}
+
+		double Uniform(const double min, const double max) { return std::uniform_real_distribution<double>(min, max)(random_); }
+		bool Chance(const double probability) { return std::bernoulli_distribution(probability)(random_); }
+
+		Vector2D Point() { return { Uniform(0.0, size_.x), Uniform(0.0, size_.y) }; }
+
+		Vector2D Clamp(const Vector2D& point) const { return { std::clamp(point.x, 0.0, size_.x), std::clamp(point.y, 0.0, size_.y) }; }
+
+		Vector2D Polar(const Vector2D& centre, const double radius, const double angle) const
+		{
+			return Clamp(centre + Vector2D(std::cos(angle), std::sin(angle)) * radius);
+		}
+
+		//Most lines of a blueprint are horizontal or vertical
+		Vector2D Direction()
+		{
+			if (Chance(0.6))
+				return Chance(0.5) ? Vector2D(Chance(0.5) ? 1.0 : -1.0, 0.0) : Vector2D(0.0, Chance(0.5) ? 1.0 : -1.0);
+
+			const auto angle = Uniform(0.0, 2.0 * std::numbers::pi);
+			return { std::cos(angle), std::sin(angle) };
+		}
+
+		std::mt19937& GetRandom() { return random_; }
+
+	private:
+		std::mt19937 random_;
+		Vector2D size_;
+	};
+}
+
+BlueprintReader::ShapeBatch SyntheticBlueprint::Generate(const size_t shapeCount, const quint32 seed, const Vector2D& size, const std::vector<StyleIndex>& styles)
+{
+	Generator generator(seed, size);
+
+	std::vector<double> weights;
+	for (const auto& mix : DefaultMix)
+		weights.push_back(static_cast<double>(mix.percent));
+
+	std::discrete_distribution<size_t> typeDistribution(weights.begin(), weights.end());
+
+	BlueprintReader::ShapeBatch result;
+	result.reserve(shapeCount);
+
+	std::optional<Vector2D> lineEnd;
+	for (size_t i = 0; i < shapeCount; i++)
+	{
+		const auto type = DefaultMix[typeDistribution(generator.GetRandom())].type;
+		const auto styleIndex = styles[i / StyleRunLength % styles.size()];
+
+		std::vector<Vector2D> nodes;
+		switch (type)
+		{
+		case Shape::Type::LINE:
+		{
+			const auto start = lineEnd.has_value() && generator.Chance(ChainProbability) ? *lineEnd : generator.Point();
+			const auto end = generator.Clamp(start + generator.Direction() * generator.Uniform(2.0, 60.0));
+			nodes = { start, end };
+			lineEnd = end;
+			break;
+		}
+		case Shape::Type::BOX:
+		case Shape::Type::OVAL:
+		{
+			const auto corner = generator.Point();
+			nodes = { corner, generator.Clamp(corner + Vector2D(generator.Uniform(5.0, 80.0), generator.Uniform(5.0, 80.0))) };
+			break;
+		}
+		case Shape::Type::CIRCLE:
+		{
+			const auto centre = generator.Point();
+			nodes = { centre, generator.Polar(centre, generator.Uniform(2.0, 40.0), generator.Uniform(0.0, 2.0 * std::numbers::pi)) };
+			break;
+		}
+		case Shape::Type::CURVE:
+		{
+			const auto start = generator.Point();
+			nodes = {
+				start,
+				generator.Clamp(start + Vector2D(generator.Uniform(-60.0, 60.0), generator.Uniform(-60.0, 60.0))),
+				generator.Clamp(start + Vector2D(generator.Uniform(-60.0, 60.0), generator.Uniform(-60.0, 60.0))) };
+			break;
+		}
+		case Shape::Type::SECTOR:
+		{
+			const auto centre = generator.Point();
+			const auto radius = generator.Uniform(4.0, 40.0);
+			const auto startAngle = generator.Uniform(0.0, 2.0 * std::numbers::pi);
+			nodes = {
+				centre,
+				generator.Polar(centre, radius, startAngle),
+				generator.Polar(centre, radius, startAngle + generator.Uniform(0.2, 1.5 * std::numbers::pi)) };
+			break;
+		}
+		default:
+			break;
+		}
+
+		auto shape = Shape::Make(type);
+		shape->Restore(styleIndex, nodes.size(), [&nodes](const size_t index) { return nodes[index]; });
+		result.emplace_back(std::move(shape));
+	}
+
+	return result;
+}
+
+std::unique_ptr<Shape> SyntheticBlueprint::MakeShape(const Shape::Type type, const std::vector<Vector2D>& nodes, const StyleIndex styleIndex)
+{
+	auto result = Shape::Make(type);
+	result->Restore(styleIndex, nodes.size(), [&](const size_t i) { return nodes[i]; });
+	return result;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "BlueprintReader.h"
+#include "Shape.h"
+
+//Reproducible drawings for benchmarks. Shapes are sized like parts of a real sheet and lines
+//mostly continue from the previous one, so snapping meets shared endpoints as it does in practice.
+class SyntheticBlueprint
+{
+public:
+	//Share of each type in the drawing, in percent
+	struct Mix
+	{
+		Shape::Type type;
+		quint32 percent;
+	};
+
+	static constexpr std::array<Mix, 6> DefaultMix = { {
+		{ Shape::Type::LINE, 50 },
+		{ Shape::Type::BOX, 12 },
+		{ Shape::Type::CIRCLE, 12 },
+		{ Shape::Type::OVAL, 8 },
+		{ Shape::Type::CURVE, 12 },
+		{ Shape::Type::SECTOR, 6 } } };
+
+	//Shapes spread over [0, size] in world units, drawn with the given styles in turn
+	[[nodiscard]] static BlueprintReader::ShapeBatch Generate(size_t shapeCount, quint32 seed, const Vector2D& size, const std::vector<StyleIndex>& styles);
+
+	//A finished shape of the given type through exactly these nodes, for tests that need known geometry
+	[[nodiscard]] static std::unique_ptr<Shape> MakeShape(Shape::Type type, const std::vector<Vector2D>& nodes, StyleIndex styleIndex = 0);
+};
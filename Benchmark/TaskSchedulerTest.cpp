@@ -0,0 +1,143 @@
+#include "stdafx.h"
+
+#include "NodeSearcher.h"
+#include "SyntheticBlueprint.h"
+#include "TaskScheduler.h"
+#include "Workspace.h"
+
+#include <QTest>
+#include <atomic>
+#include <chrono>
+
+namespace
+{
+	constexpr Vector2D SheetSize{ 420.0, 297.0 };
+
+	bool IsReady(const std::future<void>& future)
+	{
+		return future.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+	}
+}
+
+//Jobs on the shared pool and the owners that wait for them
+class TaskSchedulerTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void ForEachVisitsEveryIndexOnce();
+	void ForEachInsideJobsFinishes();
+	void ContinuationsReachTheirContext();
+	void CancelledJobsAreStillAwaitable();
+	void DestroyedContextsDropTheirContinuation();
+	void DestroyedWorkspacesAreDetached();
+};
+
+void TaskSchedulerTest::ForEachVisitsEveryIndexOnce()
+{
+	constexpr size_t Count = 10000;
+
+	std::vector<std::atomic<qint32>> visits(Count);
+	TaskScheduler::Instance()->ForEach(TaskPriority::BACKGROUND, Count, [&visits](const size_t i) { visits[i]++; });
+
+	for (const auto& visit : visits)
+		QCOMPARE(visit.load(), 1);
+
+	//Nothing to do is not an error
+	TaskScheduler::Instance()->ForEach(TaskPriority::BACKGROUND, 0, [](size_t) { QFAIL("No index expected"); });
+}
+
+void TaskSchedulerTest::ForEachInsideJobsFinishes()
+{
+	auto* scheduler = TaskScheduler::Instance();
+
+	//Every worker is busy with a job that waits on its own loop, the callers take part so none is stuck
+	std::atomic<size_t> sum{ 0 };
+	std::vector<std::future<void>> jobs;
+	for (size_t job = 0; job < scheduler->GetWorkerCount() * 2; job++)
+	{
+		jobs.push_back(scheduler->Post(TaskPriority::BACKGROUND, [scheduler, &sum]
+		{
+			scheduler->ForEach(TaskPriority::BACKGROUND, 100, [&sum](const size_t i) { sum += i; });
+		}, this, [] {}));
+	}
+
+	for (const auto& job : jobs)
+		QVERIFY(IsReady(job));
+
+	QCOMPARE(sum.load(), jobs.size() * 4950);
+}
+
+void TaskSchedulerTest::ContinuationsReachTheirContext()
+{
+	std::optional<qint32> result;
+	const auto job = TaskScheduler::Instance()->Post(TaskPriority::RENDER, [] { return 42; }, this, [&result](const qint32 value)
+	{
+		result = value;
+	});
+
+	QVERIFY(IsReady(job));
+	QTRY_VERIFY(result.has_value());
+	QCOMPARE(*result, 42);
+}
+
+void TaskSchedulerTest::CancelledJobsAreStillAwaitable()
+{
+	CancellationToken token;
+	token.Cancel();
+
+	bool bHasRun = false;
+	const auto job = TaskScheduler::Instance()->Post(TaskPriority::BACKGROUND, [&bHasRun] { bHasRun = true; }, this, [] {}, token);
+
+	QVERIFY(IsReady(job));
+	QVERIFY(!bHasRun);
+}
+
+void TaskSchedulerTest::DestroyedContextsDropTheirContinuation()
+{
+	//The context goes away while its job is still running, as a closed dialog does
+	std::promise<void> release;
+	auto released = release.get_future().share();
+
+	auto* context = new QObject();
+	bool bHasContinued = false;
+	const auto job = TaskScheduler::Instance()->Post(TaskPriority::RENDER, [released] { released.wait(); }, context, [&bHasContinued]
+	{
+		bHasContinued = true;
+	});
+
+	delete context;
+	release.set_value();
+
+	QVERIFY(IsReady(job));
+	QTest::qWait(50);
+	QVERIFY(!bHasContinued);
+}
+
+void TaskSchedulerTest::DestroyedWorkspacesAreDetached()
+{
+	NodeSearcher searcher;
+
+	for (qint32 round = 0; round < 20; round++)
+	{
+		//Large enough to be searched on the pool
+		auto* ws = new Workspace(nullptr, FormatType::A3, &searcher);
+		ws->InternStyle(QPen(Qt::black, 0.5));
+		ws->ImportShapes(SyntheticBlueprint::Generate(NodeSearcher::SyncSearchLimit, static_cast<quint32>(round), SheetSize, { 0 }));
+		searcher.SetWorkspace(ws);
+
+		const NodeSearcher::View view{ ws, Vector2D(), 1.0, 0 };
+		[[maybe_unused]] const auto answer = searcher.Search({ view, Vector2D(10.0, 10.0) });
+		searcher.Prefetch(view, { Vector2D(20.0, 20.0), Vector2D(30.0, 30.0) });
+
+		//Searches still queued or running must neither touch the workspace nor post to it
+		delete ws;
+		QVERIFY(searcher.GetWorkspace() == nullptr);
+		QCOMPARE(searcher.GetPrefetchMemoryUsage(view.ws), size_t(0));
+
+		QTest::qWait(5);
+	}
+}
+
+QTEST_MAIN(TaskSchedulerTest)
+#include "TaskSchedulerTest.moc"
@@ -0,0 +1,233 @@
+#include "stdafx.h"
+
+#include "DocumentSnapshot.h"
+#include "SyntheticBlueprint.h"
+#include "Workspace.h"
+
+#include <QTest>
+#include <algorithm>
+
+namespace
+{
+	std::vector<Vector2D> GetPositions(const Shape& shape)
+	{
+		std::vector<Vector2D> result;
+		for (const auto& node : shape.GetNodes())
+			result.push_back(node.position);
+
+		return result;
+	}
+
+	void MakeStyles(Workspace& ws)
+	{
+		ws.InternStyle(QPen(Qt::black, 0.5));
+		ws.InternStyle(QPen(Qt::red, 0.5));
+	}
+}
+
+//Whole-document edits of the workspace
+class WorkspaceEditTest : public QObject
+{
+	Q_OBJECT
+
+private slots:
+	void LongChainsBecomeOnePolyline();
+	void MergeKeepsDocumentOrder();
+	void ClosedLoopsAreMerged();
+	void BranchesAndStylesSplitChains();
+	void SimplifyKeepsToItsRegion();
+	void SimplifyIsUndone();
+	void FlatCurvesBecomeLines();
+};
+
+void WorkspaceEditTest::LongChainsBecomeOnePolyline()
+{
+	constexpr size_t LineCount = 1000;
+
+	Workspace ws(nullptr, FormatType::A3, nullptr);
+	MakeStyles(ws);
+
+	//Lines are added out of order and some of them backwards
+	BlueprintReader::ShapeBatch lines;
+	for (size_t i = 0; i < LineCount; i++)
+	{
+		const auto line = (i * 7) % LineCount;
+		const Vector2D from(static_cast<double>(line), 0.0);
+		const Vector2D to(static_cast<double>(line + 1), 0.0);
+		lines.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, i % 2 == 0 ? std::vector{ from, to } : std::vector{ to, from }));
+	}
+	ws.ImportShapes(std::move(lines));
+
+	QCOMPARE(ws.MergeConnectedLines(), size_t(1));
+
+	const auto snapshot = ws.MakeSnapshot();
+	QCOMPARE(snapshot->shapes.size(), size_t(1));
+	QVERIFY(snapshot->shapes.front()->GetType() == Shape::Type::POLYLINE);
+	QCOMPARE(snapshot->shapes.front()->GetNodes().size(), LineCount + 1);
+
+	//Every point lies on the chain exactly once
+	auto xs = GetPositions(*snapshot->shapes.front());
+	std::ranges::sort(xs, {}, &Vector2D::x);
+	for (size_t i = 0; i <= LineCount; i++)
+		QCOMPARE(xs[i].x, static_cast<double>(i));
+}
+
+void WorkspaceEditTest::MergeKeepsDocumentOrder()
+{
+	const auto fMerge = []()
+	{
+		Workspace ws(nullptr, FormatType::A3, nullptr);
+		MakeStyles(ws);
+
+		BlueprintReader::ShapeBatch shapes;
+		shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::BOX, { { 0.0, 0.0 }, { 5.0, 5.0 } }));
+		shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 20.0, 0.0 }, { 30.0, 0.0 } }));
+		shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::CIRCLE, { { 50.0, 50.0 }, { 55.0, 50.0 } }));
+		shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 10.0, 0.0 }, { 20.0, 0.0 } }));
+		shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 100.0, 0.0 }, { 110.0, 0.0 } }));
+		shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 110.0, 0.0 }, { 110.0, 10.0 } }));
+		ws.ImportShapes(std::move(shapes));
+
+		const auto mergedCount = ws.MergeConnectedLines();
+		return std::pair(mergedCount, ws.MakeSnapshot());
+	};
+
+	const auto [mergedCount, snapshot] = fMerge();
+	QCOMPARE(mergedCount, size_t(2));
+
+	//Each polyline takes the place of the earliest line it was made of
+	const auto& shapes = snapshot->shapes;
+	QCOMPARE(shapes.size(), size_t(4));
+	QVERIFY(shapes[0]->GetType() == Shape::Type::BOX);
+	QVERIFY(shapes[1]->GetType() == Shape::Type::POLYLINE);
+	QVERIFY(shapes[2]->GetType() == Shape::Type::CIRCLE);
+	QVERIFY(shapes[3]->GetType() == Shape::Type::POLYLINE);
+	QCOMPARE(shapes[1]->GetNodes().size(), size_t(3));
+	QCOMPARE(shapes[3]->GetNodes().size(), size_t(3));
+
+	//The same document always gives the same result
+	const auto [repeatedCount, repeated] = fMerge();
+	QCOMPARE(repeatedCount, mergedCount);
+	for (size_t i = 0; i < shapes.size(); i++)
+		QVERIFY(GetPositions(*repeated->shapes[i]) == GetPositions(*shapes[i]));
+}
+
+void WorkspaceEditTest::ClosedLoopsAreMerged()
+{
+	Workspace ws(nullptr, FormatType::A3, nullptr);
+	MakeStyles(ws);
+
+	const std::vector<Vector2D> corners = { { 0.0, 0.0 }, { 10.0, 0.0 }, { 10.0, 10.0 }, { 0.0, 10.0 } };
+
+	BlueprintReader::ShapeBatch lines;
+	for (size_t i = 0; i < corners.size(); i++)
+		lines.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { corners[i], corners[(i + 1) % corners.size()] }));
+	ws.ImportShapes(std::move(lines));
+
+	QCOMPARE(ws.MergeConnectedLines(), size_t(1));
+
+	const auto snapshot = ws.MakeSnapshot();
+	QCOMPARE(snapshot->shapes.size(), size_t(1));
+
+	const auto& nodes = snapshot->shapes.front()->GetNodes();
+	QCOMPARE(nodes.size(), corners.size() + 1);
+	QVERIFY(nodes.front().position == nodes.back().position);
+}
+
+void WorkspaceEditTest::BranchesAndStylesSplitChains()
+{
+	Workspace ws(nullptr, FormatType::A3, nullptr);
+	MakeStyles(ws);
+
+	//Three lines meet at the origin, a fourth one continues the first in another pen
+	BlueprintReader::ShapeBatch lines;
+	lines.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 0.0, 0.0 }, { 10.0, 0.0 } }));
+	lines.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 0.0, 0.0 }, { 0.0, 10.0 } }));
+	lines.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 0.0, 0.0 }, { -10.0, 0.0 } }));
+	lines.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 10.0, 0.0 }, { 20.0, 0.0 } }, 1));
+	ws.ImportShapes(std::move(lines));
+
+	QCOMPARE(ws.MergeConnectedLines(), size_t(0));
+	QCOMPARE(ws.GetShapeCount(), size_t(4));
+}
+
+void WorkspaceEditTest::SimplifyKeepsToItsRegion()
+{
+	Workspace ws(nullptr, FormatType::A3, nullptr);
+	MakeStyles(ws);
+
+	//Two straight polylines with a point in the middle that simplifying drops
+	BlueprintReader::ShapeBatch shapes;
+	shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::POLYLINE, { { 0.0, 0.0 }, { 5.0, 0.001 }, { 10.0, 0.0 } }));
+	shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::POLYLINE, { { 100.0, 0.0 }, { 105.0, 0.001 }, { 110.0, 0.0 } }));
+	ws.ImportShapes(std::move(shapes));
+
+	QCOMPARE(ws.SimplifyPolylines(0.01, QRectF(-1.0, -1.0, 20.0, 2.0), false), size_t(1));
+
+	const auto snapshot = ws.MakeSnapshot();
+	QCOMPARE(snapshot->shapes[0]->GetNodes().size(), size_t(2));
+	QCOMPARE(snapshot->shapes[1]->GetNodes().size(), size_t(3));
+
+	//The whole document
+	QCOMPARE(ws.SimplifyPolylines(0.01, std::nullopt, false), size_t(1));
+	QCOMPARE(ws.MakeSnapshot()->shapes[1]->GetNodes().size(), size_t(2));
+}
+
+void WorkspaceEditTest::SimplifyIsUndone()
+{
+	Workspace ws(nullptr, FormatType::A3, nullptr);
+	MakeStyles(ws);
+
+	BlueprintReader::ShapeBatch shapes;
+	shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::BOX, { { 0.0, 0.0 }, { 5.0, 5.0 } }));
+	shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::POLYLINE, { { 0.0, 0.0 }, { 5.0, 0.001 }, { 10.0, 0.0 } }));
+	ws.ImportShapes(std::move(shapes));
+
+	const auto before = ws.MakeSnapshot();
+
+	QVERIFY(!ws.CanUndoSimplify());
+	QCOMPARE(ws.SimplifyPolylines(0.01, std::nullopt, false), size_t(1));
+	QVERIFY(ws.CanUndoSimplify());
+
+	QVERIFY(ws.UndoSimplify());
+	QVERIFY(!ws.CanUndoSimplify());
+
+	const auto after = ws.MakeSnapshot();
+	QCOMPARE(after->shapes.size(), before->shapes.size());
+	for (size_t i = 0; i < before->shapes.size(); i++)
+		QVERIFY(after->shapes[i] == before->shapes[i]);
+
+	//An edit after simplifying leaves nothing to undo
+	QCOMPARE(ws.SimplifyPolylines(0.01, std::nullopt, false), size_t(1));
+
+	BlueprintReader::ShapeBatch more;
+	more.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::LINE, { { 0.0, 0.0 }, { 1.0, 1.0 } }));
+	ws.ImportShapes(std::move(more));
+
+	QVERIFY(!ws.UndoSimplify());
+	QCOMPARE(ws.MakeSnapshot()->shapes[1]->GetNodes().size(), size_t(2));
+}
+
+void WorkspaceEditTest::FlatCurvesBecomeLines()
+{
+	Workspace ws(nullptr, FormatType::A3, nullptr);
+	MakeStyles(ws);
+
+	//Curves run from the first node to the second, bent towards the third
+	BlueprintReader::ShapeBatch shapes;
+	shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::CURVE, { { 0.0, 0.0 }, { 10.0, 0.0 }, { 5.0, 0.001 } }));
+	shapes.emplace_back(SyntheticBlueprint::MakeShape(Shape::Type::CURVE, { { 0.0, 0.0 }, { 10.0, 0.0 }, { 5.0, 5.0 } }));
+	ws.ImportShapes(std::move(shapes));
+
+	//Curves are only touched when asked for
+	QCOMPARE(ws.SimplifyPolylines(0.01, std::nullopt, false), size_t(0));
+	QCOMPARE(ws.SimplifyPolylines(0.01, std::nullopt, true), size_t(1));
+
+	const auto snapshot = ws.MakeSnapshot();
+	QVERIFY(snapshot->shapes[0]->GetType() == Shape::Type::LINE);
+	QVERIFY(snapshot->shapes[0]->GetNodes()[1].position == Vector2D(10.0, 0.0));
+	QVERIFY(snapshot->shapes[1]->GetType() == Shape::Type::CURVE);
+}
+
+QTEST_MAIN(WorkspaceEditTest)
+#include "WorkspaceEditTest.moc"
@@ -0,0 +1,36 @@
+#include "stdafx.h"
+
+#include "ArrayDialog.h"
+
+ArrayDialog::ArrayDialog(QWidget* parent)
+	: QDialog(parent)
+{
+	setupUi(this);
+	setWindowFlag(Qt::MSWindowsFixedSizeDialogHint);
+
+	connect(applyButton, &QPushButton::pressed, [this] { done(QDialog::Accepted); });
+	connect(exitButton, &QPushButton::pressed, [this] { done(QDialog::Rejected); });
+}
+
+ArrayDialog::~ArrayDialog() {}
+
+ShapeArray::Settings ArrayDialog::GetSettings(const double factor) const
+{
+	ShapeArray::Settings result;
+
+	if (layoutTabs->currentWidget() == polarTab)
+	{
+		result.layout = ShapeArray::Layout::POLAR;
+		result.columns = static_cast<quint16>(countEdit->value());
+		result.centerOffset = Vector2D(centerXEdit->value(), centerYEdit->value()) / factor;
+		return result;
+	}
+
+	result.layout = ShapeArray::Layout::RECTANGULAR;
+	result.columns = static_cast<quint16>(columnsEdit->value());
+	result.rows = static_cast<quint16>(rowsEdit->value());
+	result.columnSpacing = Vector2D(columnSpacingEdit->value() / factor, 0.0);
+	result.rowSpacing = Vector2D(0.0, rowSpacingEdit->value() / factor);
+
+	return result;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <QDialog>
+#include "ui_ArrayDialog.h"
+
+#include "Shape.h"
+
+//Asks for the layout of a rectangular or polar array; distances are entered in millimetres
+class ArrayDialog : public QDialog, public Ui::ArrayDialog
+{
+	Q_OBJECT
+
+public:
+	ArrayDialog(QWidget* parent);
+	virtual ~ArrayDialog();
+
+	//Converts to world units with the size of one world unit in millimetres
+	ShapeArray::Settings GetSettings(double factor) const;
+};
@@ -0,0 +1,225 @@
+#include "stdafx.h"
+
+#include "Block.h"
+
+#include "BlueprintExporter.h"
+#include "Profiler.h"
+
+#include <QPainter>
+#include <QPaintEngine>
+#include <cmath>
+#include <algorithm>
+
+Block::Block(const QString& name, BlueprintChunk::ShapeBatch&& shapes)
+	: name_(name),
+	referenceLength_(1.0)
+{
+	QRectF sourceBounds;
+	for (const auto& shape : shapes)
+		sourceBounds |= shape->GetBounds();
+
+	//Blocks are placed by their centre and drawn in the instance's pen
+	const Vector2D center = sourceBounds.center();
+
+	shapes_.reserve(shapes.size());
+	for (auto& shape : shapes)
+	{
+		std::vector<Vector2D> positions;
+		positions.reserve(shape->GetNodes().size());
+		for (const auto& node : shape->GetNodes())
+			positions.push_back(node.position - center);
+
+		shape->Restore(0, positions.size(), [&positions](const size_t i) { return positions[i]; });
+
+		bounds_ |= shape->GetBounds();
+		shapes_.emplace_back(std::move(shape));
+	}
+
+	const auto extent = std::max(bounds_.width(), bounds_.height()) / 2.0;
+	if (extent > 0.0)
+		referenceLength_ = extent;
+}
+
+void Block::Draw(QPainter* painter, const QTransform& placement) const
+{
+	const auto pixelScale = std::sqrt(std::abs((placement * painter->transform()).determinant()));
+	if (pixelScale == 0.0 || shapes_.empty())
+		return;
+
+	//Printers and PDF get vectors, the raster cache only serves screens and images
+	if (painter->paintEngine()->type() == QPaintEngine::Raster)
+	{
+		const auto zoomStep = static_cast<qint32>(std::lround(2.0 * std::log2(pixelScale)));
+
+		const auto raster = GetRaster_(painter->pen(), zoomStep);
+		if (raster.has_value())
+		{
+			const auto rasterScale = std::exp2(zoomStep / 2.0);
+
+			painter->save();
+			painter->setTransform(placement, true);
+			painter->scale(1.0 / rasterScale, 1.0 / rasterScale);
+			painter->drawImage(raster->topLeft * rasterScale, raster->image);
+			painter->restore();
+
+			return;
+		}
+	}
+
+	painter->save();
+	painter->setTransform(placement, true);
+
+	for (const auto& shape : shapes_)
+		shape->Draw(painter);
+
+	painter->restore();
+}
+
+std::optional<Block::Raster> Block::GetRaster_(const QPen& pen, const qint32 zoomStep) const
+{
+	std::scoped_lock lock(rasterMutex_);
+
+	for (const auto& raster : rasters_)
+	{
+		if (raster.zoomStep == zoomStep && raster.pen == pen)
+		{
+			Profiler::Count(ProfileCounter::BLOCK_RASTER_HITS);
+			return raster;
+		}
+	}
+
+	Profiler::Count(ProfileCounter::BLOCK_RASTER_MISSES);
+
+	const auto rasterScale = std::exp2(zoomStep / 2.0);
+
+	//Leave room for the pen around the geometry, cosmetic widths are in pixels
+	const auto penWidth = pen.isCosmetic() ? std::max(pen.widthF(), 1.0) / rasterScale : pen.widthF();
+	const auto margin = penWidth / 2.0 + 1.0 / rasterScale;
+	const auto area = bounds_.adjusted(-margin, -margin, margin, margin);
+
+	const auto width = static_cast<qint32>(std::ceil(area.width() * rasterScale));
+	const auto height = static_cast<qint32>(std::ceil(area.height() * rasterScale));
+	if (width > MaxRasterSize || height > MaxRasterSize)
+		return std::nullopt;
+
+	Raster result{ pen, zoomStep, QImage(std::max(width, 1), std::max(height, 1), QImage::Format_ARGB32_Premultiplied), area.topLeft() };
+	result.image.fill(Qt::transparent);
+
+	QPainter painter(&result.image);
+	painter.setRenderHint(QPainter::Antialiasing);
+	painter.scale(rasterScale, rasterScale);
+	painter.translate(-area.topLeft());
+	painter.setPen(pen);
+
+	for (const auto& shape : shapes_)
+		shape->Draw(&painter);
+
+	painter.end();
+
+	if (rasters_.size() == MaxRasterCount)
+		rasters_.erase(rasters_.begin());
+
+	rasters_.push_back(result);
+	return result;
+}
+
+void Block::Export(IShapeExporter& exporter, const QTransform& placement) const
+{
+	TransformedExporter placedExporter(exporter, placement);
+
+	for (const auto& shape : shapes_)
+		shape->Export(placedExporter);
+}
+
+void Block::Serialize(QDataStream& out) const
+{
+	out << name_;
+	BlueprintChunk::WriteAll(out, shapes_);
+}
+
+std::shared_ptr<const Block> Block::Deserialize(QDataStream& in)
+{
+	QString name;
+	in >> name;
+
+	BlueprintChunk::ShapeBatch shapes;
+	const auto bIsRead = BlueprintChunk::ReadAll(in, BlueprintChunk::AnyStyleCount, [&shapes](BlueprintChunk::ShapeBatch&& batch)
+	{
+		shapes.insert(shapes.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+	});
+
+	if (!bIsRead || in.status() != QDataStream::Ok)
+		return nullptr;
+
+	return std::make_shared<const Block>(name, std::move(shapes));
+}
+
+Shape::MemoryUsage Block::GetMemoryUsage() const
+{
+	Shape::MemoryUsage result;
+	result.object = sizeof(Block) + static_cast<size_t>(name_.capacity()) * sizeof(QChar)
+		+ shapes_.capacity() * sizeof(std::shared_ptr<const Shape>) + shapes_.size() * Shape::MemoryUsage::ControlBlockSize;
+
+	for (const auto& shape : shapes_)
+		result += shape->GetMemoryUsage();
+
+	return result;
+}
+
+size_t Block::GetRasterMemoryUsage() const
+{
+	std::scoped_lock lock(rasterMutex_);
+
+	size_t result = rasters_.capacity() * sizeof(Raster);
+	for (const auto& raster : rasters_)
+		result += static_cast<size_t>(raster.image.sizeInBytes());
+
+	return result;
+}
+
+size_t Block::ClearRasters() const
+{
+	const auto result = GetRasterMemoryUsage();
+
+	std::scoped_lock lock(rasterMutex_);
+	std::vector<Raster>().swap(rasters_);
+
+	return result;
+}
+
+BlockIndex BlockTable::Add(std::shared_ptr<const Block> block)
+{
+	blocks_.emplace_back(std::move(block));
+	return static_cast<BlockIndex>(blocks_.size() - 1);
+}
+
+void BlockTable::Serialize(QDataStream& out) const
+{
+	out << static_cast<quint32>(blocks_.size());
+
+	for (const auto& block : blocks_)
+		block->Serialize(out);
+}
+
+bool BlockTable::Deserialize(QDataStream& in)
+{
+	quint32 blockCount;
+	in >> blockCount;
+
+	blocks_.clear();
+	for (quint32 i = 0; i < blockCount && in.status() == QDataStream::Ok; i++)
+	{
+		auto block = Block::Deserialize(in);
+		if (block == nullptr)
+			return false;
+
+		blocks_.emplace_back(std::move(block));
+	}
+
+	return in.status() == QDataStream::Ok;
+}
+
+std::unique_ptr<Shape> BlockInstanceFactory::Create(const StyleIndex styleIndex) const
+{
+	return std::make_unique<Instance>(styleIndex, blockIndex_, block_);
+}
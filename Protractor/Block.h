@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <QImage>
+#include <QPen>
+
+#include "Shape.h"
+#include "ShapeFactory.h"
+#include "BlueprintChunk.h"
+
+//Named symbol shared by every Instance placing it. The geometry is centred on the block's origin
+//and has no pens of its own, instances draw it in theirs. Raster images of the block are cached
+//per zoom step and pen, so drawing a thousand doors rasterizes the door once.
+class Block
+{
+public:
+	//Rasters are cached in half-octave zoom steps, larger ones are drawn as vectors instead
+	static constexpr qint32 MaxRasterSize = 1024;
+	static constexpr size_t MaxRasterCount = 4;
+
+	Block(const QString& name, BlueprintChunk::ShapeBatch&& shapes);
+
+	void Draw(QPainter* painter, const QTransform& placement) const;
+	void Export(IShapeExporter& exporter, const QTransform& placement) const;
+
+	void Serialize(QDataStream& out) const;
+	[[nodiscard]] static std::shared_ptr<const Block> Deserialize(QDataStream& in);
+
+	//Bytes held by the geometry and by the cached rasters
+	Shape::MemoryUsage GetMemoryUsage() const;
+	size_t GetRasterMemoryUsage() const;
+
+	//Drops the cached rasters, the next draws rebuild them; returns the bytes released
+	size_t ClearRasters() const;
+
+private:
+	struct Raster
+	{
+		QPen pen;
+		qint32 zoomStep;
+		QImage image;
+		QPointF topLeft;
+	};
+
+	std::optional<Raster> GetRaster_(const QPen& pen, qint32 zoomStep) const;
+
+	QString name_;
+	std::vector<std::shared_ptr<const Shape>> shapes_;
+	QRectF bounds_;
+	double referenceLength_;
+
+	mutable std::mutex rasterMutex_;
+	mutable std::vector<Raster> rasters_;
+
+public:
+	__forceinline const QString& GetName() const { return name_; }
+	__forceinline const std::vector<std::shared_ptr<const Shape>>& GetShapes() const { return shapes_; }
+	__forceinline const QRectF& GetBounds() const { return bounds_; }
+
+	//Distance of an instance handle from its origin at scale 1
+	__forceinline double GetReferenceLength() const { return referenceLength_; }
+};
+
+//Per-document list of blocks; instances refer to their block by index
+class BlockTable
+{
+public:
+	BlockTable() = default;
+
+	BlockIndex Add(std::shared_ptr<const Block> block);
+
+	void Serialize(QDataStream& out) const;
+	[[nodiscard]] bool Deserialize(QDataStream& in);
+
+private:
+	std::vector<std::shared_ptr<const Block>> blocks_;
+
+public:
+	__forceinline const std::shared_ptr<const Block>& Get(const BlockIndex index) const { return blocks_[index]; }
+
+	__forceinline size_t GetSize() const { return blocks_.size(); }
+	__forceinline bool IsEmpty() const { return blocks_.empty(); }
+};
+
+class BlockInstanceFactory : public IShapeFactory
+{
+public:
+	BlockInstanceFactory(const BlockIndex blockIndex, std::shared_ptr<const Block> block)
+		: blockIndex_(blockIndex), block_(std::move(block)) {}
+
+	[[nodiscard]] std::unique_ptr<Shape> Create(StyleIndex styleIndex) const override;
+
+	[[nodiscard]] Shape::Type GetType() const override { return Shape::Type::INSTANCE; }
+
+private:
+	BlockIndex blockIndex_;
+	std::shared_ptr<const Block> block_;
+};
@@ -0,0 +1,544 @@
+#include "stdafx.h"
+
+#include "BlueprintChunk.h"
+
+#include "TaskScheduler.h"
+
+#include <QtEndian>
+#include <algorithm>
+#include <cmath>
+#include <array>
+#include <cstring>
+#include <limits>
+
+#if Q_BYTE_ORDER != Q_LITTLE_ENDIAN
+#error "Packed chunks are copied as-is and assume a little-endian host"
+#endif
+
+namespace
+{
+	constexpr size_t NodeSize = 2 * sizeof(double);
+
+	//Grid coordinates are kept below 2^53 so rounding is exact and deltas cannot overflow
+	constexpr double MaxGridCoordinate = 9007199254740992.0;
+
+	__forceinline quint64 ZigZag(const qint64 value)
+	{
+		return (static_cast<quint64>(value) << 1) ^ static_cast<quint64>(value >> 63);
+	}
+
+	__forceinline qint64 UnZigZag(const quint64 value)
+	{
+		return static_cast<qint64>(value >> 1) ^ -static_cast<qint64>(value & 1);
+	}
+
+	void WriteVarint(QByteArray& out, quint64 value)
+	{
+		while (value >= 0x80)
+		{
+			out.append(static_cast<char>(value | 0x80));
+			value >>= 7;
+		}
+		out.append(static_cast<char>(value));
+	}
+
+	__forceinline bool ReadVarint(const char*& it, const char* end, quint64& value)
+	{
+		value = 0;
+		for (qint32 shift = 0; shift < 64 && it != end; shift += 7)
+		{
+			const auto byte = static_cast<quint8>(*it++);
+			value |= static_cast<quint64>(byte & 0x7F) << shift;
+			if ((byte & 0x80) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	//Bytes left in a file or buffer; sequential devices cannot tell, so they are not bounded
+	quint64 GetRemainingSize(const QDataStream& in)
+	{
+		const auto* device = in.device();
+		if (device == nullptr || device->isSequential())
+			return std::numeric_limits<quint64>::max();
+
+		return static_cast<quint64>(std::max<qint64>(0, device->bytesAvailable()));
+	}
+
+	//readRawData and writeRawData take an int, larger payloads are passed in pieces
+	constexpr quint64 MaxRawPiece = std::numeric_limits<int>::max();
+
+	bool ReadRaw(QDataStream& in, char* data, quint64 size)
+	{
+		while (size > 0)
+		{
+			const auto piece = static_cast<int>(std::min(size, MaxRawPiece));
+			if (in.readRawData(data, piece) != piece)
+				return false;
+
+			data += piece;
+			size -= piece;
+		}
+		return true;
+	}
+
+	void WriteRaw(QDataStream& out, const char* data, quint64 size)
+	{
+		while (size > 0)
+		{
+			const auto piece = static_cast<int>(std::min(size, MaxRawPiece));
+			out.writeRawData(data, piece);
+
+			data += piece;
+			size -= piece;
+		}
+	}
+}
+
+quint64 BlueprintChunk::GetPayloadSize(const quint32 shapeCount, const quint32 nodeCount)
+{
+	return static_cast<quint64>(shapeCount) * (sizeof(StyleIndex) + sizeof(quint32))
+		+ static_cast<quint64>(nodeCount) * NodeSize;
+}
+
+BlueprintChunk BlueprintChunk::Encode(const Shape::Type type, const std::vector<const Shape*>& shapes, const EncodingOptions& options)
+{
+	BlueprintChunk result;
+
+	auto& header = result.header_;
+	header.type = type;
+	header.shapeCount = static_cast<quint32>(shapes.size());
+	for (const auto* shape : shapes)
+		header.nodeCount += static_cast<quint32>(shape->GetNodes().size());
+
+	if (options.encoding != BlueprintFormat::ChunkEncoding::RAW && result.EncodeDelta_(shapes, options.grid))
+	{
+		header.encoding = BlueprintFormat::ChunkEncoding::DELTA;
+
+		if (options.encoding == BlueprintFormat::ChunkEncoding::DELTA_COMPRESSED)
+		{
+			auto compressed = qCompress(result.data_);
+			if (compressed.size() < result.data_.size())
+			{
+				header.encoding = BlueprintFormat::ChunkEncoding::DELTA_COMPRESSED;
+				result.data_ = std::move(compressed);
+			}
+		}
+	}
+	else
+	{
+		result.EncodeRaw_(shapes);
+	}
+
+	header.byteSize = static_cast<quint64>(result.data_.size());
+	return result;
+}
+
+void BlueprintChunk::EncodeRaw_(const std::vector<const Shape*>& shapes)
+{
+	header_.encoding = BlueprintFormat::ChunkEncoding::RAW;
+	data_.resize(static_cast<qsizetype>(GetPayloadSize(header_.shapeCount, header_.nodeCount)));
+
+	auto* styles = data_.data();
+	auto* counts = styles + header_.shapeCount * sizeof(StyleIndex);
+	auto* positions = counts + header_.shapeCount * sizeof(quint32);
+
+	for (const auto* shape : shapes)
+	{
+		const auto styleIndex = shape->GetStyleIndex();
+		std::memcpy(styles, &styleIndex, sizeof(StyleIndex));
+		styles += sizeof(StyleIndex);
+
+		const auto& nodes = shape->GetNodes();
+		const auto nodeCount = static_cast<quint32>(nodes.size());
+		std::memcpy(counts, &nodeCount, sizeof(quint32));
+		counts += sizeof(quint32);
+
+		for (const auto& node : nodes)
+		{
+			const std::array xy = { node.position.x, node.position.y };
+			std::memcpy(positions, xy.data(), NodeSize);
+			positions += NodeSize;
+		}
+	}
+}
+
+bool BlueprintChunk::EncodeDelta_(const std::vector<const Shape*>& shapes, const double grid)
+{
+	if (!(grid > 0.0) || !std::isfinite(grid))
+		return false;
+
+	data_.clear();
+	//Most deltas between neighbouring nodes fit into two or three bytes per coordinate
+	data_.reserve(static_cast<qsizetype>(sizeof(double) + header_.shapeCount * (sizeof(StyleIndex) + sizeof(quint32)) + static_cast<quint64>(header_.nodeCount) * 6));
+
+	data_.append(reinterpret_cast<const char*>(&grid), sizeof(grid));
+
+	for (const auto* shape : shapes)
+	{
+		const auto styleIndex = shape->GetStyleIndex();
+		data_.append(reinterpret_cast<const char*>(&styleIndex), sizeof(StyleIndex));
+	}
+
+	for (const auto* shape : shapes)
+	{
+		const auto nodeCount = static_cast<quint32>(shape->GetNodes().size());
+		data_.append(reinterpret_cast<const char*>(&nodeCount), sizeof(quint32));
+	}
+
+	qint64 previousX = 0;
+	qint64 previousY = 0;
+	for (const auto* shape : shapes)
+	{
+		for (const auto& node : shape->GetNodes())
+		{
+			const auto gridX = node.position.x / grid;
+			const auto gridY = node.position.y / grid;
+			if (!(std::abs(gridX) < MaxGridCoordinate) || !(std::abs(gridY) < MaxGridCoordinate))
+				return false;
+
+			const auto x = std::llround(gridX);
+			const auto y = std::llround(gridY);
+
+			WriteVarint(data_, ZigZag(x - previousX));
+			WriteVarint(data_, ZigZag(y - previousY));
+
+			previousX = x;
+			previousY = y;
+		}
+	}
+
+	return true;
+}
+
+bool BlueprintChunk::IsValidHeader(const Header& header)
+{
+	if (static_cast<size_t>(header.type) >= Shape::TypeCount || !Shape::IsChunkable(header.type))
+		return false;
+
+	if (header.shapeCount > MaxShapesPerChunk || header.byteSize > static_cast<quint64>(std::numeric_limits<qsizetype>::max()))
+		return false;
+
+	switch (header.encoding)
+	{
+	case BlueprintFormat::ChunkEncoding::RAW:
+		return header.byteSize == GetPayloadSize(header.shapeCount, header.nodeCount);
+	case BlueprintFormat::ChunkEncoding::DELTA:
+		return header.byteSize >= sizeof(double) + static_cast<quint64>(header.shapeCount) * (sizeof(StyleIndex) + sizeof(quint32));
+	case BlueprintFormat::ChunkEncoding::DELTA_COMPRESSED:
+		return true;
+	default:
+		return false;
+	}
+}
+
+bool BlueprintChunk::IsValidTable(const Header& header, const char* styles, const char* counts, const size_t styleCount)
+{
+	quint64 nodeCount = 0;
+	for (quint32 i = 0; i < header.shapeCount; i++)
+	{
+		StyleIndex styleIndex;
+		std::memcpy(&styleIndex, styles + i * sizeof(StyleIndex), sizeof(StyleIndex));
+
+		const auto shapeNodeCount = GetNodeCount(counts, i);
+		if (styleIndex >= styleCount || !Shape::IsValidNodeCount(header.type, shapeNodeCount))
+			return false;
+
+		nodeCount += shapeNodeCount;
+	}
+
+	return nodeCount == header.nodeCount;
+}
+
+bool BlueprintChunk::Decode(const Header& header, const char* data, const size_t styleCount, ShapeBatch& result)
+{
+	if (!IsValidHeader(header))
+		return false;
+
+	switch (header.encoding)
+	{
+	case BlueprintFormat::ChunkEncoding::RAW:
+		return DecodeRaw_(header, data, styleCount, result);
+
+	case BlueprintFormat::ChunkEncoding::DELTA:
+		return DecodeDelta_(header, data, header.byteSize, styleCount, result);
+
+	case BlueprintFormat::ChunkEncoding::DELTA_COMPRESSED:
+	{
+		const auto unpacked = qUncompress(reinterpret_cast<const uchar*>(data), static_cast<qsizetype>(header.byteSize));
+		return !unpacked.isEmpty() && DecodeDelta_(header, unpacked.constData(), static_cast<quint64>(unpacked.size()), styleCount, result);
+	}
+	}
+
+	return false;
+}
+
+bool BlueprintChunk::DecodeRaw_(const Header& header, const char* data, const size_t styleCount, ShapeBatch& result)
+{
+	const auto* styles = data;
+	const auto* counts = styles + header.shapeCount * sizeof(StyleIndex);
+	const auto* positions = counts + header.shapeCount * sizeof(quint32);
+
+	//The header ties byteSize to the node count and the table ties the node count to the shapes,
+	//so every shape's nodes lie inside the payload
+	if (!IsValidTable(header, styles, counts, styleCount))
+		return false;
+
+	result.reserve(result.size() + header.shapeCount);
+	for (quint32 i = 0; i < header.shapeCount; i++)
+	{
+		StyleIndex styleIndex;
+		std::memcpy(&styleIndex, styles + i * sizeof(StyleIndex), sizeof(StyleIndex));
+
+		const auto nodeCount = GetNodeCount(counts, i);
+
+		auto newShape = Shape::Make(header.type);
+		if (newShape == nullptr)
+			return false;
+
+		newShape->Restore(styleIndex, nodeCount, [&](const size_t n)
+		{
+			std::array<double, 2> xy;
+			std::memcpy(xy.data(), positions + n * NodeSize, NodeSize);
+			return Vector2D(xy[0], xy[1]);
+		});
+		positions += nodeCount * NodeSize;
+
+		result.emplace_back(std::move(newShape));
+	}
+
+	return true;
+}
+
+bool BlueprintChunk::DecodeDelta_(const Header& header, const char* data, const quint64 size, const size_t styleCount, ShapeBatch& result)
+{
+	const auto tableSize = sizeof(double) + static_cast<quint64>(header.shapeCount) * (sizeof(StyleIndex) + sizeof(quint32));
+	if (size < tableSize)
+		return false;
+
+	double grid;
+	std::memcpy(&grid, data, sizeof(grid));
+	if (!(grid > 0.0) || !std::isfinite(grid))
+		return false;
+
+	const auto* styles = data + sizeof(grid);
+	const auto* counts = styles + header.shapeCount * sizeof(StyleIndex);
+	const auto* it = counts + header.shapeCount * sizeof(quint32);
+	const auto* end = data + size;
+
+	if (!IsValidTable(header, styles, counts, styleCount))
+		return false;
+
+	qint64 x = 0;
+	qint64 y = 0;
+	bool bIsTruncated = false;
+
+	result.reserve(result.size() + header.shapeCount);
+	for (quint32 i = 0; i < header.shapeCount; i++)
+	{
+		StyleIndex styleIndex;
+		std::memcpy(&styleIndex, styles + i * sizeof(StyleIndex), sizeof(StyleIndex));
+
+		auto newShape = Shape::Make(header.type);
+		if (newShape == nullptr)
+			return false;
+
+		//Restore asks for the nodes in order, so they are decoded straight from the stream
+		newShape->Restore(styleIndex, GetNodeCount(counts, i), [&](const size_t)
+		{
+			quint64 dx, dy;
+			if (!ReadVarint(it, end, dx) || !ReadVarint(it, end, dy))
+				bIsTruncated = true;
+			else
+			{
+				x += UnZigZag(dx);
+				y += UnZigZag(dy);
+			}
+
+			return Vector2D(static_cast<double>(x) * grid, static_cast<double>(y) * grid);
+		});
+
+		if (bIsTruncated)
+			return false;
+
+		result.emplace_back(std::move(newShape));
+	}
+
+	return it == end;
+}
+
+void BlueprintChunk::SerializeHeader(QDataStream& out, const Header& header)
+{
+	out << header.type << header.encoding << header.shapeCount << header.nodeCount << header.byteSize;
+}
+
+void BlueprintChunk::DeserializeHeader(QDataStream& in, Header& header)
+{
+	in >> header.type >> header.encoding >> header.shapeCount >> header.nodeCount >> header.byteSize;
+}
+
+void BlueprintChunk::WriteAll(QDataStream& out, const std::vector<std::shared_ptr<const Shape>>& shapes, const EncodingOptions& options)
+{
+	std::vector<BlueprintChunk> chunks;
+	std::vector<const Shape*> run;
+	quint64 runNodeCount = 0;
+
+	const auto fFlushRun = [&]()
+	{
+		if (!run.empty())
+			chunks.push_back(Encode(run.front()->GetType(), run, options));
+
+		run.clear();
+		runNodeCount = 0;
+	};
+
+	for (const auto& shape : shapes)
+	{
+		//The rest is written by WriteRecords
+		if (!Shape::IsChunkable(shape->GetType()))
+			continue;
+
+		//The header counts the nodes of a chunk in 32 bits
+		const auto nodeCount = static_cast<quint64>(shape->GetNodes().size());
+		if (!run.empty() && (run.front()->GetType() != shape->GetType() || run.size() == MaxShapesPerChunk
+			|| runNodeCount + nodeCount > std::numeric_limits<quint32>::max()))
+			fFlushRun();
+
+		run.push_back(shape.get());
+		runNodeCount += nodeCount;
+	}
+	fFlushRun();
+
+	out << static_cast<quint32>(chunks.size());
+	for (const auto& chunk : chunks)
+		SerializeHeader(out, chunk.header_);
+
+	for (const auto& chunk : chunks)
+		WriteRaw(out, chunk.data_.constData(), static_cast<quint64>(chunk.data_.size()));
+}
+
+void BlueprintChunk::WriteRecords(QDataStream& out, const std::vector<std::shared_ptr<const Shape>>& shapes)
+{
+	const auto recordCount = std::ranges::count_if(shapes, [](const auto& shape) { return !Shape::IsChunkable(shape->GetType()); });
+	out << static_cast<quint32>(recordCount);
+
+	for (size_t i = 0; i < shapes.size(); i++)
+	{
+		if (!Shape::IsChunkable(shapes[i]->GetType()))
+		{
+			out << static_cast<quint64>(i);
+			shapes[i]->Serialize(out);
+		}
+	}
+}
+
+bool BlueprintChunk::ReadRecords(QDataStream& in, const size_t styleCount, ShapeBatch& result, std::vector<quint64>& positions)
+{
+	quint32 recordCount;
+	in >> recordCount;
+
+	for (quint32 i = 0; i < recordCount && in.status() == QDataStream::Ok; i++)
+	{
+		quint64 position;
+		in >> position;
+
+		//Positions grow strictly, so records can be merged into the chunks in one pass
+		if (!positions.empty() && position <= positions.back())
+			return false;
+
+		positions.push_back(position);
+
+		Shape::Type type;
+		in >> type;
+
+		auto shape = Shape::Make(type);
+		if (shape == nullptr)
+			return false;
+
+		PenStyleTable unusedStyles;
+		shape->Deserialize(in, BlueprintFormat::CurrentVersion, unusedStyles);
+		if (in.status() != QDataStream::Ok || shape->GetStyleIndex() >= styleCount)
+			return false;
+
+		result.emplace_back(std::move(shape));
+	}
+
+	return in.status() == QDataStream::Ok;
+}
+
+bool BlueprintChunk::ReadAll(QDataStream& in, const size_t styleCount,
+	const std::function<void(ShapeBatch&&)>& fOnBatch, const std::function<bool()>& fShouldStop)
+{
+	quint32 chunkCount;
+	in >> chunkCount;
+
+	//Nothing is allocated for a directory or payload that could not fit in the rest of the file
+	auto remainingSize = GetRemainingSize(in);
+	if (in.status() != QDataStream::Ok || chunkCount > remainingSize / SerializedHeaderSize)
+		return false;
+
+	std::vector<Header> headers(chunkCount);
+	for (auto& header : headers)
+		DeserializeHeader(in, header);
+
+	if (in.status() != QDataStream::Ok)
+		return false;
+
+	remainingSize -= chunkCount * SerializedHeaderSize;
+	for (const auto& header : headers)
+	{
+		if (!IsValidHeader(header) || header.byteSize > remainingSize)
+			return false;
+
+		remainingSize -= header.byteSize;
+	}
+
+	//Chunks are read in waves of up to one full chunk of shapes per decoding thread, decoded on the
+	//shared pool and delivered in file order. Documents alternating between types have many small
+	//chunks, so a wave is bounded by shapes rather than by chunks
+	auto* scheduler = TaskScheduler::Instance();
+	const auto waveShapeCount = static_cast<quint64>(scheduler->GetWorkerCount() + 1) * MaxShapesPerChunk;
+
+	for (quint32 firstChunk = 0; firstChunk < chunkCount;)
+	{
+		if (fShouldStop != nullptr && fShouldStop())
+			return true;
+
+		quint32 waveCount = 0;
+		quint64 shapeCount = 0;
+		while (firstChunk + waveCount < chunkCount && (waveCount == 0 || shapeCount + headers[firstChunk + waveCount].shapeCount <= waveShapeCount))
+			shapeCount += headers[firstChunk + waveCount++].shapeCount;
+
+		std::vector<QByteArray> payloads(waveCount);
+		for (quint32 i = 0; i < waveCount; i++)
+		{
+			const auto byteSize = headers[firstChunk + i].byteSize;
+			payloads[i].resize(static_cast<qsizetype>(byteSize));
+			if (!ReadRaw(in, payloads[i].data(), byteSize))
+				return false;
+		}
+
+		std::vector<ShapeBatch> batches(waveCount);
+		std::vector<char> decoded(waveCount, false);
+
+		scheduler->ForEach(TaskPriority::BACKGROUND, waveCount, [&](const size_t i)
+		{
+			decoded[i] = Decode(headers[firstChunk + i], payloads[i].constData(), styleCount, batches[i]);
+		});
+
+		if (!std::ranges::all_of(decoded, [](const char bIsDecoded) { return bIsDecoded != 0; }))
+			return false;
+
+		//One batch per wave, however many chunks it had
+		auto& waveBatch = batches.front();
+		waveBatch.reserve(static_cast<size_t>(shapeCount));
+		for (quint32 i = 1; i < waveCount; i++)
+			waveBatch.insert(waveBatch.end(), std::make_move_iterator(batches[i].begin()), std::make_move_iterator(batches[i].end()));
+
+		fOnBatch(std::move(waveBatch));
+
+		firstChunk += waveCount;
+	}
+
+	return true;
+}
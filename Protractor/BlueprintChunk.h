@@ -0,0 +1,107 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <limits>
+#include <cstring>
+#include <QByteArray>
+
+#include "Shape.h"
+
+//Independent block of shapes of a single type with their nodes packed into flat arrays.
+//RAW payload: StyleIndex[shapeCount], quint32 nodeCount[shapeCount], double[2 * nodeCount] (little endian)
+//DELTA payload: double grid, StyleIndex[shapeCount], quint32 nodeCount[shapeCount], then for every node
+//the zig-zag varint difference to the previous node of the chunk in grid steps, x before y
+class BlueprintChunk
+{
+public:
+	//1/1024 of a world unit is well below a micrometre on an A3 sheet
+	static constexpr double DefaultGrid = 1.0 / 1024.0;
+
+	//DELTA encodings are lossy: every position is rounded to the nearest multiple of grid
+	struct EncodingOptions
+	{
+		BlueprintFormat::ChunkEncoding encoding{ BlueprintFormat::ChunkEncoding::RAW };
+		double grid{ DefaultGrid };
+
+		//Not defaulted, GCC cannot use the member initializers for the {} default arguments below
+		EncodingOptions() {}
+	};
+
+	struct Header
+	{
+		Shape::Type type{ Shape::Type::LINE };
+		BlueprintFormat::ChunkEncoding encoding{ BlueprintFormat::ChunkEncoding::RAW };
+		quint32 shapeCount{ 0 };
+		quint32 nodeCount{ 0 };
+		quint64 byteSize{ 0 };
+	};
+
+	using ShapeBatch = std::vector<std::unique_ptr<Shape>>;
+
+	static constexpr size_t MaxShapesPerChunk = 1 << 16;
+
+	//Bytes of a serialized header, used to bound the chunk count by what is left of the file
+	static constexpr quint64 SerializedHeaderSize = 2 * sizeof(quint8) + 2 * sizeof(quint32) + sizeof(quint64);
+
+	//Shapes of blocks are drawn in the pen of their instance, so their style index is not checked
+	static constexpr size_t AnyStyleCount = static_cast<size_t>(std::numeric_limits<StyleIndex>::max()) + 1;
+
+	BlueprintChunk() = default;
+
+	//DELTA rounds positions to options.grid; the chunk falls back to RAW only when a position lies too far out
+	//to be counted in grid steps. Compression is dropped when it does not pay off
+	static BlueprintChunk Encode(Shape::Type type, const std::vector<const Shape*>& shapes, const EncodingOptions& options = {});
+
+	//Checks what can be told from the header alone: a chunkable type, a known encoding and sizes that fit
+	[[nodiscard]] static bool IsValidHeader(const Header& header);
+
+	//Checks the style index and node count of every shape in the tables against the type and the header
+	[[nodiscard]] static bool IsValidTable(const Header& header, const char* styles, const char* counts, size_t styleCount);
+
+	static quint32 GetNodeCount(const char* counts, size_t shapeIndex);
+
+	//Decodes a payload of header.byteSize bytes that is already in memory, e.g. read from a stream or memory mapped
+	[[nodiscard]] static bool Decode(const Header& header, const char* data, size_t styleCount, ShapeBatch& result);
+
+	//Writes the chunk directory followed by every payload. Consecutive shapes of a type share a chunk, so
+	//the chunks keep the document order. Shapes that are not chunkable are skipped
+	static void WriteAll(QDataStream& out, const std::vector<std::shared_ptr<const Shape>>& shapes, const EncodingOptions& options = {});
+
+	//Reads every chunk and decodes them in parallel; batches are delivered in file order.
+	//Reading stops early, without an error, once fShouldStop returns true
+	[[nodiscard]] static bool ReadAll(QDataStream& in, size_t styleCount, const std::function<void(ShapeBatch&&)>& fOnBatch,
+		const std::function<bool()>& fShouldStop = nullptr);
+
+	//Shapes that are not chunkable, written whole as in journal records, each one preceded by its position in shapes
+	static void WriteRecords(QDataStream& out, const std::vector<std::shared_ptr<const Shape>>& shapes);
+	[[nodiscard]] static bool ReadRecords(QDataStream& in, size_t styleCount, ShapeBatch& result, std::vector<quint64>& positions);
+
+	static void SerializeHeader(QDataStream& out, const Header& header);
+	static void DeserializeHeader(QDataStream& in, Header& header);
+
+	static quint64 GetPayloadSize(quint32 shapeCount, quint32 nodeCount);
+
+private:
+	void EncodeRaw_(const std::vector<const Shape*>& shapes);
+	[[nodiscard]] bool EncodeDelta_(const std::vector<const Shape*>& shapes, double grid);
+
+	[[nodiscard]] static bool DecodeRaw_(const Header& header, const char* data, size_t styleCount, ShapeBatch& result);
+	[[nodiscard]] static bool DecodeDelta_(const Header& header, const char* data, quint64 size, size_t styleCount, ShapeBatch& result);
+
+private:
+	Header header_;
+	QByteArray data_;
+
+public:
+	__forceinline const Header& GetHeader() const { return header_; }
+	__forceinline const QByteArray& GetData() const { return data_; }
+};
+
+__forceinline quint32 BlueprintChunk::GetNodeCount(const char* counts, const size_t shapeIndex)
+{
+	quint32 result;
+	std::memcpy(&result, counts + shapeIndex * sizeof(quint32), sizeof(quint32));
+	return result;
+}
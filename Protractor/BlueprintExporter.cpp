@@ -0,0 +1,542 @@
+#include "stdafx.h"
+
+#include "BlueprintExporter.h"
+
+#include "DocumentSnapshot.h"
+#include "TaskScheduler.h"
+
+#include <QPainter>
+#include <QPainterPath>
+#include <QPdfWriter>
+#include <QTextStream>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+namespace
+{
+	class FormatWriter : public IShapeExporter
+	{
+	public:
+		[[nodiscard]] virtual bool Begin(const PenStyleTable& styles, const BlueprintExporter::Settings& settings) = 0;
+		virtual void SetStyle(StyleIndex styleIndex) = 0;
+		[[nodiscard]] virtual bool End() = 0;
+	};
+
+	__forceinline Vector2D GetPiePoint(const QRectF& rect, const double angle)
+	{
+		const auto radians = angle / 16.0 * std::numbers::pi_v<double> / 180.0;
+		return { rect.center().x() + rect.width() / 2.0 * std::cos(radians),
+				 rect.center().y() - rect.height() / 2.0 * std::sin(radians) };
+	}
+
+	//Every pen becomes one CSS class, shapes are grouped by style so the class is written once per run
+	class SvgWriter final : public FormatWriter
+	{
+	public:
+		explicit SvgWriter(const QString& path) : file_(path), out_(&file_) {}
+
+		bool Begin(const PenStyleTable& styles, const BlueprintExporter::Settings& settings) override
+		{
+			if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate))
+				return false;
+
+			const auto [w, h] = settings.sheetSize;
+			out_ << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+				<< "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << w * settings.factor << "mm\" height=\"" << h * settings.factor
+				<< "mm\" viewBox=\"0 0 " << w << ' ' << h << "\" fill=\"none\">\n<style>\n";
+
+			const auto& pens = styles.GetPens();
+			for (size_t i = 0; i < pens.size(); i++)
+				WriteStyle_(i, pens[i]);
+
+			out_ << "</style>\n";
+			return out_.status() == QTextStream::Ok;
+		}
+
+		void SetStyle(const StyleIndex styleIndex) override
+		{
+			if (bIsGroupOpen_)
+				out_ << "</g>\n";
+
+			out_ << "<g class=\"s" << styleIndex << "\">\n";
+			bIsGroupOpen_ = true;
+		}
+
+		bool End() override
+		{
+			if (bIsGroupOpen_)
+				out_ << "</g>\n";
+
+			out_ << "</svg>\n";
+			out_.flush();
+
+			return out_.status() == QTextStream::Ok && file_.flush();
+		}
+
+		void ExportLine(const QLineF& line) override
+		{
+			out_ << "<line x1=\"" << line.x1() << "\" y1=\"" << line.y1() << "\" x2=\"" << line.x2() << "\" y2=\"" << line.y2() << "\"/>\n";
+		}
+
+		void ExportRect(const QRectF& rect) override
+		{
+			const auto r = rect.normalized();
+			out_ << "<rect x=\"" << r.x() << "\" y=\"" << r.y() << "\" width=\"" << r.width() << "\" height=\"" << r.height() << "\"/>\n";
+		}
+
+		void ExportEllipse(const QRectF& rect) override
+		{
+			const auto r = rect.normalized();
+			out_ << "<ellipse cx=\"" << r.center().x() << "\" cy=\"" << r.center().y()
+				<< "\" rx=\"" << r.width() / 2.0 << "\" ry=\"" << r.height() / 2.0 << "\"/>\n";
+		}
+
+		void ExportPath(const QPainterPath& path) override
+		{
+			out_ << "<path d=\"";
+			for (qint32 i = 0; i < path.elementCount(); i++)
+			{
+				const auto element = path.elementAt(i);
+				switch (element.type)
+				{
+				case QPainterPath::MoveToElement: out_ << 'M'; break;
+				case QPainterPath::LineToElement: out_ << 'L'; break;
+				case QPainterPath::CurveToElement: out_ << 'C'; break;
+				case QPainterPath::CurveToDataElement: out_ << ' '; break;
+				}
+				out_ << element.x << ' ' << element.y;
+			}
+			out_ << "\"/>\n";
+		}
+
+		void ExportPolyline(const QPolygonF& points) override
+		{
+			out_ << "<polyline points=\"";
+			for (qsizetype i = 0; i < points.size(); i++)
+				out_ << (i == 0 ? "" : " ") << points[i].x() << ',' << points[i].y();
+			out_ << "\"/>\n";
+		}
+
+		void ExportPie(const QRectF& rect, const qint32 startAngle, const qint32 spanAngle) override
+		{
+			const auto center = rect.center();
+			const auto start = GetPiePoint(rect, startAngle);
+			const auto end = GetPiePoint(rect, startAngle + spanAngle);
+
+			//Positive Qt angles run counter-clockwise on screen, which is SVG's negative sweep
+			const auto bIsLargeArc = std::abs(spanAngle) > 180 * 16;
+			const auto bIsPositiveSweep = spanAngle < 0;
+
+			out_ << "<path d=\"M" << center.x() << ' ' << center.y()
+				<< "L" << start.x << ' ' << start.y
+				<< "A" << rect.width() / 2.0 << ' ' << rect.height() / 2.0 << " 0 " << (bIsLargeArc ? 1 : 0) << ' ' << (bIsPositiveSweep ? 1 : 0)
+				<< ' ' << end.x << ' ' << end.y << "Z\"/>\n";
+		}
+
+	private:
+		void WriteStyle_(const size_t index, const QPen& pen)
+		{
+			out_ << ".s" << index << '{';
+
+			if (pen.style() == Qt::NoPen)
+			{
+				out_ << "stroke:none}\n";
+				return;
+			}
+
+			const auto color = pen.color();
+			out_ << "stroke:" << color.name(QColor::HexRgb) << ";stroke-width:" << pen.widthF();
+
+			if (color.alpha() != 255)
+				out_ << ";stroke-opacity:" << color.alphaF();
+
+			switch (pen.capStyle())
+			{
+			case Qt::RoundCap: out_ << ";stroke-linecap:round"; break;
+			case Qt::SquareCap: out_ << ";stroke-linecap:square"; break;
+			default: break;
+			}
+
+			//Qt dash patterns are in units of the pen width
+			const auto dashPattern = pen.style() != Qt::SolidLine ? pen.dashPattern() : QList<qreal>();
+			if (!dashPattern.isEmpty())
+			{
+				out_ << ";stroke-dasharray:";
+				for (qsizetype i = 0; i < dashPattern.size(); i++)
+					out_ << (i == 0 ? "" : ",") << dashPattern[i] * pen.widthF();
+			}
+
+			out_ << "}\n";
+		}
+
+		QFile file_;
+		QTextStream out_;
+
+		bool bIsGroupOpen_{ false };
+	};
+
+	//R12 ASCII DXF in millimetres: only LINE, POLYLINE, CIRCLE and ARC entities, which every CAD
+	//reader accepts. Every pen becomes one layer, y is flipped because DXF's y axis points up.
+	class DxfWriter final : public FormatWriter
+	{
+	public:
+		explicit DxfWriter(const QString& path) : file_(path), out_(&file_) {}
+
+		bool Begin(const PenStyleTable& styles, const BlueprintExporter::Settings& settings) override
+		{
+			if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate))
+				return false;
+
+			height_ = settings.sheetSize.y;
+			factor_ = settings.factor;
+
+			Group_(0, "SECTION");
+			Group_(2, "TABLES");
+			Group_(0, "TABLE");
+			Group_(2, "LAYER");
+			Group_(70, styles.GetSize());
+
+			for (size_t i = 0; i < styles.GetSize(); i++)
+			{
+				Group_(0, "LAYER");
+				Group_(2, GetLayerName_(i));
+				Group_(70, 0);
+				Group_(62, GetNearestColorIndex_(styles.Get(static_cast<StyleIndex>(i)).color()));
+				Group_(6, "CONTINUOUS");
+			}
+
+			Group_(0, "ENDTAB");
+			Group_(0, "ENDSEC");
+			Group_(0, "SECTION");
+			Group_(2, "ENTITIES");
+
+			return out_.status() == QTextStream::Ok;
+		}
+
+		void SetStyle(const StyleIndex styleIndex) override
+		{
+			layer_ = GetLayerName_(styleIndex);
+		}
+
+		bool End() override
+		{
+			Group_(0, "ENDSEC");
+			Group_(0, "EOF");
+			out_.flush();
+
+			return out_.status() == QTextStream::Ok && file_.flush();
+		}
+
+		void ExportLine(const QLineF& line) override
+		{
+			WriteLine_(line.p1(), line.p2());
+		}
+
+		void ExportRect(const QRectF& rect) override
+		{
+			WritePolyline_(QPolygonF(rect), true);
+		}
+
+		void ExportEllipse(const QRectF& rect) override
+		{
+			if (qFuzzyCompare(rect.width(), rect.height()))
+			{
+				Entity_("CIRCLE");
+				Point_(10, rect.center());
+				Group_(40, std::abs(rect.width()) / 2.0 * factor_);
+				return;
+			}
+
+			QPainterPath path;
+			path.addEllipse(rect);
+			ExportPath(path);
+		}
+
+		void ExportPath(const QPainterPath& path) override
+		{
+			for (const auto& polygon : path.toSubpathPolygons())
+				WritePolyline_(polygon, false);
+		}
+
+		void ExportPolyline(const QPolygonF& points) override
+		{
+			WritePolyline_(points, false);
+		}
+
+		void ExportPie(const QRectF& rect, const qint32 startAngle, const qint32 spanAngle) override
+		{
+			const auto center = rect.center();
+			WriteLine_(center, GetPiePoint(rect, startAngle));
+			WriteLine_(center, GetPiePoint(rect, startAngle + spanAngle));
+
+			//DXF arcs always run counter-clockwise, which matches Qt's angles once y is flipped
+			const auto first = spanAngle >= 0 ? startAngle : startAngle + spanAngle;
+
+			Entity_("ARC");
+			Point_(10, center);
+			Group_(40, rect.width() / 2.0 * factor_);
+			Group_(50, first / 16.0);
+			Group_(51, (first + std::abs(spanAngle)) / 16.0);
+		}
+
+	private:
+		template<typename T>
+		void Group_(const qint32 code, const T& value)
+		{
+			out_ << code << '\n' << value << '\n';
+		}
+
+		void Entity_(const char* name)
+		{
+			Group_(0, name);
+			Group_(8, layer_);
+		}
+
+		void Point_(const qint32 code, const QPointF& p)
+		{
+			Group_(code, p.x() * factor_);
+			Group_(code + 10, (height_ - p.y()) * factor_);
+		}
+
+		void WriteLine_(const QPointF& p1, const QPointF& p2)
+		{
+			Entity_("LINE");
+			Point_(10, p1);
+			Point_(11, p2);
+		}
+
+		void WritePolyline_(const QPolygonF& polygon, const bool bIsClosed)
+		{
+			Entity_("POLYLINE");
+			Group_(66, 1);
+			Group_(70, bIsClosed ? 1 : 0);
+
+			for (const auto& p : polygon)
+			{
+				Entity_("VERTEX");
+				Point_(10, p);
+			}
+
+			Entity_("SEQEND");
+		}
+
+		static QString GetLayerName_(const size_t styleIndex)
+		{
+			return QString("STYLE_%0").arg(styleIndex);
+		}
+
+		//Closest of the seven basic AutoCAD colors; black maps to 7, which CAD tools show as black or white
+		static qint32 GetNearestColorIndex_(const QColor& color)
+		{
+			static constexpr std::array<std::array<qint32, 3>, 7> basicColors = { {
+				{ 255, 0, 0 }, { 255, 255, 0 }, { 0, 255, 0 }, { 0, 255, 255 },
+				{ 0, 0, 255 }, { 255, 0, 255 }, { 0, 0, 0 } } };
+
+			qint32 result = 7;
+			auto bestDistance = std::numeric_limits<qint32>::max();
+			for (size_t i = 0; i < basicColors.size(); i++)
+			{
+				const auto dr = color.red() - basicColors[i][0];
+				const auto dg = color.green() - basicColors[i][1];
+				const auto db = color.blue() - basicColors[i][2];
+
+				const auto distance = dr * dr + dg * dg + db * db;
+				if (distance < bestDistance)
+				{
+					bestDistance = distance;
+					result = static_cast<qint32>(i) + 1;
+				}
+			}
+
+			return result;
+		}
+
+		QFile file_;
+		QTextStream out_;
+
+		double height_{ 0.0 };
+		double factor_{ 1.0 };
+		QString layer_{ "0" };
+	};
+
+	//One page of the document's paper size, drawn through QPainter like a print
+	class PdfWriter final : public FormatWriter
+	{
+	public:
+		explicit PdfWriter(const QString& path) : writer_(path) {}
+
+		bool Begin(const PenStyleTable& styles, const BlueprintExporter::Settings& settings) override
+		{
+			const auto pageSize = settings.sheetSize * settings.factor;
+			writer_.setPageSize(QPageSize(QSizeF(pageSize.x, pageSize.y), QPageSize::Millimeter));
+			writer_.setPageMargins(QMarginsF());
+
+			if (!painter_.begin(&writer_))
+				return false;
+
+			const auto scale = writer_.resolution() / 25.4 * settings.factor;
+			painter_.setRenderHint(QPainter::Antialiasing);
+			painter_.scale(scale, scale);
+
+			pens_ = styles.GetPens();
+			return true;
+		}
+
+		void SetStyle(const StyleIndex styleIndex) override
+		{
+			painter_.setPen(pens_[styleIndex]);
+		}
+
+		bool End() override
+		{
+			return painter_.end();
+		}
+
+		void ExportLine(const QLineF& line) override { painter_.drawLines(&line, 1); }
+		void ExportRect(const QRectF& rect) override { painter_.drawRects(&rect, 1); }
+		void ExportEllipse(const QRectF& rect) override { painter_.drawEllipse(rect); }
+		void ExportPath(const QPainterPath& path) override { painter_.drawPath(path); }
+		void ExportPolyline(const QPolygonF& points) override { painter_.drawPolyline(points); }
+		void ExportPie(const QRectF& rect, const qint32 startAngle, const qint32 spanAngle) override { painter_.drawPie(rect, startAngle, spanAngle); }
+
+	private:
+		QPdfWriter writer_;
+		QPainter painter_;
+
+		std::vector<QPen> pens_;
+	};
+}
+
+TransformedExporter::TransformedExporter(IShapeExporter& target, const QTransform& transform)
+	: target_(target),
+	transform_(transform),
+	bIsAxisAligned_(transform.type() <= QTransform::TxScale)
+{
+}
+
+void TransformedExporter::ExportLine(const QLineF& line)
+{
+	target_.ExportLine(transform_.map(line));
+}
+
+void TransformedExporter::ExportRect(const QRectF& rect)
+{
+	if (bIsAxisAligned_)
+		target_.ExportRect(transform_.mapRect(rect));
+	else
+		target_.ExportPolyline(transform_.map(QPolygonF(rect)));
+}
+
+void TransformedExporter::ExportEllipse(const QRectF& rect)
+{
+	if (bIsAxisAligned_)
+	{
+		target_.ExportEllipse(transform_.mapRect(rect));
+		return;
+	}
+
+	QPainterPath path;
+	path.addEllipse(rect);
+	target_.ExportPath(transform_.map(path));
+}
+
+void TransformedExporter::ExportPath(const QPainterPath& path)
+{
+	target_.ExportPath(transform_.map(path));
+}
+
+void TransformedExporter::ExportPolyline(const QPolygonF& points)
+{
+	target_.ExportPolyline(transform_.map(points));
+}
+
+void TransformedExporter::ExportPie(const QRectF& rect, const qint32 startAngle, const qint32 spanAngle)
+{
+	if (bIsAxisAligned_)
+	{
+		target_.ExportPie(transform_.mapRect(rect), startAngle, spanAngle);
+		return;
+	}
+
+	QPainterPath path;
+	path.moveTo(rect.center());
+	path.arcTo(rect, startAngle / 16.0, spanAngle / 16.0);
+	path.closeSubpath();
+	target_.ExportPath(transform_.map(path));
+}
+
+BlueprintExporter::BlueprintExporter()
+	: bIsBusy_(false)
+{
+}
+
+BlueprintExporter::~BlueprintExporter()
+{
+	if (job_.valid())
+		job_.wait();
+}
+
+bool BlueprintExporter::Start(std::shared_ptr<const DocumentSnapshot> snapshot, const QString& path, const Format format, const Settings& settings)
+{
+	if (bIsBusy_)
+		return false;
+
+	bIsBusy_ = true;
+
+	job_ = TaskScheduler::Instance()->Post(TaskPriority::BACKGROUND, [snapshot = std::move(snapshot), path, format, settings]
+	{
+		return Write(*snapshot, path, format, settings);
+	}, this, [this, path](const bool bIsSuccessful)
+	{
+		bIsBusy_ = false;
+		emit Finished(bIsSuccessful, path);
+	});
+
+	return true;
+}
+
+bool BlueprintExporter::Write(const DocumentSnapshot& snapshot, const QString& path, const Format format, const Settings& settings)
+{
+	std::unique_ptr<FormatWriter> writer;
+	switch (format)
+	{
+	case Format::SVG: writer = std::make_unique<SvgWriter>(path); break;
+	case Format::DXF: writer = std::make_unique<DxfWriter>(path); break;
+	case Format::PDF: writer = std::make_unique<PdfWriter>(path); break;
+	default: return false;
+	}
+
+	if (!writer->Begin(snapshot.styles, settings))
+		return false;
+
+	std::optional<StyleIndex> currentStyle;
+	for (const auto& shape : snapshot.shapes)
+	{
+		const auto styleIndex = shape->GetStyleIndex();
+		if (currentStyle != styleIndex)
+		{
+			writer->SetStyle(styleIndex);
+			currentStyle = styleIndex;
+		}
+
+		shape->Export(*writer);
+	}
+
+	return writer->End();
+}
+
+std::optional<BlueprintExporter::Format> BlueprintExporter::GetFormatFromPath(const QString& path)
+{
+	const auto suffix = QFileInfo(path).suffix().toLower();
+
+	if (suffix == "svg")
+		return Format::SVG;
+	if (suffix == "dxf")
+		return Format::DXF;
+	if (suffix == "pdf")
+		return Format::PDF;
+
+	return std::nullopt;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <QObject>
+#include <QLineF>
+#include <QRectF>
+#include <QTransform>
+#include <future>
+#include <memory>
+#include <optional>
+
+#include "Vector2D.h"
+
+class DocumentSnapshot;
+class QPainterPath;
+class QPolygonF;
+
+//Receives the geometry of every shape during an export, see Shape::Export
+class IShapeExporter
+{
+public:
+	virtual ~IShapeExporter() = default;
+
+	virtual void ExportLine(const QLineF& line) = 0;
+	virtual void ExportRect(const QRectF& rect) = 0;
+	virtual void ExportEllipse(const QRectF& rect) = 0;
+	virtual void ExportPath(const QPainterPath& path) = 0;
+	virtual void ExportPolyline(const QPolygonF& points) = 0;
+	//Angles are in 1/16 of a degree, counter-clockwise from 3 o'clock as in QPainter::drawPie
+	virtual void ExportPie(const QRectF& rect, qint32 startAngle, qint32 spanAngle) = 0;
+};
+
+//Forwards geometry to another exporter with a transform applied, e.g. for block instances and
+//array copies. Shapes that stop being axis-aligned are handed on as paths or polylines.
+class TransformedExporter : public IShapeExporter
+{
+public:
+	TransformedExporter(IShapeExporter& target, const QTransform& transform);
+
+	void ExportLine(const QLineF& line) override;
+	void ExportRect(const QRectF& rect) override;
+	void ExportEllipse(const QRectF& rect) override;
+	void ExportPath(const QPainterPath& path) override;
+	void ExportPolyline(const QPolygonF& points) override;
+	void ExportPie(const QRectF& rect, qint32 startAngle, qint32 spanAngle) override;
+
+private:
+	IShapeExporter& target_;
+	QTransform transform_;
+	bool bIsAxisAligned_;
+};
+
+//Writes a document snapshot as SVG, DXF or PDF as a background job. Shapes are streamed
+//straight to a buffered file in one pass and every pen style is written once.
+class BlueprintExporter : public QObject
+{
+	Q_OBJECT
+
+public:
+	enum class Format : quint8
+	{
+		SVG,
+		DXF,
+		PDF
+	};
+
+	struct Settings
+	{
+		//Drawable area in world units and the size of one world unit in millimetres
+		Vector2D sheetSize;
+		double factor{ 1.0 };
+	};
+
+	BlueprintExporter();
+	virtual ~BlueprintExporter();
+
+	//Returns false while a previous export is still running
+	bool Start(std::shared_ptr<const DocumentSnapshot> snapshot, const QString& path, Format format, const Settings& settings);
+
+	[[nodiscard]] static bool Write(const DocumentSnapshot& snapshot, const QString& path, Format format, const Settings& settings);
+
+	static std::optional<Format> GetFormatFromPath(const QString& path);
+
+signals:
+	void Finished(bool bIsSuccessful, const QString& path);
+
+private:
+	std::future<void> job_;
+	bool bIsBusy_;
+
+public:
+	__forceinline bool IsBusy() const { return bIsBusy_; }
+};
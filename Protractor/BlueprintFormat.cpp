@@ -0,0 +1,49 @@
+#include "stdafx.h"
+
+#include "BlueprintFormat.h"
+
+#include <QtEndian>
+#include <QFileDevice>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace BlueprintFormat
+{
+	FileVersion ReadHeader(QDataStream& in)
+	{
+		auto* device = in.device();
+		if (device == nullptr)
+			return FileVersion::LEGACY;
+
+		const auto head = device->peek(sizeof(FileMagic));
+		if (head.size() != sizeof(FileMagic) || qFromBigEndian<quint32>(head.constData()) != FileMagic)
+			return FileVersion::LEGACY;
+
+		quint32 magic;
+		FileVersion version;
+		in >> magic >> version;
+
+		return version;
+	}
+
+	void WriteHeader(QDataStream& out, const FileVersion version)
+	{
+		out << FileMagic << version;
+	}
+
+	bool SyncToDisk(QFileDevice& file)
+	{
+		if (!file.flush())
+			return false;
+
+#ifdef Q_OS_WIN
+		return _commit(file.handle()) == 0;
+#else
+		return fsync(file.handle()) == 0;
+#endif
+	}
+}
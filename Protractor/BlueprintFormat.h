@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QtGlobal>
+
+class QFileDevice;
+
+namespace BlueprintFormat
+{
+	//"PROB"; legacy files start directly with the format type byte, so they can never match
+	inline constexpr quint32 FileMagic = 0x50524F42;
+
+	enum class FileVersion : quint16
+	{
+		//Headerless stream of shapes, each with its own QPen
+		LEGACY = 1,
+		//Preview, pen style table and block table, then every shape that does not fit a chunk as a full
+		//record preceded by its position in the document, then the chunks
+		CHUNKED = 2
+	};
+
+	inline constexpr auto CurrentVersion = FileVersion::CHUNKED;
+
+	enum class ChunkEncoding : quint8
+	{
+		RAW,
+		//Positions rounded to a grid and stored as zig-zag varint deltas
+		DELTA,
+		//DELTA payload passed through qCompress
+		DELTA_COMPRESSED
+	};
+
+	//Returns LEGACY for headerless files, otherwise consumes the header
+	FileVersion ReadHeader(QDataStream& in);
+	void WriteHeader(QDataStream& out, FileVersion version = CurrentVersion);
+
+	//Flushes Qt and OS buffers so the data survives a crash or power loss
+	bool SyncToDisk(QFileDevice& file);
+}
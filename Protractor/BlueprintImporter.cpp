@@ -0,0 +1,780 @@
+#include "stdafx.h"
+
+#include "BlueprintImporter.h"
+
+#include "TaskScheduler.h"
+
+#include <QByteArrayView>
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <numbers>
+#include <vector>
+
+namespace
+{
+	//Shapes of one range of entities, merged in file order once every range is done
+	class ShapeSink
+	{
+	public:
+		explicit ShapeSink(const StyleIndex styleIndex) : styleIndex_(styleIndex) {}
+
+		void AddLine(const Vector2D& p1, const Vector2D& p2)
+		{
+			Add_(Shape::Type::LINE, { p1, p2 });
+		}
+
+		void AddBox(const Vector2D& p1, const Vector2D& p2)
+		{
+			Add_(Shape::Type::BOX, { p1, p2 });
+		}
+
+		void AddCircle(const Vector2D& center, const double radius)
+		{
+			Add_(Shape::Type::CIRCLE, { center, center + Vector2D(radius, 0.0) });
+		}
+
+		void AddOval(const Vector2D& center, const Vector2D& radii)
+		{
+			Add_(Shape::Type::OVAL, { center - radii, center + radii });
+		}
+
+		//Curve's first control point is its start node, so a general cubic is replaced by the
+		//least-squares closest one of that family: control = c2 + 3/4 * (c1 - p0)
+		void AddCubic(const Vector2D& p0, const Vector2D& c1, const Vector2D& c2, const Vector2D& p3)
+		{
+			Add_(Shape::Type::CURVE, { p0, p3, c2 + (c1 - p0) * 0.75 });
+		}
+
+		//Angles in degrees, counter-clockwise as seen on screen. A sector would add its two radii,
+		//so the arc becomes a polyline whose chords stay within ArcTolerance of the circle.
+		void AddArc(const Vector2D& center, const double radius, const double startAngle, double spanAngle)
+		{
+			//Well below what a pen can show, and the same step compressed saves round to
+			constexpr double ArcTolerance = 1.0 / 1024.0;
+			constexpr qint32 MaxArcSegments = 4096;
+
+			if (!(radius > 0.0) || !std::isfinite(radius) || !std::isfinite(startAngle) || !std::isfinite(spanAngle))
+			{
+				Skip();
+				return;
+			}
+
+			const auto fPoint = [&](const double angle)
+			{
+				const auto radians = angle * std::numbers::pi_v<double> / 180.0;
+				return center + Vector2D(std::cos(radians), -std::sin(radians)) * radius;
+			};
+
+			spanAngle = std::fmod(spanAngle, 360.0);
+			if (spanAngle <= 0.0)
+				spanAngle += 360.0;
+
+			//A chord spanning the angle a strays radius * (1 - cos(a / 2)) from its arc
+			const auto maxSegmentAngle = radius > ArcTolerance
+				? 2.0 * std::acos(1.0 - ArcTolerance / radius) * 180.0 / std::numbers::pi_v<double>
+				: 90.0;
+			const auto segmentCount = std::clamp(static_cast<qint32>(std::ceil(spanAngle / std::min(maxSegmentAngle, 90.0))), 1, MaxArcSegments);
+
+			std::vector<Vector2D> points;
+			points.reserve(static_cast<size_t>(segmentCount) + 1);
+			for (qint32 i = 0; i <= segmentCount; i++)
+				points.push_back(fPoint(startAngle + spanAngle * i / segmentCount));
+
+			AddPolyline(std::move(points), false);
+		}
+
+		//Axis-aligned closed quads become boxes, anything else polylines that share their end points
+		void AddPolyline(std::vector<Vector2D> points, const bool bIsClosed)
+		{
+			if (bIsClosed && points.size() == 4 && IsAxisAlignedRect_(points))
+			{
+				AddBox(points[0], points[2]);
+				return;
+			}
+
+			if (bIsClosed && points.size() > 2)
+				points.push_back(points.front());
+
+			if (points.size() < 2)
+			{
+				Skip();
+				return;
+			}
+
+			if (points.size() == 2)
+			{
+				AddLine(points[0], points[1]);
+				return;
+			}
+
+			Add_(Shape::Type::POLYLINE, points.data(), points.size());
+		}
+
+		void Skip() { skippedCount++; }
+
+		BlueprintChunk::ShapeBatch shapes;
+		quint64 skippedCount{ 0 };
+
+	private:
+		void Add_(const Shape::Type type, const Vector2D* nodes, const size_t nodeCount)
+		{
+			auto newShape = Shape::Make(type);
+			newShape->Restore(styleIndex_, nodeCount, [&](const size_t i) { return nodes[i]; });
+			shapes.emplace_back(std::move(newShape));
+		}
+
+		void Add_(const Shape::Type type, std::initializer_list<Vector2D> nodes)
+		{
+			Add_(type, nodes.begin(), nodes.size());
+		}
+
+		static bool IsAxisAlignedRect_(const std::vector<Vector2D>& p)
+		{
+			constexpr auto epsilon = 1e-9;
+			const auto fSame = [&](const double a, const double b) { return std::abs(a - b) <= epsilon * std::max(1.0, std::abs(a)); };
+
+			return (fSame(p[0].y, p[1].y) && fSame(p[1].x, p[2].x) && fSame(p[2].y, p[3].y) && fSame(p[3].x, p[0].x))
+				|| (fSame(p[0].x, p[1].x) && fSame(p[1].y, p[2].y) && fSame(p[2].x, p[3].x) && fSame(p[3].y, p[0].y));
+		}
+
+		StyleIndex styleIndex_;
+	};
+
+	//File units to world positions
+	struct Transform
+	{
+		double scale{ 1.0 };
+		Vector2D offset;
+		bool bIsFlipped{ false };
+
+		__forceinline Vector2D Map(const double x, const double y) const
+		{
+			return { offset.x + x * scale, bIsFlipped ? offset.y - y * scale : offset.y + y * scale };
+		}
+	};
+
+	__forceinline bool IsSpace(const char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+	QByteArrayView Trim(const char* first, const char* last)
+	{
+		while (first != last && IsSpace(*first))
+			first++;
+		while (last != first && IsSpace(*(last - 1)))
+			last--;
+
+		return QByteArrayView(first, last - first);
+	}
+
+	bool ParseNumber(const QByteArrayView text, double& value)
+	{
+		const auto* first = text.data();
+		if (first != text.data() + text.size() && *first == '+')
+			first++;
+
+		return std::from_chars(first, text.data() + text.size(), value).ec == std::errc();
+	}
+
+	template<typename F>
+	std::vector<ShapeSink> ParseInParallel(const size_t rangeCount, const StyleIndex styleIndex, F&& fParseRange)
+	{
+		std::vector<ShapeSink> sinks;
+		sinks.reserve(rangeCount);
+		for (size_t i = 0; i < rangeCount; i++)
+			sinks.emplace_back(styleIndex);
+
+		TaskScheduler::Instance()->ForEach(TaskPriority::BACKGROUND, rangeCount, [&](const size_t i) { fParseRange(i, sinks[i]); });
+
+		return sinks;
+	}
+
+	size_t GetRangeCount(const size_t itemCount)
+	{
+		//The calling thread parses a range of its own next to the pool's workers
+		return std::min<size_t>(itemCount, TaskScheduler::Instance()->GetWorkerCount() + 1);
+	}
+
+	//DXF: pairs of lines, a group code followed by its value
+	class DxfReader
+	{
+	public:
+		DxfReader(const char* first, const char* last) : it_(first), end_(last) {}
+
+		bool Next()
+		{
+			if (it_ == end_)
+				return false;
+
+			pairStart_ = it_;
+
+			const auto codeText = ReadLine_();
+			value_ = ReadLine_();
+
+			return std::from_chars(codeText.data(), codeText.data() + codeText.size(), code_).ec == std::errc();
+		}
+
+		qint32 GetCode() const { return code_; }
+		QByteArrayView GetValue() const { return value_; }
+		const char* GetPairStart() const { return pairStart_; }
+
+	private:
+		QByteArrayView ReadLine_()
+		{
+			const auto* lineEnd = std::find(it_, end_, '\n');
+			const auto result = Trim(it_, lineEnd);
+			it_ = lineEnd == end_ ? end_ : lineEnd + 1;
+			return result;
+		}
+
+		const char* it_;
+		const char* end_;
+		const char* pairStart_{ nullptr };
+
+		qint32 code_{ 0 };
+		QByteArrayView value_;
+	};
+
+	//Marks where a VERTEX starts inside a POLYLINE's groups
+	constexpr qint32 VertexMarker = -1;
+
+	struct DxfEntity
+	{
+		QByteArrayView type;
+		std::vector<std::pair<qint32, double>> groups;
+
+		double Get(const qint32 code, const double defaultValue = 0.0) const
+		{
+			const auto it = std::ranges::find_if(groups, [&](const auto& group) { return group.first == code; });
+			return it != groups.end() ? it->second : defaultValue;
+		}
+
+		//Vertex lists repeat codes 10 and 20, one pair per vertex. POLYLINE keeps its vertices
+		//in VERTEX entities, anything in front of the first one is skipped.
+		std::vector<Vector2D> GetPoints(const Transform& transform, const bool bIsVertexOnly = false) const
+		{
+			std::vector<Vector2D> result;
+			std::optional<double> x;
+			bool bIsInVertex = !bIsVertexOnly;
+			for (const auto& [code, value] : groups)
+			{
+				if (code == VertexMarker)
+				{
+					bIsInVertex = true;
+					x.reset();
+				}
+				else if (!bIsInVertex)
+					continue;
+				else if (code == 10)
+					x = value;
+				else if (code == 20 && x.has_value())
+				{
+					result.push_back(transform.Map(*x, value));
+					x.reset();
+				}
+			}
+			return result;
+		}
+	};
+
+	void AddDxfEntity(const DxfEntity& entity, const Transform& transform, ShapeSink& sink)
+	{
+		const auto& type = entity.type;
+		const auto scale = transform.scale;
+
+		if (type == "LINE")
+		{
+			sink.AddLine(transform.Map(entity.Get(10), entity.Get(20)), transform.Map(entity.Get(11), entity.Get(21)));
+		}
+		else if (type == "CIRCLE")
+		{
+			sink.AddCircle(transform.Map(entity.Get(10), entity.Get(20)), entity.Get(40) * scale);
+		}
+		else if (type == "ARC")
+		{
+			//DXF arcs run counter-clockwise with y up, which stays counter-clockwise on screen after the flip
+			const auto startAngle = entity.Get(50);
+			sink.AddArc(transform.Map(entity.Get(10), entity.Get(20)), entity.Get(40) * scale, startAngle, entity.Get(51) - startAngle);
+		}
+		else if (type == "ELLIPSE")
+		{
+			//Only full, axis-aligned ellipses have an Oval counterpart
+			const auto majorX = entity.Get(11);
+			const auto majorY = entity.Get(21);
+			const auto ratio = entity.Get(40, 1.0);
+			const auto bIsFull = std::abs(entity.Get(41)) < 1e-6 && std::abs(entity.Get(42, 2.0 * std::numbers::pi_v<double>) - 2.0 * std::numbers::pi_v<double>) < 1e-6;
+
+			if (!bIsFull || (std::abs(majorX) > 1e-9 && std::abs(majorY) > 1e-9))
+			{
+				sink.Skip();
+				return;
+			}
+
+			const auto major = std::hypot(majorX, majorY) * scale;
+			const auto radii = std::abs(majorX) > 1e-9 ? Vector2D(major, major * ratio) : Vector2D(major * ratio, major);
+			sink.AddOval(transform.Map(entity.Get(10), entity.Get(20)), radii);
+		}
+		else if (type == "LWPOLYLINE" || type == "POLYLINE")
+		{
+			const auto bIsClosed = (static_cast<qint32>(entity.Get(70)) & 1) != 0;
+			sink.AddPolyline(entity.GetPoints(transform, type == "POLYLINE"), bIsClosed);
+		}
+		else if (type == "SPLINE")
+		{
+			const auto points = entity.GetPoints(transform);
+			if (static_cast<qint32>(entity.Get(71)) != 3 || points.size() != 4)
+			{
+				sink.Skip();
+				return;
+			}
+
+			sink.AddCubic(points[0], points[1], points[2], points[3]);
+		}
+		else
+		{
+			sink.Skip();
+		}
+	}
+
+	void ParseDxfRange(const char* first, const char* last, const Transform& transform, ShapeSink& sink)
+	{
+		DxfReader reader(first, last);
+
+		std::optional<DxfEntity> entity;
+		while (reader.Next())
+		{
+			const auto code = reader.GetCode();
+			const auto value = reader.GetValue();
+
+			if (code == 0)
+			{
+				//Vertices and the closing SEQEND belong to the POLYLINE in front of them
+				if (value == "VERTEX" || value == "SEQEND")
+				{
+					if (entity.has_value() && value == "VERTEX")
+						entity->groups.emplace_back(VertexMarker, 0.0);
+					continue;
+				}
+
+				if (entity.has_value())
+					AddDxfEntity(*entity, transform, sink);
+
+				entity = DxfEntity{ value, {} };
+				continue;
+			}
+
+			const bool bIsNumeric = (code >= 10 && code <= 59) || (code >= 70 && code <= 79);
+			double number;
+			if (entity.has_value() && bIsNumeric && ParseNumber(value, number))
+				entity->groups.emplace_back(code, number);
+		}
+
+		if (entity.has_value())
+			AddDxfEntity(*entity, transform, sink);
+	}
+
+	bool ReadDxf(const QByteArray& data, const BlueprintImporter::Settings& settings, BlueprintImporter::Result& result)
+	{
+		const auto* end = data.constData() + data.size();
+
+		//A quick serial pass only finds where entities start, parsing them is what runs in parallel
+		DxfReader reader(data.constData(), end);
+		bool bIsInEntities = false;
+		bool bIsSectionStart = false;
+		const char* entitiesEnd = end;
+		std::vector<const char*> entityStarts;
+
+		while (reader.Next())
+		{
+			if (reader.GetCode() != 0 && reader.GetCode() != 2)
+				continue;
+
+			const auto value = reader.GetValue();
+			if (!bIsInEntities)
+			{
+				if (reader.GetCode() == 2 && bIsSectionStart && value == "ENTITIES")
+					bIsInEntities = true;
+
+				bIsSectionStart = reader.GetCode() == 0 && value == "SECTION";
+				continue;
+			}
+
+			if (reader.GetCode() != 0)
+				continue;
+
+			if (value == "ENDSEC")
+			{
+				entitiesEnd = reader.GetPairStart();
+				break;
+			}
+
+			if (value != "VERTEX" && value != "SEQEND")
+				entityStarts.push_back(reader.GetPairStart());
+		}
+
+		if (!bIsInEntities)
+			return false;
+
+		const Transform transform{ 1.0 / settings.factor, Vector2D(0.0, settings.sheetHeight), true };
+
+		const auto rangeCount = GetRangeCount(entityStarts.size());
+		auto sinks = ParseInParallel(rangeCount, settings.styleIndex, [&](const size_t range, ShapeSink& sink)
+		{
+			const auto first = entityStarts.size() * range / rangeCount;
+			const auto last = entityStarts.size() * (range + 1) / rangeCount;
+
+			ParseDxfRange(entityStarts[first], last < entityStarts.size() ? entityStarts[last] : entitiesEnd, transform, sink);
+		});
+
+		for (auto& sink : sinks)
+		{
+			result.shapes.insert(result.shapes.end(), std::make_move_iterator(sink.shapes.begin()), std::make_move_iterator(sink.shapes.end()));
+			result.skippedCount += sink.skippedCount;
+		}
+
+		return true;
+	}
+
+	//SVG: a flat scan over tags, which covers exported drawings but ignores transforms and styles
+	using SvgAttributes = std::vector<std::pair<QByteArrayView, QByteArrayView>>;
+
+	const char* ParseSvgTag(const char* it, const char* end, QByteArrayView& name, SvgAttributes& attributes)
+	{
+		attributes.clear();
+
+		const auto* nameFirst = it;
+		while (it != end && !IsSpace(*it) && *it != '>' && *it != '/')
+			it++;
+		name = QByteArrayView(nameFirst, it - nameFirst);
+
+		while (it != end && *it != '>')
+		{
+			while (it != end && (IsSpace(*it) || *it == '/'))
+				it++;
+
+			const auto* attributeFirst = it;
+			while (it != end && *it != '=' && !IsSpace(*it) && *it != '>')
+				it++;
+			const auto attributeName = QByteArrayView(attributeFirst, it - attributeFirst);
+
+			if (it == end || *it != '=')
+				continue;
+
+			it++;
+			if (it == end || (*it != '"' && *it != '\''))
+				continue;
+
+			const auto quote = *it++;
+			const auto* valueFirst = it;
+			it = std::find(it, end, quote);
+			attributes.emplace_back(attributeName, QByteArrayView(valueFirst, it - valueFirst));
+
+			if (it != end)
+				it++;
+		}
+
+		return it;
+	}
+
+	QByteArrayView GetSvgAttribute(const SvgAttributes& attributes, const QByteArrayView name)
+	{
+		const auto it = std::ranges::find_if(attributes, [&](const auto& attribute) { return attribute.first == name; });
+		return it != attributes.end() ? it->second : QByteArrayView();
+	}
+
+	//Reads the next number of a list separated by spaces and/or commas
+	bool ReadSvgNumber(const char*& it, const char* end, double& value)
+	{
+		while (it != end && (IsSpace(*it) || *it == ','))
+			it++;
+
+		if (it != end && *it == '+')
+			it++;
+
+		const auto [ptr, ec] = std::from_chars(it, end, value);
+		if (ec != std::errc())
+			return false;
+
+		it = ptr;
+		return true;
+	}
+
+	double GetSvgNumber(const SvgAttributes& attributes, const QByteArrayView name)
+	{
+		double result = 0.0;
+		const auto text = GetSvgAttribute(attributes, name);
+		const auto* it = text.data();
+		ReadSvgNumber(it, text.data() + text.size(), result);
+		return result;
+	}
+
+	std::vector<Vector2D> GetSvgPoints(const SvgAttributes& attributes, const Transform& transform)
+	{
+		std::vector<Vector2D> result;
+
+		const auto text = GetSvgAttribute(attributes, "points");
+		const auto* it = text.data();
+		const auto* end = text.data() + text.size();
+
+		double x, y;
+		while (ReadSvgNumber(it, end, x) && ReadSvgNumber(it, end, y))
+			result.push_back(transform.Map(x, y));
+
+		return result;
+	}
+
+	//Supports M, L, H, V, C and Z in both absolute and relative form
+	void AddSvgPath(const QByteArrayView d, const Transform& transform, ShapeSink& sink)
+	{
+		const auto* it = d.data();
+		const auto* end = d.data() + d.size();
+
+		Vector2D current;
+		Vector2D subpathStart;
+		char command = 0;
+
+		while (true)
+		{
+			while (it != end && (IsSpace(*it) || *it == ','))
+				it++;
+			if (it == end)
+				return;
+
+			if (std::isalpha(static_cast<unsigned char>(*it)))
+				command = *it++;
+			else if (command == 0)
+				return;
+
+			const bool bIsRelative = std::islower(static_cast<unsigned char>(command)) != 0;
+			const auto base = bIsRelative ? current : Vector2D();
+
+			double v[6];
+			const auto fRead = [&](const qint32 count)
+			{
+				for (qint32 i = 0; i < count; i++)
+					if (!ReadSvgNumber(it, end, v[i]))
+						return false;
+				return true;
+			};
+
+			switch (std::toupper(static_cast<unsigned char>(command)))
+			{
+			case 'M':
+				if (!fRead(2))
+					return;
+				current = base + Vector2D(v[0], v[1]);
+				subpathStart = current;
+				//Further coordinate pairs after a move are implicit line-tos
+				command = bIsRelative ? 'l' : 'L';
+				break;
+
+			case 'L':
+			{
+				if (!fRead(2))
+					return;
+				const auto next = base + Vector2D(v[0], v[1]);
+				sink.AddLine(transform.Map(current.x, current.y), transform.Map(next.x, next.y));
+				current = next;
+				break;
+			}
+
+			case 'H':
+			{
+				if (!fRead(1))
+					return;
+				const Vector2D next(bIsRelative ? current.x + v[0] : v[0], current.y);
+				sink.AddLine(transform.Map(current.x, current.y), transform.Map(next.x, next.y));
+				current = next;
+				break;
+			}
+
+			case 'V':
+			{
+				if (!fRead(1))
+					return;
+				const Vector2D next(current.x, bIsRelative ? current.y + v[0] : v[0]);
+				sink.AddLine(transform.Map(current.x, current.y), transform.Map(next.x, next.y));
+				current = next;
+				break;
+			}
+
+			case 'C':
+			{
+				if (!fRead(6))
+					return;
+				const auto c1 = base + Vector2D(v[0], v[1]);
+				const auto c2 = base + Vector2D(v[2], v[3]);
+				const auto next = base + Vector2D(v[4], v[5]);
+				sink.AddCubic(transform.Map(current.x, current.y), transform.Map(c1.x, c1.y), transform.Map(c2.x, c2.y), transform.Map(next.x, next.y));
+				current = next;
+				break;
+			}
+
+			case 'Z':
+				if (current != subpathStart)
+					sink.AddLine(transform.Map(current.x, current.y), transform.Map(subpathStart.x, subpathStart.y));
+				current = subpathStart;
+				command = 0;
+				break;
+
+			default:
+				//Quadratic and elliptical arc segments have no shape counterpart
+				sink.Skip();
+				return;
+			}
+		}
+	}
+
+	void AddSvgElement(const QByteArrayView name, const SvgAttributes& attributes, const Transform& transform, ShapeSink& sink)
+	{
+		const auto fNumber = [&](const char* attribute) { return GetSvgNumber(attributes, attribute); };
+
+		if (name == "line")
+		{
+			sink.AddLine(transform.Map(fNumber("x1"), fNumber("y1")), transform.Map(fNumber("x2"), fNumber("y2")));
+		}
+		else if (name == "rect")
+		{
+			const auto x = fNumber("x");
+			const auto y = fNumber("y");
+			sink.AddBox(transform.Map(x, y), transform.Map(x + fNumber("width"), y + fNumber("height")));
+		}
+		else if (name == "circle")
+		{
+			sink.AddCircle(transform.Map(fNumber("cx"), fNumber("cy")), fNumber("r") * transform.scale);
+		}
+		else if (name == "ellipse")
+		{
+			sink.AddOval(transform.Map(fNumber("cx"), fNumber("cy")), Vector2D(fNumber("rx"), fNumber("ry")) * transform.scale);
+		}
+		else if (name == "polyline" || name == "polygon")
+		{
+			sink.AddPolyline(GetSvgPoints(attributes, transform), name == "polygon");
+		}
+		else if (name == "path")
+		{
+			AddSvgPath(GetSvgAttribute(attributes, "d"), transform, sink);
+		}
+	}
+
+	void ParseSvgRange(const char* it, const char* end, const Transform& transform, ShapeSink& sink)
+	{
+		QByteArrayView name;
+		SvgAttributes attributes;
+
+		while ((it = std::find(it, end, '<')) != end)
+		{
+			it = ParseSvgTag(it + 1, end, name, attributes);
+			AddSvgElement(name, attributes, transform, sink);
+		}
+	}
+
+	//Millimetres per unit of a length such as "420mm", plain numbers are CSS pixels
+	double GetSvgLength(const QByteArrayView text, double& value)
+	{
+		const auto* it = text.data();
+		const auto* end = text.data() + text.size();
+		if (!ReadSvgNumber(it, end, value))
+			return 0.0;
+
+		const auto unit = Trim(it, end);
+		if (unit == "mm")
+			return 1.0;
+		if (unit == "cm")
+			return 10.0;
+		if (unit == "in")
+			return 25.4;
+		if (unit == "pt")
+			return 25.4 / 72.0;
+
+		return 25.4 / 96.0;
+	}
+
+	bool ReadSvg(const QByteArray& data, const BlueprintImporter::Settings& settings, BlueprintImporter::Result& result)
+	{
+		const auto* begin = data.constData();
+		const auto* end = begin + data.size();
+
+		const auto* root = std::search(begin, end, "<svg", "<svg" + 4);
+		if (root == end)
+			return false;
+
+		QByteArrayView name;
+		SvgAttributes attributes;
+		const auto* body = ParseSvgTag(root + 1, end, name, attributes);
+
+		//User units are mapped to millimetres through the root size and viewBox, then to world units
+		double viewBox[4] = { 0.0, 0.0, 0.0, 0.0 };
+		const auto viewBoxText = GetSvgAttribute(attributes, "viewBox");
+		const auto* viewBoxIt = viewBoxText.data();
+		const auto bHasViewBox = std::ranges::all_of(viewBox, [&](double& value)
+		{
+			return ReadSvgNumber(viewBoxIt, viewBoxText.data() + viewBoxText.size(), value);
+		}) && viewBox[2] > 0.0;
+
+		double width = 0.0;
+		auto millimetresPerUnit = GetSvgLength(GetSvgAttribute(attributes, "width"), width);
+		if (millimetresPerUnit == 0.0)
+			millimetresPerUnit = 25.4 / 96.0;
+		else if (bHasViewBox)
+			millimetresPerUnit *= width / viewBox[2];
+
+		const auto scale = millimetresPerUnit / settings.factor;
+		const Transform transform{ scale, Vector2D(-viewBox[0] * scale, -viewBox[1] * scale), false };
+
+		//Ranges start on a tag boundary, so every tag is parsed by exactly one thread
+		const auto rangeCount = GetRangeCount(static_cast<size_t>(end - body) / 4096 + 1);
+		std::vector<const char*> rangeStarts(rangeCount + 1, end);
+		rangeStarts[0] = body;
+		for (size_t i = 1; i < rangeCount; i++)
+			rangeStarts[i] = std::find(std::max(rangeStarts[i - 1], body + (end - body) * i / rangeCount), end, '<');
+
+		auto sinks = ParseInParallel(rangeCount, settings.styleIndex, [&](const size_t range, ShapeSink& sink)
+		{
+			ParseSvgRange(rangeStarts[range], rangeStarts[range + 1], transform, sink);
+		});
+
+		for (auto& sink : sinks)
+		{
+			result.shapes.insert(result.shapes.end(), std::make_move_iterator(sink.shapes.begin()), std::make_move_iterator(sink.shapes.end()));
+			result.skippedCount += sink.skippedCount;
+		}
+
+		return true;
+	}
+}
+
+bool BlueprintImporter::Read(const QString& path, const Settings& settings, Result& result)
+{
+	const auto format = GetFormatFromPath(path);
+	if (!format.has_value())
+		return false;
+
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	const auto data = file.readAll();
+
+	switch (*format)
+	{
+	case Format::DXF: return ReadDxf(data, settings, result);
+	case Format::SVG: return ReadSvg(data, settings, result);
+	default: return false;
+	}
+}
+
+std::optional<BlueprintImporter::Format> BlueprintImporter::GetFormatFromPath(const QString& path)
+{
+	const auto suffix = QFileInfo(path).suffix().toLower();
+
+	if (suffix == "svg")
+		return Format::SVG;
+	if (suffix == "dxf")
+		return Format::DXF;
+
+	return std::nullopt;
+}
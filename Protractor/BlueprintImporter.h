@@ -0,0 +1,37 @@
+#pragma once
+
+#include <optional>
+
+#include "BlueprintChunk.h"
+
+//Reads DXF and SVG drawings into shapes. The entity list is split into one range per core and
+//parsed in parallel; entities without a matching shape type are skipped and counted.
+class BlueprintImporter
+{
+public:
+	enum class Format : quint8
+	{
+		SVG,
+		DXF
+	};
+
+	struct Settings
+	{
+		//Size of one world unit in millimetres and the sheet height in world units, DXF's y axis is flipped against it
+		double factor{ 1.0 };
+		double sheetHeight{ 0.0 };
+
+		StyleIndex styleIndex{ 0 };
+	};
+
+	struct Result
+	{
+		BlueprintChunk::ShapeBatch shapes;
+		quint64 skippedCount{ 0 };
+	};
+
+	//DXF coordinates are taken as millimetres, SVG ones are scaled by the root element's size and viewBox
+	[[nodiscard]] static bool Read(const QString& path, const Settings& settings, Result& result);
+
+	static std::optional<Format> GetFormatFromPath(const QString& path);
+};
@@ -0,0 +1,104 @@
+#include "stdafx.h"
+
+#include "BlueprintLoader.h"
+
+#include "Workspace.h"
+#include "BlueprintReader.h"
+#include "Profiler.h"
+
+#include <memory>
+
+BlueprintLoader::BlueprintLoader(Workspace* ws, const QString& path)
+	: QObject(ws),
+	ws_(ws),
+	path_(path),
+	bIsRunning_(false),
+	progress_(0)
+{
+}
+
+BlueprintLoader::~BlueprintLoader()
+{
+	Cancel();
+
+	//The job posts its batches to this loader, it has to be done before the loader is gone
+	if (job_.valid())
+		job_.wait();
+}
+
+bool BlueprintLoader::Start()
+{
+	auto file = std::make_shared<QFile>(path_);
+	if (!file->open(QIODevice::ReadOnly))
+		return false;
+
+	bIsRunning_ = true;
+
+	//The reader stops between batches without an error, so a cancelled read has to be told apart here
+	job_ = TaskScheduler::Instance()->Post(TaskPriority::BACKGROUND, [this, file]
+	{
+		const auto bIsRead = Run_(*file);
+		return std::pair(bIsRead, IsCancelled());
+	}, this, [this](const std::pair<bool, bool>& result)
+	{
+		const auto [bIsRead, bIsCancelled] = result;
+
+		if (ws_ != nullptr)
+			ws_->EndLoading();
+
+		bIsRunning_ = false;
+		emit Finished(bIsRead && !bIsCancelled, bIsCancelled);
+	});
+
+	return true;
+}
+
+void BlueprintLoader::Cancel()
+{
+	token_.Cancel();
+}
+
+bool BlueprintLoader::Run_(QFile& file)
+{
+	const ProfileScope profileScope(ProfileZone::DESERIALIZE);
+
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_6_2);
+
+	//Everything that touches the workspace is posted to the GUI thread; the calls are dropped if the tab is closed
+	const auto fPost = [this](auto&& fCall)
+	{
+		QMetaObject::invokeMethod(this, std::forward<decltype(fCall)>(fCall), Qt::QueuedConnection);
+	};
+
+	BlueprintReader reader(in);
+	if (!reader.ReadHeader())
+		return false;
+
+	fPost([this, type = reader.GetFormatType()]
+	{
+		if (ws_ != nullptr)
+			ws_->BeginLoading(type);
+	});
+
+	const auto fileSize = std::max<qint64>(file.size(), 1);
+
+	const auto bIsRead = reader.ReadShapes([&](BlueprintReader::ShapeBatch&& batch)
+	{
+		auto sharedBatch = std::make_shared<BlueprintReader::ShapeBatch>(std::move(batch));
+		const auto percent = static_cast<qint32>(file.pos() * 100 / fileSize);
+
+		fPost([this, sharedBatch, styles = reader.GetStyles(), blocks = reader.GetBlocks(), percent]
+		{
+			if (ws_ != nullptr)
+				ws_->AppendShapes(std::move(*sharedBatch), styles, blocks);
+
+			progress_ = percent;
+			emit ProgressChanged(percent);
+		});
+	},
+	[this] { return IsCancelled(); });
+
+	//The continuation ends the loading after every batch posted above has been appended
+	return bIsRead;
+}
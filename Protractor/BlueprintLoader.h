@@ -0,0 +1,48 @@
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+#include <future>
+#include <memory>
+
+#include "TaskScheduler.h"
+
+class Workspace;
+
+//Reads a blueprint as a background job and streams its shapes into a workspace in batches
+class BlueprintLoader : public QObject
+{
+	Q_OBJECT
+
+public:
+	BlueprintLoader(Workspace* ws, const QString& path);
+	virtual ~BlueprintLoader();
+
+	[[nodiscard]] bool Start();
+	void Cancel();
+
+signals:
+	void ProgressChanged(qint32 percent);
+
+	//A cancelled load is never successful, the workspace then holds only part of the blueprint
+	void Finished(bool bIsSuccessful, bool bIsCancelled);
+
+private:
+	bool Run_(QFile& file);
+
+private:
+	QPointer<Workspace> ws_;
+	QString path_;
+
+	//Stops the read between batches; Finished is still emitted so the window can tidy up
+	CancellationToken token_;
+	std::future<void> job_;
+
+	bool bIsRunning_;
+	qint32 progress_;
+
+public:
+	__forceinline bool IsCancelled() const { return token_.IsCancelled(); }
+	__forceinline bool IsRunning() const { return bIsRunning_; }
+	__forceinline qint32 GetProgress() const { return progress_; }
+};
@@ -0,0 +1,127 @@
+#include "stdafx.h"
+
+#include "BlueprintPreview.h"
+
+#include "DocumentSnapshot.h"
+
+#include <QPainter>
+#include <QBuffer>
+#include <cmath>
+#include <optional>
+
+BlueprintPreview BlueprintPreview::Make(const DocumentSnapshot& snapshot)
+{
+	BlueprintPreview result;
+	result.type = snapshot.type;
+	result.shapeCount = snapshot.shapes.size();
+
+	for (const auto& shape : snapshot.shapes)
+	{
+		result.nodeCount += shape->GetNodes().size();
+		result.bounds |= shape->GetBounds();
+	}
+
+	if (result.bounds.isEmpty())
+		return result;
+
+	const auto scale = ThumbnailSize / std::max(result.bounds.width(), result.bounds.height());
+	const auto width = std::max(1, static_cast<qint32>(std::ceil(result.bounds.width() * scale)));
+	const auto height = std::max(1, static_cast<qint32>(std::ceil(result.bounds.height() * scale)));
+
+	result.thumbnail = QImage(width, height, QImage::Format_RGB32);
+	result.thumbnail.fill(Qt::white);
+
+	//Pens are made cosmetic so thin lines stay visible at thumbnail scale
+	std::vector<QPen> pens = snapshot.styles.GetPens();
+	for (auto& pen : pens)
+	{
+		pen.setCosmetic(true);
+		pen.setWidthF(1.0);
+	}
+
+	QPainter painter(&result.thumbnail);
+	painter.setRenderHint(QPainter::Antialiasing);
+	painter.scale(scale, scale);
+	painter.translate(-result.bounds.topLeft());
+
+	std::optional<StyleIndex> currentStyle;
+	for (const auto& shape : snapshot.shapes)
+	{
+		const auto styleIndex = shape->GetStyleIndex();
+		if (currentStyle != styleIndex && styleIndex < pens.size())
+		{
+			painter.setPen(pens[styleIndex]);
+			currentStyle = styleIndex;
+		}
+
+		shape->Draw(&painter);
+	}
+
+	return result;
+}
+
+void BlueprintPreview::Serialize(QDataStream& out) const
+{
+	QByteArray png;
+	QBuffer pngBuffer(&png);
+	if (!thumbnail.isNull() && pngBuffer.open(QIODevice::WriteOnly))
+		thumbnail.save(&pngBuffer, "PNG");
+
+	QByteArray block;
+	QDataStream blockOut(&block, QIODevice::WriteOnly);
+	blockOut.setVersion(QDataStream::Qt_6_2);
+
+	blockOut << type << shapeCount << nodeCount << bounds << png;
+
+	out << block;
+}
+
+bool BlueprintPreview::Deserialize(QDataStream& in)
+{
+	QByteArray block;
+	in >> block;
+	if (in.status() != QDataStream::Ok)
+		return false;
+
+	QDataStream blockIn(block);
+	blockIn.setVersion(QDataStream::Qt_6_2);
+
+	QByteArray png;
+	blockIn >> type >> shapeCount >> nodeCount >> bounds >> png;
+	if (blockIn.status() != QDataStream::Ok)
+		return false;
+
+	if (!png.isEmpty())
+		thumbnail.loadFromData(png, "PNG");
+
+	return true;
+}
+
+void BlueprintPreview::Skip(QDataStream& in)
+{
+	//Same layout QDataStream uses for a QByteArray: quint32 size, 0xFFFFFFFF for a null array
+	quint32 byteSize;
+	in >> byteSize;
+
+	if (byteSize != 0xFFFFFFFF && in.skipRawData(static_cast<qint32>(byteSize)) != static_cast<qint32>(byteSize))
+		in.setStatus(QDataStream::ReadPastEnd);
+}
+
+std::optional<BlueprintPreview> BlueprintPreview::ReadFromFile(const QString& path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+		return std::nullopt;
+
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_6_2);
+
+	if (BlueprintFormat::ReadHeader(in) != BlueprintFormat::FileVersion::CHUNKED)
+		return std::nullopt;
+
+	BlueprintPreview result;
+	if (!result.Deserialize(in))
+		return std::nullopt;
+
+	return result;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QImage>
+#include <QRectF>
+#include <optional>
+
+#include "WorkspaceSettings.h"
+
+class DocumentSnapshot;
+
+//Stats and a small pre-rendered thumbnail stored in front of the shapes, so a file
+//can be browsed by reading only its first few kilobytes
+class BlueprintPreview
+{
+public:
+	static constexpr qint32 ThumbnailSize = 256;
+
+	FormatType type{ FormatType::A3 };
+	quint64 shapeCount{ 0 };
+	quint64 nodeCount{ 0 };
+	QRectF bounds;
+	QImage thumbnail;
+
+	static BlueprintPreview Make(const DocumentSnapshot& snapshot);
+
+	//The block is a QByteArray, so readers that do not care about it skip it without parsing
+	void Serialize(QDataStream& out) const;
+	[[nodiscard]] bool Deserialize(QDataStream& in);
+	static void Skip(QDataStream& in);
+
+	//Reads just the file header and the preview block, files written before previews return nothing
+	[[nodiscard]] static std::optional<BlueprintPreview> ReadFromFile(const QString& path);
+};
@@ -0,0 +1,138 @@
+#include "stdafx.h"
+
+#include "BlueprintReader.h"
+
+#include "BlueprintPreview.h"
+
+BlueprintReader::BlueprintReader(QDataStream& in)
+	: in_(in),
+	version_(BlueprintFormat::FileVersion::LEGACY),
+	type_(FormatType::A3),
+	streamShapeCount_(0)
+{
+}
+
+bool BlueprintReader::ReadHeader()
+{
+	version_ = BlueprintFormat::ReadHeader(in_);
+
+	switch (version_)
+	{
+	case BlueprintFormat::FileVersion::LEGACY:
+	{
+		size_t legacyShapeCount;
+		in_ >> type_ >> legacyShapeCount;
+		streamShapeCount_ = legacyShapeCount;
+		break;
+	}
+	case BlueprintFormat::FileVersion::CHUNKED:
+		BlueprintPreview::Skip(in_);
+		in_ >> type_;
+		styles_.Deserialize(in_);
+		if (!blocks_.Deserialize(in_))
+			return false;
+		break;
+	default:
+		return false;
+	}
+
+	return in_.status() == QDataStream::Ok;
+}
+
+bool BlueprintReader::ReadShapes(const std::function<void(ShapeBatch&&)>& fOnBatch, const std::function<bool()>& fShouldStop)
+{
+	if (version_ == BlueprintFormat::FileVersion::CHUNKED)
+		return ReadOrderedShapes_(fOnBatch, fShouldStop);
+
+	return ReadStreamShapes_(fOnBatch, fShouldStop);
+}
+
+bool BlueprintReader::ReadOrderedShapes_(const std::function<void(ShapeBatch&&)>& fOnBatch, const std::function<bool()>& fShouldStop)
+{
+	ShapeBatch records;
+	std::vector<quint64> positions;
+	if (!BlueprintChunk::ReadRecords(in_, styles_.GetSize(), records, positions))
+		return false;
+
+	for (auto& shape : records)
+		shape->ResolveBlocks(blocks_);
+
+	//Records are put back between the chunked shapes at the positions they were saved from
+	size_t nextRecord = 0;
+	quint64 position = 0;
+
+	const auto fTakeRecords = [&](ShapeBatch& result)
+	{
+		while (nextRecord < records.size() && positions[nextRecord] == position)
+		{
+			result.emplace_back(std::move(records[nextRecord++]));
+			position++;
+		}
+	};
+
+	const auto bIsRead = BlueprintChunk::ReadAll(in_, styles_.GetSize(), [&](ShapeBatch&& batch)
+	{
+		ShapeBatch merged;
+		merged.reserve(batch.size());
+
+		for (auto& shape : batch)
+		{
+			fTakeRecords(merged);
+			merged.emplace_back(std::move(shape));
+			position++;
+		}
+		fTakeRecords(merged);
+
+		fOnBatch(std::move(merged));
+	}, fShouldStop);
+
+	if (!bIsRead)
+		return false;
+
+	if (fShouldStop != nullptr && fShouldStop())
+		return true;
+
+	//Records saved after the last chunked shape
+	ShapeBatch rest(std::make_move_iterator(records.begin() + nextRecord), std::make_move_iterator(records.end()));
+	if (!rest.empty())
+		fOnBatch(std::move(rest));
+
+	return true;
+}
+
+bool BlueprintReader::ReadStreamShapes_(const std::function<void(ShapeBatch&&)>& fOnBatch, const std::function<bool()>& fShouldStop)
+{
+	ShapeBatch batch;
+	batch.reserve(std::min<quint64>(streamShapeCount_, StreamBatchSize));
+
+	for (quint64 i = 0; i < streamShapeCount_; i++)
+	{
+		Shape::Type type;
+		in_ >> type;
+
+		auto newShape = Shape::Make(type);
+		if (newShape == nullptr || in_.status() != QDataStream::Ok)
+			return false;
+
+		newShape->Deserialize(in_, version_, styles_);
+		if (in_.status() != QDataStream::Ok || newShape->GetStyleIndex() >= styles_.GetSize())
+			return false;
+
+		batch.emplace_back(std::move(newShape));
+
+		if (batch.size() == StreamBatchSize)
+		{
+			fOnBatch(std::move(batch));
+			batch = ShapeBatch();
+			batch.reserve(StreamBatchSize);
+
+			if (fShouldStop != nullptr && fShouldStop())
+				return true;
+		}
+	}
+
+	if (!batch.empty())
+		fOnBatch(std::move(batch));
+
+	return in_.status() == QDataStream::Ok;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <functional>
+
+#include "BlueprintChunk.h"
+#include "Block.h"
+#include "WorkspaceSettings.h"
+
+//Reads any blueprint version into shape batches without touching a Workspace, so it can run off the GUI thread
+class BlueprintReader
+{
+public:
+	using ShapeBatch = BlueprintChunk::ShapeBatch;
+
+	//Legacy files have no chunks, their shapes are grouped into batches of this size
+	static constexpr size_t StreamBatchSize = 4096;
+
+	explicit BlueprintReader(QDataStream& in);
+
+	[[nodiscard]] bool ReadHeader();
+
+	//Legacy files intern their pens while reading, so styles grow until the last batch
+	[[nodiscard]] bool ReadShapes(const std::function<void(ShapeBatch&&)>& fOnBatch, const std::function<bool()>& fShouldStop = nullptr);
+
+private:
+	//Records come before the chunks and are merged into them by their saved positions
+	bool ReadOrderedShapes_(const std::function<void(ShapeBatch&&)>& fOnBatch, const std::function<bool()>& fShouldStop);
+	bool ReadStreamShapes_(const std::function<void(ShapeBatch&&)>& fOnBatch, const std::function<bool()>& fShouldStop);
+
+	QDataStream& in_;
+
+	BlueprintFormat::FileVersion version_;
+	FormatType type_;
+	PenStyleTable styles_;
+	BlockTable blocks_;
+
+	quint64 streamShapeCount_;
+
+public:
+	__forceinline BlueprintFormat::FileVersion GetVersion() const { return version_; }
+	__forceinline FormatType GetFormatType() const { return type_; }
+	__forceinline const PenStyleTable& GetStyles() const { return styles_; }
+	__forceinline const BlockTable& GetBlocks() const { return blocks_; }
+};
@@ -0,0 +1,161 @@
+#include "stdafx.h"
+
+#include "BlueprintSaver.h"
+
+#include "BlueprintReader.h"
+#include "DocumentSnapshot.h"
+#include "EditJournal.h"
+#include "TaskScheduler.h"
+
+#include <QSaveFile>
+
+BlueprintSaver::BlueprintSaver()
+	: bIsBusy_(false)
+{
+}
+
+BlueprintSaver::~BlueprintSaver()
+{
+	if (job_.valid())
+		job_.wait();
+
+	//Never drop a requested save, even when the document is being closed
+	if (pendingSnapshot_ != nullptr)
+		Write(*pendingSnapshot_, pendingPath_, pendingOptions_);
+}
+
+void BlueprintSaver::Save(std::shared_ptr<const DocumentSnapshot> snapshot, const QString& path, const BlueprintChunk::EncodingOptions& options)
+{
+	pendingSnapshot_ = std::move(snapshot);
+	pendingPath_ = path;
+	pendingOptions_ = options;
+
+	if (!bIsBusy_)
+		StartNext_();
+}
+
+bool BlueprintSaver::Write(const DocumentSnapshot& snapshot, const QString& path, const BlueprintChunk::EncodingOptions& options)
+{
+	//QSaveFile::commit flushes, syncs to disk and renames the temporary file into place
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly))
+		return false;
+
+	QDataStream out(&file);
+	out.setVersion(QDataStream::Qt_6_2);
+
+	snapshot.Serialize(out, options);
+	if (out.status() != QDataStream::Ok)
+	{
+		file.cancelWriting();
+		return false;
+	}
+
+	return file.commit();
+}
+
+bool BlueprintSaver::FoldJournal(const QString& path, std::shared_ptr<const DocumentSnapshot> current, const BlueprintChunk::EncodingOptions& options)
+{
+	const auto state = EditJournal::Inspect(path);
+	if (!state.bIsValid || state.uncommittedCount > 0)
+		return true;
+
+	//A journal without commits adds nothing to the file
+	if (state.committedCount == 0)
+	{
+		EditJournal::Remove(path);
+		return true;
+	}
+
+	if (current == nullptr)
+	{
+		auto replayed = std::make_shared<DocumentSnapshot>();
+		{
+			QFile file(path);
+			if (!file.open(QIODevice::ReadOnly))
+				return false;
+
+			QDataStream in(&file);
+			in.setVersion(QDataStream::Qt_6_2);
+
+			BlueprintReader reader(in);
+			if (!reader.ReadHeader())
+				return false;
+
+			const auto bIsRead = reader.ReadShapes([&replayed](BlueprintReader::ShapeBatch&& batch)
+			{
+				replayed->shapes.insert(replayed->shapes.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+			});
+			if (!bIsRead)
+				return false;
+
+			replayed->type = reader.GetFormatType();
+			replayed->styles = reader.GetStyles();
+			replayed->blocks = reader.GetBlocks();
+		}
+
+		if (!EditJournal::ReplayInto(path, state.committedEnd, replayed->styles, replayed->blocks, replayed->shapes))
+			return false;
+
+		current = std::move(replayed);
+	}
+
+	//The rewritten file no longer matches the journal's header, so a crash before the removal leaves nothing to replay
+	if (!Write(*current, path, options))
+		return false;
+
+	EditJournal::Remove(path);
+	return true;
+}
+
+void BlueprintSaver::Fold(const QString& path, std::shared_ptr<const DocumentSnapshot> current, const BlueprintChunk::EncodingOptions& options)
+{
+	if (bIsBusy_)
+		return;
+
+	bIsBusy_ = true;
+	jobPath_ = path;
+
+	//Reported like a save of the current document, the file only holds exact positions if current does
+	job_ = TaskScheduler::Instance()->Post(TaskPriority::BACKGROUND, [path, current = std::move(current), options]
+	{
+		return FoldJournal(path, current, options);
+	}, this, [this, path, bIsExact = options.encoding == BlueprintFormat::ChunkEncoding::RAW](const bool bIsSuccessful)
+	{
+		OnJobFinished_(bIsSuccessful, path, 0, bIsExact);
+	});
+}
+
+bool BlueprintSaver::IsWriting(const QString& path) const
+{
+	return (bIsBusy_ && jobPath_ == path) || (pendingSnapshot_ != nullptr && pendingPath_ == path);
+}
+
+void BlueprintSaver::StartNext_()
+{
+	bIsBusy_ = true;
+	jobPath_ = pendingPath_;
+
+	const auto generation = pendingSnapshot_->generation;
+	const bool bIsExact = pendingOptions_.encoding == BlueprintFormat::ChunkEncoding::RAW;
+	job_ = TaskScheduler::Instance()->Post(TaskPriority::BACKGROUND, [snapshot = std::move(pendingSnapshot_), path = pendingPath_, options = pendingOptions_]
+	{
+		return Write(*snapshot, path, options);
+	}, this, [this, path = pendingPath_, generation, bIsExact](const bool bIsSuccessful)
+	{
+		OnJobFinished_(bIsSuccessful, path, generation, bIsExact);
+	});
+
+	pendingSnapshot_.reset();
+	pendingPath_.clear();
+}
+
+void BlueprintSaver::OnJobFinished_(const bool bIsSuccessful, const QString& path, const quint64 generation, const bool bIsExact)
+{
+	bIsBusy_ = false;
+
+	emit Finished(bIsSuccessful, path, generation, bIsExact);
+
+	if (pendingSnapshot_ != nullptr)
+		StartNext_();
+}
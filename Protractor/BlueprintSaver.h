@@ -0,0 +1,55 @@
+#pragma once
+
+#include <QObject>
+#include <future>
+#include <memory>
+
+#include "BlueprintChunk.h"
+
+class DocumentSnapshot;
+
+//Writes document snapshots as background jobs of the TaskScheduler. A save requested while another
+//one is running replaces any queued one, so only the newest state is written once the job is done.
+class BlueprintSaver : public QObject
+{
+	Q_OBJECT
+
+public:
+	BlueprintSaver();
+	virtual ~BlueprintSaver();
+
+	void Save(std::shared_ptr<const DocumentSnapshot> snapshot, const QString& path, const BlueprintChunk::EncodingOptions& options = {});
+
+	//Folds the committed journal of path into the file as a job, see FoldJournal; only when no save is running
+	void Fold(const QString& path, std::shared_ptr<const DocumentSnapshot> current, const BlueprintChunk::EncodingOptions& options = {});
+
+	//True while a job or a queued save is about to replace path
+	bool IsWriting(const QString& path) const;
+
+	//Writes to a temporary file, syncs it to disk and atomically renames it over path
+	static bool Write(const DocumentSnapshot& snapshot, const QString& path, const BlueprintChunk::EncodingOptions& options = {});
+
+	//Rewrites path with its committed journal applied and removes the journal. Without current, the file is
+	//read and replayed; a journal holding unsaved edits is kept for recovery.
+	static bool FoldJournal(const QString& path, std::shared_ptr<const DocumentSnapshot> current, const BlueprintChunk::EncodingOptions& options = {});
+
+signals:
+	//bIsExact is false when the file holds positions rounded to a grid rather than the document's own
+	void Finished(bool bIsSuccessful, const QString& path, quint64 generation, bool bIsExact);
+
+private:
+	void StartNext_();
+	void OnJobFinished_(bool bIsSuccessful, const QString& path, quint64 generation, bool bIsExact);
+
+private:
+	std::future<void> job_;
+	bool bIsBusy_;
+	QString jobPath_;
+
+	std::shared_ptr<const DocumentSnapshot> pendingSnapshot_;
+	QString pendingPath_;
+	BlueprintChunk::EncodingOptions pendingOptions_;
+
+public:
+	__forceinline bool IsBusy() const { return bIsBusy_; }
+};
@@ -0,0 +1,100 @@
+#include "stdafx.h"
+
+#include "CompactDocument.h"
+
+#include <cmath>
+#include <limits>
+
+std::optional<QuantizedVector2D> QuantizedVector2D::FromVector2D(const Vector2D& V)
+{
+	constexpr auto limit = static_cast<double>(std::numeric_limits<qint32>::max()) * Resolution;
+	if (!(std::abs(V.x) < limit && std::abs(V.y) < limit))
+		return std::nullopt;
+
+	return QuantizedVector2D(static_cast<qint32>(std::lround(V.x / Resolution)),
+		static_cast<qint32>(std::lround(V.y / Resolution)));
+}
+
+void CompactDocument::Reserve(const size_t shapeCount, const size_t nodeCount)
+{
+	shapes_.reserve(shapeCount);
+	nodes_.reserve(nodeCount);
+}
+
+void CompactDocument::Clear()
+{
+	shapes_.clear();
+	styles_.Clear();
+	nodes_.clear();
+	keptShapes_.clear();
+	bIsExact_ = true;
+}
+
+bool CompactDocument::Append(const std::shared_ptr<Shape>& shape)
+{
+	if (!Shape::IsChunkable(shape->GetType()))
+	{
+		if (keptShapes_.size() >= std::numeric_limits<quint32>::max())
+			return false;
+
+		shapes_.push_back({ shape->GetType(), shape->GetStyleIndex(), 0, static_cast<quint32>(keptShapes_.size()) });
+		keptShapes_.push_back(shape);
+		return true;
+	}
+
+	const auto& nodes = shape->GetNodes();
+	if (nodes_.size() + nodes.size() > std::numeric_limits<quint32>::max())
+		return false;
+
+	const auto firstNode = nodes_.size();
+	for (const auto& node : nodes)
+	{
+		const auto quantized = QuantizedVector2D::FromVector2D(node.position);
+		if (!quantized.has_value())
+		{
+			nodes_.resize(firstNode);
+			return false;
+		}
+
+		bIsExact_ = bIsExact_ && quantized->ToVector2D() == node.position;
+		nodes_.push_back(*quantized);
+	}
+
+	shapes_.push_back({ shape->GetType(), shape->GetStyleIndex(), static_cast<quint32>(nodes.size()), static_cast<quint32>(firstNode) });
+	return true;
+}
+
+std::shared_ptr<Shape> CompactDocument::Materialize(const size_t shapeIndex) const
+{
+	const auto& record = shapes_[shapeIndex];
+	if (!Shape::IsChunkable(record.type))
+		return keptShapes_[record.firstNode];
+
+	std::shared_ptr<Shape> result = Shape::Make(record.type);
+	if (result == nullptr)
+		return nullptr;
+
+	result->Restore(record.styleIndex, record.nodeCount, [&](const size_t i)
+	{
+		return nodes_[record.firstNode + i].ToVector2D();
+	});
+
+	return result;
+}
+
+size_t CompactDocument::GetNodeCount() const
+{
+	size_t result = nodes_.size();
+	for (const auto& shape : keptShapes_)
+		result += shape->GetNodes().size();
+
+	return result;
+}
+
+size_t CompactDocument::GetMemoryUsage() const
+{
+	return shapes_.capacity() * sizeof(ShapeRecord)
+		+ styles_.GetMemoryUsage()
+		+ nodes_.capacity() * sizeof(QuantizedVector2D)
+		+ keptShapes_.capacity() * sizeof(std::shared_ptr<Shape>);
+}
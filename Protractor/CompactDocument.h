@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <optional>
+
+#include "Shape.h"
+
+//Node position stored as 32-bit fixed point relative to the sheet origin
+class QuantizedVector2D
+{
+public:
+	qint32 x{ 0 };
+	qint32 y{ 0 };
+
+	//1/1024 of a world unit is well below a micrometre on an A3 sheet
+	static constexpr double Resolution = 1.0 / 1024.0;
+	static constexpr double MaxError = Resolution / 2.0;
+
+	QuantizedVector2D() = default;
+	constexpr QuantizedVector2D(const qint32 X, const qint32 Y) : x(X), y(Y) {}
+
+	//None for positions too far from the origin to be represented, and for NaN
+	static std::optional<QuantizedVector2D> FromVector2D(const Vector2D& V);
+	constexpr Vector2D ToVector2D() const { return { x * Resolution, y * Resolution }; }
+
+	constexpr bool operator==(const QuantizedVector2D& V) const { return x == V.x && y == V.y; }
+	constexpr bool operator!=(const QuantizedVector2D& V) const { return !(*this == V); }
+};
+
+static_assert(sizeof(QuantizedVector2D) == 8);
+
+//Flat, quantized copy of a document: 8 bytes per node instead of a heap-allocated Node per shape.
+//Shapes with data beyond their nodes, instances and arrays, are kept as they are and shared.
+class CompactDocument
+{
+public:
+	struct ShapeRecord
+	{
+		Shape::Type type;
+		StyleIndex styleIndex;
+		quint32 nodeCount;
+
+		//Index of the first node, or of the kept shape for types that are not chunkable
+		quint32 firstNode;
+	};
+
+	CompactDocument() = default;
+
+	void Reserve(size_t shapeCount, size_t nodeCount);
+	void Clear();
+
+	//False, leaving the document unchanged, if a node cannot be quantized or the document is full
+	[[nodiscard]] bool Append(const std::shared_ptr<Shape>& shape);
+
+	//Committed shapes are never modified in place, so kept shapes are handed out shared
+	[[nodiscard]] std::shared_ptr<Shape> Materialize(size_t shapeIndex) const;
+
+	size_t GetMemoryUsage() const;
+
+private:
+	std::vector<ShapeRecord> shapes_;
+	PenStyleTable styles_;
+	std::vector<QuantizedVector2D> nodes_;
+	std::vector<std::shared_ptr<Shape>> keptShapes_;
+
+	//Every appended node was already on the quantization grid, materializing gives the same positions
+	bool bIsExact_{ true };
+
+public:
+	__forceinline size_t GetShapeCount() const { return shapes_.size(); }
+	//Quantized nodes and those of the kept shapes
+	size_t GetNodeCount() const;
+
+	__forceinline const ShapeRecord& GetShape(const size_t shapeIndex) const { return shapes_[shapeIndex]; }
+	__forceinline const PenStyleTable& GetStyles() const { return styles_; }
+	__forceinline void SetStyles(const PenStyleTable& styles) { styles_ = styles; }
+
+	__forceinline Vector2D GetNode(const size_t shapeIndex, const size_t nodeIndex) const
+	{
+		return nodes_[shapes_[shapeIndex].firstNode + nodeIndex].ToVector2D();
+	}
+
+	__forceinline const std::vector<QuantizedVector2D>& GetQuantizedNodes() const { return nodes_; }
+
+	__forceinline bool IsExact() const { return bIsExact_; }
+};
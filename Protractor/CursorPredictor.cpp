@@ -0,0 +1,44 @@
+#include "stdafx.h"
+
+#include "CursorPredictor.h"
+
+#include <algorithm>
+
+void CursorPredictor::AddSample(const Vector2D& position, const quint64 timestamp)
+{
+	samples_[nextSample_] = { position, timestamp };
+	nextSample_ = (nextSample_ + 1) % SampleCount;
+	sampleCount_ = std::min(sampleCount_ + 1, SampleCount);
+}
+
+void CursorPredictor::Reset()
+{
+	sampleCount_ = 0;
+	nextSample_ = 0;
+}
+
+std::optional<Vector2D> CursorPredictor::Predict(const double aheadMs) const
+{
+	if (sampleCount_ < 2)
+		return std::nullopt;
+
+	const auto& newest = samples_[(nextSample_ + SampleCount - 1) % SampleCount];
+
+	//Oldest sample still recent enough, the whole window gives a steadier velocity than the last pair
+	const Sample* oldest = nullptr;
+	for (size_t i = sampleCount_; i > 1; i--)
+	{
+		const auto& sample = samples_[(nextSample_ + SampleCount - i) % SampleCount];
+		if (newest.timestamp - sample.timestamp <= MaxSampleAge)
+		{
+			oldest = &sample;
+			break;
+		}
+	}
+
+	if (oldest == nullptr || oldest->timestamp == newest.timestamp)
+		return std::nullopt;
+
+	const auto velocity = (newest.position - oldest->position) / static_cast<double>(newest.timestamp - oldest->timestamp);
+	return newest.position + velocity * aheadMs;
+}
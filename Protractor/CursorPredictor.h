@@ -0,0 +1,33 @@
+#pragma once
+
+#include <array>
+#include <optional>
+
+//Estimates cursor velocity from the latest raw mouse moves and extrapolates where the cursor
+//will be a few milliseconds ahead. Samples more than MaxSampleAge older than the newest one
+//do not count, so a pause starts the estimate afresh.
+class CursorPredictor
+{
+public:
+	static constexpr size_t SampleCount = 6;
+	static constexpr quint64 MaxSampleAge = 50;
+
+	CursorPredictor() = default;
+
+	void AddSample(const Vector2D& position, quint64 timestamp);
+	void Reset();
+
+	//Position expected aheadMs after the latest sample, none while the cursor rests
+	[[nodiscard]] std::optional<Vector2D> Predict(double aheadMs) const;
+
+private:
+	struct Sample
+	{
+		Vector2D position;
+		quint64 timestamp;
+	};
+
+	std::array<Sample, SampleCount> samples_;
+	size_t sampleCount_{ 0 };
+	size_t nextSample_{ 0 };
+};
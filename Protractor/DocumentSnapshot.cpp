@@ -0,0 +1,22 @@
+#include "stdafx.h"
+
+#include "DocumentSnapshot.h"
+
+#include "BlueprintPreview.h"
+#include "Profiler.h"
+
+void DocumentSnapshot::Serialize(QDataStream& out, const BlueprintChunk::EncodingOptions& options) const
+{
+	const ProfileScope profileScope(ProfileZone::SERIALIZE);
+
+	BlueprintFormat::WriteHeader(out);
+	BlueprintPreview::Make(*this).Serialize(out);
+
+	out << type;
+	styles.Serialize(out);
+
+	blocks.Serialize(out);
+	BlueprintChunk::WriteRecords(out, shapes);
+
+	BlueprintChunk::WriteAll(out, shapes, options);
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+
+#include "Shape.h"
+#include "BlueprintChunk.h"
+#include "Block.h"
+#include "WorkspaceSettings.h"
+
+//Copy-on-write view of a document taken on the GUI thread. Shapes are shared with the workspace,
+//which never changes a committed shape in place, so the snapshot can be written from any thread.
+class DocumentSnapshot
+{
+public:
+	FormatType type{ FormatType::A3 };
+	PenStyleTable styles;
+	BlockTable blocks;
+	std::vector<std::shared_ptr<const Shape>> shapes;
+
+	//Workspace edit generation the snapshot was taken at
+	quint64 generation{ 0 };
+
+	void Serialize(QDataStream& out, const BlueprintChunk::EncodingOptions& options = {}) const;
+};
@@ -0,0 +1,281 @@
+#include "stdafx.h"
+
+#include "EditJournal.h"
+
+#include <QFileInfo>
+
+EditJournal::~EditJournal()
+{
+	//A clean close discards unsaved edits, only a crash leaves them behind for recovery
+	if (file_.isOpen())
+	{
+		out_.setDevice(nullptr);
+		file_.resize(committedEnd_);
+		file_.close();
+	}
+}
+
+bool EditJournal::Start(const QString& filePath, const PenStyleTable& styles)
+{
+	file_.setFileName(GetJournalPath(filePath));
+	if (!file_.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+
+	const QFileInfo baseInfo(filePath);
+
+	out_.setDevice(&file_);
+	out_.setVersion(QDataStream::Qt_6_2);
+	out_ << JournalMagic << JournalVersion
+		<< static_cast<qint64>(baseInfo.size())
+		<< baseInfo.lastModified().toMSecsSinceEpoch()
+		<< static_cast<StyleIndex>(styles.GetSize());
+
+	journaledStyleCount_ = static_cast<StyleIndex>(styles.GetSize());
+
+	if (!BlueprintFormat::SyncToDisk(file_))
+		return false;
+
+	committedEnd_ = file_.pos();
+	return true;
+}
+
+bool EditJournal::Resume(const QString& filePath, const qint64 end, const qint64 committedEnd, const PenStyleTable& styles)
+{
+	file_.setFileName(GetJournalPath(filePath));
+	if (!file_.open(QIODevice::ReadWrite))
+		return false;
+
+	{
+		QDataStream in(&file_);
+		in.setVersion(QDataStream::Qt_6_2);
+
+		StyleIndex baseStyleCount;
+		if (!ReadHeader_(in, filePath, baseStyleCount))
+			return false;
+	}
+
+	if (!file_.resize(end) || !file_.seek(end))
+		return false;
+
+	out_.setDevice(&file_);
+	out_.setVersion(QDataStream::Qt_6_2);
+
+	//Replay interned every journaled style, so the table already holds them
+	journaledStyleCount_ = static_cast<StyleIndex>(styles.GetSize());
+	committedEnd_ = committedEnd;
+
+	return true;
+}
+
+void EditJournal::WriteShape_(const Record record, const Shape& shape, const PenStyleTable& styles)
+{
+	if (!file_.isOpen())
+		return;
+
+	for (; journaledStyleCount_ < styles.GetSize(); journaledStyleCount_++)
+		out_ << Record::STYLE << styles.Get(journaledStyleCount_);
+
+	out_ << record;
+	shape.Serialize(out_);
+
+	//Hand the record to the OS right away so it survives an application crash
+	file_.flush();
+}
+
+size_t EditJournal::GetContentHash_(const Shape& shape)
+{
+	//Adding zero turns -0.0 into 0.0, which compare equal
+	const auto fCombine = [](size_t& seed, const size_t value) { seed ^= value + 0x9E3779B97F4A7C15ull + (seed << 6) + (seed >> 2); };
+
+	size_t result = std::hash<quint8>()(static_cast<quint8>(shape.GetType()));
+	fCombine(result, std::hash<StyleIndex>()(shape.GetStyleIndex()));
+	for (const auto& node : shape.GetNodes())
+	{
+		fCombine(result, std::hash<double>()(node.position.x + 0.0));
+		fCombine(result, std::hash<double>()(node.position.y + 0.0));
+	}
+
+	return result;
+}
+
+bool EditJournal::IsSameContent_(const Shape& a, const Shape& b)
+{
+	return a.GetType() == b.GetType()
+		&& a.GetStyleIndex() == b.GetStyleIndex()
+		&& std::ranges::equal(a.GetNodes(), b.GetNodes(), {}, &Node::position, &Node::position);
+}
+
+void EditJournal::RecordAdd(const Shape& shape, const PenStyleTable& styles)
+{
+	WriteShape_(Record::ADD, shape, styles);
+}
+
+void EditJournal::RecordRemove(const Shape& shape, const PenStyleTable& styles)
+{
+	WriteShape_(Record::REMOVE, shape, styles);
+}
+
+bool EditJournal::Commit()
+{
+	if (!file_.isOpen())
+		return false;
+
+	out_ << Record::COMMIT;
+	if (!BlueprintFormat::SyncToDisk(file_))
+		return false;
+
+	committedEnd_ = file_.pos();
+	return true;
+}
+
+void EditJournal::Remove(const QString& filePath)
+{
+	QFile::remove(GetJournalPath(filePath));
+}
+
+bool EditJournal::ReadHeader_(QDataStream& in, const QString& filePath, StyleIndex& baseStyleCount)
+{
+	quint32 magic;
+	quint16 version;
+	qint64 baseSize;
+	qint64 baseModified;
+	in >> magic >> version >> baseSize >> baseModified >> baseStyleCount;
+
+	const QFileInfo baseInfo(filePath);
+
+	return in.status() == QDataStream::Ok
+		&& magic == JournalMagic
+		&& version == JournalVersion
+		&& baseSize == baseInfo.size()
+		&& baseModified == baseInfo.lastModified().toMSecsSinceEpoch();
+}
+
+EditJournal::State EditJournal::Inspect(const QString& filePath)
+{
+	State result;
+
+	QFile file(GetJournalPath(filePath));
+	if (!file.open(QIODevice::ReadOnly))
+		return result;
+
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_6_2);
+
+	StyleIndex baseStyleCount;
+	if (!ReadHeader_(in, filePath, baseStyleCount))
+		return result;
+
+	result.bIsValid = true;
+	result.committedEnd = file.pos();
+	result.recoverableEnd = result.committedEnd;
+
+	//Walk the records; a torn record at the end is simply where the crash happened
+	qint32 pendingCount = 0;
+	while (!in.atEnd())
+	{
+		Record record;
+		in >> record;
+
+		if (record == Record::STYLE)
+		{
+			QPen pen;
+			in >> pen;
+			if (in.status() != QDataStream::Ok)
+				break;
+
+			result.recoverableEnd = file.pos();
+		}
+		else if (record == Record::ADD || record == Record::REMOVE)
+		{
+			Shape::Type type;
+			in >> type;
+
+			auto shape = Shape::Make(type);
+			if (shape == nullptr)
+				break;
+
+			PenStyleTable scratchStyles;
+			shape->Deserialize(in, BlueprintFormat::CurrentVersion, scratchStyles);
+			if (in.status() != QDataStream::Ok)
+				break;
+
+			result.recoverableEnd = file.pos();
+			pendingCount++;
+		}
+		else if (record == Record::COMMIT)
+		{
+			if (in.status() != QDataStream::Ok)
+				break;
+
+			result.committedEnd = file.pos();
+			result.recoverableEnd = result.committedEnd;
+			result.committedCount += pendingCount;
+			pendingCount = 0;
+		}
+		else
+			break;
+	}
+
+	result.uncommittedCount = pendingCount;
+	return result;
+}
+
+bool EditJournal::Replay(const QString& filePath, const qint64 end, PenStyleTable& styles,
+	const std::function<void(Record, std::unique_ptr<Shape>&&)>& fOnRecord)
+{
+	QFile file(GetJournalPath(filePath));
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_6_2);
+
+	StyleIndex baseStyleCount;
+	if (!ReadHeader_(in, filePath, baseStyleCount) || baseStyleCount > styles.GetSize())
+		return false;
+
+	std::vector<StyleIndex> styleRemap(baseStyleCount);
+	for (StyleIndex i = 0; i < baseStyleCount; i++)
+		styleRemap[i] = i;
+
+	while (file.pos() < end && in.status() == QDataStream::Ok)
+	{
+		Record record;
+		in >> record;
+
+		switch (record)
+		{
+		case Record::STYLE:
+		{
+			QPen pen;
+			in >> pen;
+			styleRemap.push_back(styles.Intern(pen));
+			break;
+		}
+		case Record::ADD:
+		case Record::REMOVE:
+		{
+			Shape::Type type;
+			in >> type;
+
+			auto shape = Shape::Make(type);
+			if (shape == nullptr)
+				return false;
+
+			shape->Deserialize(in, BlueprintFormat::CurrentVersion, styles);
+			if (in.status() != QDataStream::Ok || shape->GetStyleIndex() >= styleRemap.size())
+				return false;
+
+			shape->SetStyleIndex(styleRemap[shape->GetStyleIndex()]);
+			fOnRecord(record, std::move(shape));
+			break;
+		}
+		case Record::COMMIT:
+			break;
+		default:
+			return false;
+		}
+	}
+
+	return in.status() == QDataStream::Ok;
+}
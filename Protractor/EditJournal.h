@@ -0,0 +1,139 @@
+#pragma once
+
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <ranges>
+#include <unordered_map>
+#include <QFile>
+
+#include "Shape.h"
+#include "Block.h"
+
+//Append-only log of committed edits stored next to a blueprint. Ctrl+S only appends a commit mark,
+//records after the last mark are edits that were never saved and are offered for crash recovery.
+class EditJournal
+{
+public:
+	enum class Record : quint8
+	{
+		STYLE,
+		ADD,
+		REMOVE,
+		COMMIT
+	};
+
+	struct State
+	{
+		bool bIsValid{ false };
+		qint64 committedEnd{ 0 };
+		qint64 recoverableEnd{ 0 };
+		qint32 committedCount{ 0 };
+		qint32 uncommittedCount{ 0 };
+	};
+
+	static constexpr quint32 JournalMagic = 0x50524F4A;
+	static constexpr quint16 JournalVersion = 1;
+
+	//Past this size the next save rewrites the blueprint and starts a fresh journal
+	static constexpr qint64 CompactionThreshold = 4 * 1024 * 1024;
+
+	EditJournal() = default;
+	~EditJournal();
+
+	//Starts a fresh journal on top of the snapshot that was just written to filePath
+	[[nodiscard]] bool Start(const QString& filePath, const PenStyleTable& styles);
+
+	//Keeps appending to a replayed journal, dropping everything after end. Records between committedEnd
+	//and end were recovered but never saved, they stay uncommitted until the next Commit
+	[[nodiscard]] bool Resume(const QString& filePath, qint64 end, qint64 committedEnd, const PenStyleTable& styles);
+
+	void RecordAdd(const Shape& shape, const PenStyleTable& styles);
+	void RecordRemove(const Shape& shape, const PenStyleTable& styles);
+
+	//Appends a commit mark and forces everything to disk
+	[[nodiscard]] bool Commit();
+
+	static QString GetJournalPath(const QString& filePath) { return filePath + ".journal"; }
+
+	static void Remove(const QString& filePath);
+
+	//Checks that the journal belongs to the current blueprint file and finds the last commit mark
+	static State Inspect(const QString& filePath);
+
+	//Delivers the shapes of ADD and REMOVE records up to end, with style indices remapped into styles
+	[[nodiscard]] static bool Replay(const QString& filePath, qint64 end, PenStyleTable& styles,
+		const std::function<void(Record, std::unique_ptr<Shape>&&)>& fOnRecord);
+
+	//Applies the records up to end to the shapes of the blueprint the journal was started on. Shapes are
+	//indexed by content once, so every removal is found without scanning the document
+	template<typename S>
+	[[nodiscard]] static bool ReplayInto(const QString& filePath, qint64 end, PenStyleTable& styles, const BlockTable& blocks,
+		std::vector<std::shared_ptr<S>>& shapes);
+
+private:
+	void WriteShape_(Record record, const Shape& shape, const PenStyleTable& styles);
+
+	//Equal for shapes of the same type, style and node positions
+	static size_t GetContentHash_(const Shape& shape);
+	static bool IsSameContent_(const Shape& a, const Shape& b);
+
+	static bool ReadHeader_(QDataStream& in, const QString& filePath, StyleIndex& baseStyleCount);
+
+	QFile file_;
+	QDataStream out_;
+
+	StyleIndex journaledStyleCount_{ 0 };
+	qint64 committedEnd_{ 0 };
+
+public:
+	__forceinline qint64 GetSize() const { return file_.size(); }
+
+	__forceinline bool HasUncommittedEdits() const { return file_.size() > committedEnd_; }
+};
+
+template<typename S>
+bool EditJournal::ReplayInto(const QString& filePath, const qint64 end, PenStyleTable& styles, const BlockTable& blocks,
+	std::vector<std::shared_ptr<S>>& shapes)
+{
+	std::unordered_multimap<size_t, size_t> index;
+	index.reserve(shapes.size());
+	for (size_t i = 0; i < shapes.size(); i++)
+		index.emplace(GetContentHash_(*shapes[i]), i);
+
+	//Removed shapes are only marked, erasing them one by one would move the rest of the document each time
+	std::vector<bool> bIsRemoved(shapes.size(), false);
+
+	const auto bIsReplayed = Replay(filePath, end, styles, [&](const Record record, std::unique_ptr<Shape>&& shape)
+	{
+		shape->ResolveBlocks(blocks);
+
+		const auto hash = GetContentHash_(*shape);
+		if (record == Record::ADD)
+		{
+			index.emplace(hash, shapes.size());
+			shapes.emplace_back(std::move(shape));
+			bIsRemoved.push_back(false);
+			return;
+		}
+
+		//Removed shapes are identified by content, any identical copy is equivalent
+		const auto [first, last] = index.equal_range(hash);
+		const auto it = std::find_if(first, last, [&](const auto& entry) { return IsSameContent_(*shapes[entry.second], *shape); });
+		if (it != last)
+		{
+			bIsRemoved[it->second] = true;
+			index.erase(it);
+		}
+	});
+
+	size_t keptCount = 0;
+	for (size_t i = 0; i < shapes.size(); i++)
+	{
+		if (!bIsRemoved[i])
+			shapes[keptCount++] = std::move(shapes[i]);
+	}
+	shapes.resize(keptCount);
+
+	return bIsReplayed;
+}
@@ -0,0 +1,51 @@
+#include "stdafx.h"
+
+#include "InputRecorder.h"
+
+#include "Workspace.h"
+#include "WorkspaceSettings.h"
+
+InputRecorder::InputRecorder(Workspace* ws)
+	: QObject(nullptr),
+	ws_(ws)
+{
+	QDataStream out(&session_.document, QIODevice::WriteOnly);
+	out.setVersion(QDataStream::Qt_6_2);
+	ws->Serialize(out);
+
+	session_.offset = ws->GetOffset();
+	session_.scale = ws->GetScale();
+	session_.size = ws->size();
+	session_.maxWorkspaceSize = WorkspaceSettings::Instance()->GetMaxWorkspaceSize();
+	session_.frameIntervalMs = ws->GetFrameInterval();
+
+	ws->installEventFilter(this);
+	timer_.start();
+}
+
+InputRecorder::~InputRecorder()
+{
+	Stop();
+}
+
+void InputRecorder::Stop()
+{
+	if (ws_ != nullptr)
+		ws_->removeEventFilter(this);
+
+	ws_ = nullptr;
+}
+
+bool InputRecorder::eventFilter(QObject* watched, QEvent* event)
+{
+	if (watched == ws_ && InputSession::IsInputEvent(event->type()))
+	{
+		const auto tool = ws_->GetShapeFactory()->GetType();
+
+		auto recorded = InputSession::MakeEvent(event, timer_.nsecsElapsed(), tool);
+		if (recorded.has_value())
+			session_.events.push_back(*recorded);
+	}
+
+	return QObject::eventFilter(watched, event);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+#include <QElapsedTimer>
+
+#include "InputSession.h"
+
+class Workspace;
+
+//Watches the input a workspace receives and keeps it as an InputSession, starting from the
+//document and view the workspace had when the recording began
+class InputRecorder : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit InputRecorder(Workspace* ws);
+	virtual ~InputRecorder();
+
+	//Stops watching the workspace; the events recorded so far stay in the session
+	void Stop();
+
+protected:
+	bool eventFilter(QObject* watched, QEvent* event) override;
+
+private:
+	QPointer<Workspace> ws_;
+	QElapsedTimer timer_;
+
+	InputSession session_;
+
+public:
+	__forceinline const InputSession& GetSession() const { return session_; }
+};
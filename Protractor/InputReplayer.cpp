@@ -0,0 +1,146 @@
+#include "stdafx.h"
+
+#include "InputReplayer.h"
+
+#include "Workspace.h"
+#include "WorkspaceSettings.h"
+#include "NodeSearcher.h"
+#include "ShapeFactory.h"
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace
+{
+	__forceinline double ToMilliseconds(const qint64 nanoseconds) { return nanoseconds / 1e6; }
+
+	QJsonObject MakeStats(std::vector<qint64> durations)
+	{
+		if (durations.empty())
+			return { { "count", 0 } };
+
+		std::ranges::sort(durations);
+
+		const auto percentile = [&durations](const double p)
+		{
+			return ToMilliseconds(durations[std::min(durations.size() - 1, static_cast<size_t>(p * static_cast<double>(durations.size())))]);
+		};
+
+		qint64 total = 0;
+		for (const auto duration : durations)
+			total += duration;
+
+		return {
+			{ "count", static_cast<qint64>(durations.size()) },
+			{ "totalMs", ToMilliseconds(total) },
+			{ "p50Ms", percentile(0.5) },
+			{ "p95Ms", percentile(0.95) },
+			{ "p99Ms", percentile(0.99) },
+			{ "maxMs", ToMilliseconds(durations.back()) } };
+	}
+}
+
+QJsonObject InputReplayer::Report::ToJson() const
+{
+	QJsonObject events;
+	for (size_t i = 0; i < eventDurations.size(); i++)
+	{
+		if (!eventDurations[i].empty())
+			events.insert(InputSession::GetEventTypeName(static_cast<InputSession::EventType>(i)), MakeStats(eventDurations[i]));
+	}
+
+	return {
+		{ "pace", pace == Pace::FAST ? "fast" : "realTime" },
+		{ "totalMs", ToMilliseconds(totalDuration) },
+		{ "shapes", static_cast<qint64>(shapeCount) },
+		{ "events", events },
+		{ "frames", MakeStats(frameDurations) } };
+}
+
+std::optional<InputReplayer::Report> InputReplayer::Run(const InputSession& session, const Pace pace)
+{
+	WorkspaceSettings::Instance()->SetMaxWorkspaceSize(session.maxWorkspaceSize);
+
+	NodeSearcher nodeSearcher;
+	nodeSearcher.SetSynchronous(true);
+	nodeSearcher.SetPredictionEnabled(false);
+
+	Workspace ws(nullptr, FormatType::A3, &nodeSearcher);
+	ws.setAttribute(Qt::WA_DontShowOnScreen);
+	ws.resize(session.size);
+	ws.show();
+
+	QDataStream in(session.document);
+	in.setVersion(QDataStream::Qt_6_2);
+	ws.Deserialize(in);
+	if (in.status() != QDataStream::Ok)
+		return std::nullopt;
+
+	//The view is restored after showing, which resets the scale to the widget's size
+	ws.SetOffset(session.offset);
+	ws.SetScale(session.scale);
+	nodeSearcher.SetWorkspace(&ws);
+
+	Report report{};
+	report.pace = pace;
+
+	QImage image(session.size, QImage::Format_ARGB32_Premultiplied);
+
+	const auto runFrame = [&ws, &image, &report]
+	{
+		const auto start = Profiler::Now();
+
+		ws.FlushPendingMove_();
+		ws.render(&image);
+
+		report.frameDurations.push_back(Profiler::Now() - start);
+	};
+
+	const auto frameInterval = std::max<qint64>(1, static_cast<qint64>(session.frameIntervalMs * 1e6));
+	std::optional<qint64> currentFrame;
+
+	const auto replayStart = Profiler::Now();
+	for (const auto& event : session.events)
+	{
+		const auto frame = event.time / frameInterval;
+		if (currentFrame.has_value() && frame != *currentFrame)
+			runFrame();
+
+		currentFrame = frame;
+
+		if (pace == Pace::REAL_TIME)
+		{
+			const auto due = replayStart + event.time;
+			const auto now = Profiler::Now();
+			if (due > now)
+				std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+		}
+
+		//Shapes are created on release with the tool the user had picked by then
+		if (event.type == InputSession::EventType::MOUSE_RELEASE && ws.GetShapeFactory()->GetType() != event.tool)
+		{
+			auto factory = IShapeFactory::Make(event.tool);
+			if (factory != nullptr)
+				ws.SetShapeFactory(factory.release());
+		}
+
+		auto qEvent = InputSession::MakeQEvent(event);
+		if (qEvent == nullptr)
+			continue;
+
+		const auto start = Profiler::Now();
+		QCoreApplication::sendEvent(&ws, qEvent.get());
+		report.eventDurations[static_cast<size_t>(event.type)].push_back(Profiler::Now() - start);
+	}
+
+	if (currentFrame.has_value())
+		runFrame();
+
+	report.totalDuration = Profiler::Now() - replayStart;
+	report.shapeCount = ws.GetShapeCount();
+
+	nodeSearcher.SetWorkspace(nullptr);
+	return report;
+}
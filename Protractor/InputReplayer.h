@@ -0,0 +1,40 @@
+#pragma once
+
+#include <array>
+#include <vector>
+#include <optional>
+#include <QJsonObject>
+
+#include "InputSession.h"
+
+//Feeds a recorded session to a fresh workspace that is never shown and times how it is handled.
+//Events are sent in recorded order; a frame, i.e. the coalesced cursor move with its snapping and
+//a repaint into an image, runs whenever the recording crossed into the next frame interval.
+//Snap searches run on the calling thread and prediction is off, so every replay of a session
+//does the same work.
+class InputReplayer
+{
+public:
+	enum class Pace : quint8
+	{
+		FAST,		//Events back to back
+		REAL_TIME	//Events at their recorded times
+	};
+
+	struct Report
+	{
+		Pace pace;
+
+		//Nanoseconds spent handling each event, by event type, and running each frame
+		std::array<std::vector<qint64>, static_cast<size_t>(InputSession::EventType::Count)> eventDurations;
+		std::vector<qint64> frameDurations;
+
+		qint64 totalDuration;
+		size_t shapeCount;
+
+		[[nodiscard]] QJsonObject ToJson() const;
+	};
+
+	//None if the session's document cannot be read
+	[[nodiscard]] static std::optional<Report> Run(const InputSession& session, Pace pace);
+};
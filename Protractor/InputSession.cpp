@@ -0,0 +1,184 @@
+#include "stdafx.h"
+
+#include "InputSession.h"
+
+#include <QFile>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QKeyEvent>
+#include <array>
+
+namespace
+{
+	constexpr std::array<const char*, static_cast<size_t>(InputSession::EventType::Count)> EventTypeNames = {
+		"mousePress",
+		"mouseRelease",
+		"mouseMove",
+		"wheel",
+		"keyPress",
+		"keyRelease" };
+
+	//Event timestamps are milliseconds
+	__forceinline quint64 ToTimestamp(const qint64 time) { return static_cast<quint64>(time / 1000000); }
+}
+
+const char* InputSession::GetEventTypeName(const EventType type)
+{
+	return EventTypeNames[static_cast<size_t>(type)];
+}
+
+std::optional<InputSession::Event> InputSession::MakeEvent(const QEvent* event, const qint64 time, const Shape::Type tool)
+{
+	Event result{};
+	result.time = time;
+	result.tool = tool;
+
+	switch (event->type())
+	{
+	case QEvent::MouseButtonPress:
+	case QEvent::MouseButtonRelease:
+	case QEvent::MouseMove:
+	{
+		const auto* mouseEvent = static_cast<const QMouseEvent*>(event);
+		result.type = event->type() == QEvent::MouseButtonPress ? EventType::MOUSE_PRESS
+			: event->type() == QEvent::MouseButtonRelease ? EventType::MOUSE_RELEASE : EventType::MOUSE_MOVE;
+		result.position = mouseEvent->position();
+		result.button = mouseEvent->button();
+		result.buttons = mouseEvent->buttons();
+		result.modifiers = mouseEvent->modifiers();
+		return result;
+	}
+	case QEvent::Wheel:
+	{
+		const auto* wheelEvent = static_cast<const QWheelEvent*>(event);
+		result.type = EventType::WHEEL;
+		result.position = wheelEvent->position();
+		result.buttons = wheelEvent->buttons();
+		result.modifiers = wheelEvent->modifiers();
+		result.angleDelta = wheelEvent->angleDelta();
+		return result;
+	}
+	case QEvent::KeyPress:
+	case QEvent::KeyRelease:
+	{
+		const auto* keyEvent = static_cast<const QKeyEvent*>(event);
+		result.type = event->type() == QEvent::KeyPress ? EventType::KEY_PRESS : EventType::KEY_RELEASE;
+		result.modifiers = keyEvent->modifiers();
+		result.key = keyEvent->key();
+		return result;
+	}
+	default: return std::nullopt;
+	}
+}
+
+std::unique_ptr<QEvent> InputSession::MakeQEvent(const Event& event)
+{
+	std::unique_ptr<QInputEvent> result;
+
+	switch (event.type)
+	{
+	case EventType::MOUSE_PRESS:
+	case EventType::MOUSE_RELEASE:
+	case EventType::MOUSE_MOVE:
+	{
+		const auto type = event.type == EventType::MOUSE_PRESS ? QEvent::MouseButtonPress
+			: event.type == EventType::MOUSE_RELEASE ? QEvent::MouseButtonRelease : QEvent::MouseMove;
+		result = std::make_unique<QMouseEvent>(type, event.position, event.position, event.button, event.buttons, event.modifiers);
+		break;
+	}
+	case EventType::WHEEL:
+		result = std::make_unique<QWheelEvent>(event.position, event.position, QPoint(), event.angleDelta, event.buttons, event.modifiers, Qt::NoScrollPhase, false);
+		break;
+	case EventType::KEY_PRESS:
+		result = std::make_unique<QKeyEvent>(QEvent::KeyPress, event.key, event.modifiers);
+		break;
+	case EventType::KEY_RELEASE:
+		result = std::make_unique<QKeyEvent>(QEvent::KeyRelease, event.key, event.modifiers);
+		break;
+	default: return nullptr;
+	}
+
+	//The cursor predictor works on event timestamps, replays get the recorded ones
+	result->setTimestamp(ToTimestamp(event.time));
+	return result;
+}
+
+bool InputSession::WriteToFile(const QString& path) const
+{
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+
+	QDataStream out(&file);
+	out.setVersion(QDataStream::Qt_6_2);
+
+	Serialize(out);
+	return out.status() == QDataStream::Ok;
+}
+
+bool InputSession::ReadFromFile(const QString& path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+		return false;
+
+	QDataStream in(&file);
+	in.setVersion(QDataStream::Qt_6_2);
+
+	return Deserialize(in);
+}
+
+void InputSession::Serialize(QDataStream& out) const
+{
+	out << SessionMagic << SessionVersion;
+	out << document << offset << scale << size << maxWorkspaceSize << frameIntervalMs;
+
+	out << static_cast<quint64>(events.size());
+	for (const auto& event : events)
+	{
+		out << static_cast<quint8>(event.type) << event.time << event.position
+			<< static_cast<quint32>(event.button) << static_cast<quint32>(event.buttons) << static_cast<quint32>(event.modifiers)
+			<< event.key << event.angleDelta << static_cast<quint8>(event.tool);
+	}
+}
+
+bool InputSession::Deserialize(QDataStream& in)
+{
+	quint32 magic = 0;
+	quint16 version = 0;
+	in >> magic >> version;
+	if (magic != SessionMagic || version != SessionVersion)
+		return false;
+
+	in >> document >> offset >> scale >> size >> maxWorkspaceSize >> frameIntervalMs;
+
+	quint64 eventCount = 0;
+	in >> eventCount;
+	if (in.status() != QDataStream::Ok)
+		return false;
+
+	events.clear();
+	for (quint64 i = 0; i < eventCount && in.status() == QDataStream::Ok; i++)
+	{
+		quint8 type = 0;
+		quint32 button = 0;
+		quint32 buttons = 0;
+		quint32 modifiers = 0;
+		quint8 tool = 0;
+
+		Event event{};
+		in >> type >> event.time >> event.position >> button >> buttons >> modifiers >> event.key >> event.angleDelta >> tool;
+
+		if (type >= static_cast<quint8>(EventType::Count) || tool >= Shape::TypeCount)
+			return false;
+
+		event.type = static_cast<EventType>(type);
+		event.button = static_cast<Qt::MouseButton>(button);
+		event.buttons = Qt::MouseButtons::fromInt(buttons);
+		event.modifiers = Qt::KeyboardModifiers::fromInt(modifiers);
+		event.tool = static_cast<Shape::Type>(tool);
+		events.push_back(event);
+	}
+
+	return in.status() == QDataStream::Ok;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <QByteArray>
+#include <QPointF>
+#include <QPoint>
+#include <QSize>
+#include <QString>
+#include <QEvent>
+#include <vector>
+#include <memory>
+#include <optional>
+
+#include "Shape.h"
+
+//Workspace input recorded for replaying: the document and view it started from and every mouse,
+//wheel and key event in order. Written as <name>.prsession.
+class InputSession
+{
+public:
+	static constexpr quint32 SessionMagic = 0x50524F53;
+	static constexpr quint16 SessionVersion = 1;
+
+	enum class EventType : quint8
+	{
+		MOUSE_PRESS,
+		MOUSE_RELEASE,
+		MOUSE_MOVE,
+		WHEEL,
+		KEY_PRESS,
+		KEY_RELEASE,
+
+		Count
+	};
+
+	struct Event
+	{
+		EventType type;
+
+		//Since the start of the recording
+		qint64 time;
+
+		QPointF position;
+		Qt::MouseButton button;
+		Qt::MouseButtons buttons;
+		Qt::KeyboardModifiers modifiers;
+		qint32 key;
+		QPoint angleDelta;
+
+		//Tool in use, releases create shapes of this type
+		Shape::Type tool;
+	};
+
+	//Workspace contents as Workspace::Serialize writes them
+	QByteArray document;
+
+	Vector2D offset;
+	qreal scale{ 1.0 };
+	QSize size;
+	Vector2D maxWorkspaceSize;
+	double frameIntervalMs{ 1000.0 / 60.0 };
+
+	std::vector<Event> events;
+
+	static constexpr bool IsInputEvent(const QEvent::Type type)
+	{
+		return type == QEvent::MouseButtonPress || type == QEvent::MouseButtonRelease || type == QEvent::MouseMove
+			|| type == QEvent::Wheel || type == QEvent::KeyPress || type == QEvent::KeyRelease;
+	}
+
+	static const char* GetEventTypeName(EventType type);
+
+	//Recorded form of a mouse, wheel or key event, none for any other event
+	[[nodiscard]] static std::optional<Event> MakeEvent(const QEvent* event, qint64 time, Shape::Type tool);
+
+	//Copy of a recorded event that can be sent to a widget, or null for an unknown type
+	[[nodiscard]] static std::unique_ptr<QEvent> MakeQEvent(const Event& event);
+
+	[[nodiscard]] bool WriteToFile(const QString& path) const;
+	[[nodiscard]] bool ReadFromFile(const QString& path);
+
+	void Serialize(QDataStream& out) const;
+	[[nodiscard]] bool Deserialize(QDataStream& in);
+};
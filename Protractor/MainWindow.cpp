@@ -3,10 +3,13 @@
 #include "MainWindow.h"
 
 #include <QLabel>
+#include <QProgressBar>
+#include <QToolButton>
 #include <QMouseEvent>
 
 #include <QPrintDialog>
 #include <QPrinter>
+#include <QInputDialog>
 
 #include "Workspace.h"
 #include "NodeSearcher.h"
@@ -17,6 +20,23 @@
 #include "DoubleSpinLabel.h"
 #include "LinePattern.h"
 #include "NodeLocationDialog.h"
+#include "ArrayDialog.h"
+#include "PreviewBrowserDialog.h"
+#include "MemoryDialog.h"
+#include "BlueprintLoader.h"
+#include "EditJournal.h"
+#include "BlueprintSaver.h"
+#include "BlueprintExporter.h"
+#include "BlueprintImporter.h"
+#include "DocumentSnapshot.h"
+#include "Block.h"
+#include "Profiler.h"
+#include "InputRecorder.h"
+#include "TaskScheduler.h"
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
 
 #include <functional>
 #include <ranges>
@@ -24,12 +44,19 @@
 MainWindow::MainWindow(QWidget* parent)
 	: QMainWindow(parent),
 	printer_(new QPrinter(QPrinter::HighResolution)),
+	journalCompactionTimer_(new QTimer(this)),
 	nodeSearcher_(new NodeSearcher()),
+	exporter_(new BlueprintExporter()),
 	shapeSelectionGroup_(new QActionGroup(this)),
 	coordinateLabel_(new QLabel(this)),
 	shapeInfoLabel_(new QLabel(this)),
+	saveStatusLabel_(new QLabel(this)),
+	loadProgressBar_(new QProgressBar(this)),
+	cancelLoadButton_(new QToolButton(this)),
 	thicknessSpinLabel_(new DoubleSpinLabel(this, 0.25, 0.05, 0.1, 2.0)),
-	patternsMainButton_(new LinePattern(this))
+	patternsMainButton_(new LinePattern(this)),
+	traceStart_(-1),
+	saveGrid_(BlueprintChunk::DefaultGrid)
 {
 	setupUi(this);
 
@@ -47,11 +74,23 @@ MainWindow::MainWindow(QWidget* parent)
 	shapeSelectionGroup_->addAction(actionEllipse);
 	shapeSelectionGroup_->addAction(actionCurve);
 	shapeSelectionGroup_->addAction(actionSector);
+	shapeSelectionGroup_->addAction(actionPolyline);
+	shapeSelectionGroup_->addAction(actionInsert_Block);
 
 	//Init status bar
 	mainStatusBar->addWidget(coordinateLabel_.get(), 1);
 	mainStatusBar->addWidget(shapeInfoLabel_.get(), 1);
 
+	//Init load progress, only visible while a blueprint is streaming in
+	loadProgressBar_->setRange(0, 100);
+	loadProgressBar_->setMaximumWidth(200);
+	loadProgressBar_->hide();
+	cancelLoadButton_->setText(tr("Cancel"));
+	cancelLoadButton_->hide();
+	mainStatusBar->addPermanentWidget(saveStatusLabel_.get());
+	mainStatusBar->addPermanentWidget(loadProgressBar_.get());
+	mainStatusBar->addPermanentWidget(cancelLoadButton_.get());
+
 	//Init pen thickness label
 	thicknessSpinLabel_->SetValue(1.0);
 	thicknessSpinLabel_->SetPrefix(QString("Thickness: "));
@@ -83,9 +122,46 @@ MainWindow::MainWindow(QWidget* parent)
 	MakePattern({ 15.0, 4.0, 2.0, 4.0 });
 
 	lineSettingsToolBar->addWidget(patternsMainButton_.get());
+
+	connect(exporter_.get(), &BlueprintExporter::Finished, this, [this](const bool bIsSuccessful, const QString& path)
+	{
+		if (bIsSuccessful)
+			saveStatusLabel_->setText(tr("Exported %0").arg(QFileInfo(path).fileName()));
+		else
+			QMessageBox::critical(this, "Export error", "This blueprint cannot be exported");
+	});
+
+	nodeSearcher_->SetPredictionEnabled(actionPredictive_Snapping->isChecked());
+	connect(actionPredictive_Snapping, &QAction::toggled, this, [this](const bool bIsChecked)
+	{
+		nodeSearcher_->SetPredictionEnabled(bIsChecked);
+	});
+
+	WorkspaceSettings::Instance()->SetCompactModeEnabled(actionCompact_Hidden_Documents->isChecked());
+	connect(actionCompact_Hidden_Documents, &QAction::toggled, this, [](const bool bIsChecked)
+	{
+		WorkspaceSettings::Instance()->SetCompactModeEnabled(bIsChecked);
+	});
+
+	//Periodically fold oversized journals back into their blueprints
+	connect(journalCompactionTimer_.get(), &QTimer::timeout, this, &MainWindow::OnCompactJournals_);
+	journalCompactionTimer_->start(60 * 1000);
 }
 
-MainWindow::~MainWindow() { }
+MainWindow::~MainWindow()
+{
+	//Workspaces detach from the node searcher as they go, so they have to go before it
+	while (documentTabs->count() > 0)
+	{
+		if (auto* ws = dynamic_cast<Workspace*>(documentTabs->widget(0)))
+			RetireSaver_(ws->TakeSaver(GetSaveOptions_()));
+
+		delete documentTabs->widget(0);
+	}
+
+	//Every save and fold still running is written before the application quits
+	closingSavers_.clear();
+}
 
 
 void MainWindow::InitializeFromFile(const QString& path) const
@@ -96,39 +172,106 @@ void MainWindow::InitializeFromFile(const QString& path) const
 
 bool MainWindow::SaveFile(const QString& path) const
 {
-	QFile file(path);
-	if (!file.open(QIODevice::WriteOnly))
+	return SaveWorkspace_(GetCurrentWorkspace(), path, true);
+}
+
+bool MainWindow::SaveWorkspace_(Workspace* ws, const QString& path, const bool bAllowJournal) const
+{
+	if (ws->IsLoading())
 		return false;
 
-	QDataStream out(&file);
-	out.setVersion(QDataStream::Qt_6_2);
+	//Journaled save: only the edits since the last save are forced to disk
+	const bool bIsJournaled = bAllowJournal && actionJournaled_Save->isChecked()
+		&& ws->HasJournal() && path == ws->GetFilePath();
+	if (bIsJournaled && ws->GetJournalSize() < EditJournal::CompactionThreshold)
+		return ws->CommitJournal();
 
-	auto* ws = GetCurrentWorkspace();
-	ws->Serialize(out);
+	ws->ReleaseMapped();
+
+	//The old journal describes the file that is about to be replaced
+	ws->StopJournal();
 	ws->SetFilePath(path);
 
-	file.close();
+	saveStatusLabel_->setText(tr("Saving..."));
+	ws->GetSaver()->Save(ws->MakeSnapshot(), path, GetSaveOptions_());
 
 	return true;
 }
 
+BlueprintChunk::EncodingOptions MainWindow::GetSaveOptions_() const
+{
+	BlueprintChunk::EncodingOptions result;
+	if (actionCompressed_Save->isChecked())
+	{
+		result.encoding = BlueprintFormat::ChunkEncoding::DELTA_COMPRESSED;
+		result.grid = saveGrid_;
+	}
+
+	return result;
+}
+
+void MainWindow::OnSaveFinished_(Workspace* ws, const bool bIsSuccessful, const QString& path, const quint64 generation, const bool bIsExact) const
+{
+	if (!bIsSuccessful)
+	{
+		saveStatusLabel_->clear();
+		QMessageBox::critical(documentTabs, "Saving error", "This blueprint cannot be saved");
+		return;
+	}
+
+	saveStatusLabel_->setText(tr("Saved %0").arg(QFileInfo(path).fileName()));
+
+	if (path != ws->GetFilePath())
+		return;
+
+	//A journal can only start from a file that holds the current document, edits made
+	//while the save was running will go into the next full save instead. A compressed file
+	//holds rounded positions, removals journaled from the exact ones would never match it
+	if (actionJournaled_Save->isChecked() && bIsExact && ws->GetEditGeneration() == generation)
+		ws->StartJournal();
+	else
+		EditJournal::Remove(path);
+}
+
 bool MainWindow::OpenFile(const QString& path) const
 {
-	QFile file(path);
-	if (!file.open(QIODevice::ReadOnly))
+	WaitForClosingSaves_(path);
+
+	const auto newWorkspace = new Workspace(documentTabs, FormatType::A3, nodeSearcher_.get());
+
+	auto* loader = new BlueprintLoader(newWorkspace, path);
+	if (!loader->Start())
+	{
+		delete newWorkspace;
 		return false;
+	}
+
+	newWorkspace->SetFilePath(path);
+	AddWorkspace_(newWorkspace);
 
-	QDataStream in(&file);
-	in.setVersion(QDataStream::Qt_6_2);
+	TrackLoader_(loader);
+
+	return true;
+}
+
+bool MainWindow::OpenFileMapped(const QString& path) const
+{
+	WaitForClosingSaves_(path);
+
+	//Journaled edits have to be replayed onto real shapes
+	if (EditJournal::Inspect(path).bIsValid)
+		return OpenFile(path);
 
 	const auto newWorkspace = new Workspace(documentTabs, FormatType::A3, nodeSearcher_.get());
-	newWorkspace->Deserialize(in);
-	newWorkspace->SetFilePath(path);
+	if (!newWorkspace->OpenMapped(path))
+	{
+		delete newWorkspace;
+		return OpenFile(path);
+	}
 
+	newWorkspace->SetFilePath(path);
 	AddWorkspace_(newWorkspace);
 
-	file.close();
-
 	return true;
 }
 
@@ -161,12 +304,21 @@ void MainWindow::InitializeActions_()
 	connect(actionNewA3File, &QAction::triggered, this, &MainWindow::OnNewA3File_);
 	connect(actionNewA4File, &QAction::triggered, this, &MainWindow::OnNewA4File_);
 	connect(actionOpen, &QAction::triggered, this, &MainWindow::OnOpenFile_);
+	connect(actionOpen_Read_Only, &QAction::triggered, this, &MainWindow::OnOpenFileReadOnly_);
+	connect(actionBrowse, &QAction::triggered, this, &MainWindow::OnBrowseFiles_);
+	connect(actionImport, &QAction::triggered, this, &MainWindow::OnImportFile_);
+	connect(actionExport, &QAction::triggered, this, &MainWindow::OnExportFile_);
 	connect(actionSave, &QAction::triggered, this, &MainWindow::OnSaveFile_);
 	connect(actionSave_as, &QAction::triggered, this, &MainWindow::OnSaveFileAs_);
 	connect(actionPrint, &QAction::triggered, this, &MainWindow::OnPrintFile_);
 
 	//View Menu
 	connect(actionReset_Transform, &QAction::triggered, this, &MainWindow::OnResetTransform_);
+	connect(actionProfiler_Overlay, &QAction::toggled, this, &MainWindow::OnToggleProfilerOverlay_);
+	connect(actionRecord_Trace, &QAction::toggled, this, &MainWindow::OnRecordTrace_);
+	connect(actionRecord_Input, &QAction::toggled, this, &MainWindow::OnRecordInput_);
+	connect(actionExport_Latency, &QAction::triggered, this, &MainWindow::OnExportLatency_);
+	connect(actionMemory_Usage, &QAction::triggered, this, &MainWindow::OnShowMemoryUsage_);
 
 	//Shape Menu
 	connect(actionLine, &QAction::triggered, this, &MainWindow::OnNewShape_<Line>);
@@ -175,13 +327,28 @@ void MainWindow::InitializeActions_()
 	connect(actionEllipse, &QAction::triggered, this, &MainWindow::OnNewShape_<Oval>);
 	connect(actionCurve, &QAction::triggered, this, &MainWindow::OnNewShape_<Curve>);
 	connect(actionSector, &QAction::triggered, this, &MainWindow::OnNewShape_<Sector>);
+	connect(actionPolyline, &QAction::triggered, this, &MainWindow::OnNewShape_<Polyline>);
+	connect(actionInsert_Block, &QAction::triggered, this, &MainWindow::OnInsertBlock_);
+	connect(actionDefine_Block, &QAction::triggered, this, &MainWindow::OnDefineBlock_);
+	connect(actionArray, &QAction::triggered, this, &MainWindow::OnMakeArray_);
+	connect(actionMerge_Lines, &QAction::triggered, this, &MainWindow::OnMergeLines_);
+	connect(actionSimplify_Polylines, &QAction::triggered, this, &MainWindow::OnSimplifyPolylines_);
+	connect(actionUndo_Simplify, &QAction::triggered, this, &MainWindow::OnUndoSimplify_);
 
 	//Node Location Dialog
 	connect(actionSet_Node_Location, &QAction::triggered, this, &MainWindow::OnNodeLocation_);
+	connect(actionCompressed_Save_Grid, &QAction::triggered, this, &MainWindow::OnSetSaveGrid_);
 
 	//Tabs
 	connect(documentTabs, &QTabWidget::tabCloseRequested, this, &MainWindow::DeleteWorkspace_);
 	connect(documentTabs, &QTabWidget::currentChanged, this, &MainWindow::OnChangeCurrentTab_);
+
+	//Several tabs may be loading at once, the status bar always stands for the one on show
+	connect(cancelLoadButton_.get(), &QToolButton::clicked, this, [this]
+	{
+		if (auto* loader = GetCurrentLoader_())
+			loader->Cancel();
+	});
 }
 
 template <typename T>
@@ -190,6 +357,147 @@ void MainWindow::OnNewShape_() const
 	GetCurrentWorkspace()->SetShapeFactory(new ShapeFactory<T>());
 }
 
+void MainWindow::OnDefineBlock_()
+{
+	auto* ws = GetCurrentWorkspace();
+	if (ws->IsLoading())
+		return;
+
+	const auto filePath = QFileDialog::getOpenFileName(this, tr("Define Block"), "", tr("Drawings (*.dxf *.svg)"));
+	if (filePath.isEmpty())
+		return;
+
+	const auto* wsSettings = WorkspaceSettings::Instance();
+	const auto factor = wsSettings->GetFactor(ws->GetFormatType());
+	const BlueprintImporter::Settings settings{ factor, wsSettings->GetFormatSizeByType(ws->GetFormatType()).y / factor, 0 };
+
+	BlueprintImporter::Result result;
+
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	const auto bIsRead = BlueprintImporter::Read(filePath, settings, result);
+	QApplication::restoreOverrideCursor();
+
+	if (!bIsRead || result.shapes.empty())
+	{
+		QMessageBox::critical(this, "Block error", "This drawing has no shapes to make a block of");
+		return;
+	}
+
+	bool bIsAccepted = false;
+	const auto name = QInputDialog::getText(this, tr("Define Block"), tr("Block name:"), QLineEdit::Normal,
+		QFileInfo(filePath).completeBaseName(), &bIsAccepted);
+	if (!bIsAccepted || name.isEmpty())
+		return;
+
+	SelectBlock_(ws, ws->DefineBlock(name, std::move(result.shapes)));
+}
+
+void MainWindow::OnInsertBlock_()
+{
+	auto* ws = GetCurrentWorkspace();
+	const auto& blocks = ws->GetBlocks();
+
+	if (blocks.IsEmpty())
+	{
+		QMessageBox::information(this, "Insert Block", "This blueprint has no blocks yet, define one from a drawing first");
+		actionLine->trigger();
+		return;
+	}
+
+	//Names are numbered, two blocks may share one
+	QStringList names;
+	for (size_t i = 0; i < blocks.GetSize(); i++)
+		names << QString("%0. %1").arg(i + 1).arg(blocks.Get(static_cast<BlockIndex>(i))->GetName());
+
+	bool bIsAccepted = false;
+	const auto name = QInputDialog::getItem(this, tr("Insert Block"), tr("Block:"), names, 0, false, &bIsAccepted);
+	if (!bIsAccepted)
+	{
+		actionLine->trigger();
+		return;
+	}
+
+	SelectBlock_(ws, static_cast<BlockIndex>(names.indexOf(name)));
+}
+
+void MainWindow::SelectBlock_(Workspace* ws, const BlockIndex blockIndex) const
+{
+	actionInsert_Block->setChecked(true);
+	ws->SetShapeFactory(new BlockInstanceFactory(blockIndex, ws->GetBlocks().Get(blockIndex)));
+}
+
+void MainWindow::OnMakeArray_()
+{
+	auto* ws = GetCurrentWorkspace();
+	if (ws->IsLoading())
+		return;
+
+	ArrayDialog d(this);
+	if (d.exec() == QDialog::Rejected)
+		return;
+
+	const auto factor = WorkspaceSettings::Instance()->GetFactor(ws->GetFormatType());
+	if (!ws->MakeArray(d.GetSettings(factor)))
+		QMessageBox::information(this, "Array", "Draw the shape to repeat first, arrays cannot be repeated again");
+}
+
+void MainWindow::OnMergeLines_() const
+{
+	auto* ws = GetCurrentWorkspace();
+	if (ws->IsLoading())
+		return;
+
+	ws->ReleaseMapped();
+
+	const auto mergedCount = ws->MergeConnectedLines();
+	saveStatusLabel_->setText(tr("Merged connected lines into %0 polylines").arg(mergedCount));
+}
+
+void MainWindow::OnSimplifyPolylines_()
+{
+	auto* ws = GetCurrentWorkspace();
+	if (ws->IsLoading())
+		return;
+
+	//The visible area comes first, simplifying everything is a deliberate choice
+	const QStringList scopes = {
+		tr("Polylines in the visible area"),
+		tr("Polylines and curves in the visible area"),
+		tr("Polylines in the whole document"),
+		tr("Polylines and curves in the whole document") };
+
+	bool bIsAccepted = false;
+	const auto scope = scopes.indexOf(QInputDialog::getItem(this, tr("Simplify Polylines"), tr("Simplify:"), scopes, 0, false, &bIsAccepted));
+	if (!bIsAccepted)
+		return;
+
+	const auto toleranceMm = QInputDialog::getDouble(this, tr("Simplify Polylines"), tr("Tolerance (mm):"), 0.1, 0.001, 100.0, 3, &bIsAccepted);
+	if (!bIsAccepted)
+		return;
+
+	ws->ReleaseMapped();
+
+	const auto region = scope < 2 ? std::optional(ws->GetVisibleArea()) : std::nullopt;
+	const auto bSimplifyCurves = scope % 2 == 1;
+
+	const auto factor = WorkspaceSettings::Instance()->GetFactor(ws->GetFormatType());
+	const auto removedCount = ws->SimplifyPolylines(toleranceMm / factor, region, bSimplifyCurves);
+	saveStatusLabel_->setText(removedCount != 0
+		? tr("Removed %0 points, Undo Simplification puts them back").arg(removedCount)
+		: tr("Nothing to simplify"));
+}
+
+void MainWindow::OnUndoSimplify_() const
+{
+	auto* ws = GetCurrentWorkspace();
+	if (ws->IsLoading())
+		return;
+
+	saveStatusLabel_->setText(ws->UndoSimplify()
+		? tr("Simplification undone")
+		: tr("Nothing to undo, the document was edited since"));
+}
+
 void MainWindow::UpdateActions_() const
 {
 	const bool bIsWsValid = GetCurrentWorkspace() != nullptr;
@@ -210,6 +518,13 @@ void MainWindow::UpdateActions_() const
 	actionEllipse->setEnabled(bIsWsValid);
 	actionCurve->setEnabled(bIsWsValid);
 	actionSector->setEnabled(bIsWsValid);
+	actionPolyline->setEnabled(bIsWsValid);
+	actionInsert_Block->setEnabled(bIsWsValid);
+	actionDefine_Block->setEnabled(bIsWsValid);
+	actionArray->setEnabled(bIsWsValid);
+	actionMerge_Lines->setEnabled(bIsWsValid);
+	actionSimplify_Polylines->setEnabled(bIsWsValid);
+	actionUndo_Simplify->setEnabled(bIsWsValid);
 
 	//Node Location Dialog
 	actionSet_Node_Location->setEnabled(bIsWsValid);
@@ -234,12 +549,40 @@ void MainWindow::OnOpenFile_()
 	}
 }
 
+void MainWindow::OnOpenFileReadOnly_()
+{
+	const auto filePath = QFileDialog::getOpenFileName(this, tr("Open Protractor Blueprint Read-Only"), "", tr("Protractor Blueprint (*.prob)"));
+	if (!OpenFileMapped(filePath))
+	{
+		QMessageBox::critical(this, "Opening error", "This blueprint cannot be opened");
+	}
+}
+
+void MainWindow::OnBrowseFiles_()
+{
+	PreviewBrowserDialog d(this);
+
+	const auto currentPath = GetCurrentWorkspace()->GetFilePath();
+	d.SetDirectory(currentPath.isEmpty() ? QDir::currentPath() : QFileInfo(currentPath).absolutePath());
+
+	if (d.exec() == QDialog::Rejected || d.GetSelectedPath().isEmpty())
+		return;
+
+	if (!OpenFile(d.GetSelectedPath()))
+	{
+		QMessageBox::critical(this, "Opening error", "This blueprint cannot be opened");
+	}
+}
+
 void MainWindow::OnSaveFile_()
 {
 	const auto& filePath = GetCurrentWorkspace()->GetFilePath();
 
 	if (filePath.isEmpty())
+	{
 		OnSaveFileAs_();
+		return;
+	}
 
 	if(!SaveFile(filePath))
 	{
@@ -250,10 +593,82 @@ void MainWindow::OnSaveFile_()
 void MainWindow::OnSaveFileAs_()
 {
 	const auto filePath = QFileDialog::getSaveFileName(this, tr("Save Protractor Blueprint"), "", tr("Protractor Blueprint (*.prob)"));
+	if (filePath.isEmpty())
+		return;
+
 	if (SaveFile(filePath))
 		documentTabs->setTabText(documentTabs->currentIndex(), GetFixedTabTitle_(GetCurrentWorkspace()));
 }
 
+void MainWindow::OnImportFile_()
+{
+	auto* ws = GetCurrentWorkspace();
+	if (ws->IsLoading())
+		return;
+
+	const auto filePath = QFileDialog::getOpenFileName(this, tr("Import Drawing"), "", tr("Drawings (*.dxf *.svg)"));
+	if (filePath.isEmpty())
+		return;
+
+	const auto* wsSettings = WorkspaceSettings::Instance();
+	const auto factor = wsSettings->GetFactor(ws->GetFormatType());
+	const BlueprintImporter::Settings settings{ factor, wsSettings->GetFormatSizeByType(ws->GetFormatType()).y / factor, ws->InternStyle(GetPen()) };
+
+	BlueprintImporter::Result result;
+
+	QApplication::setOverrideCursor(Qt::WaitCursor);
+	const auto bIsRead = BlueprintImporter::Read(filePath, settings, result);
+	QApplication::restoreOverrideCursor();
+
+	if (!bIsRead)
+	{
+		QMessageBox::critical(this, "Import error", "This drawing cannot be imported");
+		return;
+	}
+
+	const auto importedCount = result.shapes.size();
+	ws->ImportShapes(std::move(result.shapes));
+
+	saveStatusLabel_->setText(result.skippedCount == 0
+		? tr("Imported %0 shapes").arg(importedCount)
+		: tr("Imported %0 shapes, skipped %1 unsupported entities").arg(importedCount).arg(result.skippedCount));
+}
+
+void MainWindow::OnExportFile_()
+{
+	auto* ws = GetCurrentWorkspace();
+	if (ws->IsLoading())
+		return;
+
+	if (exporter_->IsBusy())
+	{
+		QMessageBox::information(this, "Export", "The previous export is still running");
+		return;
+	}
+
+	const auto filePath = QFileDialog::getSaveFileName(this, tr("Export Protractor Blueprint"), "",
+		tr("Scalable Vector Graphics (*.svg);;Drawing Exchange Format (*.dxf);;Portable Document Format (*.pdf)"));
+	if (filePath.isEmpty())
+		return;
+
+	const auto format = BlueprintExporter::GetFormatFromPath(filePath);
+	if (!format.has_value())
+	{
+		QMessageBox::critical(this, "Export error", "Unknown export format");
+		return;
+	}
+
+	//The sheet is the document's paper size expressed in world units
+	const auto* wsSettings = WorkspaceSettings::Instance();
+	const auto factor = wsSettings->GetFactor(ws->GetFormatType());
+	const BlueprintExporter::Settings settings{ wsSettings->GetFormatSizeByType(ws->GetFormatType()) / factor, factor };
+
+	ws->ReleaseMapped();
+
+	saveStatusLabel_->setText(tr("Exporting..."));
+	exporter_->Start(ws->MakeSnapshot(), filePath, *format, settings);
+}
+
 void MainWindow::OnPrintFile_()
 {
 	auto* currentWS = GetCurrentWorkspace();
@@ -268,27 +683,160 @@ void MainWindow::OnPrintFile_()
 	if (dialog.exec() == QDialog::Rejected)
 		return;
 
-	QPainter painter(printer_.get());
-	painter.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
+	currentWS->Print(printer_.get(), d.GetOffset(), d.ShouldPrintFrame());
+}
 
-	const auto* wsSettings = WorkspaceSettings::Instance();
-	const auto scale = printer_->paperRect(QPrinter::DevicePixel).width() / wsSettings->GetMaxWorkspaceSize().x;
-	painter.translate(d.GetOffset() * scale);
-	painter.scale(scale, scale);
-	currentWS->DrawShapes(&painter);
+void MainWindow::OnResetTransform_() const
+{
+	GetCurrentWorkspace()->ResetTransform();
+}
+
+void MainWindow::OnToggleProfilerOverlay_(const bool bIsChecked) const
+{
+	WorkspaceSettings::Instance()->SetProfilerOverlayVisible(bIsChecked);
+	UpdateProfiler_();
+
+	GetCurrentWorkspace()->update();
+}
 
-	if (d.ShouldPrintFrame())
+void MainWindow::OnRecordTrace_(const bool bIsChecked)
+{
+	if (bIsChecked)
 	{
-		const auto frameScale = printer_->paperRect(QPrinter::DevicePixel).width() / wsSettings->GetFormatSizeByType(currentWS->GetFormatType()).x;
-		painter.resetTransform();
-		painter.scale(frameScale, frameScale);
-		currentWS->DrawFrame(&painter);
+		StartTrace();
+		saveStatusLabel_->setText(tr("Recording trace"));
+		return;
 	}
+
+	const auto path = QFileDialog::getSaveFileName(this, tr("Save Trace"), "", tr("Chrome Trace (*.json)"));
+	if (!path.isEmpty())
+	{
+		if (WriteTrace(path))
+			saveStatusLabel_->setText(tr("Saved trace %0").arg(QFileInfo(path).fileName()));
+		else
+			QMessageBox::critical(this, "Trace error", "The trace cannot be saved");
+	}
+
+	traceStart_ = -1;
+	UpdateProfiler_();
 }
 
-void MainWindow::OnResetTransform_() const
+void MainWindow::OnRecordInput_(const bool bIsChecked)
 {
-	GetCurrentWorkspace()->ResetTransform();
+	if (bIsChecked)
+	{
+		auto* ws = GetCurrentWorkspace();
+
+		//Replays start from the serialized shapes, which a mapped document keeps in its file
+		if (ws->IsLoading() || ws->IsMapped())
+		{
+			const QSignalBlocker blocker(actionRecord_Input);
+			actionRecord_Input->setChecked(false);
+
+			QMessageBox::warning(this, "Recording error", "Input can only be recorded on a fully loaded, editable document");
+			return;
+		}
+
+		inputRecorder_ = std::make_unique<InputRecorder>(ws);
+		saveStatusLabel_->setText(tr("Recording input"));
+		return;
+	}
+
+	if (inputRecorder_ == nullptr)
+		return;
+
+	inputRecorder_->Stop();
+
+	const auto path = QFileDialog::getSaveFileName(this, tr("Save Input Session"), "", tr("Input Session (*.prsession)"));
+	if (!path.isEmpty())
+	{
+		if (inputRecorder_->GetSession().WriteToFile(path))
+			saveStatusLabel_->setText(tr("Saved input session %0").arg(QFileInfo(path).fileName()));
+		else
+			QMessageBox::critical(this, "Recording error", "The input session cannot be saved");
+	}
+
+	inputRecorder_.reset();
+}
+
+void MainWindow::OnExportLatency_()
+{
+	const auto path = QFileDialog::getSaveFileName(this, tr("Export Latency"), "", tr("Latency Histograms (*.json)"));
+	if (path.isEmpty())
+		return;
+
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)
+		|| file.write(QJsonDocument(Profiler::Instance()->GetLatencyReport()).toJson(QJsonDocument::Indented)) == -1)
+	{
+		QMessageBox::critical(this, "Export error", "The latency histograms cannot be saved");
+		return;
+	}
+
+	saveStatusLabel_->setText(tr("Saved latency %0").arg(QFileInfo(path).fileName()));
+}
+
+void MainWindow::OnShowMemoryUsage_()
+{
+	MemoryDialog d(this, documentTabs);
+	d.exec();
+}
+
+void MainWindow::StartTrace()
+{
+	traceStart_ = Profiler::Now();
+
+	const QSignalBlocker blocker(actionRecord_Trace);
+	actionRecord_Trace->setChecked(true);
+
+	UpdateProfiler_();
+}
+
+bool MainWindow::WriteTrace(const QString& path) const
+{
+	if (traceStart_ < 0)
+		return false;
+
+	//Sizes of the open documents, a slow frame means little without them
+	QJsonArray documents;
+	for (qint32 i = 0; i < documentTabs->count(); i++)
+	{
+		const auto* ws = dynamic_cast<Workspace*>(documentTabs->widget(i));
+		if (ws == nullptr)
+			continue;
+
+		documents.append(QJsonObject{
+			{ "title", documentTabs->tabText(i) },
+			{ "format", ws->GetFormatType() == FormatType::A3 ? "A3" : "A4" },
+			{ "shapes", static_cast<qint64>(ws->GetShapeCount()) },
+			{ "nodes", static_cast<qint64>(ws->GetNodeCount()) },
+			{ "blocks", static_cast<qint64>(ws->GetBlocks().GetSize()) },
+			{ "mapped", ws->IsMapped() } });
+	}
+
+	const QJsonObject metadata{
+		{ "documents", documents },
+		{ "workers", static_cast<qint32>(TaskScheduler::Instance()->GetWorkerCount()) } };
+
+	return Profiler::Instance()->WriteChromeTrace(path, traceStart_, Profiler::Now(), metadata);
+}
+
+void MainWindow::UpdateProfiler_() const
+{
+	Profiler::SetEnabled(actionProfiler_Overlay->isChecked() || traceStart_ >= 0);
+}
+
+void MainWindow::OnSetSaveGrid_()
+{
+	bool bIsAccepted = false;
+	const auto grid = QInputDialog::getDouble(this, tr("Compressed Save Grid"),
+		tr("Compressed saves round every node position to this step (mm); the rounding is kept in the file:"),
+		saveGrid_, 0.000001, 1.0, 6, &bIsAccepted);
+	if (!bIsAccepted)
+		return;
+
+	saveGrid_ = grid;
+	actionCompressed_Save->setToolTip(tr("Round node positions to %0 mm and compress them when saving").arg(saveGrid_));
 }
 
 void MainWindow::OnNodeLocation_()
@@ -302,7 +850,7 @@ void MainWindow::OnNodeLocation_()
 		return;
 
 	node->position = d.GetLocation(ws);
-	node->parent->Update();
+	node->parent->UpdateWhileEditing();
 	QMouseEvent event(QEvent::MouseButtonRelease, 
 		QPointF(), 
 		Qt::MouseButton::LeftButton, 
@@ -329,10 +877,124 @@ void MainWindow::OnChangeCurrentTab_(const qint32 index) const
 	auto* ws = dynamic_cast<Workspace*>(documentTabs->widget(index));
 	ws->SetNodeSearcher(nodeSearcher_.get());
 	nodeSearcher_->SetWorkspace(ws);
+
+	UpdateLoadStatus_();
+}
+
+BlueprintLoader* MainWindow::GetCurrentLoader_() const
+{
+	const auto* ws = GetCurrentWorkspace();
+	if (ws == nullptr)
+		return nullptr;
+
+	auto* loader = ws->findChild<BlueprintLoader*>(QString(), Qt::FindDirectChildrenOnly);
+	return loader != nullptr && loader->IsRunning() ? loader : nullptr;
+}
+
+void MainWindow::UpdateLoadStatus_() const
+{
+	const auto* loader = GetCurrentLoader_();
+	loadProgressBar_->setVisible(loader != nullptr);
+	cancelLoadButton_->setVisible(loader != nullptr);
+
+	if (loader != nullptr)
+		loadProgressBar_->setValue(loader->GetProgress());
+}
+
+void MainWindow::TrackLoader_(BlueprintLoader* loader) const
+{
+	UpdateLoadStatus_();
+
+	connect(loader, &BlueprintLoader::ProgressChanged, this, [this, loader](const qint32 percent)
+	{
+		if (loader == GetCurrentLoader_())
+			loadProgressBar_->setValue(percent);
+	});
+
+	const QPointer<Workspace> ws(dynamic_cast<Workspace*>(loader->parent()));
+	connect(loader, &BlueprintLoader::Finished, this, [this, ws](const bool bIsSuccessful, const bool bIsCancelled)
+	{
+		UpdateLoadStatus_();
+
+		if (ws == nullptr)
+			return;
+
+		//The tab keeps what was read, but it is no longer the blueprint: its journal is not replayed and
+		//neither saving nor closing the tab may write it over the file
+		if (bIsCancelled)
+		{
+			const auto index = documentTabs->indexOf(ws);
+			ws->SetFilePath(QString());
+			documentTabs->setTabText(index, tr("%0 (partial)").arg(documentTabs->tabText(index)));
+			return;
+		}
+
+		if (bIsSuccessful)
+		{
+			RecoverJournal_(ws);
+			return;
+		}
+
+		QMessageBox::critical(documentTabs, "Opening error", "This blueprint cannot be opened");
+
+		//The loader is the sender, so the tab that owns it is closed once the signal has returned
+		QMetaObject::invokeMethod(documentTabs, [this, ws]
+		{
+			if (ws != nullptr)
+				DeleteWorkspace_(documentTabs->indexOf(ws));
+		}, Qt::QueuedConnection);
+	});
+}
+
+void MainWindow::RecoverJournal_(Workspace* ws) const
+{
+	const auto& path = ws->GetFilePath();
+
+	const auto state = EditJournal::Inspect(path);
+	if (!state.bIsValid)
+		return;
+
+	auto end = state.committedEnd;
+	if (state.uncommittedCount > 0)
+	{
+		const auto answer = QMessageBox::question(documentTabs, "Recovery",
+			QString("%0 unsaved edits of this blueprint were found. Recover them?").arg(state.uncommittedCount));
+
+		if (answer == QMessageBox::Yes)
+			end = state.recoverableEnd;
+	}
+
+	if (!ws->ReplayJournal(end))
+	{
+		QMessageBox::warning(documentTabs, "Recovery error", "The journal of this blueprint is damaged, some edits were not restored");
+		return;
+	}
+
+	if (actionJournaled_Save->isChecked())
+		ws->ResumeJournal(end, state.committedEnd);
+}
+
+void MainWindow::OnCompactJournals_() const
+{
+	for (qint32 i = 0; i < documentTabs->count(); i++)
+	{
+		//Only fully saved documents are compacted, otherwise unsaved edits would silently become saved
+		auto* ws = dynamic_cast<Workspace*>(documentTabs->widget(i));
+		if (ws != nullptr && !ws->GetSaver()->IsBusy()
+			&& ws->GetJournalSize() >= EditJournal::CompactionThreshold && !ws->HasUncommittedEdits())
+			SaveWorkspace_(ws, ws->GetFilePath(), false);
+	}
 }
 
 void MainWindow::AddWorkspace_(Workspace* newWorkspace) const
 {
+	connect(newWorkspace->GetSaver(), &BlueprintSaver::Finished, this,
+		[this, ws = QPointer<Workspace>(newWorkspace)](const bool bIsSuccessful, const QString& path, const quint64 generation, const bool bIsExact)
+	{
+		if (ws != nullptr)
+			OnSaveFinished_(ws, bIsSuccessful, path, generation, bIsExact);
+	});
+
 	documentTabs->addTab(newWorkspace, GetFixedTabTitle_(newWorkspace));
 	documentTabs->setCurrentWidget(newWorkspace);
 	newWorkspace->setFocus();
@@ -344,12 +1006,40 @@ void MainWindow::AddWorkspace_(Workspace* newWorkspace) const
 void MainWindow::DeleteWorkspace_(const qint32 index) const
 {
 	const QWidget* oldWidget{ documentTabs->widget(index) };
+
+	//Previews, the preview extractor and mapped opens read the bare file, which has to hold every saved edit
+	if (auto* ws = dynamic_cast<Workspace*>(documentTabs->widget(index)))
+		RetireSaver_(ws->TakeSaver(GetSaveOptions_()));
+
 	documentTabs->removeTab(index);
 	delete oldWidget;
 
 	UpdateActions_();
 }
 
+void MainWindow::RetireSaver_(std::unique_ptr<BlueprintSaver> saver) const
+{
+	if (saver == nullptr || !saver->IsBusy())
+		return;
+
+	//Queued so the saver has started any save it still had pending before it is checked
+	connect(saver.get(), &BlueprintSaver::Finished, this, [this, saver = QPointer<BlueprintSaver>(saver.get())]
+	{
+		if (saver == nullptr || saver->IsBusy())
+			return;
+
+		std::erase_if(closingSavers_, [&saver](const std::unique_ptr<BlueprintSaver>& closing) { return closing.get() == saver; });
+	}, Qt::QueuedConnection);
+
+	closingSavers_.push_back(std::move(saver));
+}
+
+void MainWindow::WaitForClosingSaves_(const QString& path) const
+{
+	//Deleting a saver waits for its job
+	std::erase_if(closingSavers_, [&path](const std::unique_ptr<BlueprintSaver>& closing) { return closing->IsWriting(path); });
+}
+
 QString MainWindow::GetFixedTabTitle_(const Workspace* ws) const
 {
 	const QFileInfo fileInfo(ws->GetFilePath());
@@ -4,14 +4,25 @@
 #include "ui_MainWindow.h"
 
 #include <memory>
+#include <vector>
+
+#include "Shape.h"
+#include "BlueprintChunk.h"
 
 class QScrollBar;
 class Workspace;
 class QPrinter;
+class QTimer;
 class NodeSearcher;
 class QLabel;
 class DoubleSpinLabel;
 class LinePattern;
+class QProgressBar;
+class QToolButton;
+class BlueprintLoader;
+class BlueprintExporter;
+class BlueprintSaver;
+class InputRecorder;
 
 class MainWindow : public QMainWindow, public Ui::MainWindowClass
 {
@@ -25,9 +36,14 @@ public:
 
 	bool SaveFile(const QString& path) const;
 	bool OpenFile(const QString& path) const;
+	bool OpenFileMapped(const QString& path) const;
 
 	QPen GetPen() const;
 
+	//Records profiler spans from now on; WriteTrace dumps those recorded so far as a Chrome trace
+	void StartTrace();
+	bool WriteTrace(const QString& path) const;
+
 private:
 	void InitializeActions_();
 	void UpdateActions_() const;
@@ -35,41 +51,95 @@ private:
 	void OnNewA3File_() const;
 	void OnNewA4File_() const;
 	void OnOpenFile_();
+	void OnOpenFileReadOnly_();
+	void OnBrowseFiles_();
 	void OnSaveFile_();
 	void OnSaveFileAs_();
+	void OnImportFile_();
+	void OnExportFile_();
 	void OnPrintFile_();
 
 	void OnResetTransform_() const;
+	void OnToggleProfilerOverlay_(bool bIsChecked) const;
+	void OnRecordTrace_(bool bIsChecked);
+	void OnRecordInput_(bool bIsChecked);
+	void OnExportLatency_();
+	void OnShowMemoryUsage_();
+	void UpdateProfiler_() const;
 
 	template<typename T>
 	void OnNewShape_() const;
 
+	void OnDefineBlock_();
+	void OnInsertBlock_();
+	void SelectBlock_(Workspace* ws, BlockIndex blockIndex) const;
+
+	void OnMakeArray_();
+	void OnMergeLines_() const;
+	void OnSimplifyPolylines_();
+	void OnUndoSimplify_() const;
+
 	void OnNodeLocation_();
+	void OnSetSaveGrid_();
 
 	void OnLinePatternButtonPressed_(LinePattern* pattern) const;
 
 	void OnChangeCurrentTab_(qint32 index) const;
 
+	void TrackLoader_(BlueprintLoader* loader) const;
+	void UpdateLoadStatus_() const;
+	BlueprintLoader* GetCurrentLoader_() const;
+
+	bool SaveWorkspace_(Workspace* ws, const QString& path, bool bAllowJournal) const;
+	BlueprintChunk::EncodingOptions GetSaveOptions_() const;
+	void OnSaveFinished_(Workspace* ws, bool bIsSuccessful, const QString& path, quint64 generation, bool bIsExact) const;
+	void RecoverJournal_(Workspace* ws) const;
+	void OnCompactJournals_() const;
+
 	void AddWorkspace_(Workspace* newWorkspace) const;
 	void DeleteWorkspace_(qint32 index) const;
 
+	//Savers of closed workspaces finish their jobs in the background, opening a file waits for the ones writing it
+	void RetireSaver_(std::unique_ptr<BlueprintSaver> saver) const;
+	void WaitForClosingSaves_(const QString& path) const;
+
 	QString GetFixedTabTitle_(const Workspace* ws) const;
 
 private:
 	std::unique_ptr<QPrinter> printer_;
 
+	std::unique_ptr<QTimer> journalCompactionTimer_;
+
 	std::unique_ptr<NodeSearcher> nodeSearcher_;
 
+	std::unique_ptr<BlueprintExporter> exporter_;
+
 	std::unique_ptr<QActionGroup> shapeSelectionGroup_;
 
 	std::unique_ptr<QLabel> coordinateLabel_;
 
 	std::unique_ptr<QLabel> shapeInfoLabel_;
 
+	std::unique_ptr<QLabel> saveStatusLabel_;
+
+	std::unique_ptr<QProgressBar> loadProgressBar_;
+
+	std::unique_ptr<QToolButton> cancelLoadButton_;
+
 	std::unique_ptr<DoubleSpinLabel> thicknessSpinLabel_;
 
 	std::unique_ptr<LinePattern> patternsMainButton_;
 
+	//Profiler time the current trace started at, -1 while not tracing
+	qint64 traceStart_;
+
+	//Step compressed saves round node positions to, in world units
+	double saveGrid_;
+
+	mutable std::vector<std::unique_ptr<BlueprintSaver>> closingSavers_;
+
+	std::unique_ptr<InputRecorder> inputRecorder_;
+
 public:
 	Workspace* GetCurrentWorkspace() const;
 
@@ -0,0 +1,372 @@
+#include "stdafx.h"
+
+#include "MappedDocument.h"
+
+#include "BlueprintPreview.h"
+#include "Profiler.h"
+
+#include <QPainter>
+#include <QPainterPath>
+
+MappedDocument::~MappedDocument()
+{
+	if (data_ != nullptr)
+		file_.unmap(const_cast<uchar*>(data_));
+}
+
+bool MappedDocument::Open(const QString& path, FormatType& type, PenStyleTable& styles)
+{
+	file_.setFileName(path);
+	if (!file_.open(QIODevice::ReadOnly))
+		return false;
+
+	const auto fileSize = file_.size();
+	const auto* mapped = file_.map(0, fileSize);
+	if (mapped == nullptr)
+		return false;
+
+	//Only the header and chunk directory are parsed, payloads stay untouched until used
+	const auto rawFile = QByteArray::fromRawData(reinterpret_cast<const char*>(mapped), fileSize);
+	QDataStream in(rawFile);
+	in.setVersion(QDataStream::Qt_6_2);
+
+	if (BlueprintFormat::ReadHeader(in) != BlueprintFormat::FileVersion::CHUNKED)
+	{
+		file_.unmap(const_cast<uchar*>(mapped));
+		return false;
+	}
+
+	BlueprintPreview::Skip(in);
+
+	in >> type;
+	styles.Deserialize(in);
+
+	//Instances and arrays live outside the chunks, documents with them are always loaded
+	quint32 blockCount, recordCount;
+	in >> blockCount >> recordCount;
+	if (blockCount != 0 || recordCount != 0)
+	{
+		file_.unmap(const_cast<uchar*>(mapped));
+		return false;
+	}
+
+	quint32 chunkCount;
+	in >> chunkCount;
+
+	//The directory is bounded by the file before anything is allocated for it
+	const auto directoryOffset = static_cast<quint64>(in.device()->pos());
+	if (in.status() != QDataStream::Ok
+		|| chunkCount > (static_cast<quint64>(fileSize) - directoryOffset) / BlueprintChunk::SerializedHeaderSize)
+	{
+		file_.unmap(const_cast<uchar*>(mapped));
+		return false;
+	}
+
+	chunks_.resize(chunkCount);
+	for (auto& chunk : chunks_)
+		BlueprintChunk::DeserializeHeader(in, chunk.header);
+
+	auto offset = static_cast<quint64>(in.device()->pos());
+	for (auto& chunk : chunks_)
+	{
+		const auto& header = chunk.header;
+		bool bIsValid = in.status() == QDataStream::Ok
+			&& header.encoding == BlueprintFormat::ChunkEncoding::RAW
+			&& BlueprintChunk::IsValidHeader(header)
+			&& header.byteSize <= static_cast<quint64>(fileSize) - offset;
+
+		const auto* payload = reinterpret_cast<const char*>(mapped) + offset;
+		if (bIsValid)
+		{
+			chunk.styles = payload;
+			chunk.counts = payload + header.shapeCount * sizeof(StyleIndex);
+			chunk.positions = chunk.counts + header.shapeCount * sizeof(quint32);
+
+			//Drawing and searching trust the counts, so they are checked once here
+			bIsValid = BlueprintChunk::IsValidTable(header, chunk.styles, chunk.counts, styles.GetSize());
+		}
+
+		if (!bIsValid)
+		{
+			chunks_.clear();
+			file_.unmap(const_cast<uchar*>(mapped));
+			return false;
+		}
+
+		chunk.erased.assign(header.shapeCount, false);
+
+		offset += header.byteSize;
+	}
+
+	data_ = mapped;
+	return true;
+}
+
+std::unique_ptr<Shape> MappedDocument::Materialize_(const Chunk& chunk, const size_t shapeIndex, const size_t firstNode) const
+{
+	auto result = Shape::Make(chunk.header.type);
+	if (result == nullptr)
+		return nullptr;
+
+	StyleIndex styleIndex;
+	std::memcpy(&styleIndex, chunk.styles + shapeIndex * sizeof(StyleIndex), sizeof(StyleIndex));
+
+	result->Restore(styleIndex, chunk.GetNodeCount(shapeIndex), [&](const size_t n)
+	{
+		return ReadPosition_(chunk.positions, firstNode + n);
+	});
+
+	return result;
+}
+
+void MappedDocument::RankLodLevels_(const Chunk& chunk)
+{
+	chunk.lodLevels.resize(chunk.header.nodeCount);
+
+	size_t firstNode = 0;
+	for (quint32 i = 0; i < chunk.header.shapeCount; i++)
+	{
+		const auto nodeCount = chunk.GetNodeCount(i);
+		Polyline::RankLodLevels(nodeCount, [&](const size_t n) { return ReadPosition_(chunk.positions, firstNode + n); }, chunk.lodLevels.data() + firstNode);
+
+		firstNode += nodeCount;
+	}
+}
+
+QRectF MappedDocument::GetShapeBounds_(const Chunk& chunk, const size_t shapeIndex, const size_t firstNode)
+{
+	const auto fPositionAt = [&](const size_t n) { return ReadPosition_(chunk.positions, firstNode + n); };
+
+	//Circles and sectors reach as far as their radius around the first node
+	const auto type = chunk.header.type;
+	if (type == Shape::Type::CIRCLE || type == Shape::Type::SECTOR)
+	{
+		const auto center = fPositionAt(0);
+		const auto radius = Vector2D::Distance(center, fPositionAt(1));
+		return QRectF(center - radius, center + radius);
+	}
+
+	//The other types stay within their nodes, curves included as their control points are nodes
+	auto min = fPositionAt(0);
+	auto max = min;
+	for (size_t n = 1; n < chunk.GetNodeCount(shapeIndex); n++)
+	{
+		const auto position = fPositionAt(n);
+		min = Vector2D(std::min(min.x, position.x), std::min(min.y, position.y));
+		max = Vector2D(std::max(max.x, position.x), std::max(max.y, position.y));
+	}
+
+	return QRectF(QPointF(min), QPointF(max));
+}
+
+QRectF MappedDocument::GetChunkBounds_(const Chunk& chunk)
+{
+	std::optional<QRectF> result;
+
+	size_t firstNode = 0;
+	for (quint32 i = 0; i < chunk.header.shapeCount; i++)
+	{
+		const auto bounds = GetShapeBounds_(chunk, i, firstNode);
+		result = result.has_value() ? result->united(bounds) : bounds;
+
+		firstNode += chunk.GetNodeCount(i);
+	}
+
+	return result.value_or(QRectF());
+}
+
+void MappedDocument::Draw(QPainter* painter, const QRectF& visibleArea, std::optional<StyleIndex>& currentStyle, const PenStyleTable& styles) const
+{
+	//Compared by hand, QRectF::intersects misses the empty bounds of straight lines
+	const auto fIsOutside = [&visibleArea](const QRectF& bounds)
+	{
+		return bounds.right() < visibleArea.left() || bounds.left() > visibleArea.right()
+			|| bounds.bottom() < visibleArea.top() || bounds.top() > visibleArea.bottom();
+	};
+
+	size_t drawnCount = 0;
+	size_t culledCount = 0;
+
+	for (const auto& chunk : chunks_)
+	{
+		//Whole chunks out of view are skipped without reading their shapes
+		if (!chunk.bounds.has_value())
+			chunk.bounds = GetChunkBounds_(chunk);
+
+		if (fIsOutside(*chunk.bounds))
+		{
+			culledCount += chunk.header.shapeCount;
+			continue;
+		}
+
+		if (chunk.header.type == Shape::Type::POLYLINE && chunk.lodLevels.size() != chunk.header.nodeCount)
+			RankLodLevels_(chunk);
+
+		size_t firstNode = 0;
+		for (quint32 i = 0; i < chunk.header.shapeCount; i++)
+		{
+			if (!chunk.erased[i])
+			{
+				if (fIsOutside(GetShapeBounds_(chunk, i, firstNode)))
+				{
+					culledCount++;
+				}
+				else
+				{
+					StyleIndex styleIndex;
+					std::memcpy(&styleIndex, chunk.styles + i * sizeof(StyleIndex), sizeof(StyleIndex));
+
+					if (currentStyle != styleIndex)
+					{
+						painter->setPen(styles.Get(styleIndex));
+						currentStyle = styleIndex;
+					}
+
+					DrawShape_(painter, chunk, i, firstNode);
+					drawnCount++;
+				}
+			}
+
+			firstNode += chunk.GetNodeCount(i);
+		}
+	}
+
+	Profiler::Count(ProfileCounter::SHAPES_DRAWN, drawnCount);
+	Profiler::Count(ProfileCounter::SHAPES_CULLED, culledCount);
+}
+
+void MappedDocument::DrawShape_(QPainter* painter, const Chunk& chunk, const size_t shapeIndex, const size_t firstNode) const
+{
+	const auto fPositionAt = [&](const size_t n) { return ReadPosition_(chunk.positions, firstNode + n); };
+
+	//The geometry each type builds in its Update, made on the stack from the mapped nodes
+	switch (chunk.header.type)
+	{
+	case Shape::Type::LINE:
+	{
+		const QLineF line(fPositionAt(0), fPositionAt(1));
+		painter->drawLines(&line, 1);
+		return;
+	}
+	case Shape::Type::BOX:
+	{
+		const QRectF rect(fPositionAt(0), fPositionAt(1));
+		painter->drawRects(&rect, 1);
+		return;
+	}
+	case Shape::Type::OVAL:
+		painter->drawEllipse(QRectF(fPositionAt(0), fPositionAt(1)));
+		return;
+	case Shape::Type::CIRCLE:
+		painter->drawEllipse(GetShapeBounds_(chunk, shapeIndex, firstNode));
+		return;
+	case Shape::Type::CURVE:
+	{
+		//A curve runs from its first to its second node, bent towards the third one
+		thread_local QPainterPath path;
+		path.clear();
+
+		const auto start = fPositionAt(0);
+		path.moveTo(start);
+		path.cubicTo(start, fPositionAt(2), fPositionAt(1));
+
+		painter->drawPath(path);
+		return;
+	}
+	case Shape::Type::POLYLINE:
+		Polyline::DrawLod(painter, chunk.GetNodeCount(shapeIndex), fPositionAt, [&](const size_t n) { return chunk.lodLevels[firstNode + n]; });
+		return;
+	default:
+		break;
+	}
+
+	//Sectors work out their angles in Update, they are drawn through a scratch shape
+	auto& scratch = scratchShapes_[static_cast<size_t>(chunk.header.type)];
+	if (scratch == nullptr)
+		scratch = Shape::Make(chunk.header.type);
+
+	StyleIndex styleIndex;
+	std::memcpy(&styleIndex, chunk.styles + shapeIndex * sizeof(StyleIndex), sizeof(StyleIndex));
+
+	scratch->Restore(styleIndex, chunk.GetNodeCount(shapeIndex), fPositionAt);
+	scratch->Draw(painter);
+}
+
+std::unique_ptr<Shape> MappedDocument::TakeShape(const Vector2D& atScreen,
+	const std::function<Vector2D(const Vector2D& v)>& WorldToScreen, size_t& hitNodeIndex)
+{
+	for (auto& chunk : chunks_)
+	{
+		size_t firstNode = 0;
+		for (quint32 i = 0; i < chunk.header.shapeCount; i++)
+		{
+			const auto nodeCount = chunk.GetNodeCount(i);
+			if (!chunk.erased[i])
+			{
+				for (size_t n = 0; n < nodeCount; n++)
+				{
+					const auto distanceToNode = Vector2D::Distance(atScreen, WorldToScreen(ReadPosition_(chunk.positions, firstNode + n)));
+					if (distanceToNode < 0.01)
+					{
+						chunk.erased[i] = true;
+						hitNodeIndex = n;
+
+						return Materialize_(chunk, i, firstNode);
+					}
+				}
+			}
+
+			firstNode += nodeCount;
+		}
+	}
+
+	return nullptr;
+}
+
+void MappedDocument::TakeAll(std::vector<std::shared_ptr<Shape>>& result)
+{
+	ForEachShape_([&](const Chunk& chunk, const size_t shapeIndex, const size_t firstNode)
+	{
+		auto newShape = Materialize_(chunk, shapeIndex, firstNode);
+		if (newShape != nullptr)
+			result.emplace_back(std::move(newShape));
+	});
+
+	for (auto& chunk : chunks_)
+		chunk.erased.assign(chunk.header.shapeCount, true);
+}
+
+size_t MappedDocument::GetMemoryUsage() const
+{
+	size_t result = chunks_.capacity() * sizeof(Chunk);
+	for (const auto& chunk : chunks_)
+		result += chunk.erased.capacity() / 8 + chunk.lodLevels.capacity();
+
+	for (const auto& scratch : scratchShapes_)
+	{
+		if (scratch != nullptr)
+			result += scratch->GetMemoryUsage().GetTotal();
+	}
+
+	return result;
+}
+
+size_t MappedDocument::ClearScratchShapes() const
+{
+	size_t result = 0;
+	for (auto& scratch : scratchShapes_)
+	{
+		if (scratch != nullptr)
+			result += scratch->GetMemoryUsage().GetTotal();
+
+		scratch.reset();
+	}
+
+	for (const auto& chunk : chunks_)
+	{
+		result += chunk.lodLevels.capacity();
+		chunk.lodLevels = {};
+	}
+
+	return result;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <vector>
+#include <array>
+#include <memory>
+#include <functional>
+#include <optional>
+#include <cstring>
+#include <QFile>
+
+#include "BlueprintChunk.h"
+#include "WorkspaceSettings.h"
+
+class QPainter;
+
+//Read-only view over a memory mapped chunked blueprint. Shapes are drawn and searched
+//straight from the mapped node arrays and only become Shape objects when taken for editing.
+class MappedDocument
+{
+public:
+	MappedDocument() = default;
+	~MappedDocument();
+
+	MappedDocument(const MappedDocument&) = delete;
+	MappedDocument& operator=(const MappedDocument&) = delete;
+
+	//Fails for anything but a chunked file with RAW chunks, in which case the caller falls back to a regular open
+	[[nodiscard]] bool Open(const QString& path, FormatType& type, PenStyleTable& styles);
+
+	//Draws the shapes reaching into visibleArea, which already allows for the widest pen
+	void Draw(QPainter* painter, const QRectF& visibleArea, std::optional<StyleIndex>& currentStyle, const PenStyleTable& styles) const;
+
+	template<typename F>
+	void ForEachNode(F&& fOnNode) const;
+
+	//Materializes the shape owning the node under atScreen and hides it from the mapped view
+	[[nodiscard]] std::unique_ptr<Shape> TakeShape(const Vector2D& atScreen,
+		const std::function<Vector2D(const Vector2D& v)>& WorldToScreen, size_t& hitNodeIndex);
+
+	//Materializes every remaining shape so the file can be released
+	void TakeAll(std::vector<std::shared_ptr<Shape>>& result);
+
+	//Heap bytes besides the mapping, which the system pages in and out on its own
+	size_t GetMemoryUsage() const;
+
+	//Drops the scratch shapes and polyline levels, drawing makes them again; returns the bytes released
+	size_t ClearScratchShapes() const;
+
+private:
+	struct Chunk
+	{
+		BlueprintChunk::Header header;
+		const char* styles{ nullptr };
+		const char* counts{ nullptr };
+		const char* positions{ nullptr };
+		std::vector<bool> erased;
+
+		//Display levels of every node of a polyline chunk, ranked the first time the chunk is drawn
+		mutable std::vector<quint8> lodLevels;
+
+		//Bounds of all shapes of the chunk, found the first time it is drawn; taking shapes out
+		//leaves them as they are, they still contain the rest
+		mutable std::optional<QRectF> bounds;
+
+		__forceinline quint32 GetNodeCount(const size_t shapeIndex) const { return BlueprintChunk::GetNodeCount(counts, shapeIndex); }
+	};
+
+	static Vector2D ReadPosition_(const char* positions, size_t nodeIndex);
+
+	template<typename F>
+	void ForEachShape_(F&& fOnShape) const;
+
+	std::unique_ptr<Shape> Materialize_(const Chunk& chunk, size_t shapeIndex, size_t firstNode) const;
+
+	static void RankLodLevels_(const Chunk& chunk);
+
+	static QRectF GetShapeBounds_(const Chunk& chunk, size_t shapeIndex, size_t firstNode);
+	static QRectF GetChunkBounds_(const Chunk& chunk);
+
+	void DrawShape_(QPainter* painter, const Chunk& chunk, size_t shapeIndex, size_t firstNode) const;
+
+	QFile file_;
+	const uchar* data_{ nullptr };
+
+	std::vector<Chunk> chunks_;
+
+	//One reusable shape per type for the few types not drawn from the mapped nodes directly
+	mutable std::array<std::unique_ptr<Shape>, Shape::TypeCount> scratchShapes_;
+
+public:
+	__forceinline bool IsOpen() const { return data_ != nullptr; }
+
+	__forceinline qint64 GetMappedSize() const { return file_.size(); }
+};
+
+__forceinline Vector2D MappedDocument::ReadPosition_(const char* positions, const size_t nodeIndex)
+{
+	double xy[2];
+	std::memcpy(xy, positions + nodeIndex * sizeof(xy), sizeof(xy));
+	return { xy[0], xy[1] };
+}
+
+template<typename F>
+void MappedDocument::ForEachShape_(F&& fOnShape) const
+{
+	for (const auto& chunk : chunks_)
+	{
+		size_t firstNode = 0;
+		for (quint32 i = 0; i < chunk.header.shapeCount; i++)
+		{
+			if (!chunk.erased[i])
+				fOnShape(chunk, i, firstNode);
+
+			firstNode += chunk.GetNodeCount(i);
+		}
+	}
+}
+
+template<typename F>
+void MappedDocument::ForEachNode(F&& fOnNode) const
+{
+	ForEachShape_([&](const Chunk& chunk, const size_t shapeIndex, const size_t firstNode)
+	{
+		for (size_t n = 0; n < chunk.GetNodeCount(shapeIndex); n++)
+			fOnNode(ReadPosition_(chunk.positions, firstNode + n));
+	});
+}
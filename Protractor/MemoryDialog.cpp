@@ -0,0 +1,138 @@
+#include "stdafx.h"
+
+#include "MemoryDialog.h"
+
+#include "Workspace.h"
+
+#include <optional>
+
+namespace
+{
+	__forceinline QString FormatBytes(const size_t bytes) { return QLocale().formattedDataSize(static_cast<qint64>(bytes)); }
+
+	QTreeWidgetItem* AddRow(QTreeWidgetItem* parent, const QString& name, const size_t bytes, const std::optional<size_t> count = std::nullopt)
+	{
+		auto* item = new QTreeWidgetItem(parent, { name, count.has_value() ? QString::number(*count) : QString(), FormatBytes(bytes) });
+		item->setTextAlignment(1, Qt::AlignRight | Qt::AlignVCenter);
+		item->setTextAlignment(2, Qt::AlignRight | Qt::AlignVCenter);
+		return item;
+	}
+
+	void AddUsageRows(QTreeWidgetItem* parent, const Shape::MemoryUsage& usage)
+	{
+		AddRow(parent, QObject::tr("Objects"), usage.object);
+		AddRow(parent, QObject::tr("Nodes"), usage.nodes);
+		AddRow(parent, QObject::tr("Cached geometry"), usage.geometry);
+	}
+}
+
+MemoryDialog::MemoryDialog(QWidget* parent, QTabWidget* documents)
+	: QDialog(parent),
+	documents_(documents)
+{
+	setupUi(this);
+
+	memoryTree->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+	memoryTree->header()->setSectionResizeMode(1, QHeaderView::ResizeToContents);
+	memoryTree->header()->setSectionResizeMode(2, QHeaderView::ResizeToContents);
+
+	connect(trimButton, &QPushButton::pressed, this, &MemoryDialog::OnTrimCaches_);
+	connect(refreshButton, &QPushButton::pressed, this, &MemoryDialog::Refresh_);
+	connect(exitButton, &QPushButton::pressed, [this] { done(QDialog::Rejected); });
+
+	Refresh_();
+}
+
+MemoryDialog::~MemoryDialog() {}
+
+void MemoryDialog::Refresh_()
+{
+	memoryTree->clear();
+
+	size_t total = 0;
+	size_t rebuildable = 0;
+	for (qint32 i = 0; i < documents_->count(); i++)
+	{
+		const auto* ws = dynamic_cast<Workspace*>(documents_->widget(i));
+		if (ws == nullptr)
+			continue;
+
+		const auto report = ws->GetMemoryReport();
+		AddDocument_(documents_->tabText(i), report);
+
+		total += report.GetTotal();
+		rebuildable += report.GetRebuildable();
+	}
+
+	statsLabel->setText(tr("%0 in %1 documents, %2 rebuildable")
+		.arg(FormatBytes(total)).arg(memoryTree->topLevelItemCount()).arg(FormatBytes(rebuildable)));
+}
+
+void MemoryDialog::OnTrimCaches_()
+{
+	size_t released = 0;
+	for (qint32 i = 0; i < documents_->count(); i++)
+	{
+		auto* ws = dynamic_cast<Workspace*>(documents_->widget(i));
+		if (ws != nullptr)
+			released += ws->TrimCaches();
+	}
+
+	Refresh_();
+	statsLabel->setText(tr("%0; released %1").arg(statsLabel->text(), FormatBytes(released)));
+}
+
+void MemoryDialog::AddDocument_(const QString& title, const MemoryReport& report) const
+{
+	const auto shapeTotal = report.GetShapeTotal();
+
+	size_t shapeCount = 0;
+	for (const auto count : report.shapeCounts)
+		shapeCount += count;
+
+	auto* document = new QTreeWidgetItem(memoryTree, { title, QString(), FormatBytes(report.GetTotal()) });
+	document->setTextAlignment(2, Qt::AlignRight | Qt::AlignVCenter);
+
+	auto* shapes = AddRow(document, tr("Shapes"), shapeTotal.GetTotal(), shapeCount);
+	for (size_t i = 0; i < Shape::TypeCount; i++)
+	{
+		if (report.shapeCounts[i] == 0)
+			continue;
+
+		auto* type = AddRow(shapes, MemoryReport::GetTypeName(static_cast<Shape::Type>(i)), report.shapes[i].GetTotal(), report.shapeCounts[i]);
+		AddUsageRows(type, report.shapes[i]);
+	}
+
+	if (report.editedShape.GetTotal() != 0)
+		AddRow(shapes, tr("being edited"), report.editedShape.GetTotal(), 1);
+
+	//The same bytes again, across all types
+	AddRow(shapes, tr("Node storage, all types"), shapeTotal.nodes);
+	AddRow(shapes, tr("Cached geometry, all types"), shapeTotal.geometry);
+
+	auto* shapeList = AddRow(document, tr("Shape list"), report.shapeList + report.shapeListSlack);
+	AddRow(shapeList, tr("Unused capacity"), report.shapeListSlack);
+
+	AddRow(document, tr("Pens"), report.pens);
+
+	auto* blocks = AddRow(document, tr("Blocks"), report.blocks.GetTotal(), report.blockCount);
+	AddUsageRows(blocks, report.blocks);
+
+	AddRow(document, tr("Block rasters"), report.blockRasters);
+
+	if (report.compactDocument != 0)
+		AddRow(document, tr("Compacted shapes"), report.compactDocument);
+
+	AddRow(document, tr("Prefetched snaps"), report.snapIndex);
+
+	if (report.simplifyUndo != 0)
+		AddRow(document, tr("Undo of the last simplification"), report.simplifyUndo);
+
+	if (report.mappedFile != 0)
+	{
+		auto* mapped = AddRow(document, tr("Mapped document"), report.mappedDocument);
+		AddRow(mapped, tr("Mapped file, paged by the system"), static_cast<size_t>(report.mappedFile))->setToolTip(0, tr("Not counted in the total"));
+	}
+
+	document->setExpanded(true);
+}
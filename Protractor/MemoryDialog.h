@@ -0,0 +1,28 @@
+#pragma once
+
+#include <QDialog>
+#include "ui_MemoryDialog.h"
+
+#include "MemoryReport.h"
+
+class QTabWidget;
+
+//Estimated memory of every open document, broken down by structure, with a way to release the
+//caches that are rebuilt when needed
+class MemoryDialog : public QDialog, public Ui::MemoryDialog
+{
+	Q_OBJECT
+
+public:
+	MemoryDialog(QWidget* parent, QTabWidget* documents);
+	virtual ~MemoryDialog();
+
+private:
+	void Refresh_();
+	void OnTrimCaches_();
+
+	void AddDocument_(const QString& title, const MemoryReport& report) const;
+
+private:
+	QTabWidget* documents_;
+};
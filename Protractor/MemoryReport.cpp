@@ -0,0 +1,80 @@
+#include "stdafx.h"
+
+#include "MemoryReport.h"
+
+namespace
+{
+	constexpr std::array<const char*, Shape::TypeCount> TypeNames = {
+		"line",
+		"box",
+		"circle",
+		"oval",
+		"curve",
+		"sector",
+		"polyline",
+		"instance",
+		"array" };
+
+	QJsonObject ToJson(const Shape::MemoryUsage& usage)
+	{
+		return {
+			{ "object", static_cast<qint64>(usage.object) },
+			{ "nodes", static_cast<qint64>(usage.nodes) },
+			{ "geometry", static_cast<qint64>(usage.geometry) },
+			{ "total", static_cast<qint64>(usage.GetTotal()) } };
+	}
+}
+
+const char* MemoryReport::GetTypeName(const Shape::Type type)
+{
+	return TypeNames[static_cast<size_t>(type)];
+}
+
+Shape::MemoryUsage MemoryReport::GetShapeTotal() const
+{
+	auto result = editedShape;
+	for (const auto& usage : shapes)
+		result += usage;
+
+	return result;
+}
+
+size_t MemoryReport::GetTotal() const
+{
+	return GetShapeTotal().GetTotal() + shapeList + shapeListSlack + pens
+		+ blocks.GetTotal() + blockRasters + compactDocument + snapIndex + simplifyUndo + mappedDocument;
+}
+
+QJsonObject MemoryReport::ToJson() const
+{
+	QJsonObject byType;
+	for (size_t i = 0; i < Shape::TypeCount; i++)
+	{
+		if (shapeCounts[i] == 0)
+			continue;
+
+		auto type = ::ToJson(shapes[i]);
+		type.insert("count", static_cast<qint64>(shapeCounts[i]));
+		byType.insert(TypeNames[i], type);
+	}
+
+	auto blockJson = ::ToJson(blocks);
+	blockJson.insert("count", static_cast<qint64>(blockCount));
+	blockJson.insert("rasters", static_cast<qint64>(blockRasters));
+
+	return {
+		{ "total", static_cast<qint64>(GetTotal()) },
+		{ "rebuildable", static_cast<qint64>(GetRebuildable()) },
+		{ "shapes", ::ToJson(GetShapeTotal()) },
+		{ "shapesByType", byType },
+		{ "editedShape", static_cast<qint64>(editedShape.GetTotal()) },
+		{ "shapeList", static_cast<qint64>(shapeList) },
+		{ "shapeListSlack", static_cast<qint64>(shapeListSlack) },
+		{ "pens", static_cast<qint64>(pens) },
+		{ "blocks", blockJson },
+		{ "compactDocument", static_cast<qint64>(compactDocument) },
+		{ "snapIndex", static_cast<qint64>(snapIndex) },
+		{ "simplifyUndo", static_cast<qint64>(simplifyUndo) },
+		{ "mappedDocument", static_cast<qint64>(mappedDocument) },
+		{ "mappedFile", mappedFile } };
+}
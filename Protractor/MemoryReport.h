@@ -0,0 +1,51 @@
+#pragma once
+
+#include <array>
+#include <QJsonObject>
+
+#include "Shape.h"
+
+//Estimated bytes held by one open document, from object sizes and container capacities.
+//Qt's implicitly shared data, e.g. a pen copied into two documents, is counted in each of them.
+struct MemoryReport
+{
+	//Committed shapes by type; the shape being edited is counted apart
+	std::array<size_t, Shape::TypeCount> shapeCounts{};
+	std::array<Shape::MemoryUsage, Shape::TypeCount> shapes{};
+	Shape::MemoryUsage editedShape;
+
+	//The document's list of shapes with their shared ownership, and its unused capacity
+	size_t shapeList{ 0 };
+	size_t shapeListSlack{ 0 };
+
+	size_t pens{ 0 };
+
+	size_t blockCount{ 0 };
+	Shape::MemoryUsage blocks;
+	size_t blockRasters{ 0 };
+
+	//Quantized nodes of a compacted document; its instances and arrays are counted with the shapes
+	size_t compactDocument{ 0 };
+
+	//Snap candidates prefetched around the predicted cursor
+	size_t snapIndex{ 0 };
+
+	//Shapes kept to undo the last simplification
+	size_t simplifyUndo{ 0 };
+
+	//Heap bookkeeping of a read-mostly open; the mapped file is paged by the system and not in the total
+	size_t mappedDocument{ 0 };
+	qint64 mappedFile{ 0 };
+
+	//Committed and edited shapes together
+	Shape::MemoryUsage GetShapeTotal() const;
+
+	size_t GetTotal() const;
+
+	//What Workspace::TrimCaches releases, it is rebuilt when needed
+	size_t GetRebuildable() const { return shapeListSlack + blockRasters + snapIndex; }
+
+	[[nodiscard]] QJsonObject ToJson() const;
+
+	static const char* GetTypeName(Shape::Type type);
+};
@@ -4,88 +4,327 @@
 
 #include "Workspace.h"
 #include "Shape.h"
+#include "MappedDocument.h"
+#include "TaskScheduler.h"
+#include "Profiler.h"
 
-NodeSearcher::NodeSearcher()
-	: atomicWs_(nullptr),
-	bNeedToShutDown_(false),
-	bIsSearchActive_(false),
-	thread_([&]()
+#include <thread>
+#include <algorithm>
+
+namespace
+{
+	//Nearest node to a screen position and the nodes closest to it along X and Y
+	class SnapAccumulator
+	{
+	public:
+		explicit SnapAccumulator(const Vector2D& target)
+			: target_(target), distanceToNearestNode_(1000000.0), toLines_(1000000.0) {}
+
+		void Visit(const Vector2D& worldPosition, const Vector2D& nodePosition)
 		{
-			while (!bNeedToShutDown_.load(std::memory_order_relaxed))
+			const auto distanceToNode = Vector2D::Distance(nodePosition, target_);
+			if (distanceToNode < distanceToNearestNode_)
 			{
-				std::unique_lock lk(NodeSearchMutex);
-				cv_.wait(lk, [this] { return bIsSearchActive_; });
-
-				const auto* ws = atomicWs_.load(std::memory_order_relaxed);
-				if (ws == nullptr)
-					continue;
-
-				Node* nearestNode = nullptr;
-				qreal distanceToNearestNode = 1000000.0;
-
-				Node* fromX = nullptr;
-				Node* fromY = nullptr;
-				Vector2D toLines(1000000.0);
-
-				for (const auto& shape : ws->shapes_)
-				{
-					for (auto& node : shape->GetNodes())
-					{
-						const auto nodePosition = ws->WorldToScreen(node.position);
-						const auto targetPosition = ws->targetPos_;
-						const auto distanceToNode = Vector2D::Distance(nodePosition, targetPosition);
-
-						if (distanceToNode < distanceToNearestNode)
-						{
-							nearestNode = &node;
-							distanceToNearestNode = distanceToNode;
-						}
-
-						const auto toNode = targetPosition - nodePosition;
-						if (toNode.Abs().x < toLines.Abs().x)
-						{
-							toLines.x = toNode.x;
-							fromX = &node;
-						}
-						if (toNode.Abs().y < toLines.Abs().y)
-						{
-							toLines.y = toNode.y;
-							fromY = &node;
-						}
-					}
-				}
-
-				std::make_tuple(nearestNode, fromX, fromY).swap(latestSearchResult_);
-
-				bIsSearchActive_ = false;
+				nearestNode_ = worldPosition;
+				distanceToNearestNode_ = distanceToNode;
 			}
-		})
+
+			const auto toNode = target_ - nodePosition;
+			if (toNode.Abs().x < toLines_.Abs().x)
+			{
+				toLines_.x = toNode.x;
+				fromX_ = worldPosition;
+			}
+			if (toNode.Abs().y < toLines_.Abs().y)
+			{
+				toLines_.y = toNode.y;
+				fromY_ = worldPosition;
+			}
+		}
+
+		NodeSearcher::SearchResult GetResult() const { return { nearestNode_, fromX_, fromY_ }; }
+
+	private:
+		Vector2D target_;
+
+		std::optional<Vector2D> nearestNode_;
+		qreal distanceToNearestNode_;
+
+		std::optional<Vector2D> fromX_;
+		std::optional<Vector2D> fromY_;
+		Vector2D toLines_;
+	};
+}
+
+NodeSearcher::NodeSearcher()
+	: atomicWs_(nullptr),
+	bIsSearchQueued_(false),
+	bIsPredictionEnabled_(false),
+	bIsSynchronous_(false),
+	prefetchWs_(nullptr),
+	runningPrefetchCount_(0)
 {
 }
-		NodeSearcher::~NodeSearcher()
-		{
-			bNeedToShutDown_.store(true, std::memory_order::memory_order_relaxed);
-			Run();
 
-			thread_.join();
+NodeSearcher::~NodeSearcher()
+{
+	prefetchToken_.Cancel();
+
+	//Queued searches still refer to this searcher, let them finish first
+	while (true)
+	{
+		{
+			std::scoped_lock lock(queryMutex_);
+			if (!bIsSearchQueued_ && runningPrefetchCount_.load(std::memory_order_acquire) == 0)
+				break;
 		}
 
-		void NodeSearcher::Run()
+		std::this_thread::yield();
+	}
+}
+
+std::optional<NodeSearcher::SearchResult> NodeSearcher::Search(const Query& query)
+{
+	{
+		std::scoped_lock lock(queryMutex_);
+		if (latestAnswer_.has_value() && latestAnswer_->first == query)
+			return latestAnswer_->second;
+	}
+
+	if (bIsPredictionEnabled_)
+	{
+		auto prefetched = Resolve(query);
+		if (prefetched.has_value())
+			return prefetched;
+	}
+
+	if (bIsSynchronous_ || IsSmall_(query.view.ws))
+		return SearchNow(query);
+
+	//Only the newest query is worth answering, a queued search picks it up when it starts
+	std::scoped_lock lock(queryMutex_);
+	pendingQuery_ = query;
+
+	if (!bIsSearchQueued_)
+	{
+		bIsSearchQueued_ = true;
+		TaskScheduler::Instance()->Post(TaskPriority::INTERACTIVE, [this]() { RunQueued_(); });
+	}
+
+	return std::nullopt;
+}
+
+void NodeSearcher::RunQueued_()
+{
+	while (true)
+	{
+		Query query;
 		{
-			if (atomicWs_ == nullptr || bIsSearchActive_)
+			std::scoped_lock lock(queryMutex_);
+			if (!pendingQuery_.has_value())
+			{
+				bIsSearchQueued_ = false;
 				return;
+			}
 
-			std::unique_lock lk(NodeSearchMutex);
-			bIsSearchActive_ = true;
-			cv_.notify_one();
+			query = *pendingQuery_;
+			pendingQuery_.reset();
 		}
 
-		NodeSearcher::SearchResult NodeSearcher::GetLatestSearchResult()
+		//The answer is stored and posted before the mutex is released, a workspace being destroyed
+		//detaches under it and drops the answer and its queued call along with itself
+		std::scoped_lock lock(NodeSearchMutex);
+
+		auto* ws = atomicWs_.load(std::memory_order_relaxed);
+		if (ws != query.view.ws)
+			continue;
+
+		const auto result = SearchNow(query);
+
+		{
+			std::scoped_lock queryLock(queryMutex_);
+			latestAnswer_.emplace(query, result);
+		}
+
+		//The workspace asks again with its current query, which only matches if nothing moved
+		QMetaObject::invokeMethod(ws, [ws, query]
 		{
-			std::unique_lock lk(NodeSearchMutex/*, std::try_to_lock*/);
+			ws->OnSnapAnswered_(query);
+		}, Qt::QueuedConnection);
+	}
+}
+
+NodeSearcher::SearchResult NodeSearcher::SearchNow(const Query& query)
+{
+	const ProfileScope profileScope(ProfileZone::SNAP_SEARCH);
+
+	const auto* ws = query.view.ws;
+
+	SnapAccumulator accumulator(query.cursor);
+	const auto fVisitNode = [&](const Vector2D& worldPosition)
+	{
+		accumulator.Visit(worldPosition, query.view.WorldToScreen(worldPosition));
+	};
 
-			SearchResult sr = { nullptr, nullptr, nullptr };
-			sr.swap(latestSearchResult_);
+	//Arrays offer the nodes of every copy without storing them
+	const std::function<void(const Vector2D&)> fVisitSnapPoint = fVisitNode;
+	for (const auto& shape : ws->shapes_)
+		shape->ForEachSnapPoint(fVisitSnapPoint);
+
+	if (ws->mappedDocument_ != nullptr)
+		ws->mappedDocument_->ForEachNode(fVisitNode);
+
+	return accumulator.GetResult();
+}
 
-			return sr;
-		}
\ No newline at end of file
+bool NodeSearcher::IsSmall_(const Workspace* ws)
+{
+	if (ws->mappedDocument_ != nullptr)
+		return false;
+
+	size_t snapPointCount = 0;
+	for (const auto& shape : ws->shapes_)
+	{
+		snapPointCount += shape->GetSnapPointCount();
+		if (snapPointCount > SyncSearchLimit)
+			return false;
+	}
+
+	return true;
+}
+
+void NodeSearcher::Prefetch(const View& view, const std::vector<Vector2D>& positions)
+{
+	prefetchToken_.Cancel();
+	prefetchToken_ = CancellationToken();
+	prefetchWs_ = view.ws;
+
+	for (const auto& position : positions)
+	{
+		//Jobs check the token themselves so every one of them is accounted for on shutdown
+		runningPrefetchCount_.fetch_add(1, std::memory_order_relaxed);
+		TaskScheduler::Instance()->Post(TaskPriority::INTERACTIVE, [this, view, position, token = prefetchToken_]()
+		{
+			if (!token.IsCancelled())
+				Gather_(view, position, token);
+
+			runningPrefetchCount_.fetch_sub(1, std::memory_order_release);
+		});
+	}
+}
+
+void NodeSearcher::Gather_(const View& view, const Vector2D& position, const CancellationToken& token)
+{
+	const ProfileScope profileScope(ProfileZone::SNAP_PREFETCH);
+
+	Candidates candidates{ view, position, {} };
+	constexpr auto bandWidth = SnapRadius + PrefetchMargin;
+
+	const auto fVisitNode = [&](const Vector2D& worldPosition)
+	{
+		const auto toNode = (view.WorldToScreen(worldPosition) - position).Abs();
+		if (toNode.x < bandWidth || toNode.y < bandWidth)
+			candidates.nodes.push_back(worldPosition);
+	};
+
+	{
+		std::scoped_lock lock(NodeSearchMutex);
+
+		//Candidates gathered after a later edit or view change keep the older view and never match
+		const auto* ws = atomicWs_.load(std::memory_order_relaxed);
+		if (ws != view.ws || token.IsCancelled())
+			return;
+
+		const std::function<void(const Vector2D&)> fVisitSnapPoint = fVisitNode;
+		for (const auto& shape : ws->shapes_)
+			shape->ForEachSnapPoint(fVisitSnapPoint);
+
+		if (ws->mappedDocument_ != nullptr)
+			ws->mappedDocument_->ForEachNode(fVisitNode);
+	}
+
+	std::scoped_lock lock(prefetchMutex_);
+
+	//A detached workspace cancels its round before it clears its candidates
+	if (token.IsCancelled())
+		return;
+
+	if (prefetched_.size() == MaxPrefetchCount)
+		prefetched_.erase(prefetched_.begin());
+
+	prefetched_.push_back(std::move(candidates));
+}
+
+std::optional<NodeSearcher::SearchResult> NodeSearcher::Resolve(const Query& query) const
+{
+	std::scoped_lock lock(prefetchMutex_);
+
+	//Newest first, it was predicted from the most recent moves
+	const auto it = std::find_if(prefetched_.rbegin(), prefetched_.rend(), [&](const Candidates& candidates)
+	{
+		return candidates.view == query.view && Vector2D::Distance(candidates.position, query.cursor) <= PrefetchMargin;
+	});
+
+	if (it == prefetched_.rend())
+	{
+		Profiler::Count(ProfileCounter::SNAP_PREFETCH_MISSES);
+		return std::nullopt;
+	}
+
+	Profiler::Count(ProfileCounter::SNAP_PREFETCH_HITS);
+
+	SnapAccumulator accumulator(query.cursor);
+	for (const auto& node : it->nodes)
+		accumulator.Visit(node, query.view.WorldToScreen(node));
+
+	return accumulator.GetResult();
+}
+
+size_t NodeSearcher::GetPrefetchMemoryUsage(const Workspace* ws) const
+{
+	std::scoped_lock lock(prefetchMutex_);
+
+	size_t result = 0;
+	for (const auto& candidates : prefetched_)
+	{
+		if (candidates.view.ws == ws)
+			result += sizeof(Candidates) + candidates.nodes.capacity() * sizeof(Vector2D);
+	}
+
+	return result;
+}
+
+size_t NodeSearcher::ClearPrefetched(const Workspace* ws)
+{
+	const auto result = GetPrefetchMemoryUsage(ws);
+
+	std::scoped_lock lock(prefetchMutex_);
+	std::erase_if(prefetched_, [ws](const Candidates& candidates) { return candidates.view.ws == ws; });
+
+	return result;
+}
+
+void NodeSearcher::Detach(const Workspace* ws)
+{
+	if (atomicWs_.load(std::memory_order_relaxed) == ws)
+		atomicWs_.store(nullptr, std::memory_order_relaxed);
+
+	{
+		std::scoped_lock lock(queryMutex_);
+
+		if (pendingQuery_.has_value() && pendingQuery_->view.ws == ws)
+			pendingQuery_.reset();
+
+		if (latestAnswer_.has_value() && latestAnswer_->first.view.ws == ws)
+			latestAnswer_.reset();
+	}
+
+	//Older rounds were cancelled when the newest one started
+	if (prefetchWs_ == ws)
+	{
+		prefetchToken_.Cancel();
+		prefetchWs_ = nullptr;
+	}
+
+	ClearPrefetched(ws);
+}
@@ -1,38 +1,129 @@
 #pragma once
 
-#include <thread>
 #include <mutex>
-#include <condition_variable>
 #include <atomic>
 #include <tuple>
+#include <optional>
+#include <vector>
+#include <utility>
+
+#include "TaskScheduler.h"
 
 class Workspace;
-class Node;
 
+//Snap search for the workspace under the cursor. Every request is an immutable Query and an
+//answer is only ever used for the query it was computed for. Small documents are searched on
+//the GUI thread straight away; larger ones as interactive jobs on the shared TaskScheduler, at
+//most one queued at a time, after which the workspace is asked to snap again.
+//In predictive mode snap candidates around where the cursor is heading are gathered ahead of
+//time, so the real position can be answered on the GUI thread without waiting for a search.
 class NodeSearcher
 {
 public:
 	static inline std::mutex NodeSearchMutex;
 
-	using SearchResult = std::tuple<Node*, Node*, Node*>;
+	//Positions of the nearest node and of the nodes closest along X and Y
+	using SearchResult = std::tuple<std::optional<Vector2D>, std::optional<Vector2D>, std::optional<Vector2D>>;
+
+	//Screen distance at which the cursor snaps to a node or lines up with one
+	static constexpr double SnapRadius = 20.0;
+
+	//Prefetched candidates answer any cursor within this screen distance of the predicted position
+	static constexpr double PrefetchMargin = 24.0;
+	static constexpr size_t MaxPrefetchCount = 6;
+
+	//Documents with at most this many snap points are searched on the GUI thread
+	static constexpr size_t SyncSearchLimit = 20000;
+
+	//Everything a screen-space snap depends on besides the cursor
+	struct View
+	{
+		const Workspace* ws;
+		Vector2D offset;
+		qreal scale;
+		quint64 generation;
+
+		bool operator==(const View&) const = default;
+
+		__forceinline Vector2D WorldToScreen(const Vector2D& world) const { return (world + offset) * scale; }
+	};
+
+	struct Query
+	{
+		View view;
+		Vector2D cursor;
+
+		bool operator==(const Query&) const = default;
+	};
 
 	NodeSearcher();
 
 	~NodeSearcher();
 
-	void Run();
+	//Answer for exactly this query if one can be given now, otherwise none and a search is queued
+	[[nodiscard]] std::optional<SearchResult> Search(const Query& query);
+
+	//Gathers snap candidates around the given screen positions, replacing the previous round;
+	//its jobs that have not finished yet are cancelled
+	void Prefetch(const View& view, const std::vector<Vector2D>& positions);
+
+	//Answers from the prefetched candidates if one covers the cursor in the query's view
+	[[nodiscard]] std::optional<SearchResult> Resolve(const Query& query) const;
+
+	//Bytes of the candidates prefetched for ws; dropping them only costs the next frames a search
+	size_t GetPrefetchMemoryUsage(const Workspace* ws) const;
+	size_t ClearPrefetched(const Workspace* ws);
+
+	//Forgets everything about a workspace that is being destroyed and cancels its prefetch jobs;
+	//NodeSearchMutex must be held
+	void Detach(const Workspace* ws);
+
+	//Searches every snap point of the query's workspace on the calling thread; off the GUI thread
+	//NodeSearchMutex must be held
+	[[nodiscard]] static SearchResult SearchNow(const Query& query);
 
 private:
+	struct Candidates
+	{
+		View view;
+		Vector2D position;
+
+		//World positions of the nodes in the horizontal and vertical bands around the position;
+		//any node a cursor within the margin could snap to or line up with lies in them
+		std::vector<Vector2D> nodes;
+	};
+
+	void RunQueued_();
+	void Gather_(const View& view, const Vector2D& position, const CancellationToken& token);
+
+	static bool IsSmall_(const Workspace* ws);
+
 	std::atomic<Workspace*> atomicWs_;
-	SearchResult latestSearchResult_;
 
-	std::atomic<bool> bNeedToShutDown_;
-	bool bIsSearchActive_;
-	std::condition_variable cv_;
-	std::thread	thread_;
+	//Newest query waiting for a worker and the newest answer along with its query
+	std::mutex queryMutex_;
+	std::optional<Query> pendingQuery_;
+	std::optional<std::pair<Query, SearchResult>> latestAnswer_;
+	bool bIsSearchQueued_;
+
+	bool bIsPredictionEnabled_;
+
+	//Every query is answered on the calling thread, e.g. for replays that must not depend on timing
+	bool bIsSynchronous_;
+
+	CancellationToken prefetchToken_;
+	const Workspace* prefetchWs_;
+	std::atomic<size_t> runningPrefetchCount_;
+
+	mutable std::mutex prefetchMutex_;
+	std::vector<Candidates> prefetched_;
 public:
 	Workspace* GetWorkspace() const { return atomicWs_.load(std::memory_order_relaxed); }
 	void SetWorkspace(Workspace* newWs) { atomicWs_.store(newWs, std::memory_order_relaxed); }
 
-	SearchResult GetLatestSearchResult();
+	bool IsPredictionEnabled() const { return bIsPredictionEnabled_; }
+	void SetPredictionEnabled(const bool bIsEnabled) { bIsPredictionEnabled_ = bIsEnabled; }
+
+	bool IsSynchronous() const { return bIsSynchronous_; }
+	void SetSynchronous(const bool bIsEnabled) { bIsSynchronous_ = bIsEnabled; }
 };
\ No newline at end of file
@@ -0,0 +1,55 @@
+#include "stdafx.h"
+
+#include "PenStyleTable.h"
+
+#include <limits>
+#include <ranges>
+
+StyleIndex PenStyleTable::Intern(const QPen& pen)
+{
+	//A document only uses a handful of thickness/pattern combinations, so a linear scan is enough
+	const auto it = std::ranges::find(pens_, pen);
+	if (it != pens_.end())
+		return static_cast<StyleIndex>(it - pens_.begin());
+
+	Q_ASSERT(pens_.size() < std::numeric_limits<StyleIndex>::max());
+
+	pens_.push_back(pen);
+	return static_cast<StyleIndex>(pens_.size() - 1);
+}
+
+void PenStyleTable::Serialize(QDataStream& out) const
+{
+	out << static_cast<quint32>(pens_.size());
+
+	for (const auto& pen : pens_)
+		out << pen;
+}
+
+void PenStyleTable::Deserialize(QDataStream& in)
+{
+	quint32 penCount;
+	in >> penCount;
+
+	//Shapes cannot refer to more pens than a StyleIndex counts
+	if (penCount > static_cast<quint32>(std::numeric_limits<StyleIndex>::max()) + 1)
+	{
+		in.setStatus(QDataStream::ReadCorruptData);
+		pens_.clear();
+		return;
+	}
+
+	pens_.assign(penCount, QPen());
+	for (auto& pen : pens_)
+		in >> pen;
+}
+
+size_t PenStyleTable::GetMemoryUsage() const
+{
+	size_t result = pens_.capacity() * sizeof(QPen);
+
+	for (const auto& pen : pens_)
+		result += static_cast<size_t>(pen.dashPattern().size()) * sizeof(qreal);
+
+	return result;
+}
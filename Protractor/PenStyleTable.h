@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include <QPen>
+
+using StyleIndex = quint16;
+
+//Per-document palette of pens; shapes refer to their pen by index
+class PenStyleTable
+{
+public:
+	PenStyleTable() = default;
+
+	StyleIndex Intern(const QPen& pen);
+
+	void Clear() { pens_.clear(); }
+
+	void Serialize(QDataStream& out) const;
+	void Deserialize(QDataStream& in);
+
+	size_t GetMemoryUsage() const;
+
+private:
+	std::vector<QPen> pens_;
+
+public:
+	__forceinline const QPen& Get(const StyleIndex index) const { return pens_[index]; }
+
+	__forceinline size_t GetSize() const { return pens_.size(); }
+
+	__forceinline const std::vector<QPen>& GetPens() const { return pens_; }
+};
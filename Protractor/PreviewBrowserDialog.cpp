@@ -0,0 +1,115 @@
+#include "stdafx.h"
+
+#include "PreviewBrowserDialog.h"
+
+#include <QDirIterator>
+
+PreviewBrowserDialog::PreviewBrowserDialog(QWidget* parent)
+	: QDialog(parent)
+{
+	setupUi(this);
+
+	constexpr auto iconSize = BlueprintPreview::ThumbnailSize / 2;
+	previewList->setIconSize(QSize(iconSize, iconSize));
+	previewList->setGridSize(QSize(iconSize + 32, iconSize + 40));
+
+	connect(browseButton, &QPushButton::pressed, this, &PreviewBrowserDialog::OnBrowse_);
+	connect(previewList, &QListWidget::itemSelectionChanged, this, &PreviewBrowserDialog::OnSelectionChanged_);
+	connect(previewList, &QListWidget::itemDoubleClicked, [this] { done(QDialog::Accepted); });
+	connect(openButton, &QPushButton::pressed, [this] { done(QDialog::Accepted); });
+	connect(exitButton, &QPushButton::pressed, [this] { done(QDialog::Rejected); });
+
+	openButton->setEnabled(false);
+}
+
+PreviewBrowserDialog::~PreviewBrowserDialog()
+{
+	StopScan_();
+}
+
+void PreviewBrowserDialog::SetDirectory(const QString& directory)
+{
+	StopScan_();
+
+	previewList->clear();
+	directoryEdit->setText(directory);
+
+	scanToken_ = CancellationToken();
+
+	//Items are listed up front in directory order, their previews arrive in any order
+	QDirIterator it(directory, { "*.prob" }, QDir::Files);
+	while (it.hasNext())
+	{
+		const auto path = it.next();
+
+		auto* item = new QListWidgetItem(QFileInfo(path).fileName(), previewList);
+		item->setData(Qt::UserRole, path);
+
+		//Thumbnails are on screen and waiting to be drawn, they go ahead of saves and loads
+		TaskScheduler::Instance()->Post(TaskPriority::RENDER, [path]
+		{
+			return BlueprintPreview::ReadFromFile(path);
+		}, this, [this, item](std::optional<BlueprintPreview>&& preview)
+		{
+			SetPreview_(item, preview);
+		}, scanToken_);
+	}
+}
+
+QString PreviewBrowserDialog::GetSelectedPath() const
+{
+	const auto* item = previewList->currentItem();
+	if (item == nullptr)
+		return QString();
+
+	return item->data(Qt::UserRole).toString();
+}
+
+void PreviewBrowserDialog::OnBrowse_()
+{
+	const auto directory = QFileDialog::getExistingDirectory(this, tr("Select Blueprint Directory"), directoryEdit->text());
+	if (!directory.isEmpty())
+		SetDirectory(directory);
+}
+
+void PreviewBrowserDialog::OnSelectionChanged_() const
+{
+	const auto* item = previewList->currentItem();
+
+	openButton->setEnabled(item != nullptr);
+	statsLabel->setText(item != nullptr ? item->toolTip() : QString());
+}
+
+void PreviewBrowserDialog::StopScan_()
+{
+	//Pending reads are skipped and finished ones never reach the cleared list
+	scanToken_.Cancel();
+}
+
+void PreviewBrowserDialog::SetPreview_(QListWidgetItem* item, const std::optional<BlueprintPreview>& preview) const
+{
+	if (preview.has_value())
+	{
+		if (!preview->thumbnail.isNull())
+			item->setIcon(QIcon(QPixmap::fromImage(preview->thumbnail)));
+
+		item->setToolTip(GetStatsAsString_(*preview));
+	}
+	else
+	{
+		item->setToolTip(tr("No preview, saved by an older version"));
+	}
+}
+
+QString PreviewBrowserDialog::GetStatsAsString_(const BlueprintPreview& preview)
+{
+	const auto size = Vector2D(preview.bounds.width(), preview.bounds.height())
+		* WorkspaceSettings::Instance()->GetFactor(preview.type);
+
+	return QString("%0\tShapes: %1\tNodes: %2\tExtent: %3 x %4")
+		.arg(preview.type == FormatType::A3 ? "A3" : "A4")
+		.arg(preview.shapeCount)
+		.arg(preview.nodeCount)
+		.arg(size.x, 0, 'f', 1)
+		.arg(size.y, 0, 'f', 1);
+}
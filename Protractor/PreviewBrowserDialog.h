@@ -0,0 +1,36 @@
+#pragma once
+
+#include <QDialog>
+#include "ui_PreviewBrowserDialog.h"
+
+#include <optional>
+
+#include "BlueprintPreview.h"
+#include "TaskScheduler.h"
+
+//Quick-open browser: shows the embedded previews of every blueprint in a directory.
+//Only the preview blocks are read, as background jobs, so large directories fill in progressively.
+class PreviewBrowserDialog : public QDialog, public Ui::PreviewBrowserDialog
+{
+	Q_OBJECT
+
+public:
+	PreviewBrowserDialog(QWidget* parent);
+	virtual ~PreviewBrowserDialog();
+
+	void SetDirectory(const QString& directory);
+
+	QString GetSelectedPath() const;
+
+private:
+	void OnBrowse_();
+	void OnSelectionChanged_() const;
+
+	void StopScan_();
+	void SetPreview_(QListWidgetItem* item, const std::optional<BlueprintPreview>& preview) const;
+
+	static QString GetStatsAsString_(const BlueprintPreview& preview);
+
+private:
+	CancellationToken scanToken_;
+};
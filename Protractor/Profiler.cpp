@@ -0,0 +1,330 @@
+#include "stdafx.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+
+namespace
+{
+	//Packed slot word: zone in the low byte, thread id above it and the duration in the top 40 bits
+	constexpr int ZoneBits = 8;
+	constexpr int ThreadBits = 16;
+	constexpr int DurationShift = ZoneBits + ThreadBits;
+	constexpr quint64 ZoneMask = (1ull << ZoneBits) - 1;
+	constexpr quint64 ThreadMask = (1ull << ThreadBits) - 1;
+	constexpr qint64 MaxDuration = (1ll << (64 - DurationShift)) - 1;
+
+	//Trace timestamps are microseconds
+	__forceinline double ToMicroseconds(const qint64 nanoseconds) { return nanoseconds / 1000.0; }
+
+	constexpr std::array<const char*, static_cast<size_t>(ProfileZone::Count)> ZoneNames = {
+		"Paint",
+		"Draw shapes",
+		"Snap search",
+		"Snap prefetch",
+		"Serialize",
+		"Deserialize",
+		"Print",
+		"Draw line",
+		"Draw box",
+		"Draw circle",
+		"Draw oval",
+		"Draw curve",
+		"Draw sector",
+		"Draw polyline",
+		"Draw instance",
+		"Draw array" };
+
+	constexpr std::array<const char*, static_cast<size_t>(LatencyPath::Count)> LatencyPathNames = {
+		"move",
+		"snap",
+		"click",
+		"wheel" };
+}
+
+Profiler* Profiler::Instance()
+{
+	//Never destroyed: pool threads may still record or exit during static destruction
+	static auto* profiler = new Profiler();
+	return profiler;
+}
+
+Profiler::Profiler()
+{
+}
+
+void Profiler::SetEnabled(const bool bIsEnabled)
+{
+	bIsEnabled_.store(bIsEnabled, std::memory_order_relaxed);
+}
+
+const char* Profiler::GetZoneName(const ProfileZone zone)
+{
+	return ZoneNames[static_cast<size_t>(zone)];
+}
+
+const char* Profiler::GetLatencyPathName(const LatencyPath path)
+{
+	return LatencyPathNames[static_cast<size_t>(path)];
+}
+
+void Profiler::SetThreadName(const QString& name)
+{
+	auto& buffer = GetThreadBuffer_();
+
+	std::scoped_lock lock(buffersMutex_);
+	buffer.threadName = name;
+}
+
+void Profiler::Record(const ProfileZone zone, const qint64 start, const qint64 duration)
+{
+	const auto zoneIndex = static_cast<size_t>(zone);
+	zoneCounts_[zoneIndex].fetch_add(1, std::memory_order_relaxed);
+	zoneDurations_[zoneIndex].fetch_add(duration, std::memory_order_relaxed);
+
+	if (!IsTimelineZone(zone))
+		return;
+
+	auto& buffer = GetThreadBuffer_();
+
+	//Only this thread writes the buffer; readers may see a slot being overwritten, which at worst
+	//mixes two spans of the same thread
+	const auto index = buffer.writeCount.load(std::memory_order_relaxed);
+	auto& slot = buffer.ring[index % RingSize];
+	slot.start.store(start, std::memory_order_relaxed);
+	slot.packed.store(static_cast<quint64>(std::min(duration, MaxDuration)) << DurationShift
+		| static_cast<quint64>(buffer.threadId) << ZoneBits | zoneIndex, std::memory_order_relaxed);
+	buffer.writeCount.store(index + 1, std::memory_order_release);
+}
+
+std::vector<qint64> Profiler::GetDurations(const ProfileZone zone, const qint64 since) const
+{
+	std::vector<qint64> result;
+
+	std::scoped_lock lock(buffersMutex_);
+	for (const auto& buffer : buffers_)
+	{
+		const auto writeCount = buffer->writeCount.load(std::memory_order_acquire);
+		const auto spanCount = std::min<quint64>(writeCount, RingSize);
+
+		for (quint64 i = writeCount - spanCount; i < writeCount; i++)
+		{
+			const auto& slot = buffer->ring[i % RingSize];
+			const auto packed = slot.packed.load(std::memory_order_relaxed);
+			if ((packed & ZoneMask) == static_cast<size_t>(zone) && slot.start.load(std::memory_order_relaxed) >= since)
+				result.push_back(static_cast<qint64>(packed >> DurationShift));
+		}
+	}
+
+	return result;
+}
+
+std::vector<Profiler::Span> Profiler::GetSpans(const qint64 since, const qint64 until) const
+{
+	std::vector<Span> result;
+
+	{
+		std::scoped_lock lock(buffersMutex_);
+		for (const auto& buffer : buffers_)
+		{
+			const auto writeCount = buffer->writeCount.load(std::memory_order_acquire);
+			const auto spanCount = std::min<quint64>(writeCount, RingSize);
+
+			for (quint64 i = writeCount - spanCount; i < writeCount; i++)
+			{
+				const auto& slot = buffer->ring[i % RingSize];
+				const auto start = slot.start.load(std::memory_order_relaxed);
+				if (start < since || start >= until)
+					continue;
+
+				const auto packed = slot.packed.load(std::memory_order_relaxed);
+				result.push_back({
+					static_cast<ProfileZone>(packed & ZoneMask),
+					static_cast<quint16>(packed >> ZoneBits & ThreadMask),
+					start,
+					static_cast<qint64>(packed >> DurationShift) });
+			}
+		}
+	}
+
+	std::ranges::sort(result, {}, &Span::start);
+	return result;
+}
+
+bool Profiler::WriteChromeTrace(const QString& path, const qint64 since, const qint64 until, const QJsonObject& metadata) const
+{
+	const auto spans = GetSpans(since, until);
+
+	std::vector<std::pair<quint16, QString>> threadNames;
+	{
+		std::scoped_lock lock(buffersMutex_);
+		for (const auto& buffer : buffers_)
+			threadNames.emplace_back(buffer->threadId, buffer->threadName);
+	}
+
+	QJsonArray events;
+	events.append(QJsonObject{
+		{ "name", "process_name" }, { "ph", "M" }, { "pid", 1 },
+		{ "args", QJsonObject{ { "name", "Protractor" } } } });
+
+	for (const auto& [threadId, threadName] : threadNames)
+	{
+		events.append(QJsonObject{
+			{ "name", "thread_name" }, { "ph", "M" }, { "pid", 1 }, { "tid", static_cast<qint32>(threadId) },
+			{ "args", QJsonObject{ { "name", threadName } } } });
+	}
+
+	//Complete events relative to the window start, so the timeline opens at zero
+	for (const auto& span : spans)
+	{
+		events.append(QJsonObject{
+			{ "name", GetZoneName(span.zone) }, { "cat", "protractor" }, { "ph", "X" },
+			{ "ts", ToMicroseconds(span.start - since) }, { "dur", ToMicroseconds(span.duration) },
+			{ "pid", 1 }, { "tid", span.threadId } });
+	}
+
+	QJsonObject otherData = metadata;
+	otherData.insert("windowMs", (until - since) / 1e6);
+	otherData.insert("spanCount", static_cast<qint64>(spans.size()));
+	otherData.insert("latency", GetLatencyReport());
+
+	const QJsonObject trace{
+		{ "traceEvents", events },
+		{ "displayTimeUnit", "ms" },
+		{ "otherData", otherData } };
+
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+
+	return file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact)) != -1;
+}
+
+void Profiler::RecordLatency(const LatencyPath path, const qint64 latency)
+{
+	const auto bucket = std::min(static_cast<size_t>(std::max<qint64>(latency, 0) / LatencyBucketWidth), LatencyBucketCount - 1);
+	latencyHistograms_[static_cast<size_t>(path)][bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+Profiler::LatencyHistogram Profiler::GetLatencyHistogram(const LatencyPath path) const
+{
+	const auto& source = latencyHistograms_[static_cast<size_t>(path)];
+
+	LatencyHistogram result;
+	for (size_t i = 0; i < LatencyBucketCount; i++)
+		result[i] = source[i].load(std::memory_order_relaxed);
+
+	return result;
+}
+
+double Profiler::GetPercentile(const LatencyHistogram& histogram, const double fraction)
+{
+	const auto sampleCount = GetSampleCount(histogram);
+	if (sampleCount == 0)
+		return 0.0;
+
+	const auto rank = static_cast<quint64>(std::ceil(fraction * static_cast<double>(sampleCount)));
+
+	quint64 seen = 0;
+	for (size_t i = 0; i < LatencyBucketCount; i++)
+	{
+		seen += histogram[i];
+		if (seen >= rank)
+			return static_cast<double>((i + 1) * LatencyBucketWidth) / 1e6;
+	}
+
+	return static_cast<double>(LatencyBucketCount * LatencyBucketWidth) / 1e6;
+}
+
+quint64 Profiler::GetSampleCount(const LatencyHistogram& histogram)
+{
+	quint64 result = 0;
+	for (const auto count : histogram)
+		result += count;
+
+	return result;
+}
+
+QJsonObject Profiler::GetLatencyReport() const
+{
+	QJsonObject paths;
+	for (size_t i = 0; i < static_cast<size_t>(LatencyPath::Count); i++)
+	{
+		const auto path = static_cast<LatencyPath>(i);
+		const auto histogram = GetLatencyHistogram(path);
+
+		//Trailing empty buckets are left out
+		const auto usedCount = static_cast<size_t>(std::distance(histogram.begin(), std::find_if(histogram.rbegin(), histogram.rend(),
+			[](const quint64 count) { return count != 0; }).base()));
+
+		QJsonArray counts;
+		for (size_t bucket = 0; bucket < usedCount; bucket++)
+			counts.append(static_cast<qint64>(histogram[bucket]));
+
+		paths.insert(GetLatencyPathName(path), QJsonObject{
+			{ "count", static_cast<qint64>(GetSampleCount(histogram)) },
+			{ "p50Ms", GetPercentile(histogram, 0.50) },
+			{ "p95Ms", GetPercentile(histogram, 0.95) },
+			{ "p99Ms", GetPercentile(histogram, 0.99) },
+			{ "buckets", counts } });
+	}
+
+	return {
+		{ "bucketMs", LatencyBucketWidth / 1e6 },
+		{ "paths", paths },
+		{ "inputEvents", static_cast<qint64>(GetCounter(ProfileCounter::INPUT_EVENTS)) },
+		{ "coalescedEvents", static_cast<qint64>(GetCounter(ProfileCounter::INPUT_COALESCED)) },
+		{ "supersededFrames", static_cast<qint64>(GetCounter(ProfileCounter::FRAMES_SUPERSEDED)) },
+		{ "staleSnapAnswers", static_cast<qint64>(GetCounter(ProfileCounter::SNAP_ANSWERS_STALE)) } };
+}
+
+Profiler::ZoneTotals Profiler::GetTotals(const ProfileZone zone) const
+{
+	const auto zoneIndex = static_cast<size_t>(zone);
+	return { zoneCounts_[zoneIndex].load(std::memory_order_relaxed), zoneDurations_[zoneIndex].load(std::memory_order_relaxed) };
+}
+
+Profiler::ThreadBuffer& Profiler::GetThreadBuffer_()
+{
+	//Buffers outlive their threads, a finished thread's buffer is handed to the next new one together
+	//with its id, so ids and names stay bounded by the most threads alive at once
+	struct Holder
+	{
+		std::shared_ptr<ThreadBuffer> buffer;
+
+		~Holder()
+		{
+			if (buffer == nullptr)
+				return;
+
+			auto* profiler = Profiler::Instance();
+			std::scoped_lock lock(profiler->buffersMutex_);
+			profiler->freeBuffers_.push_back(std::move(buffer));
+		}
+	};
+
+	thread_local Holder holder;
+	if (holder.buffer != nullptr)
+		return *holder.buffer;
+
+	std::scoped_lock lock(buffersMutex_);
+	if (!freeBuffers_.empty())
+	{
+		holder.buffer = std::move(freeBuffers_.back());
+		freeBuffers_.pop_back();
+	}
+	else
+	{
+		holder.buffer = std::make_shared<ThreadBuffer>();
+		holder.buffer->threadId = static_cast<quint16>(buffers_.size() & ThreadMask);
+		buffers_.push_back(holder.buffer);
+	}
+
+	holder.buffer->threadName = QString("Thread %0").arg(holder.buffer->threadId);
+
+	return *holder.buffer;
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <array>
+#include <chrono>
+#include <QString>
+#include <QJsonObject>
+
+#include "Shape.h"
+
+//Instrumented hot paths. Spans of the timeline zones are kept per thread for the overlay;
+//shape draws are far too many for that and are only summed.
+enum class ProfileZone : uint8_t
+{
+	PAINT,
+	DRAW_SHAPES,
+	SNAP_SEARCH,
+	SNAP_PREFETCH,
+	SERIALIZE,
+	DESERIALIZE,
+	PRINT,
+
+	DRAW_SHAPE,
+	DrawShapeLast = DRAW_SHAPE + Shape::TypeCount - 1,
+
+	Count
+};
+
+enum class ProfileCounter : uint8_t
+{
+	SHAPES_DRAWN,
+	SHAPES_CULLED,
+	SNAP_PREFETCH_HITS,
+	SNAP_PREFETCH_MISSES,
+	BLOCK_RASTER_HITS,
+	BLOCK_RASTER_MISSES,
+
+	//Timed mouse events reaching the workspace, moves merged into one still waiting for its frame,
+	//frames replaced by a newer one before they were painted and snap answers that came too late
+	INPUT_EVENTS,
+	INPUT_COALESCED,
+	FRAMES_SUPERSEDED,
+	SNAP_ANSWERS_STALE,
+
+	Count
+};
+
+//Input-to-photon paths, each timed from the mouse event reaching the workspace to the end of the
+//paint that first shows its effect
+enum class LatencyPath : uint8_t
+{
+	MOVE,	//Cursor, rubber band and edited node follow the mouse
+	SNAP,	//Snap shown after waiting for a queued search
+	CLICK,	//Shape placed or picked on release
+	WHEEL,	//Zoom
+
+	Count
+};
+
+//Always compiled in; while disabled a scope costs one relaxed atomic load
+class Profiler
+{
+	Profiler();
+
+public:
+	static Profiler* Instance();
+
+	//Spans kept per thread, older ones are overwritten: about nine minutes of continuous painting
+	static constexpr size_t RingSize = 65536;
+
+	//Latency histograms have buckets of 0.25 ms up to 250 ms, the last bucket takes anything longer
+	static constexpr qint64 LatencyBucketWidth = 250'000;
+	static constexpr size_t LatencyBucketCount = 1000;
+
+	using LatencyHistogram = std::array<quint64, LatencyBucketCount>;
+
+	struct Span
+	{
+		ProfileZone zone;
+		quint16 threadId;
+		qint64 start;
+		qint64 duration;
+	};
+
+	struct ZoneTotals
+	{
+		quint64 count;
+		qint64 duration;
+	};
+
+	static bool IsEnabled() { return bIsEnabled_.load(std::memory_order_relaxed); }
+	static void SetEnabled(bool bIsEnabled);
+
+	//Nanoseconds on a steady clock
+	static qint64 Now() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+	static constexpr ProfileZone GetDrawZone(const Shape::Type type) { return static_cast<ProfileZone>(static_cast<size_t>(ProfileZone::DRAW_SHAPE) + static_cast<size_t>(type)); }
+	static constexpr bool IsTimelineZone(const ProfileZone zone) { return zone < ProfileZone::DRAW_SHAPE; }
+
+	static const char* GetZoneName(ProfileZone zone);
+	static const char* GetLatencyPathName(LatencyPath path);
+
+	//Names the calling thread in traces, unnamed ones appear as "Thread <id>"
+	void SetThreadName(const QString& name);
+
+	void Record(ProfileZone zone, qint64 start, qint64 duration);
+
+	static void Count(const ProfileCounter counter, const quint64 amount = 1)
+	{
+		if (IsEnabled())
+			Instance()->counters_[static_cast<size_t>(counter)].fetch_add(amount, std::memory_order_relaxed);
+	}
+
+	//Durations of the zone's spans that started at or after the given time, from every thread
+	[[nodiscard]] std::vector<qint64> GetDurations(ProfileZone zone, qint64 since) const;
+
+	//Spans of every thread that started within [since, until), oldest first
+	[[nodiscard]] std::vector<Span> GetSpans(qint64 since, qint64 until) const;
+
+	//Chrome trace-event JSON of the spans within the window, loadable in chrome://tracing and Perfetto
+	[[nodiscard]] bool WriteChromeTrace(const QString& path, qint64 since, qint64 until, const QJsonObject& metadata) const;
+
+	void RecordLatency(LatencyPath path, qint64 latency);
+
+	[[nodiscard]] LatencyHistogram GetLatencyHistogram(LatencyPath path) const;
+
+	//Upper edge of the bucket holding the given fraction of the samples, in milliseconds
+	[[nodiscard]] static double GetPercentile(const LatencyHistogram& histogram, double fraction);
+	[[nodiscard]] static quint64 GetSampleCount(const LatencyHistogram& histogram);
+
+	//Histograms and percentiles of every path along with the input counters
+	[[nodiscard]] QJsonObject GetLatencyReport() const;
+
+	[[nodiscard]] ZoneTotals GetTotals(ProfileZone zone) const;
+	[[nodiscard]] quint64 GetCounter(ProfileCounter counter) const { return counters_[static_cast<size_t>(counter)].load(std::memory_order_relaxed); }
+
+private:
+	//Zone, thread and duration are packed into one word so a slot is written with two stores
+	struct Slot
+	{
+		std::atomic<qint64> start{ 0 };
+		std::atomic<quint64> packed{ 0 };
+	};
+
+	//A buffer is one trace thread: its id and name go with it when a finished thread's buffer is reused
+	struct ThreadBuffer
+	{
+		std::unique_ptr<Slot[]> ring{ new Slot[RingSize] };
+		std::atomic<quint64> writeCount{ 0 };
+		quint16 threadId{ 0 };
+		QString threadName;
+	};
+
+	ThreadBuffer& GetThreadBuffer_();
+
+	static inline std::atomic<bool> bIsEnabled_{ false };
+
+	mutable std::mutex buffersMutex_;
+	std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+	std::vector<std::shared_ptr<ThreadBuffer>> freeBuffers_;
+
+	std::array<std::atomic<quint64>, static_cast<size_t>(ProfileZone::Count)> zoneCounts_{};
+	std::array<std::atomic<qint64>, static_cast<size_t>(ProfileZone::Count)> zoneDurations_{};
+	std::array<std::atomic<quint64>, static_cast<size_t>(ProfileCounter::Count)> counters_{};
+	std::array<std::array<std::atomic<quint64>, LatencyBucketCount>, static_cast<size_t>(LatencyPath::Count)> latencyHistograms_{};
+};
+
+//Times its own lifetime into the given zone
+class ProfileScope
+{
+public:
+	explicit ProfileScope(const ProfileZone zone)
+		: zone_(zone), start_(Profiler::IsEnabled() ? Profiler::Now() : -1) {}
+
+	~ProfileScope()
+	{
+		if (start_ >= 0)
+			Profiler::Instance()->Record(zone_, start_, Profiler::Now() - start_);
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	ProfileZone zone_;
+	qint64 start_;
+};
@@ -0,0 +1,128 @@
+#include "stdafx.h"
+
+#include "ProfilerOverlay.h"
+
+#include "TaskScheduler.h"
+
+#include <QPainter>
+#include <algorithm>
+
+void ProfilerOverlay::Draw(QPainter* painter)
+{
+	const auto* profiler = Profiler::Instance();
+	const auto since = Profiler::Now() - Window;
+
+	std::array<quint64, static_cast<size_t>(ProfileCounter::Count)> counters;
+	for (size_t i = 0; i < counters.size(); i++)
+		counters[i] = profiler->GetCounter(static_cast<ProfileCounter>(i));
+
+	const auto fDelta = [&](const ProfileCounter counter)
+	{
+		return counters[static_cast<size_t>(counter)] - lastCounters_[static_cast<size_t>(counter)];
+	};
+
+	auto frameTimes = profiler->GetDurations(ProfileZone::PAINT, since);
+	auto searchTimes = profiler->GetDurations(ProfileZone::SNAP_SEARCH, since);
+	const auto queueStats = TaskScheduler::Instance()->GetStats(TaskPriority::INTERACTIVE);
+
+	QStringList lines;
+	lines << QString("Frame   p50 %0 ms   p95 %1 ms   p99 %2 ms   (%3 frames)")
+		.arg(Percentile_(frameTimes, 0.50), 0, 'f', 2)
+		.arg(Percentile_(frameTimes, 0.95), 0, 'f', 2)
+		.arg(Percentile_(frameTimes, 0.99), 0, 'f', 2)
+		.arg(frameTimes.size());
+
+	lines << QString("Shapes  drawn %0   culled %1")
+		.arg(fDelta(ProfileCounter::SHAPES_DRAWN))
+		.arg(fDelta(ProfileCounter::SHAPES_CULLED));
+
+	lines << QString("Search  p50 %0 ms   p95 %1 ms   queued %2 ms avg")
+		.arg(Percentile_(searchTimes, 0.50), 0, 'f', 2)
+		.arg(Percentile_(searchTimes, 0.95), 0, 'f', 2)
+		.arg(queueStats.averageLatencyMs, 0, 'f', 2);
+
+	//Latencies since the profiler was first enabled, per path that has seen input
+	for (size_t i = 0; i < static_cast<size_t>(LatencyPath::Count); i++)
+	{
+		const auto path = static_cast<LatencyPath>(i);
+		const auto histogram = profiler->GetLatencyHistogram(path);
+		const auto sampleCount = Profiler::GetSampleCount(histogram);
+		if (sampleCount == 0)
+			continue;
+
+		lines << QString("Input   %0 p50 %1 ms   p95 %2 ms   p99 %3 ms   (%4)")
+			.arg(QString(Profiler::GetLatencyPathName(path)), -5)
+			.arg(Profiler::GetPercentile(histogram, 0.50), 0, 'f', 2)
+			.arg(Profiler::GetPercentile(histogram, 0.95), 0, 'f', 2)
+			.arg(Profiler::GetPercentile(histogram, 0.99), 0, 'f', 2)
+			.arg(sampleCount);
+	}
+
+	lines << QString("Events  %0   coalesced %1   superseded frames %2   stale snaps %3")
+		.arg(counters[static_cast<size_t>(ProfileCounter::INPUT_EVENTS)])
+		.arg(counters[static_cast<size_t>(ProfileCounter::INPUT_COALESCED)])
+		.arg(counters[static_cast<size_t>(ProfileCounter::FRAMES_SUPERSEDED)])
+		.arg(counters[static_cast<size_t>(ProfileCounter::SNAP_ANSWERS_STALE)]);
+
+	lines << QString("Cache   prefetch %0   block rasters %1")
+		.arg(GetRateAsString_(counters[static_cast<size_t>(ProfileCounter::SNAP_PREFETCH_HITS)], counters[static_cast<size_t>(ProfileCounter::SNAP_PREFETCH_MISSES)]))
+		.arg(GetRateAsString_(counters[static_cast<size_t>(ProfileCounter::BLOCK_RASTER_HITS)], counters[static_cast<size_t>(ProfileCounter::BLOCK_RASTER_MISSES)]));
+
+	QString drawLine = "Draw   ";
+	for (size_t i = 0; i < Shape::TypeCount; i++)
+	{
+		const auto zone = Profiler::GetDrawZone(static_cast<Shape::Type>(i));
+		const auto duration = profiler->GetTotals(zone).duration;
+
+		const auto frameDuration = duration - lastDrawDurations_[i];
+		lastDrawDurations_[i] = duration;
+
+		if (frameDuration > 0)
+			drawLine += QString("  %0 %1 ms").arg(QString(Profiler::GetZoneName(zone)).section(' ', 1)).arg(frameDuration / 1e6, 0, 'f', 2);
+	}
+	lines << drawLine;
+
+	lastCounters_ = counters;
+
+	painter->save();
+
+	QFont font("Consolas");
+	font.setStyleHint(QFont::Monospace);
+	font.setPointSize(9);
+	painter->setFont(font);
+
+	const QFontMetrics metrics(font);
+	qint32 width = 0;
+	for (const auto& line : lines)
+		width = std::max(width, metrics.horizontalAdvance(line));
+
+	const QRect area(8, 8, width + 16, metrics.lineSpacing() * static_cast<qint32>(lines.size()) + 12);
+	painter->setPen(Qt::NoPen);
+	painter->setBrush(QColor(0, 0, 0, 170));
+	painter->drawRoundedRect(area, 4, 4);
+
+	painter->setPen(Qt::white);
+	for (qint32 i = 0; i < lines.size(); i++)
+		painter->drawText(area.left() + 8, area.top() + 6 + metrics.ascent() + i * metrics.lineSpacing(), lines[i]);
+
+	painter->restore();
+}
+
+double ProfilerOverlay::Percentile_(std::vector<qint64>& durations, const double fraction)
+{
+	if (durations.empty())
+		return 0.0;
+
+	const auto rank = static_cast<size_t>(fraction * (durations.size() - 1));
+	std::nth_element(durations.begin(), durations.begin() + rank, durations.end());
+
+	return durations[rank] / 1e6;
+}
+
+QString ProfilerOverlay::GetRateAsString_(const quint64 hits, const quint64 misses)
+{
+	if (hits + misses == 0)
+		return "-";
+
+	return QString("%0% of %1").arg(100.0 * hits / (hits + misses), 0, 'f', 1).arg(hits + misses);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <array>
+#include <vector>
+
+#include "Profiler.h"
+
+class QPainter;
+
+//Profiler readout drawn over the workspace: frame time percentiles, shapes drawn and culled in
+//the last frame, snap search latency, input-to-photon latency, cache hit rates and where the last
+//frame's draw time went
+class ProfilerOverlay
+{
+public:
+	//History the percentiles are taken over
+	static constexpr qint64 Window = 2'000'000'000;
+
+	ProfilerOverlay() = default;
+
+	//Expects screen coordinates; per-frame figures are the change since the previous call
+	void Draw(QPainter* painter);
+
+private:
+	static double Percentile_(std::vector<qint64>& durations, double fraction);
+	static QString GetRateAsString_(quint64 hits, quint64 misses);
+
+	std::array<quint64, static_cast<size_t>(ProfileCounter::Count)> lastCounters_{};
+	std::array<qint64, Shape::TypeCount> lastDrawDurations_{};
+};
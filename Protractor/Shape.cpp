@@ -2,26 +2,86 @@
 
 #include "Shape.h"
 
+#include "BlueprintExporter.h"
+#include "Block.h"
+
 #include <QPainter>
 #include <numbers>
+#include <limits>
 #include <QPainterPath>
 #include <ranges>
 
 Shape::Shape(const Type type)
 	: nodes_(0),
 	currentNodeIndex_(0),
+	styleIndex_(0),
 	type_(type)
 {
 }
 
-Shape::Shape(const Type type, size_t maxNumberOfNodes, const QPen& pen)
+Shape::Shape(const Type type, size_t maxNumberOfNodes, const StyleIndex styleIndex)
 	: nodes_(maxNumberOfNodes, Node(Vector2D(), this)),
 	currentNodeIndex_(0),
-	pen_(pen),
+	styleIndex_(styleIndex),
 	type_(type)
 {
 }
 
+std::unique_ptr<Shape> Shape::Make(const Type type)
+{
+	switch (type)
+	{
+	case Type::LINE: return std::make_unique<Line>();
+	case Type::BOX: return std::make_unique<Box>();
+	case Type::CIRCLE: return std::make_unique<Circle>();
+	case Type::OVAL: return std::make_unique<Oval>();
+	case Type::CURVE: return std::make_unique<Curve>();
+	case Type::SECTOR: return std::make_unique<Sector>();
+	case Type::POLYLINE: return std::make_unique<Polyline>();
+	case Type::INSTANCE: return std::make_unique<Instance>();
+	case Type::ARRAY: return std::make_unique<ShapeArray>();
+	default: return nullptr;
+	}
+}
+
+bool Shape::IsValidNodeCount(const Type type, const size_t nodeCount)
+{
+	switch (type)
+	{
+	case Type::LINE:
+	case Type::BOX:
+	case Type::CIRCLE:
+	case Type::OVAL:
+	case Type::INSTANCE:
+		return nodeCount == 2;
+	case Type::CURVE:
+	case Type::SECTOR:
+		return nodeCount == 3;
+	case Type::POLYLINE:
+		return nodeCount >= 2 && nodeCount <= std::numeric_limits<quint32>::max();
+	case Type::ARRAY:
+		//Polar arrays have two nodes, rectangular ones three
+		return nodeCount == 2 || nodeCount == 3;
+	default:
+		return false;
+	}
+}
+
+std::unique_ptr<Shape> Shape::Clone() const
+{
+	auto result = Make(type_);
+	if (result == nullptr)
+		return nullptr;
+
+	CopyDataTo_(*result);
+
+	result->Restore(styleIndex_, nodes_.size(), [this](const size_t i) { return nodes_[i].position; });
+	result->currentNodeIndex_ = currentNodeIndex_;
+	result->Update();
+
+	return result;
+}
+
 Node* Shape::GetPreviousNode()
 {
 	if (currentNodeIndex_ < 2)
@@ -48,22 +108,66 @@ Node* Shape::HasNode(const Vector2D atScreen, const std::function<Vector2D(const
 	return (it != nodes_.end()) ? &(*it) : nullptr;
 }
 
+Shape::MemoryUsage Shape::MakeMemoryUsage_(const size_t objectSize, const size_t inlineGeometry, const size_t heapGeometry) const
+{
+	return { objectSize - inlineGeometry, nodes_.capacity() * sizeof(Node), inlineGeometry + heapGeometry };
+}
+
+QRectF Shape::GetBounds() const
+{
+	if (nodes_.empty())
+		return QRectF();
+
+	const auto [minX, maxX] = std::ranges::minmax(nodes_ | std::views::transform([](const Node& n) { return n.position.x; }));
+	const auto [minY, maxY] = std::ranges::minmax(nodes_ | std::views::transform([](const Node& n) { return n.position.y; }));
+
+	return QRectF(QPointF(minX, minY), QPointF(maxX, maxY));
+}
+
+void Shape::ForEachSnapPoint(const std::function<void(const Vector2D&)>& fVisit) const
+{
+	for (const auto& node : nodes_)
+		fVisit(node.position);
+}
+
 void Shape::Serialize(QDataStream& out) const
 {
-	out << type_ << nodes_.size() << pen_;
+	out << type_ << static_cast<quint32>(nodes_.size()) << styleIndex_;
 
 	for (const auto& node : nodes_)
 		out << node.position;
+
+	SerializeData_(out);
 }
 
-void Shape::Deserialize(QDataStream& in)
+void Shape::Deserialize(QDataStream& in, const BlueprintFormat::FileVersion version, PenStyleTable& styles)
 {
-	in >> currentNodeIndex_ >> pen_;
+	if (version == BlueprintFormat::FileVersion::LEGACY)
+	{
+		QPen pen;
+		in >> currentNodeIndex_ >> pen;
+		styleIndex_ = styles.Intern(pen);
+	}
+	else
+	{
+		quint32 nodeCount;
+		in >> nodeCount >> styleIndex_;
+		currentNodeIndex_ = nodeCount;
+	}
+
+	if (in.status() != QDataStream::Ok || !IsValidNodeCount(type_, currentNodeIndex_))
+	{
+		in.setStatus(QDataStream::ReadCorruptData);
+		currentNodeIndex_ = 0;
+		return;
+	}
 
 	nodes_.assign(currentNodeIndex_, Node(Vector2D(), this));
 	for (auto& node : nodes_)
 		in >> node.position;
 
+	DeserializeData_(in);
+
 	Update();
 }
 
@@ -87,10 +191,19 @@ void Line::Update()
 
 void Line::Draw(QPainter* painter) const
 {
-	painter->setPen(pen_);
 	painter->drawLines(&line_, 1);
 }
 
+void Line::Export(IShapeExporter& exporter) const
+{
+	exporter.ExportLine(line_);
+}
+
+Shape::MemoryUsage Line::GetMemoryUsage() const
+{
+	return MakeMemoryUsage_(sizeof(Line), sizeof(line_));
+}
+
 QString Box::GetSizeAsString(const qreal factor) const
 {
 	const auto currentSize = Vector2D(rect_.width(), rect_.height()).Abs() * factor;
@@ -107,10 +220,19 @@ void Box::Update()
 
 void Box::Draw(QPainter* painter) const
 {
-	painter->setPen(pen_);
 	painter->drawRects(&rect_, 1);
 }
 
+void Box::Export(IShapeExporter& exporter) const
+{
+	exporter.ExportRect(rect_);
+}
+
+Shape::MemoryUsage Box::GetMemoryUsage() const
+{
+	return MakeMemoryUsage_(sizeof(Box), sizeof(rect_));
+}
+
 Node* Circle::GetNextNode()
 {
 	if (nodes_.size() == currentNodeIndex_)
@@ -161,12 +283,26 @@ void Circle::Update()
 	radius_ = QLineF(p1, p2);
 }
 
+QRectF Circle::GetBounds() const
+{
+	return rect_;
+}
+
 void Circle::Draw(QPainter* painter) const
 {
-	painter->setPen(pen_);
 	painter->drawEllipse(rect_);
 }
 
+void Circle::Export(IShapeExporter& exporter) const
+{
+	exporter.ExportEllipse(rect_);
+}
+
+Shape::MemoryUsage Circle::GetMemoryUsage() const
+{
+	return MakeMemoryUsage_(sizeof(Circle), sizeof(rect_) + sizeof(radius_));
+}
+
 void Circle::DrawHelpers(QPainter* painter) const
 {
 	painter->setPen(Qt::DashLine);
@@ -189,10 +325,19 @@ void Oval::Update()
 
 void Oval::Draw(QPainter* painter) const
 {
-	painter->setPen(pen_);
 	painter->drawEllipse(rect_);
 }
 
+void Oval::Export(IShapeExporter& exporter) const
+{
+	exporter.ExportEllipse(rect_);
+}
+
+Shape::MemoryUsage Oval::GetMemoryUsage() const
+{
+	return MakeMemoryUsage_(sizeof(Oval), sizeof(rect_));
+}
+
 void Oval::DrawHelpers(QPainter* painter) const
 {
 	painter->setPen(Qt::DashLine);
@@ -234,12 +379,29 @@ void Curve::Update()
 	}
 }
 
+QRectF Curve::GetBounds() const
+{
+	return path_.boundingRect();
+}
+
 void Curve::Draw(QPainter* painter) const
 {
-	painter->setPen(pen_);
 	painter->drawPath(path_);
 }
 
+void Curve::Export(IShapeExporter& exporter) const
+{
+	exporter.ExportPath(path_);
+}
+
+Shape::MemoryUsage Curve::GetMemoryUsage() const
+{
+	//The path's elements live in its shared private data
+	const auto pathElements = static_cast<size_t>(path_.capacity()) * sizeof(QPainterPath::Element);
+
+	return MakeMemoryUsage_(sizeof(Curve), sizeof(path_) + sizeof(helpLine1_) + sizeof(helpLine2_), pathElements);
+}
+
 void Curve::DrawHelpers(QPainter* painter) const
 {
 	painter->setPen(Qt::DashLine);
@@ -312,12 +474,429 @@ void Sector::Update()
 		sectorAngle_ *= -1;
 }
 
-void Sector::Draw(QPainter* painter) const
+QRectF Sector::GetBounds() const
 {
-	painter->setPen(pen_);
+	if (currentNodeIndex_ == 2)
+		return Shape::GetBounds();
+
+	return rect_;
+}
 
+void Sector::Draw(QPainter* painter) const
+{
 	if (currentNodeIndex_ == 2)
 		painter->drawLine(nodes_.front().position, nodes_[1].position);
 	else
 		painter->drawPie(rect_, startAngle_, sectorAngle_);
 }
+
+void Sector::Export(IShapeExporter& exporter) const
+{
+	if (currentNodeIndex_ == 2)
+		exporter.ExportLine(QLineF(nodes_.front().position, nodes_[1].position));
+	else
+		exporter.ExportPie(rect_, startAngle_, sectorAngle_);
+}
+
+Shape::MemoryUsage Sector::GetMemoryUsage() const
+{
+	return MakeMemoryUsage_(sizeof(Sector), sizeof(rect_));
+}
+
+Polyline::Polyline(const StyleIndex styleIndex)
+	: Shape(Type::POLYLINE, 2, styleIndex),
+	bIsOpen_(true)
+{
+}
+
+void Polyline::Update()
+{
+	//A polyline being drawn is drawn in full and ranked once finished
+	if (bIsOpen_)
+	{
+		lodLevels_.clear();
+		return;
+	}
+
+	lodLevels_.resize(nodes_.size());
+	RankLodLevels(nodes_.size(), [this](const size_t i) { return nodes_[i].position; }, lodLevels_.data());
+}
+
+void Polyline::UpdateWhileEditing()
+{
+	//Ranking walks every node, so a dragged polyline is drawn in full and ranked once committed
+	lodLevels_.clear();
+}
+
+quint8 Polyline::GetLodLevel_(const qreal scale)
+{
+	//Finest level whose tolerance still stays below LodScreenTolerance pixels at this scale
+	const auto tolerance = LodScreenTolerance / scale;
+
+	quint8 level = 0;
+	while (level < LodLevelCount && LodCoarsestTolerance / static_cast<double>(1 << level) > tolerance)
+		level++;
+
+	return level;
+}
+
+Node* Polyline::GetNextNode()
+{
+	if (currentNodeIndex_ < nodes_.size())
+		return &nodes_[currentNodeIndex_++];
+
+	if (!bIsOpen_ || nodes_.size() == std::numeric_limits<quint32>::max())
+		return nullptr;
+
+	//Appending may move the nodes, the workspace takes its selected node from the pointer returned here
+	nodes_.emplace_back(nodes_.back().position, this);
+	return &nodes_[currentNodeIndex_++];
+}
+
+bool Polyline::Finish()
+{
+	if (!bIsOpen_)
+		return false;
+
+	//The last node is the one following the cursor
+	if (nodes_.size() > 2)
+		nodes_.pop_back();
+
+	nodes_.shrink_to_fit();
+	currentNodeIndex_ = nodes_.size();
+	bIsOpen_ = false;
+
+	Update();
+
+	return true;
+}
+
+QString Polyline::GetSizeAsString(const qreal factor) const
+{
+	double length = 0.0;
+	for (size_t i = 1; i < nodes_.size(); i++)
+		length += Vector2D::Distance(nodes_[i - 1].position, nodes_[i].position);
+
+	return QString("Length: %0\tPoints: %1")
+		.arg(length * factor, 0, 'f', 1)
+		.arg(nodes_.size());
+}
+
+void Polyline::Draw(QPainter* painter) const
+{
+	//Unranked nodes, e.g. of a polyline being drawn, are always shown
+	DrawLod(painter, nodes_.size(), [this](const size_t i) { return nodes_[i].position; }, [this](const size_t i)
+	{
+		return i < lodLevels_.size() ? lodLevels_[i] : quint8(0);
+	});
+}
+
+void Polyline::Export(IShapeExporter& exporter) const
+{
+	QPolygonF points;
+	points.reserve(static_cast<qsizetype>(nodes_.size()));
+	for (const auto& node : nodes_)
+		points.append(node.position);
+
+	exporter.ExportPolyline(points);
+}
+
+Shape::MemoryUsage Polyline::GetMemoryUsage() const
+{
+	return MakeMemoryUsage_(sizeof(Polyline), 0, lodLevels_.capacity() * sizeof(quint8));
+}
+
+Instance::Instance(const StyleIndex styleIndex, const BlockIndex blockIndex, std::shared_ptr<const Block> block)
+	: Shape(Type::INSTANCE, 2, styleIndex),
+	block_(std::move(block)),
+	blockIndex_(blockIndex)
+{
+}
+
+void Instance::SetBlock(const BlockIndex blockIndex, std::shared_ptr<const Block> block)
+{
+	blockIndex_ = blockIndex;
+	block_ = std::move(block);
+}
+
+QTransform Instance::GetPlacement() const
+{
+	if (block_ == nullptr || nodes_.size() < 2)
+		return QTransform();
+
+	const auto& origin = nodes_[0].position;
+	const auto axis = (nodes_[1].position - origin) / block_->GetReferenceLength();
+
+	//Rotation and uniform scale in one: the x axis of the block maps onto the handle direction
+	return QTransform(axis.x, axis.y, -axis.y, axis.x, origin.x, origin.y);
+}
+
+QString Instance::GetSizeAsString(const qreal factor) const
+{
+	if (block_ == nullptr || nodes_.size() < 2)
+		return QString();
+
+	const auto axis = nodes_[1].position - nodes_[0].position;
+
+	return QString("Block: %0\tScale: %1\tAngle: %2")
+		.arg(block_->GetName())
+		.arg(axis.Length() / block_->GetReferenceLength(), 0, 'f', 3)
+		.arg(qRadiansToDegrees(std::atan2(axis.y, axis.x)), 0, 'f', 1);
+}
+
+QRectF Instance::GetBounds() const
+{
+	if (block_ == nullptr)
+		return Shape::GetBounds();
+
+	return GetPlacement().mapRect(block_->GetBounds());
+}
+
+void Instance::Draw(QPainter* painter) const
+{
+	if (block_ != nullptr)
+		block_->Draw(painter, GetPlacement());
+}
+
+void Instance::Export(IShapeExporter& exporter) const
+{
+	if (block_ != nullptr)
+		block_->Export(exporter, GetPlacement());
+}
+
+Shape::MemoryUsage Instance::GetMemoryUsage() const
+{
+	return MakeMemoryUsage_(sizeof(Instance), 0);
+}
+
+void Instance::ResolveBlocks(const BlockTable& blocks)
+{
+	if (blockIndex_ < blocks.GetSize())
+		block_ = blocks.Get(blockIndex_);
+}
+
+void Instance::SerializeData_(QDataStream& out) const
+{
+	out << blockIndex_;
+}
+
+void Instance::DeserializeData_(QDataStream& in)
+{
+	//The block itself is resolved by whoever owns the block table
+	in >> blockIndex_;
+	block_.reset();
+}
+
+void Instance::CopyDataTo_(Shape& target) const
+{
+	static_cast<Instance&>(target).SetBlock(blockIndex_, block_);
+}
+
+ShapeArray::ShapeArray(std::shared_ptr<Shape> source, const Settings& settings)
+	: Shape(Type::ARRAY, settings.layout == Layout::RECTANGULAR ? 3 : 2, source->GetStyleIndex()),
+	layout_(settings.layout),
+	columns_(std::max<quint16>(settings.columns, 1)),
+	rows_(settings.layout == Layout::RECTANGULAR ? std::max<quint16>(settings.rows, 1) : 1)
+{
+	SetSource_(std::move(source));
+
+	if (layout_ == Layout::RECTANGULAR)
+	{
+		nodes_[0].position = sourceCenter_;
+		nodes_[1].position = sourceCenter_ + settings.columnSpacing;
+		nodes_[2].position = sourceCenter_ + settings.rowSpacing;
+	}
+	else
+	{
+		nodes_[0].position = sourceCenter_ + settings.centerOffset;
+		nodes_[1].position = sourceCenter_;
+	}
+
+	currentNodeIndex_ = nodes_.size();
+}
+
+void ShapeArray::SetSource_(std::shared_ptr<Shape> source)
+{
+	source_ = std::move(source);
+	sourceCenter_ = source_ != nullptr ? Vector2D(source_->GetBounds().center()) : Vector2D();
+}
+
+QTransform ShapeArray::GetCopyTransform(const size_t copyIndex) const
+{
+	if (layout_ == Layout::RECTANGULAR)
+	{
+		if (nodes_.size() < 3)
+			return QTransform();
+
+		const auto column = static_cast<double>(copyIndex % columns_);
+		const auto row = static_cast<double>(copyIndex / columns_);
+		const auto offset = nodes_[0].position - sourceCenter_
+			+ (nodes_[1].position - nodes_[0].position) * column
+			+ (nodes_[2].position - nodes_[0].position) * row;
+
+		return QTransform::fromTranslate(offset.x, offset.y);
+	}
+
+	if (nodes_.size() < 2)
+		return QTransform();
+
+	//Move the source onto its node, then turn it around the centre
+	const auto& center = nodes_[0].position;
+	const auto offset = nodes_[1].position - sourceCenter_;
+
+	QTransform rotation;
+	rotation.translate(center.x, center.y);
+	rotation.rotate(360.0 * static_cast<double>(copyIndex) / columns_);
+	rotation.translate(-center.x, -center.y);
+
+	return QTransform::fromTranslate(offset.x, offset.y) * rotation;
+}
+
+QString ShapeArray::GetSizeAsString(const qreal factor) const
+{
+	if (layout_ == Layout::POLAR)
+		return QString("Copies: %0").arg(columns_);
+
+	return QString("Copies: %0 x %1").arg(columns_).arg(rows_);
+}
+
+QRectF ShapeArray::GetBounds() const
+{
+	if (source_ == nullptr)
+		return Shape::GetBounds();
+
+	const auto sourceBounds = source_->GetBounds();
+
+	//Translated copies span the rectangle between the corner copies
+	if (layout_ == Layout::RECTANGULAR)
+	{
+		return GetCopyTransform(0).mapRect(sourceBounds)
+			| GetCopyTransform(columns_ - 1).mapRect(sourceBounds)
+			| GetCopyTransform(GetCopyCount() - columns_).mapRect(sourceBounds)
+			| GetCopyTransform(GetCopyCount() - 1).mapRect(sourceBounds);
+	}
+
+	QRectF result;
+	for (size_t i = 0; i < GetCopyCount(); i++)
+		result |= GetCopyTransform(i).mapRect(sourceBounds);
+
+	return result;
+}
+
+void ShapeArray::ForEachSnapPoint(const std::function<void(const Vector2D&)>& fVisit) const
+{
+	Shape::ForEachSnapPoint(fVisit);
+
+	if (source_ == nullptr)
+		return;
+
+	for (size_t i = 0; i < GetCopyCount(); i++)
+	{
+		const auto transform = GetCopyTransform(i);
+		for (const auto& node : source_->GetNodes())
+			fVisit(transform.map(node.position.ToQPointF()));
+	}
+}
+
+size_t ShapeArray::GetSnapPointCount() const
+{
+	const auto sourceCount = source_ != nullptr ? source_->GetNodes().size() : 0;
+	return GetNodes().size() + GetCopyCount() * sourceCount;
+}
+
+void ShapeArray::Draw(QPainter* painter) const
+{
+	if (source_ == nullptr)
+		return;
+
+	const auto baseTransform = painter->transform();
+
+	//Copies are culled against the visible part of the world, widened by the pen
+	const auto margin = painter->pen().widthF();
+	const auto visible = baseTransform.inverted().mapRect(QRectF(painter->viewport())).adjusted(-margin, -margin, margin, margin);
+	const auto sourceBounds = source_->GetBounds();
+
+	for (size_t i = 0; i < GetCopyCount(); i++)
+	{
+		const auto transform = GetCopyTransform(i);
+		if (!transform.mapRect(sourceBounds).intersects(visible))
+			continue;
+
+		painter->setTransform(transform * baseTransform);
+		source_->Draw(painter);
+	}
+
+	painter->setTransform(baseTransform);
+}
+
+void ShapeArray::Export(IShapeExporter& exporter) const
+{
+	if (source_ == nullptr)
+		return;
+
+	for (size_t i = 0; i < GetCopyCount(); i++)
+	{
+		TransformedExporter copyExporter(exporter, GetCopyTransform(i));
+		source_->Export(copyExporter);
+	}
+}
+
+Shape::MemoryUsage ShapeArray::GetMemoryUsage() const
+{
+	auto result = MakeMemoryUsage_(sizeof(ShapeArray), 0);
+
+	//The copies are generated, only the source is stored
+	if (source_ != nullptr)
+		result += source_->GetMemoryUsage();
+
+	return result;
+}
+
+void ShapeArray::ResolveBlocks(const BlockTable& blocks)
+{
+	if (source_ != nullptr)
+		source_->ResolveBlocks(blocks);
+}
+
+void ShapeArray::SerializeData_(QDataStream& out) const
+{
+	out << layout_ << columns_ << rows_;
+	source_->Serialize(out);
+}
+
+void ShapeArray::DeserializeData_(QDataStream& in)
+{
+	Type sourceType;
+	in >> layout_ >> columns_ >> rows_ >> sourceType;
+
+	const auto bIsValidLayout = (layout_ == Layout::RECTANGULAR && nodes_.size() == 3)
+		|| (layout_ == Layout::POLAR && nodes_.size() == 2 && rows_ == 1);
+
+	//Arrays of arrays are not built, so one is never read either
+	auto source = sourceType != Type::ARRAY ? Make(sourceType) : nullptr;
+	if (source == nullptr || !bIsValidLayout || columns_ == 0 || rows_ == 0 || GetCopyCount() > MaxArrayCopies)
+	{
+		layout_ = Layout::RECTANGULAR;
+		columns_ = 1;
+		rows_ = 1;
+		in.setStatus(QDataStream::ReadCorruptData);
+		return;
+	}
+
+	PenStyleTable unusedStyles;
+	source->Deserialize(in, BlueprintFormat::CurrentVersion, unusedStyles);
+	if (in.status() != QDataStream::Ok)
+		return;
+
+	SetSource_(std::move(source));
+}
+
+void ShapeArray::CopyDataTo_(Shape& target) const
+{
+	auto& array = static_cast<ShapeArray&>(target);
+	array.source_ = source_;
+	array.sourceCenter_ = sourceCenter_;
+	array.layout_ = layout_;
+	array.columns_ = columns_;
+	array.rows_ = rows_;
+}
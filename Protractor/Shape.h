@@ -1,11 +1,22 @@
 #pragma once
 
 #include <vector>
+#include <memory>
 #include <functional>
+#include <cmath>
+
+#include "PenStyleTable.h"
+#include "BlueprintFormat.h"
+#include "Simplifier.h"
 
 class Shape;
 class QPainter;
 class Workspace;
+class IShapeExporter;
+class Block;
+class BlockTable;
+
+using BlockIndex = quint16;
 
 class Node
 {
@@ -29,36 +40,114 @@ public:
 		CIRCLE,
 		OVAL,
 		CURVE,
-		SECTOR
+		SECTOR,
+		POLYLINE,
+		INSTANCE,
+		ARRAY
 	};
 
+	static constexpr size_t TypeCount = 9;
+
+	//Shapes with data beyond their nodes are written as whole records instead of in chunks
+	static constexpr bool IsChunkable(const Type type) { return type != Type::INSTANCE && type != Type::ARRAY; }
+
+	//Whether a finished shape of the type can have nodeCount nodes; anything else read from a file is corrupt
+	static bool IsValidNodeCount(Type type, size_t nodeCount);
+
 	Shape(Type type);
 
-	Shape(const Type type, size_t maxNumberOfNodes, const QPen& pen);
+	Shape(const Type type, size_t maxNumberOfNodes, StyleIndex styleIndex);
+
+	[[nodiscard]] static std::unique_ptr<Shape> Make(Type type);
+
+	//Committed shapes may be shared with a save snapshot, so edits are made on a clone
+	[[nodiscard]] std::unique_ptr<Shape> Clone() const;
 
 	virtual void Update() {}
+	//Called on every move of a node being edited, Update follows once the edit is committed
+	virtual void UpdateWhileEditing() { Update(); }
 
+	//The pen is set by the caller from the document's style table
 	virtual void Draw(QPainter* painter) const {}
 	virtual void DrawHelpers(QPainter* painter) const {}
 
+	//Hands the same geometry Draw uses to a file exporter
+	virtual void Export(IShapeExporter& exporter) const {}
+
 	auto& GetNodes() { return nodes_; }
+	const auto& GetNodes() const { return nodes_; }
+
+	StyleIndex GetStyleIndex() const { return styleIndex_; }
+	void SetStyleIndex(const StyleIndex newStyleIndex) { styleIndex_ = newStyleIndex; }
 
 	Node* GetPreviousNode();
 	virtual Node* GetOrientationNode(Node* selectedNode) { return nullptr; };
 	virtual  Node* GetNextNode();
 
+	//Ends an open-ended shape at its last placed node, false for shapes with a fixed node count
+	virtual bool Finish() { return false; }
+
 	Node* HasNode(const Vector2D atScreen, const std::function<Vector2D(const Vector2D& v)>& WorldToScreen);
 
 	virtual QString GetSizeAsString(const qreal factor) const { return QString(); }
 
+	//Area covered by the drawn shape, not just by its nodes
+	virtual QRectF GetBounds() const;
+
+	//Positions offered for snapping, the nodes unless the shape generates more geometry
+	virtual void ForEachSnapPoint(const std::function<void(const Vector2D&)>& fVisit) const;
+	virtual size_t GetSnapPointCount() const { return nodes_.size(); }
+
+	//Connects shapes read from a file or journal to the document's blocks
+	virtual void ResolveBlocks(const BlockTable& blocks) {}
+
+	//Bytes held by the shape, estimated from object sizes and container capacities. Data shared
+	//with other shapes, e.g. an instance's block, is left to its owner.
+	struct MemoryUsage
+	{
+		size_t object{ 0 };
+		size_t nodes{ 0 };
+
+		//Qt geometry cached by Update, kept in the object or on the heap
+		size_t geometry{ 0 };
+
+		//Separate control block of a shape handed to a shared_ptr: vtable, pointer and both counts
+		static constexpr size_t ControlBlockSize = 2 * sizeof(void*) + 2 * sizeof(qint32);
+
+		MemoryUsage& operator+=(const MemoryUsage& other)
+		{
+			object += other.object;
+			nodes += other.nodes;
+			geometry += other.geometry;
+			return *this;
+		}
+
+		size_t GetTotal() const { return object + nodes + geometry; }
+	};
+
+	virtual MemoryUsage GetMemoryUsage() const { return MakeMemoryUsage_(sizeof(Shape), 0); }
+
 	void Serialize(QDataStream& out) const;
-	void Deserialize(QDataStream& in);
+	//Legacy files store a full QPen per shape, which is interned into styles
+	void Deserialize(QDataStream& in, BlueprintFormat::FileVersion version, PenStyleTable& styles);
+
+	//Rebuilds a finished shape from an external node source, e.g. a compact or packed document
+	template<typename F>
+	void Restore(StyleIndex styleIndex, size_t nodeCount, F&& fNodeAt);
 
 protected:
+	//Type specific data following the nodes in journal records
+	virtual void SerializeData_(QDataStream& out) const {}
+	virtual void DeserializeData_(QDataStream& in) {}
+	virtual void CopyDataTo_(Shape& target) const {}
+
+	//Splits the size of the concrete shape into its cached geometry and the rest
+	MemoryUsage MakeMemoryUsage_(size_t objectSize, size_t inlineGeometry, size_t heapGeometry = 0) const;
+
 	std::vector<Node> nodes_;
 	size_t currentNodeIndex_;
 
-	QPen pen_;
+	StyleIndex styleIndex_;
 
 private:
 	Type type_;
@@ -67,12 +156,25 @@ public:
 	Type GetType() const { return type_; }
 };
 
+template<typename F>
+void Shape::Restore(const StyleIndex styleIndex, const size_t nodeCount, F&& fNodeAt)
+{
+	currentNodeIndex_ = nodeCount;
+	styleIndex_ = styleIndex;
+
+	nodes_.assign(nodeCount, Node(Vector2D(), this));
+	for (size_t i = 0; i < nodeCount; i++)
+		nodes_[i].position = fNodeAt(i);
+
+	Update();
+}
+
 class Line : public Shape
 {
 public:
 	Line() : Shape(Shape::Type::LINE) {}
 
-	Line(const QPen& pen) : Shape(Type::LINE, 2, pen) {}
+	Line(const StyleIndex styleIndex) : Shape(Type::LINE, 2, styleIndex) {}
 
 	Node* GetOrientationNode(Node* selectedNode) override;
 
@@ -82,6 +184,10 @@ public:
 
 	void Draw(QPainter* painter) const override;
 
+	void Export(IShapeExporter& exporter) const override;
+
+	MemoryUsage GetMemoryUsage() const override;
+
 private:
 	QLineF line_;
 };
@@ -91,7 +197,7 @@ class Box : public Shape
 public:
 	Box() : Shape(Shape::Type::BOX) {}
 
-	Box(const QPen& pen) : Shape(Type::BOX, 2, pen) {}
+	Box(const StyleIndex styleIndex) : Shape(Type::BOX, 2, styleIndex) {}
 
 	QString GetSizeAsString(const qreal factor) const override;
 
@@ -99,6 +205,10 @@ public:
 
 	void Draw(QPainter* painter) const override;
 
+	void Export(IShapeExporter& exporter) const override;
+
+	MemoryUsage GetMemoryUsage() const override;
+
 private:
 	QRectF rect_;
 };
@@ -108,7 +218,7 @@ class Circle : public Shape
 public:
 	Circle() : Shape(Shape::Type::CIRCLE) {}
 
-	Circle(const QPen& pen) : Shape(Type::CIRCLE, 2, pen) {}
+	Circle(const StyleIndex styleIndex) : Shape(Type::CIRCLE, 2, styleIndex) {}
 
 	Node* GetNextNode() override;
 
@@ -118,8 +228,14 @@ public:
 
 	void Update() override;
 
+	QRectF GetBounds() const override;
+
 	void Draw(QPainter* painter) const override;
 
+	void Export(IShapeExporter& exporter) const override;
+
+	MemoryUsage GetMemoryUsage() const override;
+
 	void DrawHelpers(QPainter* painter) const override;
 
 private:
@@ -132,7 +248,7 @@ class Oval : public Shape
 public:
 	Oval() : Shape(Shape::Type::OVAL) {}
 
-	Oval(const QPen& pen) : Shape(Type::OVAL, 2, pen) {}
+	Oval(const StyleIndex styleIndex) : Shape(Type::OVAL, 2, styleIndex) {}
 
 	QString GetSizeAsString(const qreal factor) const override;
 
@@ -140,6 +256,10 @@ public:
 
 	void Draw(QPainter* painter) const override;
 
+	void Export(IShapeExporter& exporter) const override;
+
+	MemoryUsage GetMemoryUsage() const override;
+
 	void DrawHelpers(QPainter* painter) const override;
 
 private:
@@ -151,14 +271,20 @@ class Curve : public Shape
 public:
 	Curve() : Shape(Shape::Type::CURVE) {}
 
-	Curve(const QPen& pen) : Shape(Type::CURVE, 3, pen) {}
+	Curve(const StyleIndex styleIndex) : Shape(Type::CURVE, 3, styleIndex) {}
 
 	Node* GetOrientationNode(Node* selectedNode) override;
 
 	void Update() override;
 
+	QRectF GetBounds() const override;
+
 	void Draw(QPainter* painter) const override;
 
+	void Export(IShapeExporter& exporter) const override;
+
+	MemoryUsage GetMemoryUsage() const override;
+
 	void DrawHelpers(QPainter* painter) const override;
 
 private:
@@ -172,7 +298,7 @@ class Sector : public Shape
 public:
 	Sector() : Shape(Shape::Type::SECTOR) {}
 
-	Sector(const QPen& pen) : Shape(Type::SECTOR, 3, pen) {}
+	Sector(const StyleIndex styleIndex) : Shape(Type::SECTOR, 3, styleIndex) {}
 
 	Node* GetNextNode() override;
 
@@ -180,10 +306,217 @@ public:
 
 	void Update() override;
 
+	QRectF GetBounds() const override;
+
 	void Draw(QPainter* painter) const override;
 
+	void Export(IShapeExporter& exporter) const override;
+
+	MemoryUsage GetMemoryUsage() const override;
+
 private:
 	QRectF rect_;
 	qint32 startAngle_{ 0 };
 	qint32 sectorAngle_{ 0 };
-};
\ No newline at end of file
+};
+
+//Chain of points drawn with a single drawPolyline. Only the nodes are stored, so a segment costs
+//one Node instead of a whole Line with its own heap vector and cached geometry.
+class Polyline : public Shape
+{
+public:
+	Polyline() : Shape(Shape::Type::POLYLINE) {}
+
+	Polyline(const StyleIndex styleIndex);
+
+	//Display levels of detail: level k hides detail below LodCoarsestTolerance / 2^k world units,
+	//the level past the last one draws every point
+	static constexpr size_t LodLevelCount = 12;
+	static constexpr double LodCoarsestTolerance = 4.0;
+
+	//Largest deviation from the true shape tolerated on screen, in pixels
+	static constexpr double LodScreenTolerance = 0.25;
+
+	void Update() override;
+	void UpdateWhileEditing() override;
+
+	Node* GetNextNode() override;
+
+	bool Finish() override;
+
+	QString GetSizeAsString(const qreal factor) const override;
+
+	void Draw(QPainter* painter) const override;
+
+	void Export(IShapeExporter& exporter) const override;
+
+	MemoryUsage GetMemoryUsage() const override;
+
+	//Coarsest level that draws each point of a chain, by its Douglas-Peucker significance; also for
+	//read-only views that rank their chains once and keep the levels themselves
+	template<typename F>
+	static void RankLodLevels(size_t nodeCount, F&& fPositionAt, quint8* levels);
+
+	//Draws the points of a chain whose level shows at the painter's scale
+	template<typename FPosition, typename FLevel>
+	static void DrawLod(QPainter* painter, size_t nodeCount, FPosition&& fPositionAt, FLevel&& fLevelAt);
+
+private:
+	static quint8 GetLodLevel_(qreal scale);
+
+	//Coarsest level that draws each node, ranked once a finished polyline is committed; empty while
+	//the polyline is being drawn or edited
+	std::vector<quint8> lodLevels_;
+
+	//Set while the shape is being drawn, every click then appends a node
+	bool bIsOpen_{ false };
+};
+
+template<typename F>
+void Polyline::RankLodLevels(const size_t nodeCount, F&& fPositionAt, quint8* levels)
+{
+	thread_local std::vector<double> significance;
+	Simplifier::Rank(nodeCount, std::forward<F>(fPositionAt), significance);
+
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		quint8 level = 0;
+		while (level < LodLevelCount && significance[i] <= LodCoarsestTolerance / static_cast<double>(1 << level))
+			level++;
+
+		levels[i] = level;
+	}
+}
+
+template<typename FPosition, typename FLevel>
+void Polyline::DrawLod(QPainter* painter, const size_t nodeCount, FPosition&& fPositionAt, FLevel&& fLevelAt)
+{
+	//Points are gathered into a reused buffer instead of a per-shape cache to keep polylines small,
+	//dropping the ones whose deviation would not show at the painter's scale
+	const auto level = GetLodLevel_(std::sqrt(std::abs(painter->transform().determinant())));
+
+	thread_local QPolygonF points;
+	points.clear();
+	for (size_t i = 0; i < nodeCount; i++)
+	{
+		if (fLevelAt(i) <= level)
+			points.append(fPositionAt(i));
+	}
+
+	painter->drawPolyline(points);
+}
+
+//Placement of a shared block: the first node is the block's origin, the second one is a handle
+//whose offset from the origin gives the rotation and, against the block's reference length, the
+//scale. The block is drawn in the instance's pen, so an instance costs two nodes however big it is.
+class Instance : public Shape
+{
+public:
+	Instance() : Shape(Shape::Type::INSTANCE) {}
+
+	Instance(StyleIndex styleIndex, BlockIndex blockIndex, std::shared_ptr<const Block> block);
+
+	void SetBlock(BlockIndex blockIndex, std::shared_ptr<const Block> block);
+
+	//Maps block coordinates to world coordinates
+	QTransform GetPlacement() const;
+
+	QString GetSizeAsString(const qreal factor) const override;
+
+	QRectF GetBounds() const override;
+
+	void Draw(QPainter* painter) const override;
+
+	void Export(IShapeExporter& exporter) const override;
+
+	MemoryUsage GetMemoryUsage() const override;
+
+	void ResolveBlocks(const BlockTable& blocks) override;
+
+protected:
+	void SerializeData_(QDataStream& out) const override;
+	void DeserializeData_(QDataStream& in) override;
+	void CopyDataTo_(Shape& target) const override;
+
+private:
+	std::shared_ptr<const Block> block_;
+	BlockIndex blockIndex_{ 0 };
+
+public:
+	__forceinline BlockIndex GetBlockIndex() const { return blockIndex_; }
+	__forceinline const std::shared_ptr<const Block>& GetBlock() const { return block_; }
+};
+
+//Rows and columns, or a ring, of copies of one source shape. The copies are never stored, they
+//are generated from the source while drawing, snapping and exporting, so a 100x100 array costs
+//about as much as a single copy. Rectangular arrays have three nodes: the source's centre and
+//the first copy along a column and along a row; polar ones have the centre of the ring and the
+//source's centre.
+class ShapeArray : public Shape
+{
+public:
+	enum class Layout : quint8
+	{
+		RECTANGULAR,
+		POLAR
+	};
+
+	struct Settings
+	{
+		Layout layout{ Layout::RECTANGULAR };
+
+		//A polar array has columns copies in a single row
+		quint16 columns{ 1 };
+		quint16 rows{ 1 };
+
+		//World units; the ring's centre is given relative to the source's centre
+		Vector2D columnSpacing;
+		Vector2D rowSpacing;
+		Vector2D centerOffset;
+	};
+
+	//The array dialog builds at most 1000 by 1000 copies, larger counts in a file are corrupt
+	static constexpr size_t MaxArrayCopies = 1000 * 1000;
+
+	ShapeArray() : Shape(Shape::Type::ARRAY) {}
+
+	ShapeArray(std::shared_ptr<Shape> source, const Settings& settings);
+
+	//Copy 0 is the source itself
+	QTransform GetCopyTransform(size_t copyIndex) const;
+
+	QString GetSizeAsString(const qreal factor) const override;
+
+	QRectF GetBounds() const override;
+
+	void ForEachSnapPoint(const std::function<void(const Vector2D&)>& fVisit) const override;
+	size_t GetSnapPointCount() const override;
+
+	void Draw(QPainter* painter) const override;
+
+	void Export(IShapeExporter& exporter) const override;
+
+	MemoryUsage GetMemoryUsage() const override;
+
+	void ResolveBlocks(const BlockTable& blocks) override;
+
+protected:
+	void SerializeData_(QDataStream& out) const override;
+	void DeserializeData_(QDataStream& in) override;
+	void CopyDataTo_(Shape& target) const override;
+
+private:
+	void SetSource_(std::shared_ptr<Shape> source);
+
+	//Never changed once the array is built, clones and snapshots share it
+	std::shared_ptr<Shape> source_;
+	Vector2D sourceCenter_;
+
+	Layout layout_{ Layout::RECTANGULAR };
+	quint16 columns_{ 1 };
+	quint16 rows_{ 1 };
+
+public:
+	__forceinline size_t GetCopyCount() const { return static_cast<size_t>(columns_) * rows_; }
+	__forceinline const std::shared_ptr<Shape>& GetSource() const { return source_; }
+};
@@ -1,14 +1,18 @@
 #pragma once
 
-#include <QPen>
+#include "PenStyleTable.h"
+#include "Shape.h"
 #include <memory>
 
-class Shape;
-
 class IShapeFactory
 {
 public:
-	[[nodiscard]] virtual std::unique_ptr<Shape> Create(const QPen& pen) const = 0;
+	[[nodiscard]] virtual std::unique_ptr<Shape> Create(StyleIndex styleIndex) const = 0;
+
+	[[nodiscard]] virtual Shape::Type GetType() const = 0;
+
+	//Factory of a drawing tool, null for shapes that are not drawn by hand
+	[[nodiscard]] static std::unique_ptr<IShapeFactory> Make(Shape::Type type);
 };
 
 template<typename T>
@@ -18,11 +22,28 @@ template<ShapeDerived T>
 class ShapeFactory : public IShapeFactory
 {
 public:
-	[[nodiscard]] std::unique_ptr<Shape> Create(const QPen& pen) const override;
+	[[nodiscard]] std::unique_ptr<Shape> Create(StyleIndex styleIndex) const override;
+
+	[[nodiscard]] Shape::Type GetType() const override { return T().GetType(); }
 };
 
 template<ShapeDerived T>
-std::unique_ptr<Shape> ShapeFactory<T>::Create(const QPen& pen) const
+std::unique_ptr<Shape> ShapeFactory<T>::Create(StyleIndex styleIndex) const
+{
+	return std::make_unique<T>(styleIndex);
+}
+
+inline std::unique_ptr<IShapeFactory> IShapeFactory::Make(const Shape::Type type)
 {
-	return std::make_unique<T>(pen);
+	switch (type)
+	{
+	case Shape::Type::LINE: return std::make_unique<ShapeFactory<Line>>();
+	case Shape::Type::BOX: return std::make_unique<ShapeFactory<Box>>();
+	case Shape::Type::CIRCLE: return std::make_unique<ShapeFactory<Circle>>();
+	case Shape::Type::OVAL: return std::make_unique<ShapeFactory<Oval>>();
+	case Shape::Type::CURVE: return std::make_unique<ShapeFactory<Curve>>();
+	case Shape::Type::SECTOR: return std::make_unique<ShapeFactory<Sector>>();
+	case Shape::Type::POLYLINE: return std::make_unique<ShapeFactory<Polyline>>();
+	default: return nullptr;
+	}
 }
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vector>
+#include <limits>
+#include <utility>
+#include <tuple>
+#include <algorithm>
+
+//Douglas-Peucker simplification of point chains. Instead of one run per tolerance every point is
+//ranked once: its significance is the largest tolerance at which Douglas-Peucker still keeps it,
+//so the result for any tolerance is simply the points whose significance exceeds it.
+class Simplifier
+{
+public:
+	static constexpr double Endpoint = std::numeric_limits<double>::infinity();
+
+	template<typename F>
+	static void Rank(size_t count, F&& fPointAt, std::vector<double>& significance);
+
+	//Indices of the points kept at the given tolerance, the endpoints are always kept
+	template<typename F>
+	static void Simplify(size_t count, F&& fPointAt, double tolerance, std::vector<size_t>& kept);
+
+	//Largest distance of a cubic Bezier from the segment between its ends, sampled finely enough
+	//to decide whether a curve can become a line
+	static double GetCurveDeviation(const Vector2D& start, const Vector2D& control1, const Vector2D& control2, const Vector2D& end);
+
+private:
+	static constexpr size_t CurveSampleCount = 64;
+
+	static double DistanceToSegment_(const Vector2D& point, const Vector2D& start, const Vector2D& end);
+};
+
+template<typename F>
+void Simplifier::Rank(const size_t count, F&& fPointAt, std::vector<double>& significance)
+{
+	significance.assign(count, 0.0);
+	if (count == 0)
+		return;
+
+	significance.front() = Endpoint;
+	significance.back() = Endpoint;
+
+	//Ranges still to split with the significance of the point that opened them; a point is never
+	//ranked above its parent, which keeps the ranking identical to a recursive run at every tolerance
+	thread_local std::vector<std::tuple<size_t, size_t, double>> ranges;
+	ranges.clear();
+	ranges.emplace_back(0, count - 1, Endpoint);
+
+	while (!ranges.empty())
+	{
+		const auto [first, last, parent] = ranges.back();
+		ranges.pop_back();
+
+		if (last <= first + 1)
+			continue;
+
+		const auto start = fPointAt(first);
+		const auto end = fPointAt(last);
+
+		size_t farthest = first + 1;
+		double maxDistance = -1.0;
+		for (size_t i = first + 1; i < last; i++)
+		{
+			const auto distance = DistanceToSegment_(fPointAt(i), start, end);
+			if (distance > maxDistance)
+			{
+				maxDistance = distance;
+				farthest = i;
+			}
+		}
+
+		const auto rank = std::min(maxDistance, parent);
+		significance[farthest] = rank;
+
+		ranges.emplace_back(first, farthest, rank);
+		ranges.emplace_back(farthest, last, rank);
+	}
+}
+
+template<typename F>
+void Simplifier::Simplify(const size_t count, F&& fPointAt, const double tolerance, std::vector<size_t>& kept)
+{
+	thread_local std::vector<double> significance;
+	Rank(count, std::forward<F>(fPointAt), significance);
+
+	kept.clear();
+	for (size_t i = 0; i < count; i++)
+	{
+		if (significance[i] > tolerance)
+			kept.push_back(i);
+	}
+}
+
+inline double Simplifier::GetCurveDeviation(const Vector2D& start, const Vector2D& control1, const Vector2D& control2, const Vector2D& end)
+{
+	double result = 0.0;
+	for (size_t i = 1; i < CurveSampleCount; i++)
+	{
+		const auto t = static_cast<double>(i) / CurveSampleCount;
+		const auto u = 1.0 - t;
+
+		const auto point = start * (u * u * u) + control1 * (3.0 * u * u * t) + control2 * (3.0 * u * t * t) + end * (t * t * t);
+		result = std::max(result, DistanceToSegment_(point, start, end));
+	}
+
+	return result;
+}
+
+__forceinline double Simplifier::DistanceToSegment_(const Vector2D& point, const Vector2D& start, const Vector2D& end)
+{
+	const auto segment = end - start;
+	const auto lengthSquared = segment.LengthSquared();
+	if (lengthSquared == 0.0)
+		return Vector2D::Distance(point, start);
+
+	const auto t = std::clamp(Vector2D::DotProduct(point - start, segment) / lengthSquared, 0.0, 1.0);
+	return Vector2D::Distance(point, start + segment * t);
+}
@@ -0,0 +1,234 @@
+#include "stdafx.h"
+
+#include "TaskScheduler.h"
+
+#include "Profiler.h"
+
+#include <algorithm>
+#include <limits>
+
+thread_local size_t TaskScheduler::CurrentWorker_ = std::numeric_limits<size_t>::max();
+
+namespace
+{
+	//Indices are claimed one at a time by the caller and its helpers. A helper only touches the
+	//body while it is counted as running, and the caller waits for that count to drop to zero.
+	struct ForEachState
+	{
+		std::atomic<size_t> nextIndex{ 0 };
+
+		std::mutex mutex;
+		std::condition_variable cv;
+		size_t runningCount{ 0 };
+		bool bIsClosed{ false };
+	};
+}
+
+TaskScheduler* TaskScheduler::Instance()
+{
+	static TaskScheduler scheduler;
+	return &scheduler;
+}
+
+TaskScheduler::TaskScheduler()
+	: nextWorker_(0),
+	pendingCount_(0),
+	bNeedToShutDown_(false)
+{
+	//The GUI thread keeps a core to itself
+	const auto workerCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+
+	workers_.reserve(workerCount);
+	for (size_t i = 0; i < workerCount; i++)
+		workers_.emplace_back(std::make_unique<Worker>());
+
+	for (size_t i = 0; i < workerCount; i++)
+		workers_[i]->thread = std::thread(&TaskScheduler::Run_, this, i);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::scoped_lock lock(sleepMutex_);
+		bNeedToShutDown_ = true;
+	}
+	cv_.notify_all();
+
+	for (const auto& worker : workers_)
+		worker->thread.join();
+}
+
+void TaskScheduler::Post(const TaskPriority priority, std::function<void()> fJob, CancellationToken token)
+{
+	const auto queueIndex = static_cast<size_t>(priority);
+	counters_[queueIndex].depth.fetch_add(1, std::memory_order_relaxed);
+
+	//Count the job first: a worker that claims it before it is queued spins until it shows up
+	{
+		std::scoped_lock lock(sleepMutex_);
+		pendingCount_++;
+	}
+
+	//Jobs spawned by a job stay with its worker, the others are spread over the pool
+	auto workerIndex = CurrentWorker_;
+	if (workerIndex >= workers_.size())
+		workerIndex = nextWorker_.fetch_add(1, std::memory_order_relaxed) % workers_.size();
+
+	{
+		auto& worker = *workers_[workerIndex];
+		std::scoped_lock lock(worker.mutex);
+		worker.queues[queueIndex].push_back({ std::move(fJob), std::move(token), Clock::now() });
+	}
+
+	cv_.notify_one();
+}
+
+void TaskScheduler::ForEach(const TaskPriority priority, const size_t count, const std::function<void(size_t)>& fBody)
+{
+	const auto state = std::make_shared<ForEachState>();
+	const CancellationToken token;
+
+	for (size_t i = 1; i < std::min(count, workers_.size() + 1); i++)
+	{
+		Post(priority, [state, fBody = &fBody, count]
+		{
+			{
+				std::scoped_lock lock(state->mutex);
+				if (state->bIsClosed)
+					return;
+
+				state->runningCount++;
+			}
+
+			for (auto index = state->nextIndex++; index < count; index = state->nextIndex++)
+				(*fBody)(index);
+
+			std::scoped_lock lock(state->mutex);
+			state->runningCount--;
+			state->cv.notify_all();
+		}, token);
+	}
+
+	for (auto index = state->nextIndex++; index < count; index = state->nextIndex++)
+		fBody(index);
+
+	//Helpers that have not started yet would find nothing left to do
+	token.Cancel();
+
+	std::unique_lock lk(state->mutex);
+	state->bIsClosed = true;
+	state->cv.wait(lk, [&state] { return state->runningCount == 0; });
+}
+
+TaskScheduler::QueueStats TaskScheduler::GetStats(const TaskPriority priority) const
+{
+	const auto& counters = counters_[static_cast<size_t>(priority)];
+
+	const auto completedCount = counters.completedCount.load(std::memory_order_relaxed);
+	const auto cancelledCount = counters.cancelledCount.load(std::memory_order_relaxed);
+	const auto startedCount = completedCount + cancelledCount;
+
+	QueueStats stats{};
+	stats.depth = counters.depth.load(std::memory_order_relaxed);
+	stats.completedCount = completedCount;
+	stats.cancelledCount = cancelledCount;
+	stats.maxLatencyMs = counters.maxLatencyUs.load(std::memory_order_relaxed) / 1000.0;
+
+	if (startedCount != 0)
+		stats.averageLatencyMs = counters.totalLatencyUs.load(std::memory_order_relaxed) / 1000.0 / startedCount;
+	if (completedCount != 0)
+		stats.averageRunMs = counters.totalRunUs.load(std::memory_order_relaxed) / 1000.0 / completedCount;
+
+	return stats;
+}
+
+void TaskScheduler::Run_(const size_t workerIndex)
+{
+	CurrentWorker_ = workerIndex;
+	Profiler::Instance()->SetThreadName(QString("Worker %0").arg(workerIndex));
+
+	while (true)
+	{
+		{
+			std::unique_lock lk(sleepMutex_);
+			cv_.wait(lk, [this] { return pendingCount_ != 0 || bNeedToShutDown_; });
+
+			//Queued jobs are still run on shutdown so their owners are not left waiting
+			if (pendingCount_ == 0)
+				return;
+
+			pendingCount_--;
+		}
+
+		Task task;
+		TaskPriority priority;
+		while (!TryTake_(workerIndex, task, priority))
+			std::this_thread::yield();
+
+		Execute_(task, priority);
+	}
+}
+
+bool TaskScheduler::TryTake_(const size_t workerIndex, Task& task, TaskPriority& priority)
+{
+	for (size_t queueIndex = 0; queueIndex < static_cast<size_t>(TaskPriority::Count); queueIndex++)
+	{
+		//Own jobs newest first while they are still in cache, stolen ones oldest first
+		{
+			auto& worker = *workers_[workerIndex];
+			std::scoped_lock lock(worker.mutex);
+
+			auto& queue = worker.queues[queueIndex];
+			if (!queue.empty())
+			{
+				task = std::move(queue.back());
+				queue.pop_back();
+				priority = static_cast<TaskPriority>(queueIndex);
+				return true;
+			}
+		}
+
+		for (size_t i = 1; i < workers_.size(); i++)
+		{
+			auto& victim = *workers_[(workerIndex + i) % workers_.size()];
+			std::scoped_lock lock(victim.mutex);
+
+			auto& queue = victim.queues[queueIndex];
+			if (!queue.empty())
+			{
+				task = std::move(queue.front());
+				queue.pop_front();
+				priority = static_cast<TaskPriority>(queueIndex);
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+void TaskScheduler::Execute_(Task& task, const TaskPriority priority)
+{
+	auto& counters = counters_[static_cast<size_t>(priority)];
+	counters.depth.fetch_sub(1, std::memory_order_relaxed);
+
+	const auto startedAt = Clock::now();
+	const auto latencyUs = static_cast<quint64>(std::chrono::duration_cast<std::chrono::microseconds>(startedAt - task.postedAt).count());
+
+	counters.totalLatencyUs.fetch_add(latencyUs, std::memory_order_relaxed);
+
+	auto maxLatencyUs = counters.maxLatencyUs.load(std::memory_order_relaxed);
+	while (latencyUs > maxLatencyUs && !counters.maxLatencyUs.compare_exchange_weak(maxLatencyUs, latencyUs, std::memory_order_relaxed));
+
+	if (task.token.IsCancelled())
+	{
+		counters.cancelledCount.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	task.fJob();
+
+	const auto runUs = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - startedAt).count();
+	counters.totalRunUs.fetch_add(static_cast<quint64>(runUs), std::memory_order_relaxed);
+	counters.completedCount.fetch_add(1, std::memory_order_relaxed);
+}
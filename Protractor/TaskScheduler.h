@@ -0,0 +1,180 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <array>
+#include <memory>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <type_traits>
+#include <QObject>
+#include <QPointer>
+#include <QCoreApplication>
+
+//Jobs are taken strictly by priority: a worker drains every queue of a higher priority,
+//its own and the ones it can steal from, before it looks at a lower one
+enum class TaskPriority : uint8_t
+{
+	INTERACTIVE,	//Snap queries, the user is waiting on the result
+	RENDER,			//Tile and preview rendering
+	BACKGROUND,		//I/O and compaction
+
+	Count
+};
+
+//Shared flag checked by the scheduler before a job starts and by long jobs between steps.
+//Copies observe the same flag, so the GUI can keep one and hand the others to its jobs.
+class CancellationToken
+{
+public:
+	CancellationToken() : bIsCancelled_(std::make_shared<std::atomic<bool>>(false)) {}
+
+	void Cancel() const { bIsCancelled_->store(true, std::memory_order_relaxed); }
+
+	[[nodiscard]] bool IsCancelled() const { return bIsCancelled_->load(std::memory_order_relaxed); }
+
+private:
+	std::shared_ptr<std::atomic<bool>> bIsCancelled_;
+};
+
+//Application-wide work-stealing pool. Each worker owns one deque per priority, runs its own
+//jobs newest first and steals the oldest ones from the others; jobs posted from outside the
+//pool are spread over the workers round-robin.
+class TaskScheduler
+{
+	TaskScheduler();
+
+public:
+	static TaskScheduler* Instance();
+
+	~TaskScheduler();
+
+	TaskScheduler(const TaskScheduler&) = delete;
+	TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+	struct QueueStats
+	{
+		size_t depth;
+		quint64 completedCount;
+		quint64 cancelledCount;
+
+		//Time from posting a job to a worker picking it up, and time spent running it
+		double averageLatencyMs;
+		double maxLatencyMs;
+		double averageRunMs;
+	};
+
+	void Post(TaskPriority priority, std::function<void()> fJob, CancellationToken token = {});
+
+	//Runs fJob on the pool and hands its result to fContinuation on the GUI thread. The
+	//continuation is dropped if the token is cancelled or the GUI-thread context is destroyed
+	//meanwhile; both are checked on the GUI thread, right before the continuation runs.
+	//The returned future is ready once the continuation is queued or the job is dropped, so an
+	//owner the job refers to can wait on it before it goes away.
+	template<typename FJob, typename FContinuation>
+	std::future<void> Post(TaskPriority priority, FJob&& fJob, QObject* context, FContinuation&& fContinuation, CancellationToken token = {});
+
+	//Runs fBody for every index below count on the pool and returns once all of them are done.
+	//The calling thread takes part, so a job may call this without waiting on a busy pool.
+	void ForEach(TaskPriority priority, size_t count, const std::function<void(size_t)>& fBody);
+
+	[[nodiscard]] QueueStats GetStats(TaskPriority priority) const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Task
+	{
+		std::function<void()> fJob;
+		CancellationToken token;
+		Clock::time_point postedAt;
+	};
+
+	struct Worker
+	{
+		std::mutex mutex;
+		std::array<std::deque<Task>, static_cast<size_t>(TaskPriority::Count)> queues;
+		std::thread thread;
+	};
+
+	struct Counters
+	{
+		std::atomic<size_t> depth{ 0 };
+		std::atomic<quint64> completedCount{ 0 };
+		std::atomic<quint64> cancelledCount{ 0 };
+		std::atomic<quint64> totalLatencyUs{ 0 };
+		std::atomic<quint64> maxLatencyUs{ 0 };
+		std::atomic<quint64> totalRunUs{ 0 };
+	};
+
+	void Run_(size_t workerIndex);
+
+	bool TryTake_(size_t workerIndex, Task& task, TaskPriority& priority);
+	void Execute_(Task& task, TaskPriority priority);
+
+	std::vector<std::unique_ptr<Worker>> workers_;
+	std::array<Counters, static_cast<size_t>(TaskPriority::Count)> counters_;
+	std::atomic<size_t> nextWorker_;
+
+	//Sleeping workers wait here; pendingCount_ is only changed under the lock so no wakeup is lost
+	std::mutex sleepMutex_;
+	std::condition_variable cv_;
+	size_t pendingCount_;
+	bool bNeedToShutDown_;
+
+	static thread_local size_t CurrentWorker_;
+
+public:
+	__forceinline size_t GetWorkerCount() const { return workers_.size(); }
+};
+
+template<typename FJob, typename FContinuation>
+std::future<void> TaskScheduler::Post(const TaskPriority priority, FJob&& fJob, QObject* context, FContinuation&& fContinuation, CancellationToken token)
+{
+	//A dropped job destroys the promise unfulfilled, which makes the future ready as well
+	auto done = std::make_shared<std::promise<void>>();
+	auto result = done->get_future();
+
+	Post(priority, [fJob = std::forward<FJob>(fJob), fContinuation = std::forward<FContinuation>(fContinuation), guard = QPointer<QObject>(context), token, done]() mutable
+	{
+		//The context may be destroyed on the GUI thread at any time, so it is never touched here. The call
+		//goes to the application object, and the pointer is only read once it runs on the GUI thread
+		auto* application = QCoreApplication::instance();
+
+		if constexpr (std::is_void_v<std::invoke_result_t<FJob&>>)
+		{
+			fJob();
+
+			if (application != nullptr && !token.IsCancelled())
+			{
+				QMetaObject::invokeMethod(application, [fContinuation = std::move(fContinuation), guard = std::move(guard), token]() mutable
+				{
+					if (guard != nullptr && !token.IsCancelled())
+						fContinuation();
+				}, Qt::QueuedConnection);
+			}
+		}
+		else
+		{
+			auto jobResult = fJob();
+
+			if (application != nullptr && !token.IsCancelled())
+			{
+				QMetaObject::invokeMethod(application, [fContinuation = std::move(fContinuation), jobResult = std::move(jobResult), guard = std::move(guard), token]() mutable
+				{
+					if (guard != nullptr && !token.IsCancelled())
+						fContinuation(std::move(jobResult));
+				}, Qt::QueuedConnection);
+			}
+		}
+
+		done->set_value();
+	}, token);
+
+	return result;
+}
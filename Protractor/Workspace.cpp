@@ -4,13 +4,31 @@
 #include "Shape.h"
 #include "MainWindow.h"
 #include "NodeSearcher.h"
+#include "CompactDocument.h"
+#include "BlueprintFormat.h"
+#include "BlueprintChunk.h"
+#include "BlueprintReader.h"
+#include "MappedDocument.h"
+#include "EditJournal.h"
+#include "DocumentSnapshot.h"
+#include "BlueprintSaver.h"
+#include "Simplifier.h"
+#include "Profiler.h"
 #include <QPainter>
+#include <QPrinter>
 #include <functional>
+#include <optional>
+#include <ranges>
+#include <unordered_map>
+#include <algorithm>
 
 Workspace::Workspace(QWidget* parent, const FormatType type, NodeSearcher* nodeSearcher)
 	: QWidget(parent),
 	type_(type),
+	editGeneration_(0),
+	saver_(new BlueprintSaver()),
 	selectedNode_(nullptr),
+	cursorPos_(0.0, 0.0),
 	targetPos_(0.0, 0.0),
 	offset_(0.0, 0.0),
 	startPan_(0.0, 0.0),
@@ -20,17 +38,34 @@ Workspace::Workspace(QWidget* parent, const FormatType type, NodeSearcher* nodeS
 	bIsCtrlPressed_(false),
 	bIsShiftPressed_(false),
 	bIsAltPressed_(false),
-	nodesOnLines_(nullptr, nullptr),
+	nodesOnLines_(std::nullopt, std::nullopt),
+	pendingSnapArrival_(-1),
+	bIsLoading_(false),
 	currentState_(State::NONE)
 {
 	setFocusPolicy(Qt::StrongFocus);
 	setAttribute(Qt::WA_StaticContents);
 	setMouseTracking(true);
 
+	frameTimer_.setSingleShot(true);
+	frameTimer_.setTimerType(Qt::PreciseTimer);
+	connect(&frameTimer_, &QTimer::timeout, this, &Workspace::OnFrame_);
+	sinceLastFrame_.start();
+
+	unpaintedInputs_.fill(-1);
+
 	InitializeStates_();
 }
 
-Workspace::~Workspace() { }
+Workspace::~Workspace()
+{
+	//Searcher jobs look their workspace up under the mutex, so none of them reaches this one afterwards
+	if (nodeSearcher_ != nullptr)
+	{
+		std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+		nodeSearcher_->Detach(this);
+	}
+}
 
 void Workspace::ResetTransform()
 {
@@ -101,9 +136,10 @@ void Workspace::ST_NONE_OnMouseRelease_(const QMouseEvent* event)
 	{
 		const auto worldPos = ScreenToWorld(targetPos_);
 
+		//Workspaces replayed without a window draw with the default pen
 		const auto mw = dynamic_cast<MainWindow*>(window());
 		
-		selectedShape_ = shapeFactory_->Create(mw->GetPen());
+		selectedShape_ = shapeFactory_->Create(styles_.Intern(mw != nullptr ? mw->GetPen() : QPen()));
 
 		selectedShape_->GetNextNode()->position = worldPos;
 		selectedNode_ = selectedShape_->GetNextNode();
@@ -125,15 +161,35 @@ void Workspace::ST_NONE_OnMouseRelease_(const QMouseEvent* event)
 			auto* hitNode = shapeIt->get()->HasNode(targetPos_, fWorldToScreen);
 			if (hitNode != nullptr)
 			{
-				std::unique_lock<std::mutex>(NodeSearchMutex);
+				std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
 
-				selectedShape_ = std::move(*shapeIt);
-				selectedNode_ = hitNode;
+				if (journal_ != nullptr)
+					journal_->RecordRemove(**shapeIt, styles_);
+
+				const auto hitNodeIndex = static_cast<size_t>(hitNode - shapeIt->get()->GetNodes().data());
+				selectedShape_ = shapeIt->get()->Clone();
+				selectedNode_ = &selectedShape_->GetNodes()[hitNodeIndex];
 
 				shapes_.erase(shapeIt);
+				editGeneration_++;
 				currentState_ = State::SHAPE_MODIFICATION;
 
-				break;
+				return;
+			}
+		}
+
+		if (mappedDocument_ != nullptr)
+		{
+			std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+
+			size_t hitNodeIndex = 0;
+			auto mappedShape = mappedDocument_->TakeShape(targetPos_, fWorldToScreen, hitNodeIndex);
+			if (mappedShape != nullptr)
+			{
+				editGeneration_++;
+				selectedShape_ = std::move(mappedShape);
+				selectedNode_ = &selectedShape_->GetNodes()[hitNodeIndex];
+				currentState_ = State::SHAPE_MODIFICATION;
 			}
 		}
 
@@ -157,11 +213,7 @@ void Workspace::ST_SHAPE_MODIFICATION_OnMouseRelease_(const QMouseEvent* event)
 		}
 
 
-		if (selectedNode_ != nullptr)
-			shapes_.emplace_back(std::move(selectedShape_));
-
-		selectedNode_ = nullptr;
-		currentState_ = State::NONE;
+		CommitSelectedShape_();
 
 		break;
 	}
@@ -169,48 +221,703 @@ void Workspace::ST_SHAPE_MODIFICATION_OnMouseRelease_(const QMouseEvent* event)
 	}
 }
 
-void Workspace::ST_SHAPE_MODIFICATION_OnMouseMove_(const QMouseEvent* event)
+void Workspace::CommitSelectedShape_()
+{
+	if (selectedNode_ != nullptr)
+	{
+		//Edits only gave the shape the updates a drag needs
+		selectedShape_->Update();
+
+		if (journal_ != nullptr)
+			journal_->RecordAdd(*selectedShape_, styles_);
+
+		shapes_.emplace_back(std::move(selectedShape_));
+		editGeneration_++;
+	}
+
+	selectedNode_ = nullptr;
+	currentState_ = State::NONE;
+}
+
+void Workspace::ST_SHAPE_MODIFICATION_OnMouseMove_()
 {
 	selectedNode_->position = ScreenToWorld(targetPos_);
-	selectedNode_->parent->Update();
+	selectedNode_->parent->UpdateWhileEditing();
 }
 
 void Workspace::Serialize(QDataStream& out) const
 {
-	out << type_ << shapes_.size();
+	MakeSnapshot()->Serialize(out);
+}
 
-	for (const auto& shape : shapes_)
-		shape->Serialize(out);
+std::shared_ptr<const DocumentSnapshot> Workspace::MakeSnapshot() const
+{
+	auto result = std::make_shared<DocumentSnapshot>();
+
+	result->type = type_;
+	result->styles = styles_;
+	result->blocks = blocks_;
+	result->generation = editGeneration_;
+
+	if (compactDocument_ == nullptr)
+	{
+		result->shapes.assign(shapes_.begin(), shapes_.end());
+		return result;
+	}
+
+	//A compacted document is saved from shapes rebuilt just for the snapshot
+	result->shapes.reserve(compactDocument_->GetShapeCount());
+	for (size_t i = 0; i < compactDocument_->GetShapeCount(); i++)
+	{
+		auto shape = compactDocument_->Materialize(i);
+		if (shape != nullptr)
+			result->shapes.emplace_back(std::move(shape));
+	}
+
+	return result;
 }
 
 void Workspace::Deserialize(QDataStream& in)
 {
-	size_t shapeCount;
-	in >> type_ >> shapeCount;
+	const ProfileScope profileScope(ProfileZone::DESERIALIZE);
+
+	Expand();
+
+	BlueprintReader reader(in);
+
+	const auto bIsRead = reader.ReadHeader() && reader.ReadShapes([this](BlueprintReader::ShapeBatch&& batch)
+	{
+		shapes_.insert(shapes_.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+	});
+
+	if (!bIsRead)
+		in.setStatus(QDataStream::ReadCorruptData);
+
+	type_ = reader.GetFormatType();
+	styles_ = reader.GetStyles();
+	blocks_ = reader.GetBlocks();
+	editGeneration_++;
+
+	update();
+}
+
+void Workspace::BeginLoading(const FormatType type)
+{
+	type_ = type;
+	bIsLoading_ = true;
+}
+
+void Workspace::AppendShapes(BlueprintReader::ShapeBatch&& batch, const PenStyleTable& styles, const BlockTable& blocks)
+{
+	Expand();
+
+	{
+		std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+
+		shapes_.insert(shapes_.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+		editGeneration_++;
+	}
 
-	shapes_.reserve(shapeCount);
-	for (size_t i = 0; i < shapeCount; i++)
+	//Editing is blocked while loading, so the loader's tables are still the only source of styles and blocks
+	if (bIsLoading_)
 	{
-		Shape::Type type;
-		in >> type;
+		styles_ = styles;
+		blocks_ = blocks;
+	}
 
-		std::unique_ptr<Shape> newShape;
+	update();
+}
 
-		switch (type)
+void Workspace::EndLoading()
+{
+	bIsLoading_ = false;
+	update();
+}
+
+void Workspace::ImportShapes(BlueprintReader::ShapeBatch&& shapes)
+{
+	Expand();
+
+	{
+		std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+
+		shapes_.reserve(shapes_.size() + shapes.size());
+		shapes_.insert(shapes_.end(), std::make_move_iterator(shapes.begin()), std::make_move_iterator(shapes.end()));
+	}
+
+	//A journal record per imported shape would outgrow the blueprint, the next save rewrites it instead
+	StopJournal();
+	editGeneration_++;
+
+	update();
+}
+
+BlockIndex Workspace::DefineBlock(const QString& name, BlueprintReader::ShapeBatch&& shapes)
+{
+	const auto blockIndex = blocks_.Add(std::make_shared<const Block>(name, std::move(shapes)));
+
+	//The block table is only written with the whole file, so the journal cannot describe it
+	StopJournal();
+	editGeneration_++;
+
+	return blockIndex;
+}
+
+bool Workspace::MakeArray(const ShapeArray::Settings& settings)
+{
+	Expand();
+
+	std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+
+	if (shapes_.empty() || shapes_.back()->GetType() == Shape::Type::ARRAY)
+		return false;
+
+	auto& source = shapes_.back();
+	auto array = std::make_shared<ShapeArray>(source, settings);
+
+	if (journal_ != nullptr)
+	{
+		journal_->RecordRemove(*source, styles_);
+		journal_->RecordAdd(*array, styles_);
+	}
+
+	source = std::move(array);
+	editGeneration_++;
+
+	update();
+
+	return true;
+}
+
+size_t Workspace::MergeConnectedLines()
+{
+	Expand();
+
+	struct EndpointKey
+	{
+		QuantizedVector2D position;
+		StyleIndex styleIndex;
+
+		bool operator==(const EndpointKey& other) const { return position == other.position && styleIndex == other.styleIndex; }
+	};
+
+	struct EndpointKeyHash
+	{
+		size_t operator()(const EndpointKey& key) const
 		{
-		case Shape::Type::LINE: newShape = std::make_unique<Line>(); break;
-		case Shape::Type::BOX: newShape = std::make_unique<Box>(); break;
-		case Shape::Type::CIRCLE: newShape = std::make_unique<Circle>(); break;
-		case Shape::Type::OVAL: newShape = std::make_unique<Oval>(); break;
-		case Shape::Type::CURVE: newShape = std::make_unique<Curve>(); break;
-		case Shape::Type::SECTOR: newShape = std::make_unique<Sector>(); break;
+			return std::hash<quint64>()((static_cast<quint64>(static_cast<quint32>(key.position.x)) << 32) | static_cast<quint32>(key.position.y))
+				^ (static_cast<size_t>(key.styleIndex) * 0x9E3779B97F4A7C15ull);
 		}
+	};
+
+	std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+
+	//Only lines whose endpoints can be quantized are indexed
+	const auto fKeyOf = [this](const size_t shapeIndex, const size_t nodeIndex)
+	{
+		const auto& shape = *shapes_[shapeIndex];
+		return EndpointKey{ *QuantizedVector2D::FromVector2D(shape.GetNodes()[nodeIndex].position), shape.GetStyleIndex() };
+	};
+
+	//Lines touching every endpoint; only endpoints shared by exactly two lines continue a chain
+	std::unordered_map<EndpointKey, std::vector<size_t>, EndpointKeyHash> linesAt;
+	std::vector<bool> bIsIndexed(shapes_.size(), false);
+	for (size_t i = 0; i < shapes_.size(); i++)
+	{
+		if (shapes_[i]->GetType() != Shape::Type::LINE)
+			continue;
+
+		const auto& nodes = shapes_[i]->GetNodes();
+		if (!QuantizedVector2D::FromVector2D(nodes[0].position).has_value() || !QuantizedVector2D::FromVector2D(nodes[1].position).has_value())
+			continue;
 
-		if (newShape != nullptr)
+		linesAt[fKeyOf(i, 0)].push_back(i);
+		linesAt[fKeyOf(i, 1)].push_back(i);
+		bIsIndexed[i] = true;
+	}
+
+	const auto fIsChainEnd = [&](const EndpointKey& at) { return linesAt.at(at).size() != 2; };
+
+	std::vector<bool> bIsMerged(shapes_.size(), false);
+
+	//A merged chain takes the place of its earliest line, so the document keeps its order
+	std::vector<std::shared_ptr<Shape>> polylineAt(shapes_.size());
+	size_t polylineCount = 0;
+
+	const auto fNextLine = [&](const size_t line, const EndpointKey& at) -> std::optional<size_t>
+	{
+		const auto& lines = linesAt.at(at);
+		if (lines.size() != 2)
+			return std::nullopt;
+
+		const auto next = lines[0] == line ? lines[1] : lines[0];
+		if (next == line || bIsMerged[next])
+			return std::nullopt;
+
+		return next;
+	};
+
+	//Follows a chain from one of its ends, or around a closed loop, visiting each line once
+	const auto fMergeChain = [&](const size_t start, const EndpointKey& startEnd)
+	{
+		std::vector<Vector2D> points;
+		auto earliest = start;
+
+		auto line = start;
+		auto lineStart = startEnd;
+		points.push_back(shapes_[line]->GetNodes()[fKeyOf(line, 0) == lineStart ? 0 : 1].position);
+		while (true)
 		{
-			newShape->Deserialize(in);
-			shapes_.emplace_back(std::move(newShape));
+			bIsMerged[line] = true;
+			earliest = std::min(earliest, line);
+
+			const auto bIsReversed = fKeyOf(line, 0) != lineStart;
+			const auto lineEnd = fKeyOf(line, bIsReversed ? 0 : 1);
+			points.push_back(shapes_[line]->GetNodes()[bIsReversed ? 0 : 1].position);
+
+			const auto next = fNextLine(line, lineEnd);
+			if (!next.has_value())
+				break;
+
+			line = *next;
+			lineStart = lineEnd;
+		}
+
+		//A single line stays a Line
+		if (points.size() < 3)
+		{
+			bIsMerged[start] = false;
+			return;
+		}
+
+		auto polyline = Shape::Make(Shape::Type::POLYLINE);
+		polyline->Restore(shapes_[start]->GetStyleIndex(), points.size(), [&points](const size_t i) { return points[i]; });
+		polylineAt[earliest] = std::move(polyline);
+		polylineCount++;
+	};
+
+	//Open chains are started from an end, in document order so the result does not depend on hashing
+	for (size_t i = 0; i < shapes_.size(); i++)
+	{
+		if (!bIsIndexed[i] || bIsMerged[i])
+			continue;
+
+		if (fIsChainEnd(fKeyOf(i, 0)))
+			fMergeChain(i, fKeyOf(i, 0));
+		else if (fIsChainEnd(fKeyOf(i, 1)))
+			fMergeChain(i, fKeyOf(i, 1));
+	}
+
+	//Every line left with both ends continued belongs to a closed loop
+	for (size_t i = 0; i < shapes_.size(); i++)
+	{
+		if (bIsIndexed[i] && !bIsMerged[i] && !fIsChainEnd(fKeyOf(i, 0)) && !fIsChainEnd(fKeyOf(i, 1)))
+			fMergeChain(i, fKeyOf(i, 0));
+	}
+
+	if (polylineCount == 0)
+		return 0;
+
+	std::vector<std::shared_ptr<Shape>> shapes;
+	shapes.reserve(shapes_.size());
+	for (size_t i = 0; i < shapes_.size(); i++)
+	{
+		if (polylineAt[i] != nullptr)
+			shapes.emplace_back(std::move(polylineAt[i]));
+		else if (!bIsMerged[i])
+			shapes.emplace_back(std::move(shapes_[i]));
+	}
+
+	shapes_ = std::move(shapes);
+
+	//Like an import, the next save rewrites the file instead of journaling every removed line
+	StopJournal();
+	editGeneration_++;
+
+	update();
+
+	return polylineCount;
+}
+
+size_t Workspace::SimplifyPolylines(const double tolerance, const std::optional<QRectF>& region, const bool bSimplifyCurves)
+{
+	Expand();
+
+	std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+
+	SimplifyUndo undo;
+	size_t removedCount = 0;
+	std::vector<size_t> kept;
+
+	for (size_t i = 0; i < shapes_.size(); i++)
+	{
+		auto& shape = shapes_[i];
+
+		const auto type = shape->GetType();
+		if (type != Shape::Type::POLYLINE && (type != Shape::Type::CURVE || !bSimplifyCurves))
+			continue;
+
+		if (region.has_value() && !region->contains(shape->GetBounds()))
+			continue;
+
+		//Shapes are shared with save snapshots, so the simplified one replaces it instead of editing it
+		const auto& nodes = shape->GetNodes();
+		std::unique_ptr<Shape> simplified;
+
+		if (type == Shape::Type::POLYLINE)
+		{
+			Simplifier::Simplify(nodes.size(), [&nodes](const size_t n) { return nodes[n].position; }, tolerance, kept);
+			if (kept.size() == nodes.size())
+				continue;
+
+			simplified = Shape::Make(Shape::Type::POLYLINE);
+			simplified->Restore(shape->GetStyleIndex(), kept.size(), [&nodes, &kept](const size_t n) { return nodes[kept[n]].position; });
+
+			removedCount += nodes.size() - kept.size();
 		}
+		else
+		{
+			//A curve runs from its first to its second node, bent towards the third one
+			const auto& start = nodes[0].position;
+			const auto& end = nodes[1].position;
+			if (Simplifier::GetCurveDeviation(start, start, nodes[2].position, end) > tolerance)
+				continue;
+
+			simplified = Shape::Make(Shape::Type::LINE);
+			simplified->Restore(shape->GetStyleIndex(), 2, [&nodes](const size_t n) { return nodes[n].position; });
+
+			removedCount++;
+		}
+
+		undo.replaced.emplace_back(i, std::move(shape));
+		shape = std::move(simplified);
+	}
+
+	if (removedCount == 0)
+		return 0;
+
+	//Like an import, the next save rewrites the file instead of journaling every replaced polyline
+	StopJournal();
+	editGeneration_++;
+
+	undo.generation = editGeneration_;
+	simplifyUndo_ = std::move(undo);
+
+	update();
+
+	return removedCount;
+}
+
+bool Workspace::UndoSimplify()
+{
+	if (!CanUndoSimplify())
+	{
+		simplifyUndo_.reset();
+		return false;
+	}
+
+	Expand();
+
+	{
+		std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+
+		//Nothing was added or removed since, so every shape is still at the index it was replaced at
+		for (auto& [index, original] : simplifyUndo_->replaced)
+			shapes_[index] = std::move(original);
+
+		editGeneration_++;
+	}
+
+	simplifyUndo_.reset();
+
+	StopJournal();
+	update();
+
+	return true;
+}
+
+QRectF Workspace::GetVisibleArea() const
+{
+	return QRectF(ScreenToWorld(Vector2D(0.0, 0.0)), ScreenToWorld(Vector2D(width(), height()))).normalized();
+}
+
+bool Workspace::StartJournal()
+{
+	if (filePath_.isEmpty() || mappedDocument_ != nullptr)
+		return false;
+
+	//The old journal truncates its file on destruction, so it has to go before the new one opens it
+	journal_.reset();
+	journal_ = std::make_unique<EditJournal>();
+	if (journal_->Start(filePath_, styles_))
+		return true;
+
+	journal_.reset();
+	return false;
+}
+
+bool Workspace::CommitJournal()
+{
+	return journal_ != nullptr && journal_->Commit();
+}
+
+void Workspace::StopJournal()
+{
+	journal_.reset();
+}
+
+bool Workspace::ResumeJournal(const qint64 end, const qint64 committedEnd)
+{
+	journal_.reset();
+	journal_ = std::make_unique<EditJournal>();
+	if (journal_->Resume(filePath_, end, committedEnd, styles_))
+		return true;
+
+	journal_.reset();
+	return false;
+}
+
+bool Workspace::ReplayJournal(const qint64 end)
+{
+	Expand();
+
+	std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+
+	const auto bIsReplayed = EditJournal::ReplayInto(filePath_, end, styles_, blocks_, shapes_);
+
+	editGeneration_++;
+
+	update();
+	return bIsReplayed;
+}
+
+std::unique_ptr<BlueprintSaver> Workspace::TakeSaver(const BlueprintChunk::EncodingOptions& options)
+{
+	//A running save replaces the file anyway, and a file still being loaded or mapped cannot be replaced
+	if (!filePath_.isEmpty() && !bIsLoading_ && mappedDocument_ == nullptr && !saver_->IsBusy())
+	{
+		//With every journaled edit committed the document is exactly what file and journal add up to
+		std::shared_ptr<const DocumentSnapshot> current;
+		if (journal_ != nullptr && !journal_->HasUncommittedEdits())
+			current = MakeSnapshot();
+
+		//Closing the journal drops the records that were never saved
+		StopJournal();
+
+		saver_->Fold(filePath_, std::move(current), options);
+	}
+
+	return std::move(saver_);
+}
+
+qint64 Workspace::GetJournalSize() const
+{
+	return journal_ != nullptr ? journal_->GetSize() : 0;
+}
+
+bool Workspace::HasUncommittedEdits() const
+{
+	return journal_ != nullptr && journal_->HasUncommittedEdits();
+}
+
+bool Workspace::OpenMapped(const QString& path)
+{
+	auto newMappedDocument = std::make_unique<MappedDocument>();
+	if (!newMappedDocument->Open(path, type_, styles_))
+		return false;
+
+	std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+	mappedDocument_ = std::move(newMappedDocument);
+	editGeneration_++;
+
+	update();
+	return true;
+}
+
+void Workspace::ReleaseMapped()
+{
+	if (mappedDocument_ == nullptr)
+		return;
+
+	std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+
+	mappedDocument_->TakeAll(shapes_);
+	mappedDocument_.reset();
+}
+
+size_t Workspace::GetShapeCount() const
+{
+	return compactDocument_ != nullptr ? compactDocument_->GetShapeCount() : shapes_.size();
+}
+
+size_t Workspace::GetNodeCount() const
+{
+	if (compactDocument_ != nullptr)
+		return compactDocument_->GetNodeCount();
+
+	size_t nodeCount = 0;
+	for (const auto& shape : shapes_)
+		nodeCount += shape->GetNodes().size();
+
+	return nodeCount;
+}
+
+MemoryReport Workspace::GetMemoryReport() const
+{
+	MemoryReport result;
+
+	for (const auto& shape : shapes_)
+	{
+		const auto type = static_cast<size_t>(shape->GetType());
+		result.shapeCounts[type]++;
+		result.shapes[type] += shape->GetMemoryUsage();
+	}
+
+	if (compactDocument_ != nullptr)
+	{
+		result.compactDocument = sizeof(CompactDocument) + compactDocument_->GetMemoryUsage();
+
+		for (size_t i = 0; i < compactDocument_->GetShapeCount(); i++)
+		{
+			const auto type = compactDocument_->GetShape(i).type;
+			result.shapeCounts[static_cast<size_t>(type)]++;
+
+			if (!Shape::IsChunkable(type))
+				result.shapes[static_cast<size_t>(type)] += compactDocument_->Materialize(i)->GetMemoryUsage();
+		}
+	}
+
+	if (selectedShape_ != nullptr)
+		result.editedShape = selectedShape_->GetMemoryUsage();
+
+	result.shapeList = shapes_.size() * (sizeof(std::shared_ptr<Shape>) + Shape::MemoryUsage::ControlBlockSize);
+	result.shapeListSlack = (shapes_.capacity() - shapes_.size()) * sizeof(std::shared_ptr<Shape>);
+
+	result.pens = styles_.GetMemoryUsage();
+
+	result.blockCount = blocks_.GetSize();
+	for (size_t i = 0; i < blocks_.GetSize(); i++)
+	{
+		const auto& block = blocks_.Get(static_cast<BlockIndex>(i));
+		result.blocks += block->GetMemoryUsage();
+		result.blockRasters += block->GetRasterMemoryUsage();
+	}
+
+	if (nodeSearcher_ != nullptr)
+		result.snapIndex = nodeSearcher_->GetPrefetchMemoryUsage(this);
+
+	if (simplifyUndo_.has_value())
+	{
+		for (const auto& [index, original] : simplifyUndo_->replaced)
+			result.simplifyUndo += original->GetMemoryUsage().GetTotal() + sizeof(std::pair<size_t, std::shared_ptr<Shape>>);
+	}
+
+	if (mappedDocument_ != nullptr)
+	{
+		result.mappedDocument = sizeof(MappedDocument) + mappedDocument_->GetMemoryUsage();
+		result.mappedFile = mappedDocument_->GetMappedSize();
+	}
+
+	return result;
+}
+
+size_t Workspace::TrimCaches()
+{
+	size_t result = 0;
+
+	for (size_t i = 0; i < blocks_.GetSize(); i++)
+		result += blocks_.Get(static_cast<BlockIndex>(i))->ClearRasters();
+
+	if (nodeSearcher_ != nullptr)
+		result += nodeSearcher_->ClearPrefetched(this);
+
+	if (mappedDocument_ != nullptr)
+		result += mappedDocument_->ClearScratchShapes();
+
+	//Shapes of a simplification that can no longer be undone are only waiting for the next one
+	if (simplifyUndo_.has_value() && !CanUndoSimplify())
+	{
+		for (const auto& [index, original] : simplifyUndo_->replaced)
+			result += original.use_count() == 1 ? original->GetMemoryUsage().GetTotal() : 0;
+
+		simplifyUndo_.reset();
+	}
+
+	{
+		std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+
+		result += (shapes_.capacity() - shapes_.size()) * sizeof(std::shared_ptr<Shape>);
+		shapes_.shrink_to_fit();
+	}
+
+	return result;
+}
+
+std::optional<CompactDocument> Workspace::MakeCompactDocument() const
+{
+	size_t nodeCount = 0;
+	for (const auto& shape : shapes_)
+		nodeCount += shape->GetNodes().size();
+
+	CompactDocument result;
+	result.Reserve(shapes_.size(), nodeCount);
+	result.SetStyles(styles_);
+
+	for (const auto& shape : shapes_)
+	{
+		if (!result.Append(shape))
+			return std::nullopt;
+	}
+
+	return result;
+}
+
+bool Workspace::Compact()
+{
+	if (compactDocument_ != nullptr)
+		return true;
+
+	if (bIsLoading_ || mappedDocument_ != nullptr || selectedShape_ != nullptr)
+		return false;
+
+	auto document = MakeCompactDocument();
+	if (!document.has_value())
+		return false;
+
+	std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+
+	compactDocument_ = std::make_unique<CompactDocument>(std::move(*document));
+	std::vector<std::shared_ptr<Shape>>().swap(shapes_);
+
+	//Rounded positions no longer match the journal's records or a save in progress
+	if (!compactDocument_->IsExact())
+	{
+		StopJournal();
+		editGeneration_++;
+	}
+
+	return true;
+}
+
+void Workspace::Expand()
+{
+	if (compactDocument_ == nullptr)
+		return;
+
+	std::vector<std::shared_ptr<Shape>> shapes;
+	shapes.reserve(compactDocument_->GetShapeCount());
+	for (size_t i = 0; i < compactDocument_->GetShapeCount(); i++)
+	{
+		auto shape = compactDocument_->Materialize(i);
+		if (shape != nullptr)
+			shapes.emplace_back(std::move(shape));
+	}
+
+	{
+		std::scoped_lock lock(NodeSearcher::NodeSearchMutex);
+
+		shapes_ = std::move(shapes);
+		compactDocument_.reset();
 	}
 
 	update();
@@ -241,10 +948,34 @@ void Workspace::DrawFrame(QPainter* painter) const
 	painter->drawLines(lines.data(), 7);
 }
 
+void Workspace::Print(QPrinter* printer, const Vector2D& offset, const bool bShouldPrintFrame) const
+{
+	const ProfileScope profileScope(ProfileZone::PRINT);
+
+	QPainter painter(printer);
+	painter.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
+
+	const auto* wsSettings = WorkspaceSettings::Instance();
+	const auto scale = printer->paperRect(QPrinter::DevicePixel).width() / wsSettings->GetMaxWorkspaceSize().x;
+	painter.translate(offset * scale);
+	painter.scale(scale, scale);
+	DrawShapes(&painter);
+
+	if (bShouldPrintFrame)
+	{
+		const auto frameScale = printer->paperRect(QPrinter::DevicePixel).width() / wsSettings->GetFormatSizeByType(type_).x;
+		painter.resetTransform();
+		painter.scale(frameScale, frameScale);
+		DrawFrame(&painter);
+	}
+}
+
 void Workspace::paintEvent(QPaintEvent* event)
 {
 	QWidget::paintEvent(event);
 
+	const ProfileScope profileScope(ProfileZone::PAINT);
+
 	QPainter painter(this);
 
 	painter.setRenderHints(QPainter::Antialiasing | QPainter::SmoothPixmapTransform);
@@ -254,12 +985,32 @@ void Workspace::paintEvent(QPaintEvent* event)
 	DrawShapes(&painter);
 
 	DrawHelpers_(&painter);
+
+	if (WorkspaceSettings::Instance()->IsProfilerOverlayVisible())
+	{
+		painter.resetTransform();
+		profilerOverlay_.Draw(&painter);
+	}
+
+	painter.end();
+
+	//Inputs marked since the previous paint are on screen from now on
+	for (size_t i = 0; i < unpaintedInputs_.size(); i++)
+	{
+		if (unpaintedInputs_[i] < 0)
+			continue;
+
+		Profiler::Instance()->RecordLatency(static_cast<LatencyPath>(i), Profiler::Now() - unpaintedInputs_[i]);
+		unpaintedInputs_[i] = -1;
+	}
 }
 
 void Workspace::mousePressEvent(QMouseEvent* event)
 {
 	QWidget::mousePressEvent(event);
 
+	FlushPendingMove_();
+
 	startPan_ = event->position();
 }
 
@@ -267,40 +1018,172 @@ void Workspace::mouseReleaseEvent(QMouseEvent* event)
 {
 	QWidget::mouseReleaseEvent(event);
 
+	const auto arrival = StampInput_();
+
+	//Clicks act on the position the user sees, not on one a frame behind
+	FlushPendingMove_();
+
+	if (bIsLoading_)
+		return;
+
 	const auto f = states_[static_cast<size_t>(currentState_)].OnMouseRelease;
 	if (f != nullptr)
 		(this->*f)(event);
+
+	MarkInput_(LatencyPath::CLICK, arrival);
 }
 
 void Workspace::mouseMoveEvent(QMouseEvent* event)
 {
 	QWidget::mouseMoveEvent(event);
 
-	targetPos_ = event->position();
+	//A move still waiting for its frame is replaced, latency counts from the oldest of them
+	auto arrival = StampInput_();
+	if (pendingMove_.has_value())
+	{
+		Profiler::Count(ProfileCounter::INPUT_COALESCED);
+		if (pendingMove_->arrival >= 0)
+			arrival = pendingMove_->arrival;
+	}
+
+	pendingMove_ = PendingMove{ event->position(), event->buttons(), arrival };
+	cursorPredictor_.AddSample(event->position(), event->timestamp());
+
+	RequestFrame_();
+}
+
+void Workspace::RequestFrame_()
+{
+	if (frameTimer_.isActive())
+		return;
+
+	//The first move after an idle frame runs at once, later ones wait for the next refresh
+	const auto frameInterval = static_cast<qint64>(GetFrameInterval());
+
+	frameTimer_.start(static_cast<int>(std::max<qint64>(0, frameInterval - sinceLastFrame_.elapsed())));
+}
+
+double Workspace::GetFrameInterval() const
+{
+	const auto refreshRate = screen() != nullptr ? screen()->refreshRate() : 60.0;
+	return 1000.0 / std::max(refreshRate, 1.0);
+}
+
+void Workspace::PrefetchSnaps_()
+{
+	//The current position covers small moves, the predicted ones the next two frames
+	std::vector<Vector2D> positions{ cursorPos_ };
 
-	const auto pressedButtons = event->buttons();
-	if (pressedButtons.testFlag(Qt::MouseButton::MiddleButton))
+	const auto frameInterval = GetFrameInterval();
+	for (const auto framesAhead : { 1.0, 2.0 })
 	{
-		offset_ += (event->position() - startPan_) / scale_;
-		startPan_ = event->position();
+		const auto predicted = cursorPredictor_.Predict(framesAhead * frameInterval);
+		if (predicted.has_value() && Vector2D::Distance(*predicted, cursorPos_) > NodeSearcher::PrefetchMargin)
+			positions.push_back(*predicted);
 	}
 
-	if (nodeSearcher_ != nullptr && (bIsCtrlPressed_ || bIsShiftPressed_))
-		nodeSearcher_->Run();
+	nodeSearcher_->Prefetch(MakeSnapQuery_().view, positions);
+}
+
+NodeSearcher::Query Workspace::MakeSnapQuery_() const
+{
+	return { { this, offset_, scale_, editGeneration_ }, cursorPos_ };
+}
+
+void Workspace::OnSnapAnswered_(const NodeSearcher::Query& query)
+{
+	//Answers for a cursor, view or document that has changed since are of no use
+	if (pendingMove_.has_value() || query != MakeSnapQuery_())
+	{
+		Profiler::Count(ProfileCounter::SNAP_ANSWERS_STALE);
+		return;
+	}
+
+	UpdateTarget_();
+}
+
+void Workspace::FlushPendingMove_()
+{
+	if (!pendingMove_.has_value())
+		return;
+
+	frameTimer_.stop();
+	OnFrame_();
+}
+
+void Workspace::OnFrame_()
+{
+	if (!pendingMove_.has_value())
+		return;
+
+	sinceLastFrame_.restart();
+
+	const auto [position, buttons, arrival] = *pendingMove_;
+	pendingMove_.reset();
+
+	MarkInput_(LatencyPath::MOVE, arrival);
+
+	cursorPos_ = position;
+
+	if (buttons.testFlag(Qt::MouseButton::MiddleButton))
+	{
+		offset_ += (position - startPan_) / scale_;
+		startPan_ = position;
+	}
+
+	UpdateTarget_();
+}
+
+qint64 Workspace::StampInput_()
+{
+	if (!Profiler::IsEnabled())
+		return -1;
+
+	Profiler::Count(ProfileCounter::INPUT_EVENTS);
+	return Profiler::Now();
+}
+
+void Workspace::MarkInput_(const LatencyPath path, const qint64 arrival)
+{
+	if (arrival < 0)
+		return;
+
+	//The previous input is not on screen yet; its latency runs on until the next paint shows both
+	auto& unpaintedArrival = unpaintedInputs_[static_cast<size_t>(path)];
+	if (unpaintedArrival >= 0)
+	{
+		if (path == LatencyPath::MOVE)
+			Profiler::Count(ProfileCounter::FRAMES_SUPERSEDED);
+
+		unpaintedArrival = std::min(unpaintedArrival, arrival);
+		return;
+	}
+
+	unpaintedArrival = arrival;
+}
+
+void Workspace::UpdateTarget_()
+{
+	targetPos_ = cursorPos_;
+
+	if (nodeSearcher_ != nullptr && (bIsCtrlPressed_ || bIsShiftPressed_) && nodeSearcher_->IsPredictionEnabled())
+		PrefetchSnaps_();
 
 	UpdateSpecialKeys_();
 
 	const auto f = states_[static_cast<size_t>(currentState_)].OnMouseMove;
 	if (f != nullptr)
-		(this->*f)(event);
+		(this->*f)();
 
 	const auto* win = dynamic_cast<MainWindow*>(window());
+	if (win != nullptr)
+	{
+		auto* coordinateLabel = win->GetCoordinateLabel();
+		coordinateLabel->setText(GetTargetPositionAsString());
 
-	auto* coordinateLabel = win->GetCoordinateLabel();
-	coordinateLabel->setText(GetTargetPositionAsString());
-
-	auto* shapeInfoLabel = win->GetShapeInfoLabel();
-	shapeInfoLabel->setText(GetSelectedShapeInfoAsString());
+		auto* shapeInfoLabel = win->GetShapeInfoLabel();
+		shapeInfoLabel->setText(GetSelectedShapeInfoAsString());
+	}
 
 	update();
 }
@@ -309,6 +1192,8 @@ void Workspace::wheelEvent(QWheelEvent* event)
 {
 	QWidget::wheelEvent(event);
 
+	const auto arrival = StampInput_();
+
 	const auto mouseWorldPositionBeforeZoom = ScreenToWorld(event->position());
 
 	if (event->angleDelta().x() > 0 || event->angleDelta().y() > 0)
@@ -323,6 +1208,8 @@ void Workspace::wheelEvent(QWheelEvent* event)
 
 	offset_ -= mouseWorldPositionBeforeZoom - mouseWorldPositionAfterZoom;
 
+	MarkInput_(LatencyPath::WHEEL, arrival);
+
 	update();
 }
 
@@ -351,6 +1238,15 @@ void Workspace::keyPressEvent(QKeyEvent* event)
 			update();
 		}
 
+		break;
+	case Qt::Key_Return:
+	case Qt::Key_Enter:
+		if (currentState_ == State::SHAPE_MODIFICATION && selectedShape_ != nullptr && selectedShape_->Finish())
+		{
+			CommitSelectedShape_();
+			update();
+		}
+
 		break;
 	default: break;
 	}
@@ -393,6 +1289,28 @@ void Workspace::resizeEvent(QResizeEvent* event)
 	scale_ = currentSize_.x / w;
 }
 
+void Workspace::showEvent(QShowEvent* event)
+{
+	QWidget::showEvent(event);
+
+	Expand();
+}
+
+void Workspace::hideEvent(QHideEvent* event)
+{
+	QWidget::hideEvent(event);
+
+	//Flipping through tabs or closing one should not pay for a compaction
+	if (WorkspaceSettings::Instance()->IsCompactModeEnabled())
+	{
+		QTimer::singleShot(CompactDelay, this, [this]
+		{
+			if (!isVisible() && WorkspaceSettings::Instance()->IsCompactModeEnabled())
+				Compact();
+		});
+	}
+}
+
 void Workspace::DrawHelpers_(QPainter* painter) const
 {
 	DrawHelperLines_(painter);
@@ -402,14 +1320,66 @@ void Workspace::DrawHelpers_(QPainter* painter) const
 
 void Workspace::DrawShapes(QPainter* painter) const
 {
+	const ProfileScope profileScope(ProfileZone::DRAW_SHAPES);
+
+	//Only switch pens when the style actually changes between consecutive shapes
+	std::optional<StyleIndex> currentStyle;
+
+	//Shapes wholly outside the painted area are skipped; bounds leave out the pen, so the
+	//area grows by the current pen's width
+	const auto visibleArea = painter->worldTransform().inverted().mapRect(QRectF(painter->viewport()));
+	const auto pixelSize = 1.0 / std::sqrt(std::abs(painter->worldTransform().determinant()));
+	const auto fGetPenMargin = [pixelSize](const QPen& pen)
+	{
+		return (pen.isCosmetic() ? std::max(pen.widthF(), 1.0) * pixelSize : pen.widthF()) + 2.0 * pixelSize;
+	};
+
+	//Mapped chunks mix styles, so they are culled against the widest pen
+	if (mappedDocument_ != nullptr)
+	{
+		double maxPenMargin = 0.0;
+		for (const auto& pen : styles_.GetPens())
+			maxPenMargin = std::max(maxPenMargin, fGetPenMargin(pen));
+
+		mappedDocument_->Draw(painter, visibleArea.adjusted(-maxPenMargin, -maxPenMargin, maxPenMargin, maxPenMargin), currentStyle, styles_);
+	}
+
+	double penMargin = 0.0;
+
+	size_t culledCount = 0;
 	for (const auto& shape : shapes_)
+	{
+		const auto styleIndex = shape->GetStyleIndex();
+		if (currentStyle != styleIndex)
+		{
+			const auto& pen = styles_.Get(styleIndex);
+			painter->setPen(pen);
+			currentStyle = styleIndex;
+
+			penMargin = fGetPenMargin(pen);
+		}
+
+		const auto bounds = shape->GetBounds();
+		if (bounds.right() < visibleArea.left() - penMargin || bounds.left() > visibleArea.right() + penMargin
+			|| bounds.bottom() < visibleArea.top() - penMargin || bounds.top() > visibleArea.bottom() + penMargin)
+		{
+			culledCount++;
+			continue;
+		}
+
+		const ProfileScope drawScope(Profiler::GetDrawZone(shape->GetType()));
 		shape->Draw(painter);
+	}
+
+	Profiler::Count(ProfileCounter::SHAPES_DRAWN, shapes_.size() - culledCount);
+	Profiler::Count(ProfileCounter::SHAPES_CULLED, culledCount);
 
 	DrawHelperLines_(painter);
 
 	if (selectedShape_ == nullptr)
 		return;
 
+	painter->setPen(styles_.Get(selectedShape_->GetStyleIndex()));
 	selectedShape_->Draw(painter);
 	selectedShape_->DrawHelpers(painter);
 }
@@ -428,17 +1398,17 @@ void Workspace::DrawHelperLines_(QPainter* painter) const
 	const QPen pen(Qt::black, 1.0, Qt::DashLine);
 	painter->setPen(pen);
 
-	const auto [xNode, yNode] = nodesOnLines_;
+	const auto& [xNode, yNode] = nodesOnLines_;
 	const auto worldTargetPosition = ScreenToWorld(targetPos_);
-	if (xNode != nullptr)
+	if (xNode.has_value())
 	{
-		const QLineF xLine(worldTargetPosition, xNode->position);
+		const QLineF xLine(worldTargetPosition, *xNode);
 		painter->drawLines(&xLine, 1);
 	}
 
-	if (yNode != nullptr)
+	if (yNode.has_value())
 	{
-		const QLineF yLine(worldTargetPosition, yNode->position);
+		const QLineF yLine(worldTargetPosition, *yNode);
 		painter->drawLines(&yLine, 1);
 	}
 }
@@ -462,8 +1432,27 @@ void Workspace::DrawAxes_(QPainter* painter) const
 
 void Workspace::UpdateSpecialKeys_()
 {
-	const auto [nearestNode, fromX, fromY] = nodeSearcher_->GetLatestSearchResult();
-	nodesOnLines_ = std::make_pair(nullptr, nullptr);
+	//Until the answer for this very query is in the cursor stays where it is, see OnSnapAnswered_
+	NodeSearcher::SearchResult searchResult;
+	if (nodeSearcher_ != nullptr && (bIsCtrlPressed_ || bIsShiftPressed_))
+	{
+		const auto answer = nodeSearcher_->Search(MakeSnapQuery_());
+		if (answer.has_value())
+		{
+			searchResult = *answer;
+
+			//A snap that had to wait for its search shows with the next paint
+			MarkInput_(LatencyPath::SNAP, pendingSnapArrival_);
+			pendingSnapArrival_ = -1;
+		}
+		else if (pendingSnapArrival_ < 0)
+			pendingSnapArrival_ = unpaintedInputs_[static_cast<size_t>(LatencyPath::MOVE)];
+	}
+	else
+		pendingSnapArrival_ = -1;
+
+	const auto& [nearestNode, fromX, fromY] = searchResult;
+	nodesOnLines_ = std::make_pair(std::nullopt, std::nullopt);
 
 	if (bIsAltPressed_)
 		UpdateStraightLine_();
@@ -473,13 +1462,13 @@ void Workspace::UpdateSpecialKeys_()
 		UpdateNearestNode_(nearestNode);
 }
 
-void Workspace::UpdateNodeOnLines_(Node* fromX, Node* fromY)
+void Workspace::UpdateNodeOnLines_(const std::optional<Vector2D>& fromX, const std::optional<Vector2D>& fromY)
 {
-	if (fromX != nullptr)
+	if (fromX.has_value())
 	{
-		const auto NodeXScreenPosition = WorldToScreen(fromX->position);
+		const auto NodeXScreenPosition = WorldToScreen(*fromX);
 		const auto distanceToX = (targetPos_ - NodeXScreenPosition).Abs().x;
-		if (distanceToX < 20.0)
+		if (distanceToX < NodeSearcher::SnapRadius)
 		{
 			targetPos_.x = NodeXScreenPosition.x;
 			nodesOnLines_.first = fromX;
@@ -487,11 +1476,11 @@ void Workspace::UpdateNodeOnLines_(Node* fromX, Node* fromY)
 
 	}
 
-	if (fromY != nullptr)
+	if (fromY.has_value())
 	{
-		const auto NodeYScreenPosition = WorldToScreen(fromY->position);
+		const auto NodeYScreenPosition = WorldToScreen(*fromY);
 		const auto distanceToY = (targetPos_ - NodeYScreenPosition).Abs().y;
-		if (distanceToY < 20.0)
+		if (distanceToY < NodeSearcher::SnapRadius)
 		{
 			targetPos_.y = NodeYScreenPosition.y;
 			nodesOnLines_.second = fromY;
@@ -499,14 +1488,14 @@ void Workspace::UpdateNodeOnLines_(Node* fromX, Node* fromY)
 	}
 }
 
-void Workspace::UpdateNearestNode_(const Node* nearestNode)
+void Workspace::UpdateNearestNode_(const std::optional<Vector2D>& nearestNode)
 {
-	if (nearestNode == nullptr)
+	if (!nearestNode.has_value())
 		return;
 
-	const auto distanceToNode = Vector2D::Distance(targetPos_, WorldToScreen(nearestNode->position));
-	if (distanceToNode < 20.0)
-		targetPos_ = WorldToScreen(nearestNode->position);
+	const auto distanceToNode = Vector2D::Distance(targetPos_, WorldToScreen(*nearestNode));
+	if (distanceToNode < NodeSearcher::SnapRadius)
+		targetPos_ = WorldToScreen(*nearestNode);
 }
 
 void Workspace::UpdateStraightLine_()
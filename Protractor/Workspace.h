@@ -8,14 +8,29 @@
 #include <atomic>
 #include <QColor>
 #include <QImage>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <tuple>
+#include <optional>
 
 #include "ShapeFactory.h"
 #include "WorkspaceSettings.h"
+#include "PenStyleTable.h"
+#include "BlueprintReader.h"
+#include "Block.h"
+#include "CursorPredictor.h"
+#include "NodeSearcher.h"
+#include "ProfilerOverlay.h"
+#include "MemoryReport.h"
 
 class Node;
 class Shape;
-class NodeSearcher;
+class CompactDocument;
+class MappedDocument;
+class EditJournal;
+class DocumentSnapshot;
+class BlueprintSaver;
+class QPrinter;
 
 class Workspace : public QWidget
 {
@@ -23,6 +38,10 @@ class Workspace : public QWidget
 
 public:
 	friend class NodeSearcher;
+	friend class InputReplayer;
+
+	//Milliseconds a document stays hidden before compact mode compacts it
+	static constexpr qint32 CompactDelay = 2000;
 
 	Workspace(QWidget* parent, const FormatType type, NodeSearcher* nodeSearcher);
 	virtual ~Workspace();
@@ -32,9 +51,81 @@ public:
 	void Serialize(QDataStream& out) const;
 	void Deserialize(QDataStream& in);
 
+	//Cheap copy-on-write copy of the committed shapes for saving off the GUI thread
+	std::shared_ptr<const DocumentSnapshot> MakeSnapshot() const;
+
+	//Progressive loading: batches arrive from a BlueprintLoader while the view stays interactive
+	void BeginLoading(FormatType type);
+	void AppendShapes(BlueprintReader::ShapeBatch&& batch, const PenStyleTable& styles, const BlockTable& blocks);
+	void EndLoading();
+
+	//Adds many shapes at once, e.g. from an import, with a single lock and repaint
+	void ImportShapes(BlueprintReader::ShapeBatch&& shapes);
+
+	StyleIndex InternStyle(const QPen& pen) { return styles_.Intern(pen); }
+
+	//Turns shapes, e.g. from an imported drawing, into a block that instances can place
+	BlockIndex DefineBlock(const QString& name, BlueprintReader::ShapeBatch&& shapes);
+
+	//Replaces the most recently drawn shape with an array of its copies, false if there is none
+	bool MakeArray(const ShapeArray::Settings& settings);
+
+	//Joins chains of lines sharing endpoints and style into polylines, returns how many were made
+	size_t MergeConnectedLines();
+
+	//Drops polyline nodes closer than the tolerance (world units) to the simplified chain and, with
+	//bSimplifyCurves, turns curves that stay within it of their chord into lines. Only shapes wholly
+	//inside the region are touched, none means the whole document. Returns how many nodes were removed
+	size_t SimplifyPolylines(double tolerance, const std::optional<QRectF>& region, bool bSimplifyCurves);
+
+	//Puts back the shapes the last simplification replaced, as long as nothing was edited since
+	bool UndoSimplify();
+
+	//Part of the document shown by the workspace, in world units
+	QRectF GetVisibleArea() const;
+
+	//Journaled saving: committed edits are appended next to the file instead of rewriting it
+	bool StartJournal();
+	bool CommitJournal();
+	void StopJournal();
+	bool ResumeJournal(qint64 end, qint64 committedEnd);
+	bool ReplayJournal(qint64 end);
+	qint64 GetJournalSize() const;
+
+	//Called as the workspace closes: starts writing the committed journal into the blueprint itself, so readers
+	//of the bare file see the saved document, and hands over the saver to finish its jobs in the background
+	[[nodiscard]] std::unique_ptr<BlueprintSaver> TakeSaver(const BlueprintChunk::EncodingOptions& options);
+	bool HasUncommittedEdits() const;
+
+	//Read-mostly open: shapes stay in the mapped file until they are edited
+	bool OpenMapped(const QString& path);
+	void ReleaseMapped();
+
+	//None if a node lies too far out to be quantized
+	std::optional<CompactDocument> MakeCompactDocument() const;
+
+	//Compact mode: a hidden document keeps its shapes quantized in a CompactDocument and rebuilds
+	//them when it is needed again. Fails, leaving the shapes as they are, while loading, editing a
+	//shape or viewing a mapped file, and when MakeCompactDocument does.
+	bool Compact();
+	void Expand();
+
 	void DrawShapes(QPainter* painter) const;
 	void DrawFrame(QPainter* painter) const;
 
+	//Paints the shapes, shifted by offset (world units), and optionally the frame onto the printer's page
+	void Print(QPrinter* printer, const Vector2D& offset, bool bShouldPrintFrame) const;
+
+	//Time between two refreshes of the screen the workspace is on, in milliseconds
+	double GetFrameInterval() const;
+
+	//Estimated memory held by the document, by structure
+	MemoryReport GetMemoryReport() const;
+
+	//Releases what is rebuilt when needed: block rasters, prefetched snaps, the mapped view's scratch
+	//shapes and the unused capacity of the shape list; returns the bytes released
+	size_t TrimCaches();
+
 protected:
 	void paintEvent(QPaintEvent* event) override;
 
@@ -50,6 +141,9 @@ protected:
 
 	void resizeEvent(QResizeEvent* event) override;
 
+	void showEvent(QShowEvent* event) override;
+	void hideEvent(QHideEvent* event) override;
+
 private:
 	void DrawHelpers_(QPainter* painter) const;
 	void DrawNodes_(QPainter* painter) const;
@@ -57,18 +151,65 @@ private:
 	void DrawAxes_(QPainter* painter) const;
 
 	void UpdateSpecialKeys_();
-	void UpdateNodeOnLines_(Node* fromX, Node* fromY);
-	void UpdateNearestNode_(const Node* nearestNode);
+	void UpdateNodeOnLines_(const std::optional<Vector2D>& fromX, const std::optional<Vector2D>& fromY);
+	void UpdateNearestNode_(const std::optional<Vector2D>& nearestNode);
 	void UpdateStraightLine_();
 
+	void CommitSelectedShape_();
+
+	//Runs the queued cursor move once per screen refresh, see mouseMoveEvent
+	void RequestFrame_();
+	void OnFrame_();
+	void FlushPendingMove_();
+
+	//Snaps the cursor, moves the edited node and refreshes the labels and the view
+	void UpdateTarget_();
+
+	//Queues snap searches where the cursor is heading so the coming frames need not wait for them
+	void PrefetchSnaps_();
+
+	NodeSearcher::Query MakeSnapQuery_() const;
+	void OnSnapAnswered_(const NodeSearcher::Query& query);
+
+	//Input-to-photon latency: the arrival of an input is kept until the paint that shows it
+	static qint64 StampInput_();
+	void MarkInput_(LatencyPath path, qint64 arrival);
+
 private:
 	FormatType type_;
 
-	//All shapes are stored here
-	std::vector<std::unique_ptr<Shape>> shapes_;
+	//All shapes are stored here; they are shared with save snapshots and never modified in place
+	std::vector<std::shared_ptr<Shape>> shapes_;
+
+	//Bumped on every change to the shapes, tells whether a finished save or a prefetched snap
+	//still matches the document
+	quint64 editGeneration_;
+
+	PenStyleTable styles_;
+	BlockTable blocks_;
+
+	std::unique_ptr<MappedDocument> mappedDocument_;
+
+	//Holds the shapes instead of shapes_ while the document is compacted
+	std::unique_ptr<CompactDocument> compactDocument_;
+
+	std::unique_ptr<EditJournal> journal_;
+
+	//Shapes replaced by the last simplification along with their indices, for UndoSimplify
+	struct SimplifyUndo
+	{
+		quint64 generation;
+		std::vector<std::pair<size_t, std::shared_ptr<Shape>>> replaced;
+	};
+	std::optional<SimplifyUndo> simplifyUndo_;
+
+	std::unique_ptr<BlueprintSaver> saver_;
 
 	std::unique_ptr<Shape> selectedShape_;
 	Node* selectedNode_;
+
+	//Cursor as the mouse left it and the position after snapping
+	Vector2D cursorPos_;
 	Vector2D targetPos_;
 
 	Vector2D offset_;
@@ -88,7 +229,32 @@ private:
 	bool bIsShiftPressed_;
 	bool bIsAltPressed_;
 
-	std::pair<Node*, Node*> nodesOnLines_;
+	std::pair<std::optional<Vector2D>, std::optional<Vector2D>> nodesOnLines_;
+
+	//Raw mouse moves only overwrite the pending move; snapping, labels and repaint run per frame
+	struct PendingMove
+	{
+		Vector2D position;
+		Qt::MouseButtons buttons;
+
+		//Of the oldest move merged into this one, -1 while the profiler is off
+		qint64 arrival;
+	};
+
+	std::optional<PendingMove> pendingMove_;
+	CursorPredictor cursorPredictor_;
+	QTimer frameTimer_;
+	QElapsedTimer sinceLastFrame_;
+
+	ProfilerOverlay profilerOverlay_;
+
+	//Oldest arrival per latency path that no paint has shown yet, -1 for none
+	std::array<qint64, static_cast<size_t>(LatencyPath::Count)> unpaintedInputs_;
+
+	//Arrival of the move whose snap is waiting for a queued search
+	qint64 pendingSnapArrival_;
+
+	bool bIsLoading_;
 
 public:
 	__forceinline Vector2D WorldToScreen(const Vector2D& world) const { return (world + offset_) * scale_; }
@@ -101,6 +267,9 @@ public:
 	__forceinline qreal GetScale() const { return scale_; }
 	__forceinline void SetScale(const qreal newScale) { scale_ = newScale; }
 
+	__forceinline Vector2D GetOffset() const { return offset_; }
+	__forceinline void SetOffset(const Vector2D& newOffset) { offset_ = newOffset; }
+
 	__forceinline Vector2D GetSize() const { return currentSize_; }
 
 	__forceinline void SetFilePath(const QString& newFilePath) { filePath_ = newFilePath; }
@@ -111,6 +280,26 @@ public:
 
 	__forceinline void SetNodeSearcher(NodeSearcher* searcher) { nodeSearcher_ = searcher; }
 
+	__forceinline const PenStyleTable& GetStyles() const { return styles_; }
+	__forceinline const BlockTable& GetBlocks() const { return blocks_; }
+
+	__forceinline bool IsLoading() const { return bIsLoading_; }
+
+	__forceinline bool HasJournal() const { return journal_ != nullptr; }
+
+	__forceinline quint64 GetEditGeneration() const { return editGeneration_; }
+
+	__forceinline bool CanUndoSimplify() const { return simplifyUndo_.has_value() && simplifyUndo_->generation == editGeneration_; }
+
+	__forceinline BlueprintSaver* GetSaver() const { return saver_.get(); }
+
+	__forceinline bool IsMapped() const { return mappedDocument_ != nullptr; }
+
+	__forceinline bool IsCompact() const { return compactDocument_ != nullptr; }
+
+	size_t GetShapeCount() const;
+	size_t GetNodeCount() const;
+
 	QString GetTargetPositionAsString() const;
 
 	QString GetSelectedShapeInfoAsString() const;
@@ -131,9 +320,12 @@ private:
 		template<typename T>
 		using MethodPtr = void(Workspace::*)(const T*);
 
+		//Moves are coalesced per frame, so the handler sees only the resulting targetPos_
+		using FrameMethodPtr = void(Workspace::*)();
+
 	public:
 		MethodPtr<QMouseEvent> OnMouseRelease{ nullptr };
-		MethodPtr<QMouseEvent> OnMouseMove{ nullptr };
+		FrameMethodPtr OnMouseMove{ nullptr };
 	};
 
 	constexpr void InitializeStates_();
@@ -141,7 +333,7 @@ private:
 	void ST_NONE_OnMouseRelease_(const QMouseEvent* event);
 
 	void ST_SHAPE_MODIFICATION_OnMouseRelease_(const QMouseEvent* event);
-	void ST_SHAPE_MODIFICATION_OnMouseMove_(const QMouseEvent* event);
+	void ST_SHAPE_MODIFICATION_OnMouseMove_();
 
 	State currentState_;
 	std::array<StateHandler, 2> states_;
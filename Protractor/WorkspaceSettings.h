@@ -20,11 +20,20 @@ public:
 
 private:
 	Vector2D maxWorkspaceSize_;
+	bool bIsProfilerOverlayVisible_{ false };
+	bool bIsCompactModeEnabled_{ false };
 
 public:
 	Vector2D GetMaxWorkspaceSize() const { return maxWorkspaceSize_; }
 	void SetMaxWorkspaceSize(const Vector2D& newSize) { maxWorkspaceSize_ = newSize; }
 
+	bool IsProfilerOverlayVisible() const { return bIsProfilerOverlayVisible_; }
+	void SetProfilerOverlayVisible(const bool bIsVisible) { bIsProfilerOverlayVisible_ = bIsVisible; }
+
+	//Hidden documents keep their nodes quantized, see Workspace::Compact
+	bool IsCompactModeEnabled() const { return bIsCompactModeEnabled_; }
+	void SetCompactModeEnabled(const bool bIsEnabled) { bIsCompactModeEnabled_ = bIsEnabled; }
+
 	Vector2D GetFormatSizeByType(const FormatType type) const;
 
 	double GetFactor(const FormatType type) const;
@@ -1,16 +1,292 @@
 #include "stdafx.h"
 
 #include "MainWindow.h"
+#include "BlueprintPreview.h"
+#include "Profiler.h"
+#include "InputSession.h"
+#include "InputReplayer.h"
+#include "Workspace.h"
 #include <QtWidgets/QApplication>
+#include <QCommandLineParser>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTimer>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+	//Saves the embedded preview of every blueprint in directory as <name>.png and prints one line of stats per file
+	int ExtractPreviews(const QString& directory, const QString& outputDirectory)
+	{
+		QTextStream out(stdout);
+		const QDir outputDir(outputDirectory.isEmpty() ? directory : outputDirectory);
+
+		qint32 failedCount = 0;
+
+		QDirIterator it(directory, { "*.prob" }, QDir::Files);
+		while (it.hasNext())
+		{
+			const auto path = it.next();
+
+			QElapsedTimer timer;
+			timer.start();
+
+			const auto preview = BlueprintPreview::ReadFromFile(path);
+			if (!preview.has_value())
+			{
+				out << path << "\tno preview\n";
+				failedCount++;
+				continue;
+			}
+
+			if (!preview->thumbnail.isNull())
+				preview->thumbnail.save(outputDir.filePath(QFileInfo(path).completeBaseName() + ".png"));
+
+			const auto& bounds = preview->bounds;
+			out << path
+				<< '\t' << (preview->type == FormatType::A3 ? "A3" : "A4")
+				<< '\t' << preview->shapeCount << " shapes"
+				<< '\t' << preview->nodeCount << " nodes"
+				<< '\t' << bounds.left() << ',' << bounds.top() << ',' << bounds.right() << ',' << bounds.bottom()
+				<< '\t' << static_cast<double>(timer.nsecsElapsed()) / 1e6 << " ms\n";
+		}
+
+		return failedCount == 0 ? 0 : 1;
+	}
+
+	//Prints json or writes it to outputPath if one is given
+	int WriteJson(const QJsonObject& json, const QString& outputPath)
+	{
+		const auto text = QJsonDocument(json).toJson(QJsonDocument::Indented);
+		if (outputPath.isEmpty())
+		{
+			QTextStream(stdout) << text;
+			return 0;
+		}
+
+		QFile file(outputPath);
+		if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(text) == -1)
+		{
+			QTextStream(stderr) << "Cannot write " << outputPath << '\n';
+			return 1;
+		}
+
+		return 0;
+	}
+
+	//Replays a recorded input session without a window and prints the timings as JSON
+	int ReplaySession(const QString& path, const InputReplayer::Pace pace, const QString& outputPath)
+	{
+		QTextStream err(stderr);
+
+		InputSession session;
+		if (!session.ReadFromFile(path))
+		{
+			err << path << "\tnot an input session\n";
+			return 1;
+		}
+
+		const auto report = InputReplayer::Run(session, pace);
+		if (!report.has_value())
+		{
+			err << path << "\tthe recorded document cannot be read\n";
+			return 1;
+		}
+
+		auto result = report->ToJson();
+		result.insert("session", path);
+		result.insert("eventCount", static_cast<qint64>(session.events.size()));
+
+		return WriteJson(result, outputPath);
+	}
+
+	//Opens every blueprint in a workspace that is never shown, draws it once so its caches fill as in
+	//an open tab, and prints the memory reports as JSON, optionally along with what trimming released
+	//and what the document holds once compacted
+	int ReportMemory(const QStringList& paths, const bool bIsMapped, const bool bShouldTrim, const bool bShouldCompact, const QString& outputPath)
+	{
+		QTextStream err(stderr);
+
+		QJsonArray documents;
+		qint64 total = 0;
+		qint32 failedCount = 0;
+
+		for (const auto& path : paths)
+		{
+			Workspace ws(nullptr, FormatType::A3, nullptr);
+			ws.setAttribute(Qt::WA_DontShowOnScreen);
+			ws.resize(1920, 1080);
+			ws.show();
+
+			bool bIsRead = bIsMapped && ws.OpenMapped(path);
+			if (!bIsRead)
+			{
+				QFile file(path);
+				if (file.open(QIODevice::ReadOnly))
+				{
+					QDataStream in(&file);
+					in.setVersion(QDataStream::Qt_6_2);
+					ws.Deserialize(in);
+					bIsRead = in.status() == QDataStream::Ok;
+				}
+			}
+
+			if (!bIsRead)
+			{
+				err << path << "\tcannot be read\n";
+				failedCount++;
+				continue;
+			}
+
+			ws.ResetTransform();
+
+			QImage image(ws.size(), QImage::Format_ARGB32_Premultiplied);
+			ws.render(&image);
+
+			const auto report = ws.GetMemoryReport();
+			total += static_cast<qint64>(report.GetTotal());
+
+			QJsonObject document{
+				{ "path", path },
+				{ "mapped", ws.IsMapped() },
+				{ "memory", report.ToJson() } };
+
+			if (bShouldTrim)
+			{
+				document.insert("released", static_cast<qint64>(ws.TrimCaches()));
+				document.insert("trimmed", ws.GetMemoryReport().ToJson());
+			}
+
+			if (bShouldCompact)
+			{
+				if (ws.Compact())
+					document.insert("compacted", ws.GetMemoryReport().ToJson());
+				else
+					err << path << "\tcannot be compacted\n";
+			}
+
+			documents.append(document);
+		}
+
+		const auto result = WriteJson(QJsonObject{ { "documents", documents }, { "total", total } }, outputPath);
+		return failedCount == 0 ? result : 1;
+	}
+}
 
 int main(int argc, char* argv[])
 {
+	const auto hasArgument = [argc, argv](const char* name)
+	{
+		return std::any_of(argv + 1, argv + argc, [name](const char* arg) { return std::strcmp(arg, name) == 0; });
+	};
+
+	//Replays need widgets but no display, they run on the offscreen platform unless another one is asked for
+	if (hasArgument("--replay"))
+	{
+		if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+			qputenv("QT_QPA_PLATFORM", "offscreen");
+
+		QApplication a(argc, argv);
+
+		QCommandLineParser parser;
+		parser.addHelpOption();
+
+		const QCommandLineOption replayOption("replay", "Replay the input session <file> and print its timings as JSON.", "file");
+		const QCommandLineOption realTimeOption("real-time", "Send the events at their recorded times instead of back to back.");
+		const QCommandLineOption outputOption("output", "Write the timings to <file> instead of the standard output.", "file");
+		parser.addOption(replayOption);
+		parser.addOption(realTimeOption);
+		parser.addOption(outputOption);
+		parser.process(a);
+
+		const auto pace = parser.isSet(realTimeOption) ? InputReplayer::Pace::REAL_TIME : InputReplayer::Pace::FAST;
+		return ReplaySession(parser.value(replayOption), pace, parser.value(outputOption));
+	}
+
+	//Memory reports build real workspaces, so like replays they need widgets but no display
+	if (hasArgument("--memory-report"))
+	{
+		if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+			qputenv("QT_QPA_PLATFORM", "offscreen");
+
+		QApplication a(argc, argv);
+
+		QCommandLineParser parser;
+		parser.addHelpOption();
+
+		const QCommandLineOption memoryReportOption("memory-report", "Print the estimated memory held by the blueprint <file> as JSON, can be repeated.", "file");
+		const QCommandLineOption mappedOption("mapped", "Open the blueprints read-mostly, as Open Read-Only does.");
+		const QCommandLineOption trimOption("trim", "Also trim the caches and report what was released and what remains.");
+		const QCommandLineOption compactOption("compact", "Also compact the documents as compact mode does for hidden tabs and report what remains.");
+		const QCommandLineOption outputOption("output", "Write the report to <file> instead of the standard output.", "file");
+		parser.addOption(memoryReportOption);
+		parser.addOption(mappedOption);
+		parser.addOption(trimOption);
+		parser.addOption(compactOption);
+		parser.addOption(outputOption);
+		parser.process(a);
+
+		return ReportMemory(parser.values(memoryReportOption), parser.isSet(mappedOption), parser.isSet(trimOption), parser.isSet(compactOption), parser.value(outputOption));
+	}
+
+	//Headless tools only need a core application, so they also run on machines without a display
+	if (hasArgument("--extract-previews"))
+	{
+		QCoreApplication a(argc, argv);
+
+		QCommandLineParser parser;
+		parser.addHelpOption();
+
+		const QCommandLineOption extractOption("extract-previews", "Save the preview of every blueprint in <directory> and print its stats.", "directory");
+		const QCommandLineOption outputOption("output", "Directory the previews are saved to, defaults to the blueprint directory.", "directory");
+		parser.addOption(extractOption);
+		parser.addOption(outputOption);
+		parser.process(a);
+
+		return ExtractPreviews(parser.value(extractOption), parser.value(outputOption));
+	}
+
 	QApplication a(argc, argv);
+	Profiler::Instance()->SetThreadName("GUI");
+
+	QCommandLineParser parser;
+	parser.addHelpOption();
+	parser.addPositionalArgument("file", "Blueprint to open.");
+
+	const QCommandLineOption traceOption("trace", "Record a profiler trace and save it as Chrome trace-event JSON to <file>.", "file");
+	const QCommandLineOption traceDurationOption("trace-duration", "Save the trace after <seconds> instead of on exit.", "seconds");
+	parser.addOption(traceOption);
+	parser.addOption(traceDurationOption);
+	parser.process(a);
 
 	MainWindow w;
 	w.showMaximized();
-	if (argc > 1)
-		w.InitializeFromFile(argv[1]);
+
+	const auto positionalArguments = parser.positionalArguments();
+	if (!positionalArguments.isEmpty())
+		w.InitializeFromFile(positionalArguments.first());
+
+	if (parser.isSet(traceOption))
+	{
+		const auto tracePath = parser.value(traceOption);
+		const auto writeTrace = [&w, tracePath]
+		{
+			if (!w.WriteTrace(tracePath))
+				QTextStream(stderr) << "Cannot write trace " << tracePath << '\n';
+		};
+
+		w.StartTrace();
+
+		bool bIsDurationValid = false;
+		const auto traceDuration = parser.value(traceDurationOption).toDouble(&bIsDurationValid);
+		if (bIsDurationValid && traceDuration > 0.0)
+			QTimer::singleShot(static_cast<qint32>(traceDuration * 1000.0), &w, writeTrace);
+		else
+			QObject::connect(&a, &QCoreApplication::aboutToQuit, &w, writeTrace);
+	}
 
 	return a.exec();
-}
\ No newline at end of file
+}